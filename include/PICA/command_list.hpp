@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+#include "helpers.hpp"
+
+// A GPU command list with its command headers parsed & parameter masks expanded into a flat list of register writes.
+// Games submit the same command lists every frame, so the GPU caches these by the list's address & contents and replays them, instead
+// of parsing the same headers over & over again. Draws are register writes too (to SignalDrawArrays/SignalDrawElements), so they get
+// replayed in order with the state changes around them.
+struct DecodedCommandList {
+	struct Write {
+		u32 index; // Register being written
+		u32 value; // Value written, or for streamed writes the offset (in words) of the first value from the start of the list
+		u32 mask;
+		u32 streamCount;  // 0 for single writes. Otherwise the number of values streamed to one of the shader upload registers
+		bool consecutive; // Whether a streamed write was in consecutive writing mode
+	};
+
+	std::vector<Write> writes;
+
+	// Lists can jump to another list by writing to CmdBufTrigger0/1, which is always the last write we decode.
+	// Replaying that write points the command processor at the new list
+	bool endsWithJump = false;
+
+	// Some lists do things we can't replay exactly, like jumping in the middle of a command, or having commands that stick out past
+	// the end of the list (which we don't hash). These are left to the regular command processor
+	bool cacheable = true;
+};
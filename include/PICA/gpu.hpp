@@ -1,11 +1,26 @@
 #pragma once
 #include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 #include "helpers.hpp"
 #include "logger.hpp"
 #include "memory.hpp"
+#include "PICA/command_list.hpp"
 #include "PICA/float_types.hpp"
+#include "PICA/gpu_capture.hpp"
+#include "PICA/gpu_thread.hpp"
+#include "PICA/index_remapper.hpp"
+#include "PICA/program_cache.hpp"
 #include "PICA/regs.hpp"
+#include "PICA/shader_batch.hpp"
+#include "PICA/shader_jit.hpp"
+#include "PICA/shader_profiler.hpp"
 #include "PICA/shader_unit.hpp"
+#include "PICA/vertex_loader.hpp"
+#include "PICA/vertex_workers.hpp"
 #include "renderer_gl/renderer_gl.hpp"
 
 class GPU {
@@ -15,25 +30,65 @@ class GPU {
 
 	Memory& mem;
 	ShaderUnit shaderUnit;
+	ShaderJIT shaderJIT;
+	PICABatchShader batchShader; // Runs the vertex shader on multiple vertices at once when it's not recompiled
+	ShaderProfiler shaderProfiler;
+	GPUCapture capture;
+
+	// Draws with at least this many vertices get their vertices shaded on multiple threads, in chunks of parallelChunkSize
+	static constexpr u32 parallelVertexThreshold = 1024;
+	static constexpr u32 parallelChunkSize = 256;
+
+	// Vertex shader state for each extra vertex worker thread, cloned from shaderUnit.vs at the start of every multithreaded draw
+	struct VertexWorkerShader {
+		PICAShader shader{ShaderType::Vertex};
+		PICABatchShader batch;
+	};
+	std::vector<std::unique_ptr<VertexWorkerShader>> workerShaders;
+	VertexWorkerPool vertexWorkers;
+
+	IndexRemapper indexRemapper; // Index buffer deduplication for indexed draws
 	u8* vram = nullptr;
 	MAKE_LOG_FUNCTION(log, gpuLogger)
 
 	static constexpr u32 maxAttribCount = 12; // Up to 12 vertex attributes
 	static constexpr u32 vramSize = 6_MB;
 	Registers regs; // GPU internal registers
-	std::array<vec4f, 16> currentAttributes; // Vertex attributes before being passed to the shader
 
 	std::array<vec4f, 16> immediateModeAttributes; // Vertex attributes uploaded via immediate mode submission
-	std::array<Vertex, 3> immediateModeVertices;
-	uint immediateModeVertIndex;
 	uint immediateModeAttrIndex; // Index of the immediate mode attribute we're uploading
 
+	// Immediate mode vertices are batched up and drawn as one primitive, instead of one draw per triangle. The batch gets flushed on
+	// a primitive restart, on any other register write (as it might change state the draw depends on) & at the end of each command list
+	std::vector<Vertex> immediateModeVertices;
+	bool immediateModePending = false; // Whether vertices were added to the batch since it was last drawn
+	void flushImmediateModeVertices(bool restart);
+
 	template <bool indexed>
 	void drawArrays();
+	template <bool indexed>
+	bool drawArraysHardware(OpenGL::Primitives shape, u32 vertexBase, u32 vertexCount);
+
+	// Run vertex shaders on the host GPU when they can be translated to GLSL, see PICA/shader_decompiler.hpp
+	bool hardwareVertexShaders = false;
+	std::vector<u8> hardwareVertexData; // The parts of the attribute buffers the current draw uses, for uploading to the host GPU
 
 	// Silly method of avoiding linking problems. TODO: Change to something less silly
 	void drawArrays(bool indexed);
 
+	// How long each draw took in nanoseconds gets appended here if it's not null. Used by the capture replay tool
+	std::vector<u64>* drawTimeLog = nullptr;
+
+	// Save the index & vertex data the current draw is going to read to the capture
+	template <bool indexed>
+	void captureDrawMemory(u32 vertexBase, u32 vertexCount);
+	void recordCapturedMemory(u32 paddr, u32 size);
+
+	// Attribute loading steps built from the attribute format & input permutation registers. Rebuilt on the next draw after they change
+	VertexLoader vertexLoader;
+	bool vertexLoaderDirty = true;
+	void buildVertexLoader();
+
 	struct AttribInfo {
 		u32 offset = 0; // Offset from base vertex array
 		int size = 0; // Bytes per vertex
@@ -58,15 +113,57 @@ class GPU {
 	u32 fixedAttribCount = 0; // How many attribute components have we written? When we get to 4 the attr will actually get submitted
 	std::array<u32, 3> fixedAttrBuff; // Buffer to hold fixed attributes in until they get submitted
 
+	// Side effects of writing each internal register, indexed by register. Built once at startup, see regs.cpp
+	using RegisterHandler = void (*)(GPU& gpu, u32 index, u32 value);
+	static const std::array<RegisterHandler, regNum> registerHandlers;
+	static std::array<RegisterHandler, regNum> buildRegisterHandlers();
+
+	void uploadFixedAttribute(u32 value);
+	// Handle a run of command list writes to one of the shader upload data registers in bulk. Returns how many values were consumed,
+	// which is 0 if "index" isn't one of them
+	u32 writeStreamingRegs(u32 index, const u32* values, u32 count, bool consecutive);
+	// How many of "count" writes starting at "index" writeStreamingRegs would consume
+	static u32 getStreamLength(u32 index, u32 count, bool consecutive);
+
 	// Command processor pointers for GPU command lists
 	u32* cmdBuffStart = nullptr;
 	u32* cmdBuffEnd = nullptr;
 	u32* cmdBuffCurr = nullptr;
 
+	// Recently submitted command lists, decoded. Keyed by a hash of their contents, see PICA/command_list.hpp
+	static constexpr size_t maxCachedCommandLists = 64;
+	ProgramCache<DecodedCommandList, maxCachedCommandLists> commandListCache;
+
+	const DecodedCommandList& getDecodedCommandList(const u32* start, const u32* end);
+	DecodedCommandList decodeCommandList(const u32* start, const u32* end);
+	void replayCommandList(const DecodedCommandList& list, const u32* start);
+	void runCommandList();
+
 	Renderer renderer;
 	Vertex getImmediateModeVertex();
+
+	// The GPU thread. While it's running it owns the GPU & the host graphics context, and everyone else hands it work through
+	// commandQueue, so that emulating the CPU for the next frame overlaps with rendering the current one
+	SPSCQueue<GPUCommand, 1024> commandQueue;
+	std::thread thread;
+	bool threadRunning = false;
+	std::function<void(bool)> setContextCurrent; // Make the host graphics context current on the calling thread (true) or release it
+	std::function<void()> presentCallback;       // Hand a finished frame to the window
+
+	u64 submittedFrames = 0;
+	std::atomic<u64> presentedFrames = 0;
+
+	// How many times each GSP interrupt was raised by finished commands without being delivered yet, indexed by GPUInterrupt
+	std::array<std::atomic<u32>, 8> pendingInterrupts = {};
+	std::atomic<bool> interruptsPending = false;
+
+	void threadMain();
+	void execute(const GPUCommand& command);
+	void resetState();
+
 public:
 	GPU(Memory& mem);
+	~GPU();
 	void initGraphicsContext() { renderer.initGraphicsContext(); }
 	void getGraphicsContext() { renderer.getGraphicsContext(); }
 	void display() { renderer.display(); }
@@ -74,8 +171,44 @@ public:
 	void fireDMA(u32 dest, u32 source, u32 size);
 	void reset();
 
+	// Run a command on the GPU thread if it's running, or right away otherwise
+	void submit(const GPUCommand& command);
+	// Wait until the GPU thread is done with everything submitted so far. Needed before touching GPU state from another thread
+	void sync();
+
+	// Hand the GPU & the host graphics context over to a new thread, which "setContextCurrent" gets called on
+	void startThread(std::function<void(bool)> setContextCurrent);
+	void stopThread();
+	bool isThreaded() const { return threadRunning; }
+
+	// Frame boundaries, from the emulator's main loop. Presenting a frame waits if the GPU thread is more than a frame behind
+	void beginFrame() { submit({GPUCommand::Type::BeginFrame}); }
+	void presentFrame();
+	void setPresentCallback(std::function<void()> callback) { presentCallback = std::move(callback); }
+
+	// Whether any commands raised interrupts since the last check. Then takePendingInterrupts gets how many of each were raised
+	bool checkPendingInterrupts() {
+		return interruptsPending.load(std::memory_order_relaxed) && interruptsPending.exchange(false, std::memory_order_acq_rel);
+	}
+	u32 takePendingInterrupts(u32 interrupt) { return pendingInterrupts[interrupt].exchange(0, std::memory_order_acq_rel); }
+
 	Registers& getRegisters() { return regs; }
-	void startCommandList(u32 addr, u32 size);
+	void setShaderJITMode(ShaderJIT::Mode mode) { shaderJIT.setMode(mode); }
+	void setVertexThreadCount(int count) { vertexWorkers.setThreadCount(count); }
+	void setHardwareVertexShaders(bool enable) { hardwareVertexShaders = enable; }
+	ShaderProfiler& getShaderProfiler() { return shaderProfiler; }
+	GPUCapture& getCapture() { return capture; }
+	void setDrawTimeLog(std::vector<u64>* log) { drawTimeLog = log; }
+
+	// Run the command list at physical address "paddr"
+	void startCommandList(u32 paddr, u32 size);
+
+	// Save the guest memory in [paddr, paddr + size) to the GPU capture if one is running, as the GPU is about to read it
+	void captureMemory(u32 paddr, u32 size) {
+		if (capture.isRunning()) [[unlikely]] {
+			recordCapturedMemory(paddr, size);
+		}
+	}
 
 	// Used by the GSP GPU service for readHwRegs/writeHwRegs/writeHwRegsMasked
 	u32 readReg(u32 address);
@@ -88,12 +221,14 @@ public:
 	// TODO: Emulate the transfer engine & its registers
 	// Then this can be emulated by just writing the appropriate values there
 	void clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) {
+		capture.recordMemoryFill(startAddress, endAddress, value, control);
 		renderer.clearBuffer(startAddress, endAddress, value, control);
 	}
 
 	// TODO: Emulate the transfer engine & its registers
 	// Then this can be emulated by just writing the appropriate values there
 	void displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {
+		capture.recordDisplayTransfer(inputAddr, outputAddr, inputSize, outputSize, flags);
 		renderer.displayTransfer(inputAddr, outputAddr, inputSize, outputSize, flags);
 	}
 
@@ -126,4 +261,18 @@ public:
 			Helpers::panic("[GPU] Tried to access unknown physical address: %08X", paddr);
 		}
 	}
+
+	// The opposite of getPointerPhys: Get the physical address of a pointer into FCRAM or VRAM
+	u32 getPhysicalAddress(const void* pointer) {
+		const u8* p = static_cast<const u8*>(pointer);
+		const u8* fcram = mem.getFCRAM();
+
+		if (p >= fcram && p < fcram + Memory::FCRAM_SIZE) {
+			return PhysicalAddrs::FCRAM + u32(p - fcram);
+		} else if (p >= vram && p < vram + vramSize) {
+			return PhysicalAddrs::VRAM + u32(p - vram);
+		} else [[unlikely]] {
+			Helpers::panic("[GPU] Tried to get the physical address of a pointer outside of FCRAM & VRAM");
+		}
+	}
 };
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+#include "helpers.hpp"
+
+// Records the commands the GSP hands to the GPU (command lists, memory fills, display transfers & DMAs) together with the guest memory
+// they read, so that they can be replayed by the AlberReplay tool without emulating the CPU or the OS. Good for benchmarking & bisecting
+// the GPU side of the emulator on its own.
+//
+// A capture is a header followed by a stream of records. Each record is a type byte followed by its arguments as u32s, and page records
+// are followed by the page's contents. Pages are only written when the GPU reads them and their contents changed since the last time
+// they were written, so a capture is mostly command records after the first few frames.
+// Memory is recorded right before the command that reads it. This is fine as the GPU doesn't write to guest memory while it's working
+// (Framebuffers live on the host GPU), apart from DMAs, whose destination gets recorded again when it's read.
+//
+// Captures have to start when the GPU is reset and replay from a freshly reset GPU, as we don't save the GPU state.
+class GPUCapture {
+public:
+	static constexpr u32 magic = 0x50414341; // "ACAP"
+	static constexpr u32 version = 1;
+	static constexpr u32 pageSize = 4_KB;
+
+	enum class RecordType : u8 {
+		Page = 0,        // Physical address, then the contents of the page
+		ZeroPage,        // Physical address of a page full of zeroes
+		CommandList,     // Physical address, size in bytes
+		MemoryFill,      // Start, end, value, control. One record per buffer filled
+		DisplayTransfer, // Input address, output address, input size, output size, flags
+		DMA,             // Physical destination, physical source, size in bytes
+		Frame,           // End of a frame, after which the emulator presented the screens
+	};
+
+	struct Record {
+		RecordType type;
+		std::array<u32, 5> args;
+		const u8* data; // Page contents for Page records, pointing into the loaded capture
+	};
+
+	// How many u32 arguments each type of record has
+	static u32 getArgumentCount(RecordType type);
+
+	// Load a whole capture file into "contents" and split it into records pointing into it. Returns false if it's not a valid capture
+	static bool load(const std::filesystem::path& path, std::vector<u8>& contents, std::vector<Record>& records);
+
+	// Start writing a capture, discarding whatever state was left from the previous one. Returns false if the file couldn't be opened
+	bool start(const std::filesystem::path& path);
+	// Stop capturing & close the file. Returns false if writing the capture failed at any point
+	bool stop();
+	bool isRunning() const { return running; }
+	u64 getFrameCount() const { return frames; }
+
+	// Record a page of guest memory the GPU is about to read, if the capture doesn't already have its current contents
+	void recordPage(u32 paddr, const u8* data);
+	void recordCommandList(u32 paddr, u32 size) { writeRecord(RecordType::CommandList, {paddr, size}); }
+	void recordMemoryFill(u32 start, u32 end, u32 value, u32 control) {
+		writeRecord(RecordType::MemoryFill, {start, end, value, control});
+	}
+	void recordDMA(u32 destPaddr, u32 sourcePaddr, u32 size) { writeRecord(RecordType::DMA, {destPaddr, sourcePaddr, size}); }
+	void recordDisplayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {
+		writeRecord(RecordType::DisplayTransfer, {inputAddr, outputAddr, inputSize, outputSize, flags});
+	}
+
+	void recordFrame() {
+		writeRecord(RecordType::Frame, {});
+		frames++;
+	}
+
+private:
+	std::ofstream file;
+	bool running = false;
+	u64 frames = 0;
+
+	// Hash of each page's contents the last time it was written to the capture, indexed by physical address
+	std::unordered_map<u32, u64> pageHashes;
+
+	void writeRecord(RecordType type, std::initializer_list<u32> args);
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include "helpers.hpp"
+
+// Work for the GPU, as handed to it by the GSP service or the emulator's frame loop.
+// When the GPU thread is running these go through a queue, so anything they point to has to be resolved before submitting them
+struct GPUCommand {
+	enum class Type : u8 {
+		CommandList,     // Physical address, size in bytes
+		MemoryFill,      // Start, end, value, control
+		DisplayTransfer, // Input address, output address, input size, output size, flags
+		DMA,             // Physical destination, physical source, size in bytes
+		WriteReg,        // Address, value, mask
+		BeginFrame,      // Set up the host GPU for rendering a new frame
+		PresentFrame,    // Display the frame & hand it to the window
+		Reset,
+		Nop,  // Does nothing, but still raises its interrupts in submission order
+		Stop, // Makes the GPU thread exit
+	};
+
+	Type type;
+	u8 interrupts = 0; // Bitmask of GSP interrupts (See GPUInterrupt) to raise once the command is done
+	std::array<u32, 5> args = {};
+};
+
+// Lock-free single-producer/single-consumer ring buffer. The consumer only pops an item once it's done with it, so the producer can
+// tell when everything it pushed has been dealt with. Either side can sleep on the queue with C++20 atomic waits
+template <typename T, size_t capacity>
+class SPSCQueue {
+	static_assert((capacity & (capacity - 1)) == 0, "SPSCQueue capacity must be a power of 2");
+	static constexpr size_t mask = capacity - 1;
+
+	std::array<T, capacity> items;
+	alignas(64) std::atomic<size_t> head = 0; // Next item to write. Only modified by the producer
+	alignas(64) std::atomic<size_t> tail = 0; // Next item to read. Only modified by the consumer
+
+public:
+	// Producer side. Sleeps while the queue is full
+	void push(const T& item) {
+		const size_t h = head.load(std::memory_order_relaxed);
+		for (size_t t = tail.load(std::memory_order_acquire); h - t == capacity; t = tail.load(std::memory_order_acquire)) {
+			tail.wait(t, std::memory_order_acquire);
+		}
+
+		items[h & mask] = item;
+		head.store(h + 1, std::memory_order_release);
+		head.notify_one();
+	}
+
+	// Producer side. Sleeps until the consumer has popped everything pushed so far
+	void waitUntilEmpty() {
+		const size_t h = head.load(std::memory_order_relaxed);
+		for (size_t t = tail.load(std::memory_order_acquire); t != h; t = tail.load(std::memory_order_acquire)) {
+			tail.wait(t, std::memory_order_acquire);
+		}
+	}
+
+	// Consumer side. Sleeps until there's an item and returns it. It stays in the queue until pop() is called
+	const T& front() {
+		const size_t t = tail.load(std::memory_order_relaxed);
+		for (size_t h = head.load(std::memory_order_acquire); h == t; h = head.load(std::memory_order_acquire)) {
+			head.wait(h, std::memory_order_acquire);
+		}
+
+		return items[t & mask];
+	}
+
+	void pop() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		tail.notify_one();
+	}
+};
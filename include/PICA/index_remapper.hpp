@@ -0,0 +1,59 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "helpers.hpp"
+
+// Index buffer deduplication for indexed draws. Index buffers reference most vertices several times, so instead of shading every index
+// the GPU shades each unique vertex once and draws them with a rewritten index buffer that points into the list of shaded vertices.
+class IndexRemapper {
+	static constexpr u32 unusedSlot = 0xffffffff;
+	// Maps (index - smallest index) to its slot in uniqueIndices. Indices are at most 16-bit, so that's the biggest range a draw can have
+	std::vector<u32> slots = std::vector<u32>(0x10000, unusedSlot);
+
+public:
+	std::vector<u32> uniqueIndices;   // Unique vertex indices of the last remapped index buffer, in order of first use
+	std::vector<u16> remappedIndices; // The last remapped index buffer, pointing into uniqueIndices
+
+	// Make room for index buffers of up to "maxCount" indices
+	void resize(u32 maxCount) {
+		uniqueIndices.resize(maxCount);
+		remappedIndices.resize(maxCount);
+	}
+
+	// Find the unique vertices an index buffer references. Fills uniqueIndices with them in order of first use and remappedIndices with
+	// the index buffer rewritten to point into that list, then returns the number of unique vertices
+	template <typename T>
+	u32 remap(const T* indices, u32 count) {
+		if (count == 0) return 0;
+
+		// Knowing the index range lets us use a flat table instead of a hash map for finding repeats.
+		// Simple min/max loop so the compiler can vectorise it
+		T minIndex = std::numeric_limits<T>::max();
+		T maxIndex = 0;
+		for (u32 i = 0; i < count; i++) {
+			minIndex = std::min(minIndex, indices[i]);
+			maxIndex = std::max(maxIndex, indices[i]);
+		}
+
+		u32 uniqueCount = 0;
+		for (u32 i = 0; i < count; i++) {
+			const u32 index = indices[i];
+			u32& slot = slots[index - minIndex];
+
+			if (slot == unusedSlot) {
+				slot = uniqueCount;
+				uniqueIndices[uniqueCount++] = index;
+			}
+
+			remappedIndices[i] = u16(slot);
+		}
+
+		// Only clear the table entries we used, so small draws don't have to wipe the whole thing
+		for (u32 i = 0; i < uniqueCount; i++) {
+			slots[uniqueIndices[i] - minIndex] = unusedSlot;
+		}
+
+		return uniqueCount;
+	}
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include "helpers.hpp"
+
+// Least recently used cache for things we build out of shader programs (decoded programs, recompiled code...), keyed by the hash of
+// the program. Also used for other things games keep resubmitting, like command lists. Games tend to cycle through a handful of shaders every frame, re-uploading them each time, so once they've all been
+// seen switching between them is just a lookup. Once the cache is full, the program that went unused the longest gets kicked out.
+template <typename T, size_t capacity>
+class ProgramCache {
+	using Entry = std::pair<u64, T>;
+
+	std::list<Entry> entries; // Most recently used entry first
+	std::unordered_map<u64, typename std::list<Entry>::iterator> lookup;
+
+public:
+	// Returns nullptr if the program isn't cached. Otherwise it becomes the most recently used entry
+	T* find(u64 hash) {
+		auto it = lookup.find(hash);
+		if (it == lookup.end()) {
+			return nullptr;
+		}
+
+		entries.splice(entries.begin(), entries, it->second);
+		return &it->second->second;
+	}
+
+	// Add a program that isn't in the cache yet, evicting the least recently used one if we're full
+	T& insert(u64 hash, T value) {
+		if (entries.size() >= capacity) {
+			lookup.erase(entries.back().first);
+			entries.pop_back();
+		}
+
+		entries.emplace_front(hash, std::move(value));
+		lookup[hash] = entries.begin();
+		return entries.front().second;
+	}
+
+	void clear() {
+		entries.clear();
+		lookup.clear();
+	}
+
+	size_t size() const { return entries.size(); }
+};
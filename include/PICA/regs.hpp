@@ -16,6 +16,16 @@ namespace PICAInternalRegs {
 		DepthmapEnable = 0x6D,
 		TexUnitCfg = 0x80,
 
+		// Texture combiner (TEV) registers. Each stage has a source, operand, combiner, constant colour & scale register, in that order
+		TexEnv0Source = 0xC0,
+		TexEnv1Source = 0xC8,
+		TexEnv2Source = 0xD0,
+		TexEnv3Source = 0xD8,
+		TexEnvBufferConfig = 0xE0,
+		TexEnv4Source = 0xF0,
+		TexEnv5Source = 0xF8,
+		TexEnvBufferColour = 0xFD,
+
 		// Framebuffer registers
 		ColourOperation = 0x100,
 		BlendFunc = 0x101,
@@ -1,10 +1,15 @@
 #pragma once
 #include <algorithm>
 #include <array>
+#include <bitset>
 #include <cstring>
+#include <memory>
+#include <vector>
 #include "helpers.hpp"
 #include "opengl.hpp"
 #include "PICA/float_types.hpp"
+#include "PICA/program_cache.hpp"
+#include "PICA/simd_vec4.hpp"
 
 enum class ShaderType {
 	Vertex, Geometry
@@ -38,13 +43,47 @@ namespace ShaderOpcodes {
 		JMPU = 0x2D,
 		CMP1 = 0x2E, // Both of these instructions are CMP
 		CMP2 = 0x2F,
+		MADI = 0x30, // Everything between 0x30-0x37 is a MADI
 		MAD = 0x38 // Everything between 0x38-0x3F is a MAD but fuck it
 	};
 }
 
+// A shader instruction with its operand descriptor already applied, so the interpreter doesn't have to dig through bitfields
+// for every instruction of every vertex
+struct DecodedInstruction {
+	u32 raw;              // Original instruction word, for error messages
+	u8 opcode;            // Top 6 bits of the instruction, except MAD/MADI variants are collapsed to ShaderOpcodes::MAD/MADI
+	u8 dest;              // Destination register
+	u8 componentMask;     // Destination write mask, with x in bit 3
+	u8 index;             // Relative addressing mode. 0 = none, 1 = a0.x, 2 = a0.y, 3 = loop counter
+	u8 indexedSource;     // Which of the sources relative addressing applies to. Depends on the instruction format
+	u8 negateMask;        // Bit n is set if source n is negated
+	std::array<u8, 3> src;
+	std::array<u8, 3> swizzle; // Component selectors for each source, with the one for x in the bottom 2 bits (Like shufps)
+	std::array<u8, 2> cmpOperations; // CMP operations for cmp.x & cmp.y
+
+	// Flow control
+	u8 condition;         // IFC/JMPC/CALLC condition
+	bool refX, refY;      // Values the cmp registers are compared against by IFC/JMPC/CALLC
+	bool jumpIfSet;       // JMPU: Jump if the bool uniform is set, or if it's clear?
+	u8 uniformIndex;      // Bool uniform bit for IFU/JMPU/CALLU, int uniform for LOOP
+	u16 target;           // DST field. Start of the function for CALL, start of the else block for IF, jump target for JMP
+	u16 endPC;            // IF: PC after the else block. CALL: PC where the function returns. LOOP: PC right after the loop body
+};
+
+// A fully decoded shader program. Never modified once built, so every shader unit running the same program can share it
+struct DecodedProgram {
+	std::vector<DecodedInstruction> instructions;
+	// PCs where a LOOP, IF or CALL block may end. The interpreter only looks at its control flow stacks when it lands on one of these.
+	// There's an extra entry for the PC past the last instruction, which is always set so that the interpreter can stop there
+	std::bitset<4097> controlFlowBoundaries;
+};
+
 class PICAShader {
 	using f24 = Floats::f24;
 	using vec4f = OpenGL::Vector<f24, 4>;
+	// The interpreter treats vector registers as 4 packed floats, see PICA/simd_vec4.hpp
+	static_assert(sizeof(vec4f) == 4 * sizeof(float), "PICA vector registers must be 4 floats");
 
 	struct Loop {
 		u32 startingPC; // PC at the start of the loop
@@ -72,7 +111,7 @@ class PICAShader {
 
 	std::array<u32, 4> floatUniformBuffer; // Buffer for temporarily caching float uniform data
 	std::array<u32, 128> operandDescriptors;
-	std::array<vec4f, 16> tempRegisters; // General purpose registers the shader can use for temp values
+	alignas(16) std::array<vec4f, 16> tempRegisters; // General purpose registers the shader can use for temp values
 	OpenGL::Vector<s32, 2> addrRegister; // Address register
 	bool cmpRegister[2]; // Comparison registers where the result of CMP is stored in
 	u32 loopCounter;
@@ -88,104 +127,125 @@ class PICAShader {
 
 	ShaderType type;
 
-	vec4f getSource(u32 source);
+	// Hash of the loaded code, operand descriptors & entrypoint, used by the shader JIT to look up compiled programs.
+	// Recomputed lazily, as games upload shaders far more often than they switch between them
+	u64 lastCodeHash = 0;
+	bool codeHashDirty = true;
+
+	const vec4f& getSource(u32 source);
 	vec4f& getDest(u32 dest);
 
 	// Shader opcodes
-	void add(u32 instruction);
-	void call(u32 instruction);
-	void callc(u32 instruction);
-	void callu(u32 instruction);
-	void cmp(u32 instruction);
-	void dp3(u32 instruction);
-	void dp4(u32 instruction);
-	void flr(u32 instruction);
-	void ifc(u32 instruction);
-	void ifu(u32 instruction);
-	void jmpc(u32 instruction);
-	void jmpu(u32 instruction);
-	void loop(u32 instruction);
-	void mad(u32 instruction);
-	void madi(u32 instruction);
-	void max(u32 instruction);
-	void min(u32 instruction);
-	void mov(u32 instruction);
-	void mova(u32 instruction);
-	void mul(u32 instruction);
-	void rcp(u32 instruction);
-	void rsq(u32 instruction);
-	void sgei(u32 instruction);
-	void slt(u32 instruction);
-	void slti(u32 instruction);
-
-	// src1, src2 and src3 have different negation & component swizzle bits in the operand descriptor
-	// https://problemkaputt.github.io/gbatek.htm#3dsgpushaderinstructionsetopcodesummary in the
-	// "Shader Operand Descriptors" section
-	template <int sourceIndex>
-	vec4f swizzle(vec4f& source, u32 opDescriptor) {
-		vec4f ret;
-		u32 compSwizzle;
-		bool negate;
-
-		if constexpr (sourceIndex == 1) { // SRC1
-			negate = (Helpers::getBit<4>(opDescriptor)) != 0;
-			compSwizzle = Helpers::getBits<5, 8>(opDescriptor);
-		} else if constexpr (sourceIndex == 2) { // SRC2
-			negate = (Helpers::getBit<13>(opDescriptor)) != 0;
-			compSwizzle = Helpers::getBits<14, 8>(opDescriptor);
-		} else if constexpr (sourceIndex == 3) { // SRC3
-			negate = (Helpers::getBit<22>(opDescriptor)) != 0;
-			compSwizzle = Helpers::getBits<23, 8>(opDescriptor);
-		}
-
-		// Iterate through every component of the swizzled vector in reverse order
-		// And get which source component's index to match it with
-		for (int comp = 0; comp < 4; comp++) {
-			int index = compSwizzle & 3; // Get index for this component
-			compSwizzle >>= 2; // Move to next component index
-			ret[3 - comp] = source[index];
-		}
-
-		// Negate result if the negate bit is set
-		if (negate) {
-			ret[0] = -ret[0];
-			ret[1] = -ret[1];
-			ret[2] = -ret[2];
-			ret[3] = -ret[3];
+	void add(const DecodedInstruction& instruction);
+	void call(const DecodedInstruction& instruction);
+	void callc(const DecodedInstruction& instruction);
+	void callu(const DecodedInstruction& instruction);
+	void cmp(const DecodedInstruction& instruction);
+	void dp3(const DecodedInstruction& instruction);
+	void dp4(const DecodedInstruction& instruction);
+	void flr(const DecodedInstruction& instruction);
+	void ifc(const DecodedInstruction& instruction);
+	void ifu(const DecodedInstruction& instruction);
+	void jmpc(const DecodedInstruction& instruction);
+	void jmpu(const DecodedInstruction& instruction);
+	void loop(const DecodedInstruction& instruction);
+	void mad(const DecodedInstruction& instruction);
+	void madi(const DecodedInstruction& instruction);
+	void max(const DecodedInstruction& instruction);
+	void min(const DecodedInstruction& instruction);
+	void mov(const DecodedInstruction& instruction);
+	void mova(const DecodedInstruction& instruction);
+	void mul(const DecodedInstruction& instruction);
+	void rcp(const DecodedInstruction& instruction);
+	void rsq(const DecodedInstruction& instruction);
+	void sgei(const DecodedInstruction& instruction);
+	void slt(const DecodedInstruction& instruction);
+	void slti(const DecodedInstruction& instruction);
+
+	// Load source n (0-2) of an instruction, with relative addressing, swizzling & negation applied
+	SIMD::Vec4 getSourceVector(const DecodedInstruction& instruction, int n) {
+		u32 source = instruction.src[n];
+		if (n == instruction.indexedSource) {
+			source = getIndexedSource(source, instruction.index);
 		}
 
-		return ret;
+		const SIMD::Vec4 ret = SIMD::loadSwizzled(reinterpret_cast<const float*>(&getSource(source)), instruction.swizzle[n]);
+		return (instruction.negateMask & (1 << n)) ? SIMD::negate(ret) : ret;
 	}
 
-	template <int sourceIndex>
-	vec4f getSourceSwizzled(u32 source, u32 opDescriptor) {
-		vec4f srcVector = getSource(source);
-		srcVector = swizzle<sourceIndex>(srcVector, opDescriptor);
+	// Write the components of "value" the instruction's write mask enables to its destination register
+	void storeDest(const DecodedInstruction& instruction, SIMD::Vec4 value) {
+		SIMD::storeMasked(reinterpret_cast<float*>(&getDest(instruction.dest)), value, instruction.componentMask);
+	}
 
-		return srcVector;
+	// Convert the 3 (f24) or 4 (f32) words of a float uniform transfer, which come in w, z, y, x order
+	void convertFloatUniform(vec4f& uniform, const u32* words) {
+		if (f32UniformTransfer) {
+			uniform.x() = f24::fromFloat32(*(float*)&words[3]);
+			uniform.y() = f24::fromFloat32(*(float*)&words[2]);
+			uniform.z() = f24::fromFloat32(*(float*)&words[1]);
+			uniform.w() = f24::fromFloat32(*(float*)&words[0]);
+		} else {
+			uniform.x() = f24::fromRaw(words[2] & 0xffffff);
+			uniform.y() = f24::fromRaw(((words[1] & 0xffff) << 8) | (words[2] >> 24));
+			uniform.z() = f24::fromRaw(((words[0] & 0xff) << 16) | (words[1] >> 16));
+			uniform.w() = f24::fromRaw(words[0] >> 8);
+		}
 	}
 
 	u8 getIndexedSource(u32 source, u32 index);
-	bool isCondTrue(u32 instruction);
+	bool isCondTrue(const DecodedInstruction& instruction);
+
+	// The decoded program, looked up or built from loadedShader & operandDescriptors the first time we run after either of them changes
+	// Programs we decoded recently stay cached by hash, so games re-uploading the same shaders every frame don't get them decoded again
+	static constexpr size_t maxCachedPrograms = 32;
+	std::shared_ptr<const DecodedProgram> decodedProgram;
+	ProgramCache<std::shared_ptr<const DecodedProgram>, maxCachedPrograms> programCache;
+	bool decodeDirty = true;
+
+	void decode();
+	static DecodedInstruction decodeInstruction(u32 instruction, const std::array<u32, 128>& descriptors);
+	void handleControlFlow();
+
+	// Execution counters for the shader profiler, indexed by PC. nullptr unless the profiler is running
+	u64* profileCounters = nullptr;
+	u64 profiledInstructions = 0; // Instructions executed since the profiler started counting for the current draw
+
+	template <bool profiling>
+	void runProgram();
+
+	// The JIT, the batch interpreter, the GLSL translator & the debugging tools need to poke at our registers, uniforms & decoded program
+	friend class ShaderEmitter;
+	friend class ShaderJIT;
+	friend class PICABatchShader;
+	friend class ShaderDecompiler;
+	friend class ShaderDisassembler;
+	friend class ShaderProfiler;
 
 public:
-	std::array<u32, 4096> loadedShader; // Currently loaded & active shader
-	std::array<u32, 4096> bufferedShader; // Shader to be transferred when the SH_CODETRANSFER_END reg gets written to
+	// Shader code memory. Uploads write here directly, like on hardware, and the changes get picked up once the upload is finalized
+	std::array<u32, 4096> loadedShader;
 
 	u32 entrypoint = 0; // Initial shader PC
 	u32 boolUniform;
 	std::array<OpenGL::Vector<u8, 4>, 4> intUniforms;
-	std::array<vec4f, 96> floatUniforms;
+	alignas(16) std::array<vec4f, 96> floatUniforms;
 
-	std::array<vec4f, 16> fixedAttributes; // Fixed vertex attributes
-	std::array<vec4f, 16> inputs; // Attributes passed to the shader
-	std::array<vec4f, 16> outputs;
+	alignas(16) std::array<vec4f, 16> fixedAttributes; // Fixed vertex attributes
+	alignas(16) std::array<vec4f, 16> inputs; // Attributes passed to the shader
+	alignas(16) std::array<vec4f, 16> outputs;
 
 	PICAShader(ShaderType type) : type(type) {}
 
 	// Theese functions are in the header to be inlined more easily, though with LTO I hope I'll be able to move them
 	void finalize() {
-		std::memcpy(&loadedShader[0], &bufferedShader[0], 4096 * sizeof(u32));
+		codeHashDirty = true;
+		decodeDirty = true;
+	}
+
+	void setEntrypoint(u32 pc) {
+		entrypoint = pc;
+		codeHashDirty = true;
 	}
 
 	void setBufferIndex(u32 index) {
@@ -198,13 +258,39 @@ public:
 
 	void uploadWord(u32 word) {
 		if (bufferIndex >= 4095) Helpers::panic("o no, shader upload overflew");
-		bufferedShader[bufferIndex++] = word;
+		loadedShader[bufferIndex++] = word;
 		bufferIndex &= 0xfff;
 	}
 
+	// Upload a bunch of words at once, for command lists that stream a whole program through the code data registers
+	void uploadWords(const u32* words, u32 count) {
+		// Uploads that overflow go word by word, so that we panic at the same spot
+		if (bufferIndex + count > 4095) [[unlikely]] {
+			for (u32 i = 0; i < count; i++) {
+				uploadWord(words[i]);
+			}
+			return;
+		}
+
+		std::memcpy(&loadedShader[bufferIndex], words, count * sizeof(u32));
+		bufferIndex += count;
+	}
+
 	void uploadDescriptor(u32 word) {
 		operandDescriptors[opDescriptorIndex++] = word;
 		opDescriptorIndex &= 0x7f;
+		codeHashDirty = true;
+		decodeDirty = true;
+	}
+
+	void uploadDescriptors(const u32* words, u32 count) {
+		for (u32 i = 0; i < count; i++) {
+			operandDescriptors[opDescriptorIndex++] = words[i];
+			opDescriptorIndex &= 0x7f;
+		}
+
+		codeHashDirty = true;
+		decodeDirty = true;
 	}
 
 	void setFloatUniformIndex(u32 word) {
@@ -219,20 +305,35 @@ public:
 			Helpers::panic("[PICA] Tried to write float uniform %d", floatUniformIndex);
 
 		if ((f32UniformTransfer && floatUniformWordCount >= 4) || (!f32UniformTransfer && floatUniformWordCount >= 3)) {
-			vec4f& uniform = floatUniforms[floatUniformIndex++];
 			floatUniformWordCount = 0;
+			convertFloatUniform(floatUniforms[floatUniformIndex++], floatUniformBuffer.data());
+		}
+	}
 
-			if (f32UniformTransfer) {
-				uniform.x() = f24::fromFloat32(*(float*)&floatUniformBuffer[3]);
-				uniform.y() = f24::fromFloat32(*(float*)&floatUniformBuffer[2]);
-				uniform.z() = f24::fromFloat32(*(float*)&floatUniformBuffer[1]);
-				uniform.w() = f24::fromFloat32(*(float*)&floatUniformBuffer[0]);
-			} else {
-				uniform.x() = f24::fromRaw(floatUniformBuffer[2] & 0xffffff);
-				uniform.y() = f24::fromRaw(((floatUniformBuffer[1] & 0xffff) << 8) | (floatUniformBuffer[2] >> 24));
-				uniform.z() = f24::fromRaw(((floatUniformBuffer[0] & 0xff) << 16) | (floatUniformBuffer[1] >> 16));
-				uniform.w() = f24::fromRaw(floatUniformBuffer[0] >> 8);
-			}
+	// Upload a bunch of float uniform words at once. Whole uniforms get converted straight from "words" instead of going through
+	// the transfer buffer
+	void uploadFloatUniforms(const u32* words, u32 count) {
+		const u32 wordsPerUniform = f32UniformTransfer ? 4 : 3;
+
+		// Finish off any uniform a previous write left half-done first
+		while (count != 0 && floatUniformWordCount != 0) {
+			uploadFloatUniform(*words++);
+			count--;
+		}
+
+		while (count >= wordsPerUniform) {
+			if (floatUniformIndex >= 96)
+				Helpers::panic("[PICA] Tried to write float uniform %d", floatUniformIndex);
+
+			convertFloatUniform(floatUniforms[floatUniformIndex++], words);
+			words += wordsPerUniform;
+			count -= wordsPerUniform;
+		}
+
+		// Leftover words of a uniform that the next write will finish
+		while (count != 0) {
+			uploadFloatUniform(*words++);
+			count--;
 		}
 	}
 
@@ -246,4 +347,8 @@ public:
 
 	void run();
 	void reset();
+	u64 getCodeHash();
+
+	// Share the program & copy the uniforms & registers of another shader unit, so it can run the same draw on another thread
+	void cloneFrom(PICAShader& other);
 };
\ No newline at end of file
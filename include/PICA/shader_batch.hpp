@@ -0,0 +1,105 @@
+#pragma once
+#include <array>
+#include "helpers.hpp"
+#include "PICA/shader.hpp"
+
+// Interpreter that runs a vertex shader on several vertices at once. Registers are stored structure-of-arrays, ie each component
+// of a register holds one float per vertex ("lane"), so every instruction gets decoded once per batch and the per-lane loops map
+// directly onto host vector registers (4 lanes for SSE/NEON, 8 for AVX2). The 8-lane mode needs an AVX2 build, see ENABLE_AVX2.
+// Lanes can diverge on IFC/CALLC, in which case each side of the branch runs with a mask of the lanes that took it. Divergence we
+// can't express with masks (JMPC, or an END only some lanes reach) makes run() bail out, and the batch has to be run through the
+// regular interpreter one vertex at a time instead.
+class PICABatchShader {
+public:
+#if defined(__AVX2__)
+	static constexpr int laneCount = 8;
+#else
+	static constexpr int laneCount = 4;
+#endif
+
+private:
+	using f24 = Floats::f24;
+	using vec4f = OpenGL::Vector<f24, 4>;
+	using LaneMask = u32; // Bit n = lane n
+	static constexpr LaneMask allLanes = (1u << laneCount) - 1;
+
+	// One vector register, for every lane. components[0] holds the x component of each lane, etc
+	struct alignas(32) Register {
+		float components[4][laneCount];
+	};
+
+	struct Loop {
+		u32 startingPC;
+		u32 endingPC;
+		u32 iterations;
+		u32 increment;
+	};
+
+	struct ConditionalInfo {
+		u32 endingPC;       // PC at the end of the block we're currently running (the if or the else block)
+		u32 newPC;          // PC after the whole IF is done executing
+		LaneMask savedMask; // Lanes that were active when we hit the IF
+		LaneMask elseMask;  // Lanes that still need to run the else block, if the lanes diverged
+	};
+
+	struct CallInfo {
+		u32 endingPC;
+		u32 returnPC;
+		LaneMask savedMask;
+	};
+
+	std::array<Register, 16> inputs;
+	std::array<Register, 16> tempRegisters;
+	std::array<Register, 16> outputs;
+	// a0.x, a0.y & the loop counter for every lane. The loop counter only depends on int uniforms, but lanes that skipped a LOOP
+	// because of a divergent branch keep their old one
+	std::array<std::array<s32, laneCount>, 3> addrRegisters;
+	LaneMask cmpX, cmpY; // cmp.x & cmp.y for every lane
+
+	LaneMask liveLanes;   // Lanes that hold an actual vertex
+	LaneMask activeLanes; // Lanes executing the current instruction
+
+	u32 pc;
+	u32 loopIndex, ifIndex, callIndex;
+	std::array<Loop, 4> loopInfo;
+	std::array<ConditionalInfo, 8> conditionalInfo;
+	std::array<CallInfo, 4> callInfo;
+
+	PICAShader* shader = nullptr; // Shader whose program & uniforms we're running
+
+	float readComponent(u32 source, int component, int lane);
+	void loadSource(Register& out, const DecodedInstruction& instruction, int n);
+	void storeDest(const DecodedInstruction& instruction, const Register& value);
+	LaneMask evaluateCondition(const DecodedInstruction& instruction);
+	void handleControlFlow();
+	void writeBack(PICAShader& shaderUnit, int lane) const;
+
+	// Apply "func" to every component of every lane of the source(s) and write the result to the instruction's destination
+	template <typename Func>
+	void unaryOp(const DecodedInstruction& instruction, Func func);
+	template <typename Func>
+	void binaryOp(const DecodedInstruction& instruction, Func func);
+	template <int components>
+	void dotProduct(const DecodedInstruction& instruction);
+	template <typename Func>
+	void scalarOp(const DecodedInstruction& instruction, Func func);
+
+	void cmp(const DecodedInstruction& instruction);
+	void mad(const DecodedInstruction& instruction);
+	void mova(const DecodedInstruction& instruction);
+	void pushIf(const DecodedInstruction& instruction, LaneMask taken);
+	void call(const DecodedInstruction& instruction, LaneMask taken);
+	void loop(const DecodedInstruction& instruction);
+
+public:
+	// Fetch the input registers of a lane. "inputs" is indexed by shader input register
+	void setInputs(int lane, const std::array<vec4f, 16>& inputs);
+	void getInputs(int lane, std::array<vec4f, 16>& inputs) const;
+	vec4f getOutput(int lane, int index) const;
+
+	// Run the program loaded in "shader" on the first "count" lanes, using its uniforms. Temporaries & outputs start out as copies of
+	// the ones in "shader", and on success the registers of the last lane get written back to it, just like they would end up when
+	// running the vertices back to back.
+	// Returns false if the lanes diverged in a way we can't run in lockstep, in which case the outputs are garbage and "shader" is untouched
+	bool run(PICAShader& shader, int count);
+};
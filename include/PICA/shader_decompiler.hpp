@@ -0,0 +1,41 @@
+#pragma once
+#include <optional>
+#include <string>
+#include "PICA/shader.hpp"
+
+// Translates PICA vertex shaders to GLSL, so they can run on the host GPU instead of the shader interpreter/JIT.
+// PICA control flow is built out of blocks with explicit end PCs (IF/CALL/LOOP), which map onto GLSL ifs, inlined calls & for loops
+// as long as the blocks nest properly. Programs that don't (backwards jumps, blocks overlapping each other) or that use instructions
+// we don't handle can't be translated, and have to go through the CPU path instead.
+//
+// The generated shader reads input register n from vertex attribute location n, the float/int/bool uniforms from the PICAUniforms
+// uniform block (see HardwareShaderUniforms) and writes the same outputs the CPU path puts in our Vertex struct
+class ShaderDecompiler {
+	const DecodedProgram& program;
+	std::string source;
+	std::string error;
+	int indentLevel = 1;
+	int callDepth = 0;
+
+	explicit ShaderDecompiler(const DecodedProgram& program) : program(program) {}
+
+	bool emitBlock(u32 begin, u32 end, bool topLevel = false);
+	bool emitInstruction(const DecodedInstruction& instruction);
+	void emitLine(const std::string& line);
+
+	std::string getSource(const DecodedInstruction& instruction, int n);
+	std::string getCondition(const DecodedInstruction& instruction);
+	bool fail(const char* message, u32 pc);
+
+public:
+	// Returns the GLSL source for the vertex shader, or std::nullopt if the program can't be translated
+	static std::optional<std::string> decompile(PICAShader& shader);
+};
+
+// Layout of the PICAUniforms block the decompiled shaders read their uniforms from (std140)
+struct HardwareShaderUniforms {
+	float floatUniforms[96][4];
+	u32 intUniforms[4][4]; // Loop iterations, initial loop counter & increment in x, y & z
+	u32 boolUniforms;
+	u32 padding[3];
+};
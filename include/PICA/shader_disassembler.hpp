@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include "PICA/shader.hpp"
+
+// Turns PICA shader programs back into something resembling assembly, for debugging & for the shader profiler's reports.
+// Registers are named like in most PICA assemblers: v0-v15 are inputs, r0-r15 temporaries, c0-c95 float uniforms, i0-i3 int uniforms,
+// b0-b15 bool uniforms and o0-o15 outputs. Relative addressing is written as c4[a0.x], c4[a0.y] or c4[aL]
+class ShaderDisassembler {
+public:
+	// Lowercase name of a decoded opcode (See DecodedInstruction::opcode), or nullptr if it isn't a valid one
+	static const char* getMnemonic(u32 opcode);
+
+	// Disassemble a single decoded instruction. Flow control targets are absolute, so we don't need to know where it lives
+	static std::string disassemble(const DecodedInstruction& instruction);
+
+	// Disassemble the instructions in [begin, end) of a decoded program, one per line, prefixed with their PC.
+	// The entrypoint gets marked so that it's easy to find where execution starts
+	static std::string disassemble(const DecodedProgram& program, u32 entrypoint, u32 begin, u32 end);
+
+	// Disassemble the program loaded in a shader unit with its current operand descriptors, up to the last END instruction
+	static std::string disassemble(PICAShader& shader);
+};
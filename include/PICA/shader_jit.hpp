@@ -0,0 +1,81 @@
+#pragma once
+#include <memory>
+#include "PICA/program_cache.hpp"
+#include "PICA/shader.hpp"
+
+// Only built with ENABLE_SHADER_JIT=ON, see CMakeLists.txt
+#ifdef PANDA3DS_SHADER_JIT_X64
+#define PANDA3DS_SHADER_JIT_SUPPORTED
+class ShaderEmitter;
+#endif
+
+// Front-end for running PICA shaders. Can compile shaders to native code on hosts that have a recompiler, falling back to the interpreter
+// for everything else, including programs the recompiler refuses to handle. The recompiler is opt-in until it's been verified against
+// more titles, so the interpreter is the default mode.
+// The interpreter also doubles as a reference for the recompiler: In Verify mode every vertex goes through both, and mismatching outputs
+// get reported.
+class ShaderJIT {
+public:
+	enum class Mode { Interpreter, Recompiler, Verify };
+
+private:
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+	// Recently used compiled programs, keyed by the hash of their code, operand descriptors & entrypoint
+	// Programs the recompiler couldn't handle are cached as nullptr so we don't try to compile them again on every draw
+	// Programs are small compared to the code cache, but games that stream shaders could still make us grow forever, hence the limit
+	static constexpr size_t maxCachedPrograms = 256;
+	ProgramCache<std::unique_ptr<ShaderEmitter>, maxCachedPrograms> cache;
+
+	using ProgramCallback = void (*)(PICAShader& shaderUnit);
+	ProgramCallback activeProgram = nullptr;
+	bool reportedMismatch = false; // Only report the first mismatch for each program in Verify mode, otherwise we'd flood the console
+
+	void verify(PICAShader& shaderUnit);
+#endif
+
+	Mode mode = Mode::Interpreter;
+
+public:
+	ShaderJIT();
+	~ShaderJIT();
+
+	static constexpr bool isAvailable() {
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void setMode(Mode newMode);
+	Mode getMode() const { return mode; }
+	void reset();
+
+	// Look up or compile the program currently loaded into "shaderUnit". Must be called before running a batch of vertices
+	void prepare(PICAShader& shaderUnit);
+
+	// Is the prepared program going to run as native code? If not, callers can batch vertices through the interpreter instead
+	bool isRecompiling() const {
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+		return activeProgram != nullptr;
+#else
+		return false;
+#endif
+	}
+
+	// Run the prepared program on the inputs of "shaderUnit"
+	void run(PICAShader& shaderUnit) {
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+		if (activeProgram != nullptr) {
+			if (mode == Mode::Verify) [[unlikely]] {
+				verify(shaderUnit);
+			} else {
+				activeProgram(shaderUnit);
+			}
+
+			return;
+		}
+#endif
+		shaderUnit.run();
+	}
+};
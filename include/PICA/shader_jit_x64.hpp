@@ -0,0 +1,111 @@
+#pragma once
+#ifdef PANDA3DS_SHADER_JIT_X64
+#include <bitset>
+#include <vector>
+#include "PICA/shader.hpp"
+#include "xbyak/xbyak.h"
+
+// Recompiles a PICA shader program to x64 code with Xbyak.
+// Vector registers map onto SSE registers one-to-one, with f24 values kept as floats like in the interpreter. SSE4.1 is required for
+// blendps (write masks) and roundps (flr).
+// The whole program gets compiled in one go, in PICA address order, with a label for every instruction. IF and LOOP blocks are compiled
+// as structured blocks, while CALLs turn into x64 calls (See compileCall for how functions return)
+class ShaderEmitter : public Xbyak::CodeGenerator {
+	using Xmm = Xbyak::Xmm;
+	static constexpr size_t maxInstructionCount = 4096;
+	// Worst case size of a compiled instruction, used for sizing the code buffer. Instructions with relative addressing on all of their
+	// sources are the biggest offenders
+	static constexpr size_t bytesPerInstruction = 512;
+	static constexpr size_t fixedCodeSize = 4096; // Prologue, epilogue & constants
+	static constexpr u32 maxCallDepth = 4;        // Matches the size of the interpreter's CALL stack
+
+	std::vector<Xbyak::Label> instructionLabels;
+	std::bitset<maxInstructionCount> returnPCs; // PCs where a function might end
+	Xbyak::Label epilogueLabel, negateMaskLabel, onesLabel;
+	Xbyak::Label loopOverflowLabel, callOverflowLabel;
+
+	u32 recompilerPC = 0; // PC of the next instruction to compile
+	u32 programEnd = 0;   // We compile everything in the [0, programEnd) range
+	const char* error = nullptr; // Why we gave up on compiling the program, or nullptr if we didn't
+
+	// Offsets of the PICAShader members the compiled code touches, relative to the state pointer
+	int inputsOffset, tempsOffset, uniformsOffset, outputsOffset;
+	int addrRegisterOffset, loopCounterOffset, cmpRegisterOffset, boolUniformOffset, intUniformsOffset;
+	int loopInfoOffset, loopIndexOffset;
+
+	using PrologueCallback = void (*)(PICAShader& shader);
+	PrologueCallback prologue = nullptr;
+
+	static u32 findProgramEnd(const PICAShader& shader);
+	static size_t codeSize(const PICAShader& shader) { return fixedCodeSize + findProgramEnd(shader) * bytesPerInstruction; }
+	void computeOffsets(const PICAShader& shader);
+	void scanProgram(const PICAShader& shader);
+	void fail(const char* reason) {
+		if (error == nullptr) error = reason;
+	}
+
+	void emitPrologue(const PICAShader& shader);
+	void emitEpilogue();
+	void emitOverflowHandler(Xbyak::Label& label, const char* stack);
+	void compileUntil(const PICAShader& shader, u32 end);
+	void compileInstruction(const PICAShader& shader);
+
+	// Helpers for loading sources & writing back results
+	int sourceOffset(u32 source) const;
+	int destOffset(u32 dest) const;
+	void loadSource(const Xmm& reg, u32 source, u32 index, u32 operandDescriptor, int sourceIndex);
+	void loadIndexedUniform(const Xmm& reg, u32 source, u32 index);
+	void storeDest(const Xmm& reg, u32 dest, u32 operandDescriptor);
+	void loadFormat1Sources(const PICAShader& shader, u32 instruction);
+	void loadFormat1iSources(const PICAShader& shader, u32 instruction);
+	void emitSafeMultiply();
+	void emitDotProduct(int components);
+	void emitComparison(u32 operation, int offset);
+	void emitCondition(u32 instruction);
+	void emitBoolUniformTest(u32 instruction);
+	void emitReturnCheck(u32 pc);
+
+	// Shader opcodes
+	void recADD(const PICAShader& shader, u32 instruction);
+	void recCALL(const PICAShader& shader, u32 instruction);
+	void recCALLC(const PICAShader& shader, u32 instruction);
+	void recCALLU(const PICAShader& shader, u32 instruction);
+	void recCMP(const PICAShader& shader, u32 instruction);
+	void recDP3(const PICAShader& shader, u32 instruction);
+	void recDP4(const PICAShader& shader, u32 instruction);
+	void recFLR(const PICAShader& shader, u32 instruction);
+	void recIFC(const PICAShader& shader, u32 instruction);
+	void recIFU(const PICAShader& shader, u32 instruction);
+	void recJMPC(const PICAShader& shader, u32 instruction);
+	void recJMPU(const PICAShader& shader, u32 instruction);
+	void recLOOP(const PICAShader& shader, u32 instruction);
+	void recMAD(const PICAShader& shader, u32 instruction);
+	void recMADI(const PICAShader& shader, u32 instruction);
+	void recMAX(const PICAShader& shader, u32 instruction);
+	void recMIN(const PICAShader& shader, u32 instruction);
+	void recMOV(const PICAShader& shader, u32 instruction);
+	void recMOVA(const PICAShader& shader, u32 instruction);
+	void recMUL(const PICAShader& shader, u32 instruction);
+	void recRCP(const PICAShader& shader, u32 instruction);
+	void recRSQ(const PICAShader& shader, u32 instruction);
+	void recSGEI(const PICAShader& shader, u32 instruction);
+	void recSLT(const PICAShader& shader, u32 instruction);
+	void recSLTI(const PICAShader& shader, u32 instruction);
+
+	// Shared by IFC/IFU and CALL/CALLC/CALLU respectively
+	void compileIf(const PICAShader& shader, u32 instruction);
+	void compileCall(u32 instruction);
+
+public:
+	// The code buffer is sized for the program we're about to compile
+	explicit ShaderEmitter(const PICAShader& shader) : Xbyak::CodeGenerator(codeSize(shader)) {}
+
+	// Returns false if the program can't be recompiled, in which case getError() says why and the interpreter needs to run it instead
+	bool compile(const PICAShader& shader);
+	const char* getError() const { return error; }
+	PrologueCallback getPrologue() const { return prologue; }
+
+	// Does the host CPU have everything the emitted code needs?
+	static bool isSupported();
+};
+#endif // PANDA3DS_SHADER_JIT_X64
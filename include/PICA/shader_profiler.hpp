@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "helpers.hpp"
+#include "PICA/shader.hpp"
+
+// Counts how often each instruction of each vertex shader program runs, to find out which opcodes & control flow patterns real titles
+// spend their time in. While the profiler is running, the GPU shades every vertex on the interpreter (no JIT, batching, threads or
+// host GPU shaders) so that every instruction gets counted, which makes it slow, but the counts are exact.
+// Programs are told apart by their code hash, the same one the program caches use
+class ShaderProfiler {
+	struct ProgramProfile {
+		std::shared_ptr<const DecodedProgram> program; // Kept alive for disassembling the report, as the game can overwrite the code
+		u32 entrypoint;
+		std::array<u64, 4096> pcCounts{}; // Number of times the instruction at each PC was executed
+		u64 draws = 0;
+		u64 vertices = 0;
+		u64 instructions = 0;
+	};
+
+	struct DrawRecord {
+		u64 hash;
+		u32 vertices;
+		u64 instructions;
+	};
+
+	// Per draw stats are only kept for this many draws, to not eat all the memory if the profiler is left running
+	static constexpr size_t maxRecordedDraws = 100000;
+
+	std::unordered_map<u64, std::unique_ptr<ProgramProfile>> programs;
+	std::vector<DrawRecord> draws;
+	u64 totalDraws = 0;
+	ProgramProfile* currentProgram = nullptr;
+	u64 currentHash = 0;
+	bool running = false;
+
+public:
+	void start();
+	void stop() { running = false; }
+	bool isRunning() const { return running; }
+
+	// Start counting instructions the shader unit runs for a draw. The profiled program is the one currently loaded into it
+	void beginDraw(PICAShader& shader);
+	// Stop counting and record the number of vertices the draw shaded
+	void endDraw(PICAShader& shader, u32 vertexCount);
+
+	// Write per opcode totals, then every program's disassembly annotated with execution counts, then the per draw stats
+	bool writeReport(const std::filesystem::path& path) const;
+};
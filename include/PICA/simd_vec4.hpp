@@ -0,0 +1,209 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include "helpers.hpp"
+
+// 4-wide float vectors for the shader interpreter. f24 values are stored as plain floats, so a PICA vector register maps directly onto
+// an SSE/NEON register. Everything here works on pointers to 16-byte aligned vec4s (x in the lowest address)
+// Runtime swizzles can't use shufps/pshufd, as those take the selectors as an immediate. Instead we use a byte shuffle (pshufb/tbl) with
+// a mask looked up from a precomputed table, which needs SSSE3 on x86. Without it we gather the components one by one.
+// x64 builds enable SSSE3 & SSE4.1 unless configured with ENABLE_SSE4_1=OFF, which defines PANDA3DS_X64_SSE41 for compilers like MSVC
+// that don't have feature macros for them.
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define PANDA3DS_SIMD_SSE
+#include <emmintrin.h>
+
+#if defined(__SSSE3__) || defined(__AVX__) || defined(PANDA3DS_X64_SSE41)
+#define PANDA3DS_SIMD_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#if defined(__SSE4_1__) || defined(__AVX__) || defined(PANDA3DS_X64_SSE41)
+#define PANDA3DS_SIMD_SSE41
+#include <smmintrin.h>
+#endif
+
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PANDA3DS_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace SIMD {
+#if defined(PANDA3DS_SIMD_SSE)
+	using Vec4 = __m128;
+#elif defined(PANDA3DS_SIMD_NEON)
+	using Vec4 = float32x4_t;
+#else
+	struct Vec4 {
+		float lanes[4];
+	};
+#endif
+
+	namespace Tables {
+		// Byte shuffle masks for every swizzle. The selector for lane n is in bits [2n + 1 : 2n] of the swizzle, like shufps
+		alignas(16) inline constexpr std::array<std::array<u8, 16>, 256> swizzleMasks = [] {
+			std::array<std::array<u8, 16>, 256> ret{};
+			for (int swizzle = 0; swizzle < 256; swizzle++) {
+				for (int lane = 0; lane < 4; lane++) {
+					const int selector = (swizzle >> (lane * 2)) & 3;
+					for (int byte = 0; byte < 4; byte++) {
+						ret[swizzle][lane * 4 + byte] = u8(selector * 4 + byte);
+					}
+				}
+			}
+			return ret;
+		}();
+
+		// Lane masks for each PICA write mask. PICA write masks have x in bit 3, and lane 0 is x
+		alignas(16) inline constexpr std::array<std::array<u32, 4>, 16> writeMasks = [] {
+			std::array<std::array<u32, 4>, 16> ret{};
+			for (int mask = 0; mask < 16; mask++) {
+				for (int lane = 0; lane < 4; lane++) {
+					ret[mask][lane] = (mask & (8 >> lane)) ? 0xffffffff : 0;
+				}
+			}
+			return ret;
+		}();
+	}  // namespace Tables
+
+#if defined(PANDA3DS_SIMD_SSE)
+	inline Vec4 load(const float* data) { return _mm_load_ps(data); }
+	inline void store(float* data, Vec4 value) { _mm_store_ps(data, value); }
+	inline Vec4 broadcast(float value) { return _mm_set1_ps(value); }
+
+	inline Vec4 loadSwizzled(const float* data, u32 swizzle) {
+#ifdef PANDA3DS_SIMD_SSSE3
+		const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(Tables::swizzleMasks[swizzle].data()));
+		return _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(_mm_load_ps(data)), mask));
+#else
+		return _mm_setr_ps(data[swizzle & 3], data[(swizzle >> 2) & 3], data[(swizzle >> 4) & 3], data[swizzle >> 6]);
+#endif
+	}
+
+	// Only write the lanes enabled in the PICA write mask
+	inline void storeMasked(float* data, Vec4 value, u32 componentMask) {
+		const __m128 mask = _mm_load_ps(reinterpret_cast<const float*>(Tables::writeMasks[componentMask].data()));
+		_mm_store_ps(data, _mm_or_ps(_mm_and_ps(mask, value), _mm_andnot_ps(mask, _mm_load_ps(data))));
+	}
+
+	inline Vec4 negate(Vec4 value) { return _mm_xor_ps(value, _mm_set1_ps(-0.0f)); }
+	inline Vec4 add(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+
+	// PICA gives 0 instead of NaN when multiplying 0 by inf, so zero out lanes that became NaN without either input being NaN
+	inline Vec4 mul(Vec4 a, Vec4 b) {
+		const __m128 result = _mm_mul_ps(a, b);
+		const __m128 becameNaN = _mm_andnot_ps(_mm_cmpunord_ps(a, b), _mm_cmpunord_ps(result, result));
+		return _mm_andnot_ps(becameNaN, result);
+	}
+
+	// maxps & minps return the 2nd operand if either is NaN, which matches a > b ? a : b and a < b ? a : b
+	inline Vec4 max(Vec4 a, Vec4 b) { return _mm_max_ps(a, b); }
+	inline Vec4 min(Vec4 a, Vec4 b) { return _mm_min_ps(a, b); }
+
+	// Returns 1.0 in lanes where the comparison is true and 0.0 in the rest
+	inline Vec4 lessThan(Vec4 a, Vec4 b) { return _mm_and_ps(_mm_cmplt_ps(a, b), _mm_set1_ps(1.0f)); }
+	inline Vec4 greaterEqual(Vec4 a, Vec4 b) { return _mm_and_ps(_mm_cmpge_ps(a, b), _mm_set1_ps(1.0f)); }
+
+	inline Vec4 floor(Vec4 value) {
+#ifdef PANDA3DS_SIMD_SSE41
+		return _mm_floor_ps(value);
+#else
+		alignas(16) float lanes[4];
+		_mm_store_ps(lanes, value);
+		return _mm_setr_ps(std::floor(lanes[0]), std::floor(lanes[1]), std::floor(lanes[2]), std::floor(lanes[3]));
+#endif
+	}
+
+#elif defined(PANDA3DS_SIMD_NEON)
+	inline Vec4 load(const float* data) { return vld1q_f32(data); }
+	inline void store(float* data, Vec4 value) { vst1q_f32(data, value); }
+	inline Vec4 broadcast(float value) { return vdupq_n_f32(value); }
+
+	inline Vec4 loadSwizzled(const float* data, u32 swizzle) {
+		const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const u8*>(data));
+		return vreinterpretq_f32_u8(vqtbl1q_u8(bytes, vld1q_u8(Tables::swizzleMasks[swizzle].data())));
+	}
+
+	inline void storeMasked(float* data, Vec4 value, u32 componentMask) {
+		vst1q_f32(data, vbslq_f32(vld1q_u32(Tables::writeMasks[componentMask].data()), value, vld1q_f32(data)));
+	}
+
+	inline Vec4 negate(Vec4 value) { return vnegq_f32(value); }
+	inline Vec4 add(Vec4 a, Vec4 b) { return vaddq_f32(a, b); }
+
+	// PICA gives 0 instead of NaN when multiplying 0 by inf, so zero out lanes that became NaN without either input being NaN
+	inline Vec4 mul(Vec4 a, Vec4 b) {
+		const float32x4_t result = vmulq_f32(a, b);
+		const uint32x4_t inputsOrdered = vandq_u32(vceqq_f32(a, a), vceqq_f32(b, b));
+		const uint32x4_t becameNaN = vbicq_u32(inputsOrdered, vceqq_f32(result, result));
+		return vbslq_f32(becameNaN, vdupq_n_f32(0.0f), result);
+	}
+
+	// vmaxq/vminq propagate NaNs, so select manually to match a > b ? a : b and a < b ? a : b
+	inline Vec4 max(Vec4 a, Vec4 b) { return vbslq_f32(vcgtq_f32(a, b), a, b); }
+	inline Vec4 min(Vec4 a, Vec4 b) { return vbslq_f32(vcltq_f32(a, b), a, b); }
+
+	inline Vec4 lessThan(Vec4 a, Vec4 b) { return vbslq_f32(vcltq_f32(a, b), vdupq_n_f32(1.0f), vdupq_n_f32(0.0f)); }
+	inline Vec4 greaterEqual(Vec4 a, Vec4 b) { return vbslq_f32(vcgeq_f32(a, b), vdupq_n_f32(1.0f), vdupq_n_f32(0.0f)); }
+	inline Vec4 floor(Vec4 value) { return vrndmq_f32(value); }
+
+#else
+	// Plain C++ fallback for everything else
+	inline Vec4 load(const float* data) { return {{data[0], data[1], data[2], data[3]}}; }
+	inline void store(float* data, Vec4 value) {
+		for (int i = 0; i < 4; i++) data[i] = value.lanes[i];
+	}
+	inline Vec4 broadcast(float value) { return {{value, value, value, value}}; }
+
+	inline Vec4 loadSwizzled(const float* data, u32 swizzle) {
+		return {{data[swizzle & 3], data[(swizzle >> 2) & 3], data[(swizzle >> 4) & 3], data[swizzle >> 6]}};
+	}
+
+	inline void storeMasked(float* data, Vec4 value, u32 componentMask) {
+		for (int i = 0; i < 4; i++) {
+			if (componentMask & (8 >> i)) data[i] = value.lanes[i];
+		}
+	}
+
+	template <typename Func>
+	inline Vec4 perLane(Vec4 a, Vec4 b, Func func) {
+		Vec4 ret;
+		for (int i = 0; i < 4; i++) ret.lanes[i] = func(a.lanes[i], b.lanes[i]);
+		return ret;
+	}
+
+	inline Vec4 negate(Vec4 value) { return perLane(value, value, [](float x, float) { return -x; }); }
+	inline Vec4 add(Vec4 a, Vec4 b) { return perLane(a, b, [](float x, float y) { return x + y; }); }
+
+	// PICA gives 0 instead of NaN when multiplying 0 by inf
+	inline Vec4 mul(Vec4 a, Vec4 b) {
+		return perLane(a, b, [](float x, float y) {
+			const float result = x * y;
+			return (std::isnan(result) && !std::isnan(x) && !std::isnan(y)) ? 0.0f : result;
+		});
+	}
+
+	inline Vec4 max(Vec4 a, Vec4 b) { return perLane(a, b, [](float x, float y) { return x > y ? x : y; }); }
+	inline Vec4 min(Vec4 a, Vec4 b) { return perLane(a, b, [](float x, float y) { return x < y ? x : y; }); }
+	inline Vec4 lessThan(Vec4 a, Vec4 b) { return perLane(a, b, [](float x, float y) { return x < y ? 1.0f : 0.0f; }); }
+	inline Vec4 greaterEqual(Vec4 a, Vec4 b) { return perLane(a, b, [](float x, float y) { return x >= y ? 1.0f : 0.0f; }); }
+	inline Vec4 floor(Vec4 value) { return perLane(value, value, [](float x, float) { return std::floor(x); }); }
+#endif
+
+	inline std::array<float, 4> toArray(Vec4 value) {
+		alignas(16) std::array<float, 4> ret;
+		store(ret.data(), value);
+		return ret;
+	}
+
+	// The products are done 4-wide, but the sum stays sequential so the result matches PICA's (x + y) + z (+ w) order bit for bit
+	inline float dot3(Vec4 a, Vec4 b) {
+		const auto products = toArray(mul(a, b));
+		return products[0] + products[1] + products[2];
+	}
+
+	inline float dot4(Vec4 a, Vec4 b) {
+		const auto products = toArray(mul(a, b));
+		return products[0] + products[1] + products[2] + products[3];
+	}
+}  // namespace SIMD
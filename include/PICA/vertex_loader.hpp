@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include "helpers.hpp"
+#include "opengl.hpp"
+#include "PICA/float_types.hpp"
+
+// Loads vertex attributes into the vertex shader's input registers.
+// Decoding the attribute format & permutation registers for every vertex is slow, so the GPU builds a list of load steps out of them
+// whenever they change. Each step knows where its attribute lives, which input register it goes to, and has a conversion function
+// specialised for the attribute's type & component count.
+class VertexLoader {
+	using vec4f = OpenGL::Vector<Floats::f24, 4>;
+	using ConvertFunc = void (*)(const u8* source, vec4f& dest);
+
+public:
+	// Size of each attribute type: Signed byte, unsigned byte, short & float
+	static constexpr std::array<u32, 4> typeSizes = {sizeof(s8), sizeof(u8), sizeof(s16), sizeof(float)};
+
+	struct Step {
+		ConvertFunc convert;     // nullptr for fixed attributes
+		const vec4f* fixedValue; // Value of fixed attributes. We point to it as fixed attributes can change without a rebuild
+		u32 offset;              // Offset of the attribute of the first vertex from the vertex base
+		u32 stride;              // Bytes between each vertex's copy of the attribute
+		u32 inputRegister;       // Shader input register the attribute ends up in
+		u8 type;                 // Same as the type passed to addAttribute
+		u8 components;
+		u8 buffer;               // Attribute buffer the attribute is stored in
+
+		bool isFixed() const { return convert == nullptr; }
+	};
+
+	// Attribute buffers (Not fixed attributes) hold the attributes of each vertex interleaved
+	struct Buffer {
+		u32 offset; // Offset of the buffer from the vertex base
+		u32 stride;
+		u32 size;   // Bytes of each vertex that the attributes we load actually use
+	};
+
+private:
+	std::array<Step, 16> steps;
+	std::array<Buffer, 12> buffers;
+	std::array<const u8*, 16> basePointers; // Host pointer to each step's attribute for vertex 0 of the current draw
+	u32 stepCount = 0;
+
+	// Components the attribute doesn't provide default to 0, except for w which defaults to 1
+	template <typename T, int components>
+	static void convert(const u8* source, vec4f& dest) {
+		float* out = reinterpret_cast<float*>(&dest);
+		for (int i = 0; i < components; i++) {
+			T value;
+			std::memcpy(&value, source + i * sizeof(T), sizeof(T));
+			out[i] = static_cast<float>(value);
+		}
+
+		for (int i = components; i < 4; i++) {
+			out[i] = (i == 3) ? 1.0f : 0.0f;
+		}
+	}
+
+	// Indexed by (type << 2) | (components - 1). Types are signed byte, unsigned byte, short & float in that order
+	static constexpr std::array<ConvertFunc, 16> converters = {
+		&convert<s8, 1>, &convert<s8, 2>, &convert<s8, 3>, &convert<s8, 4>,
+		&convert<u8, 1>, &convert<u8, 2>, &convert<u8, 3>, &convert<u8, 4>,
+		&convert<s16, 1>, &convert<s16, 2>, &convert<s16, 3>, &convert<s16, 4>,
+		&convert<float, 1>, &convert<float, 2>, &convert<float, 3>, &convert<float, 4>,
+	};
+
+	bool full() const { return stepCount >= steps.size(); }
+
+public:
+	void clear() { stepCount = 0; }
+
+	void addFixedAttribute(const vec4f* value, u32 inputRegister) {
+		if (full()) [[unlikely]] return;
+		steps[stepCount++] = Step{nullptr, value, 0, 0, inputRegister, 0, 4, 0};
+	}
+
+	// Must be called before adding the buffer's attributes. index: 0 to 11
+	void setBuffer(u32 index, u32 offset, u32 stride) { buffers[index] = Buffer{offset, stride, 0}; }
+
+	// type: 0 = signed byte, 1 = unsigned byte, 2 = short, 3 = float. components: 1 to 4
+	// offset: Offset of the attribute within each vertex of the buffer
+	void addAttribute(u32 type, u32 components, u32 buffer, u32 offset, u32 inputRegister) {
+		if (full()) [[unlikely]] return;
+
+		Buffer& info = buffers[buffer];
+		info.size = std::max(info.size, offset + components * typeSizes[type]);
+		steps[stepCount++] = Step{
+			converters[(type << 2) | (components - 1)], nullptr, info.offset + offset, info.stride, inputRegister, u8(type), u8(components), u8(buffer)
+		};
+	}
+
+	u32 getStepCount() const { return stepCount; }
+	const Step& getStep(u32 index) const { return steps[index]; }
+	const Buffer& getBuffer(u32 index) const { return buffers[index]; }
+
+	// Look up the host pointers for a draw's attribute buffers, using "getPointer" to translate physical addresses
+	template <typename Func>
+	void setVertexBase(u32 vertexBase, Func getPointer) {
+		for (u32 i = 0; i < stepCount; i++) {
+			basePointers[i] = (steps[i].convert != nullptr) ? getPointer(vertexBase + steps[i].offset) : nullptr;
+		}
+	}
+
+	// Load every attribute of a vertex into "inputs". Doesn't modify the loader, so multiple threads can load vertices at once
+	void load(u32 vertexIndex, std::array<vec4f, 16>& inputs) const {
+		for (u32 i = 0; i < stepCount; i++) {
+			const Step& step = steps[i];
+			if (step.convert != nullptr) [[likely]] {
+				step.convert(basePointers[i] + vertexIndex * step.stride, inputs[step.inputRegister]);
+			} else {
+				inputs[step.inputRegister] = *step.fixedValue;
+			}
+		}
+	}
+};
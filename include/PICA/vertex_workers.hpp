@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "helpers.hpp"
+
+// Pool of host threads for splitting up vertex processing on big draws.
+// Work is handed out in fixed-size chunks from a shared counter, so threads that finish early just grab the next chunk instead of
+// waiting on a slow one. The thread calling run() works on chunks too, as worker 0.
+// Threads are only spawned the first time a draw actually gets split, so titles with small draws never pay for them.
+class VertexWorkerPool {
+public:
+	// Called with the index of the worker running it & the [begin, end) range of items to process
+	using Job = std::function<void(int worker, u32 begin, u32 end)>;
+
+private:
+	std::vector<std::thread> threads;
+	int threadCount = 0; // Number of extra threads we want, excluding the thread calling run()
+
+	std::mutex mutex;
+	std::condition_variable jobStart, jobDone;
+	u64 jobGeneration = 0;
+	int pendingThreads = 0;
+	bool stopThreads = false;
+
+	// The job being run. Only written while all threads are waiting for the next generation
+	const Job* job = nullptr;
+	u32 itemCount = 0;
+	u32 chunkSize = 0;
+	std::atomic<u32> nextItem = 0;
+
+	void threadMain(int worker, u64 generation);
+	void processChunks(int worker);
+	void stop();
+
+public:
+	// By default we leave a couple of host threads for the emulator thread & the secondary guest CPU cores
+	VertexWorkerPool() : threadCount(defaultThreadCount()) {}
+	~VertexWorkerPool() { stop(); }
+
+	static int defaultThreadCount();
+
+	// Change how many extra threads are used. 0 disables multithreading
+	void setThreadCount(int count);
+	// Total number of workers run() can use, including the calling thread
+	int getWorkerCount() const { return threadCount + 1; }
+
+	// Split [0, count) into chunks of "chunkSize" items and run "job" on all of them, in parallel. Returns once every chunk is done
+	void run(u32 count, u32 chunkSize, const Job& job);
+};
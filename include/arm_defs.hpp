@@ -1,6 +1,9 @@
 #pragma once
 #include <cstdint>
 
+// The Old 3DS has 2 ARM11 MPCore cores, the New 3DS has 4. Core 0 is the app core, core 1 is the syscore
+static constexpr int maxARM11Cores = 4;
+
 // Status register definitions
 namespace CPSR {
     enum : std::uint32_t {
@@ -1,12 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include "dynarmic/interface/A32/a32.h"
 #include "dynarmic/interface/A32/config.h"
 #include "dynarmic/interface/exclusive_monitor.h"
+#include "arm_defs.hpp"
 #include "dynarmic_cp15.hpp"
+#include "guest_hle.hpp"
+#include "guest_profiler.hpp"
+#include "guest_registers.hpp"
 #include "helpers.hpp"
 #include "kernel.hpp"
 #include "memory.hpp"
+#include "tracing.hpp"
+
 
 class CPU;
 
@@ -16,6 +31,11 @@ public:
     u64 totalTicks = 0;
     Memory& mem;
     Kernel& kernel;
+    CPU& cpu;
+    GuestHLE& hle; // Shared between all cores
+    GuestProfiler profiler; // Only ever started for the app core
+    Dynarmic::A32::Jit* jit = nullptr; // The JIT running on top of this environment
+    const int coreID;
 
     u64 getCyclesForInstruction(bool isThumb, u32 instruction);
 
@@ -51,15 +71,35 @@ public:
         mem.write64(vaddr, value);
     }
 
+    // Other cores may be touching the same memory from their own host thread, so exclusive writes need to be a real compare-and-swap
+    // when the page is backed by host memory. Dynarmic's global exclusive monitor takes care of the reservation itself
+    template <typename T>
+    bool writeExclusive(u32 vaddr, T value, T expected) {
+        if (T* pointer = (T*)mem.getWritePointer(vaddr)) [[likely]] {
+            return std::atomic_ref<T>(*pointer).compare_exchange_strong(expected, value);
+        }
+
+        // Not backed by host memory, so just do a plain read & write like a single core would
+        T current;
+        if constexpr (sizeof(T) == 1) current = mem.read8(vaddr);
+        else if constexpr (sizeof(T) == 2) current = mem.read16(vaddr);
+        else if constexpr (sizeof(T) == 4) current = mem.read32(vaddr);
+        else current = mem.read64(vaddr);
+
+        if (current != expected) {
+            return false;
+        }
+
+        if constexpr (sizeof(T) == 1) mem.write8(vaddr, value);
+        else if constexpr (sizeof(T) == 2) mem.write16(vaddr, value);
+        else if constexpr (sizeof(T) == 4) mem.write32(vaddr, value);
+        else mem.write64(vaddr, value);
+        return true;
+    }
+
     #define makeExclusiveWriteHandler(size) \
     bool MemoryWriteExclusive##size(u32 vaddr, u##size value, u##size expected) override { \
-        u##size current = mem.read##size(vaddr); /* Get current value */                   \
-        if (current == expected) {   /* Perform the write if current == expected */        \
-            mem.write##size(vaddr, value);                                                 \
-            return true; /* Exclusive write succeeded */                                   \
-        }                                                                                  \
-                                                                                           \
-        return false; /* Exclusive write failed */                                         \
+        return writeExclusive<u##size>(vaddr, value, expected);                            \
     }
 
     makeExclusiveWriteHandler(8)
@@ -74,10 +114,21 @@ public:
         std::terminate();
     }
 
+    // Run the host version of an HLE'd guest routine. Returns false if the svc didn't come from one of our patches
+    bool callHLE();
+
     void CallSVC(u32 swi) override {
-        kernel.serviceSVC(swi);
+        // Guest routines replaced by GuestHLE are patched to use a reserved svc
+        if (swi == GuestHLE::svcNumber && callHLE()) [[unlikely]] {
+            return;
+        }
+
+        serviceSVC(swi);
     }
 
+    // Enter the kernel on behalf of this core
+    void serviceSVC(u32 swi);
+
     void ExceptionRaised(u32 pc, Dynarmic::A32::Exception exception) override {
         switch (exception) {
             case Dynarmic::A32::Exception::UnpredictableInstruction:
@@ -88,9 +139,16 @@ public:
         }
     }
 
+    // Record the current guest PC & LR for the sampling profiler
+    void sampleGuestPC();
+
     void AddTicks(u64 ticks) override {
         totalTicks += ticks;
 
+        if (profiler.isRunning() && profiler.addTicks(ticks)) [[unlikely]] {
+            sampleGuestPC();
+        }
+
         if (ticks > ticksLeft) {
             ticksLeft = 0;
             return;
@@ -106,34 +164,97 @@ public:
         return getCyclesForInstruction(isThumb, instruction);
     }
 
-    MyEnvironment(Memory& mem, Kernel& kernel, CPU& cpu) : mem(mem), kernel(kernel) {}
+    MyEnvironment(Memory& mem, Kernel& kernel, CPU& cpu, GuestHLE& hle, int coreID)
+        : mem(mem), kernel(kernel), cpu(cpu), hle(hle), coreID(coreID) {}
 };
 
-class CPU {
-    std::unique_ptr<Dynarmic::A32::Jit> jit;
+// A single emulated ARM11 core: Its JIT, the JIT's callbacks and its CP15
+struct CPUCore {
+    MyEnvironment env;
     std::shared_ptr<CP15> cp15;
+    std::unique_ptr<Dynarmic::A32::Jit> jit;
+    // Host thread running this core. Unused for the app core, which runs on the emulator thread
+    std::thread thread;
+    // Whether the core is inside its JIT, where it can touch guest memory & the page tables at any time. Protected by CPU::pauseMutex
+    bool inGuest = false;
 
-    // Make exclusive monitor with only 1 CPU core
-    Dynarmic::ExclusiveMonitor exclusiveMonitor{1};
-    MyEnvironment env;
-    Memory& mem;
+    CPUCore(CPU& cpu, Memory& mem, Kernel& kernel, GuestHLE& hle, Dynarmic::ExclusiveMonitor& monitor, int id);
+    void reset();
+};
 
+class CPU {
 public:
     static constexpr u64 ticksPerSec = 268111856;
+    static constexpr int maxCores = maxARM11Cores;
+    // Once more than one core is up, every core runs on its own host thread and they all meet at a barrier every syncInterval ticks.
+    // These are the only points where the cores' clocks get synchronised, and where idle cores check if the kernel has a thread for them
+    static constexpr u64 defaultSyncInterval = ticksPerSec / 60 / 8;
+
+private:
+    GuestHLE hle;
+    Dynarmic::ExclusiveMonitor exclusiveMonitor{maxCores};
+
+    // The app core (core 0) always exists. Other cores only get brought up once a guest thread is created on them,
+    // so titles that only use the app core run exactly like they would on a single core emulator
+    std::array<std::unique_ptr<CPUCore>, maxCores> cores;
+    std::atomic<int> activeCoreCount = 1;
+
+    // The core the kernel is running on behalf of. The register accessors below all operate on this core
+    CPUCore* activeCore;
+    GuestRegisters kernelRegs;
+
+    Memory& mem;
+    Kernel& kernel;
+
+    // Our kernel & services aren't thread-safe, so only one core can be inside them at a time
+    std::mutex kernelMutex;
+
+    // Slice synchronisation for the cores running on their own host thread
+    std::mutex sliceMutex;
+    std::condition_variable sliceStart, sliceDone;
+    u64 sliceGeneration = 0;
+    u64 sliceTicks = 0;
+    u64 syncInterval = defaultSyncInterval;
+    int workerCount = 0;
+    int pendingWorkers = 0;
+    bool stopWorkers = false;
+
+    // Cores enableCore was called for. They're brought up at the next slice boundary, while no core is running. Protected by kernelMutex
+    u32 pendingCores = 0;
+
+    // Cores parked by stopOtherCores. A core only enters its JIT while no stop is requested
+    std::mutex pauseMutex;
+    std::condition_variable pauseChanged;
+    bool pauseRequested = false;
 
+    // Called before the first secondary core comes up, see setSecondaryCoreCallback
+    std::function<void()> secondaryCoreCallback;
+
+    void activateCore(CPUCore& core);
+    void startPendingCores();
+    void enterGuest(CPUCore& core);
+    void leaveGuest(CPUCore& core);
+    void runSlice(CPUCore& core, u64 ticks);
+    void workerMain(CPUCore& core, u64 generation);
+    void stopCores();
+
+    Dynarmic::A32::Jit& jit() { return *activeCore->jit; }
+
+public:
     CPU(Memory& mem, Kernel& kernel);
+    ~CPU();
     void reset();
 
     void setReg(int index, u32 value) {
-        jit->Regs()[index] = value;
+        jit().Regs()[index] = value;
     }
 
     u32 getReg(int index) {
-        return jit->Regs()[index];
+        return jit().Regs()[index];
     }
 
     std::array<u32, 16>& regs() {
-        return jit->Regs();
+        return jit().Regs();
     }
 
     // Get reference to array of FPRs. This array consists of the FPRs as single precision values
@@ -141,45 +262,85 @@ public:
     // Note: Dynarmic keeps 64 VFP registers as VFPv3 extends the VFP register set to 64 registers.
     // However the 3DS ARM11 is an ARMv6k processor with VFPv2, so only the first 32 registers are actually used
     std::array<u32, 64>& fprs() {
-        return jit->ExtRegs();
+        return jit().ExtRegs();
     }
 
     void setCPSR(u32 value) {
-        jit->SetCpsr(value);
+        jit().SetCpsr(value);
     }
 
     u32 getCPSR() {
-        return jit->Cpsr();
+        return jit().Cpsr();
     }
 
     void setFPSCR(u32 value) {
-        jit->SetFpscr(value);
+        jit().SetFpscr(value);
     }
 
     u32 getFPSCR() {
-        return jit->Fpscr();
+        return jit().Fpscr();
     }
 
     // Set the base pointer to thread-local storage, stored in a CP15 register on the 3DS
     void setTLSBase(u32 value) {
-        cp15->setTLSBase(value);
+        activeCore->cp15->setTLSBase(value);
     }
 
+    // Ticks of the active core. All cores' clocks are synchronised at every sync point
     u64 getTicks() {
-        return env.totalTicks;
+        return activeCore->env.totalTicks;
     }
 
     // Get reference to tick count. Memory needs access to this
     u64& getTicksRef() {
-        return env.totalTicks;
+        return cores[0]->env.totalTicks;
     }
 
-    void runFrame() {
-        env.ticksLeft = ticksPerSec / 60;
+    // The guest profiler samples the app core
+    GuestProfiler& getProfiler() {
+        return cores[0]->env.profiler;
+    }
 
-        const auto exitReason = jit->Run();
-        if (static_cast<u32>(exitReason) != 0) [[unlikely]] {
-            Helpers::panic("Exit reason: %d\nPC: %08X", static_cast<u32>(exitReason), getReg(15));
-        }
+    GuestHLE& getHLE() {
+        return hle;
     }
+
+    // Registers of the core the kernel is currently running on behalf of
+    GuestRegisters& kernelRegisters() {
+        return kernelRegs;
+    }
+
+    int getActiveCoreID() {
+        return activeCore->env.coreID;
+    }
+
+    // Enter the kernel on behalf of core "id"
+    void serviceSVC(int id, u32 svc);
+    // Bring up core "id" if it's not running yet. Called by the kernel when a thread is created on that core. The core starts running
+    // at the next slice boundary
+    void enableCore(int id);
+    // Secondary cores enter the kernel, and through it the GPU, from their own host thread. The callback runs on the emulator thread at a
+    // slice boundary before the first of them starts, so the frontend can move GPU work off the thread that owns the graphics context
+    void setSecondaryCoreCallback(std::function<void()> callback) { secondaryCoreCallback = std::move(callback); }
+    // How many ticks the cores run between barriers once more than one is up. Smaller values keep the cores' clocks closer together
+    void setSyncInterval(u64 ticks) { syncInterval = std::max<u64>(ticks, 1); }
+
+    // The cores read the page tables without any locking, so the kernel parks every core that's running guest code before changing them.
+    // Must be constructed with the kernel lock held, ie from inside the kernel
+    class StoppedCores {
+        CPU& cpu;
+
+    public:
+        explicit StoppedCores(CPU& cpu) : cpu(cpu) { cpu.stopOtherCores(); }
+        ~StoppedCores() { cpu.resumeOtherCores(); }
+        StoppedCores(const StoppedCores&) = delete;
+        StoppedCores& operator=(const StoppedCores&) = delete;
+    };
+
+    void stopOtherCores();
+    void resumeOtherCores();
+    // Stop the active core until the next sync point. Called by the kernel when a secondary core has no thread left to run
+    void idleActiveCore();
+
+    void runFrame();
 };
\ No newline at end of file
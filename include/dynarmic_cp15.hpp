@@ -13,6 +13,7 @@ class CP15 final : public Dynarmic::A32::Coprocessor {
     using CallbackOrAccessTwoWords = Dynarmic::A32::Coprocessor::CallbackOrAccessTwoWords;
 
     u32 threadStoragePointer; // Pointer to thread-local storage
+    u32 cpuID; // Index of the core this coprocessor belongs to
     u32 dummy; // MCR writes here for registers whose values are ignored
 
     std::optional<Callback> CompileInternalOperation(bool two, unsigned opc1,
@@ -44,6 +45,11 @@ class CP15 final : public Dynarmic::A32::Coprocessor {
             return &threadStoragePointer;
         }
 
+        // CPU ID register, accessed via mrc p15, 0, rd, c0, c0, 5. Bits 0-3 hold the index of the core reading it
+        if (!two && CRn == CoprocReg::C0 && opc1 == 0 && CRm == CoprocReg::C0 && opc2 == 5) {
+            return &cpuID;
+        }
+
         Helpers::panic("CP15: CompileGetOneWord\nopc1: %d CRn: %d CRm: %d opc2: %d\n", opc1, (int)CRn, (int)CRm, opc2);
     }
 
@@ -62,6 +68,8 @@ class CP15 final : public Dynarmic::A32::Coprocessor {
     }
 
 public:
+    CP15(u32 cpuID = 0) : cpuID(cpuID) {}
+
     void setTLSBase(u32 value) {
         threadStoragePointer = value;
     }
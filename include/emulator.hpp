@@ -28,6 +28,19 @@ class Emulator {
     ROMType romType = ROMType::None;
     bool running = true;
 
+    // Where Chrome trace captures started with F12 are written to
+    static constexpr const char* traceFilePath = "alber_trace.json";
+    // Where guest profiles started with F11 are written to, in collapsed stack format
+    static constexpr const char* profileFilePath = "alber_profile.folded";
+    // Where PICA shader profiles started with F10 are written to
+    static constexpr const char* shaderProfileFilePath = "alber_shader_profile.txt";
+    void toggleTraceCapture();
+    void toggleGuestProfiler();
+    void toggleShaderProfiler();
+    std::filesystem::path gpuCapturePath;
+    // Replace allowlisted guest library routines in the loaded title with host code
+    void applyHLEPatches();
+
     // Keep the handle for the ROM here to reload when necessary and to prevent deleting it
     // This is currently only used for ELFs, NCSDs use the IOFile API instead
     std::ifstream loadedELF;
@@ -46,6 +59,9 @@ public:
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
         window = SDL_CreateWindow("Alber", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL);
         glContext = SDL_GL_CreateContext(window);
+        gpu.setPresentCallback([this] { SDL_GL_SwapWindow(window); });
+        // Secondary cores can reach the GPU through SVCs on their own host thread, which doesn't have the GL context
+        cpu.setSecondaryCoreCallback([this] { startGPUThread(); });
 
         reset();
     }
@@ -60,5 +76,21 @@ public:
     bool loadNCSD(const std::filesystem::path& path);
     bool loadELF(const std::filesystem::path& path);
     bool loadELF(std::ifstream& file);
+    // Load guest symbols for the profiler from a map file
+    bool loadSymbolMap(const std::filesystem::path& path);
+    // Load the config for HLE'd guest routines. Must be called before loading a ROM
+    bool loadHLEConfig(const std::filesystem::path& path);
+    void printHLEStats();
+    void setShaderJITMode(ShaderJIT::Mode mode) { gpu.setShaderJITMode(mode); }
+    void setVertexThreadCount(int count) { gpu.setVertexThreadCount(count); }
+    void setHardwareVertexShaders(bool enable) { gpu.setHardwareVertexShaders(enable); }
+    // Ticks the CPU cores run between synchronisation points, once a title uses more than one core
+    void setCPUSyncInterval(u64 ticks) { cpu.setSyncInterval(ticks); }
+    // Move the GPU & the GL context to their own thread, so that rendering a frame overlaps with emulating the next one
+    void startGPUThread();
+    // Record everything the GSP sends to the GPU to a capture file for the AlberReplay tool, see PICA/gpu_capture.hpp
+    // Captures can only start before the ROM is loaded, as they need to see the GPU from its reset state
+    bool startGPUCapture(const std::filesystem::path& path);
+    void stopGPUCapture();
     void initGraphicsContext() { gpu.initGraphicsContext(); }
 };
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "guest_profiler.hpp"
+#include "helpers.hpp"
+
+class Memory;
+
+// Guest library routines we can replace with host code
+enum class HLERoutine : u32 {
+	Memcpy,      // void* memcpy(void* dest, const void* src, size_t n), also __aeabi_memcpy & co
+	Memmove,     // void* memmove(void* dest, const void* src, size_t n), also __aeabi_memmove & co
+	Memset,      // void* memset(void* dest, int value, size_t n)
+	AeabiMemset, // void __aeabi_memset(void* dest, size_t n, int value). Note the swapped arguments compared to memset
+	AeabiMemclr, // void __aeabi_memclr(void* dest, size_t n)
+	Strlen,      // size_t strlen(const char* str)
+	Count
+};
+
+// High level emulation of hot guest library routines.
+// After a title is loaded, we look for known routines in its code, either through the ELF symbol table or by scanning the executable
+// segments for masked byte patterns. The first instruction of every routine we find is replaced with an "svc 0xFF", which our CPU
+// callbacks catch before the kernel sees it. We then run a host version of the routine on top of the bulk Memory operations and
+// return to the caller.
+// Replacements only happen for titles that are allowlisted in the HLE config file, as a bad signature will break a game in fun ways.
+// The guest is charged an estimate of the cycles the replaced routine would've taken, based on how many bytes it touched
+class GuestHLE {
+	struct Signature {
+		HLERoutine routine;
+		bool thumb;
+		std::vector<u8> bytes;
+		std::vector<u8> mask; // Bytes where the mask is 0 are wildcards
+	};
+
+	struct Patch {
+		HLERoutine routine;
+		bool thumb;
+	};
+
+	std::vector<Signature> signatures;
+	std::unordered_map<u64, u32> allowlist; // Title ID -> Bitmask of routines that may be replaced
+	u32 globalAllowMask = 0; // Routines allowed for every title
+	std::unordered_map<u32, Patch> patches; // Guest address of the replaced routine -> patch info
+	std::array<std::atomic<u64>, static_cast<size_t>(HLERoutine::Count)> hits = {}; // Atomic as every CPU core can call into us
+
+	u32 allowedRoutines(u64 titleID) const;
+	void patch(Memory& mem, u32 address, HLERoutine routine, bool thumb);
+
+public:
+	// SVC number used for our patched routines. 0xFF is the highest SVC a Thumb svc instruction can encode, and we only treat it as an
+	// HLE call if it comes from an address we patched, so a game calling svc 0xFF itself still ends up in the kernel
+	static constexpr u32 svcNumber = 0xFF;
+
+	// Load the HLE config. Lines are either
+	// "signature <routine> <arm|thumb> <pattern>", where the pattern is made of hex bytes with ?? for wildcards
+	// "title <title ID|*> <routine>[,<routine>...]", to allowlist routines for a title (ELFs have a title ID of 0) or for every title
+	bool loadConfig(const std::filesystem::path& path);
+	bool isEnabled() const { return globalAllowMask != 0 || !allowlist.empty(); }
+
+	// Find & patch the allowed routines in the loaded title. Previous patches are forgotten, as loading overwrites guest code
+	void applyPatches(Memory& mem, u64 titleID, const std::vector<GuestSymbol>& symbols);
+
+	// Runs the host version of the routine patched in at "address", if any. Returns the estimated number of guest cycles the routine
+	// took, or nullopt if there's no patch at the address
+	std::optional<u64> run(u32 address, std::array<u32, 16>& regs, Memory& mem);
+	void printStats() const;
+
+	static const char* routineName(HLERoutine routine);
+};
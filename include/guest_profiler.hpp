@@ -0,0 +1,59 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "helpers.hpp"
+
+// Guest symbol, used for symbolising profiler samples
+struct GuestSymbol {
+	u32 address;
+	u32 size; // 0 if unknown, in which case the symbol is assumed to extend up to the next one
+	std::string name;
+	bool thumb = false; // Whether the function is Thumb code. Only known for symbols from ELF symbol tables
+};
+
+// Sampling profiler for guest code. Every "interval" emulated CPU ticks we record the guest PC, as well as LR as a cheap one-frame call stack.
+// Samples get aggregated per guest function and can be written out as collapsed stacks, which flamegraph.pl, speedscope & co can read
+// Note: Our JIT only writes back PC at block boundaries, so samples are basic block-granular
+class GuestProfiler {
+	std::vector<GuestSymbol> symbols; // Sorted by address
+	std::unordered_map<u64, u64> samples; // (PC << 32 | LR) -> number of times this pair was sampled
+
+	u64 interval = 0;
+	u64 ticksUntilSample = 0;
+	bool running = false;
+
+	const GuestSymbol* findSymbol(u32 address) const;
+	std::string symbolise(u32 address) const;
+
+public:
+	static constexpr u64 defaultInterval = 10000;
+
+	void start(u64 sampleInterval = defaultInterval);
+	void stop() { running = false; }
+	bool isRunning() { return running; }
+
+	// Returns true if it's time to take a sample after executing "ticks" more ticks
+	bool addTicks(u64 ticks) {
+		if (ticks < ticksUntilSample) [[likely]] {
+			ticksUntilSample -= ticks;
+			return false;
+		}
+
+		ticksUntilSample = interval;
+		return true;
+	}
+
+	void sample(u32 pc, u32 lr) { samples[(u64(pc) << 32) | lr]++; }
+
+	// Symbol management. Symbols come from the ELF symbol table or from a user-supplied map file
+	// setSymbols replaces the whole table (used on ROM load), while addSymbols merges into it (used for map files)
+	void setSymbols(std::vector<GuestSymbol> newSymbols);
+	void addSymbols(const std::vector<GuestSymbol>& newSymbols);
+	// Load a map file. Each line is either "address size name", "address name", or nm-style "address type name", with hex addresses/sizes
+	bool loadMapFile(const std::filesystem::path& path);
+
+	// Write the aggregated samples as "caller;callee count" lines
+	bool writeCollapsedStacks(const std::filesystem::path& path) const;
+};
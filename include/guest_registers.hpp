@@ -0,0 +1,17 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include "helpers.hpp"
+
+// The GPRs of whichever guest CPU core is currently executing kernel code.
+// With multiple cores each JIT has its own register file, and the kernel & services run on behalf of the core that made the SVC,
+// so they can't just keep a reference to one core's registers. The CPU rebinds this every time a core enters the kernel.
+class GuestRegisters {
+    std::array<u32, 16>* current = nullptr;
+
+public:
+    void bind(std::array<u32, 16>& regs) { current = &regs; }
+
+    u32& operator[](size_t index) { return (*current)[index]; }
+    const u32& operator[](size_t index) const { return (*current)[index]; }
+};
@@ -4,6 +4,8 @@
 #include <limits>
 #include <string>
 #include <vector>
+#include "arm_defs.hpp"
+#include "guest_registers.hpp"
 #include "kernel_types.hpp"
 #include "helpers.hpp"
 #include "logger.hpp"
@@ -14,7 +16,7 @@
 class CPU;
 
 class Kernel {
-	std::array<u32, 16>& regs;
+	GuestRegisters& regs; // Registers of the core we're currently running on behalf of
 	CPU& cpu;
 	Memory& mem;
 
@@ -38,7 +40,12 @@ class Kernel {
 
 	Handle currentProcess;
 	Handle mainThread;
-	int currentThreadIndex;
+	int currentThreadIndex; // Thread running on the active core, or -1 if the active core is idle
+
+	// Every core has its own running thread. The SVC handlers only ever deal with the core that made the SVC (the "active" core),
+	// so the thread of the active core is kept in currentThreadIndex and swapped in & out in setActiveCore
+	int activeCore = 0;
+	std::array<int, maxARM11Cores> coreThreads;
 	Handle srvHandle; // Handle for the special service manager port "srv:"
 	Handle errorPortHandle; // Handle for the err:f port used for displaying errors
 
@@ -69,11 +76,13 @@ private:
 	void sleepThread(s64 ns);
 	void sleepThreadOnArbiter(u32 waitingAddress);
 	void switchThread(int newThreadIndex);
+	void saveContext(Thread& thread);
 	void sortThreads();
 	std::optional<int> getNextThread();
 	void switchToNextThread();
 	void rescheduleThreads();
 	bool canThreadRun(const Thread& t);
+	bool canRunOnCore(const Thread& t, int core);
 	bool shouldWaitOnObject(KernelObject* object);
 	void releaseMutex(Mutex* moo);
 
@@ -166,6 +175,11 @@ public:
 	void serviceSVC(u32 svc);
 	void reset();
 
+	// Make the kernel operate on behalf of another CPU core. Called by the CPU whenever a different core enters the kernel
+	void setActiveCore(int core);
+	// Give the active core a thread to run if it's idle. Returns false if it has nothing to run
+	bool scheduleActiveCore();
+
 	Handle makeObject(KernelObjectType type) {
 		if (handleCounter > KernelHandles::Max) [[unlikely]] {
 			Helpers::panic("Hlep we somehow created enough kernel objects to overflow this thing");
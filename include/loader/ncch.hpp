@@ -26,6 +26,7 @@ struct NCCH {
     };
 
     u64 partitionIndex = 0;
+    u64 programID = 0; // Title ID of the program
     u64 fileOffset = 0;
 
     bool isNew3DS = false;
@@ -1,56 +1,247 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace Log {
-    // Our logger class
-    template <bool enabled>
-    class Logger {
+    // Deferred (binary) logging
+    // Instead of formatting messages on the emulator thread, every log call can push the format string pointer + its raw arguments
+    // into a per-thread lock-free single-producer/single-consumer ring buffer. A background writer thread drains the rings and does
+    // the actual printf formatting, so an enabled logger only costs a few stores on the hot path.
+    // The format string pointer doubles as the format string ID, as all our format strings are string literals.
+    struct TraceRecord {
+        static constexpr size_t size = 128;
+        using Formatter = void (*)(std::FILE* file, const char* fmt, const std::uint8_t* payload);
+
+        Formatter formatter;
+        const char* fmt;
+        std::array<std::uint8_t, size - sizeof(Formatter) - sizeof(const char*)> payload;
+    };
+    static_assert(sizeof(TraceRecord) == TraceRecord::size);
+
+    class TraceRing {
+        static constexpr size_t capacity = 8192; // Must be a power of 2
+        static constexpr size_t mask = capacity - 1;
+
+        std::array<TraceRecord, capacity> records;
+        alignas(64) std::atomic<size_t> head = 0; // Next record to write. Only modified by the producer
+        alignas(64) std::atomic<size_t> tail = 0; // Next record to read. Only modified by the consumer
+        alignas(64) std::atomic<std::uint64_t> dropped = 0; // Records dropped because the ring was full
+
     public:
-        void log(const char* fmt, ...) {
-            if constexpr (!enabled) return;
-            
+        // Returns a record to fill or nullptr if the ring is full. The record is published by calling commit()
+        TraceRecord* reserve() {
+            const size_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) == capacity) [[unlikely]] {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            return &records[h & mask];
+        }
+
+        void commit() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+        // Consumer side. Formats every pending record into "file" and returns how many records were drained
+        size_t drain(std::FILE* file);
+        std::uint64_t droppedCount() { return dropped.load(std::memory_order_relaxed); }
+    };
+
+    // Get the ring of the calling thread, registering it with the background writer on first use
+    TraceRing& getThreadRing();
+
+    // Whether log calls are pushed to the trace rings instead of being printed right away
+    inline std::atomic<bool> deferredLogging = false;
+
+    // Start/stop the background writer thread. Starting it switches all loggers to deferred mode.
+    // Passing an empty path makes the writer print to stdout
+    bool startDeferredLogging(const char* path = "");
+    void stopDeferredLogging();
+
+    namespace Detail {
+        template <typename T>
+        static constexpr bool isString = std::is_same_v<std::decay_t<T>, const char*> || std::is_same_v<std::decay_t<T>, char*>;
+
+        // Scalars go at the start of the payload, in argument order, so their space is always reserved up front. Strings are copied
+        // inline after them, null-terminated and truncated to whatever space is left, keeping at least 1 byte for each string after them
+        template <typename... Args>
+        static constexpr size_t scalarSize = (size_t(0) + ... + (isString<Args> ? 0 : sizeof(std::decay_t<Args>)));
+        template <typename... Args>
+        static constexpr size_t stringCount = (size_t(0) + ... + (isString<Args> ? 1 : 0));
+
+        struct PackState {
+            std::uint8_t* scalars;
+            std::uint8_t* strings;
+            std::uint8_t* end;
+            size_t stringsLeft;
+        };
+
+        template <typename T>
+        void pack(PackState& state, const T& arg) {
+            if constexpr (isString<T>) {
+                state.stringsLeft--;
+                const size_t available = size_t(state.end - state.strings) - state.stringsLeft;
+
+                const char* str = arg != nullptr ? arg : "(null)";
+                const size_t length = std::min<size_t>(std::strlen(str), available - 1);
+                std::memcpy(state.strings, str, length);
+                state.strings[length] = '\0';
+                state.strings += length + 1;
+            } else {
+                static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= 8, "Unsupported argument type for deferred logging");
+                std::memcpy(state.scalars, &arg, sizeof(T));
+                state.scalars += sizeof(T);
+            }
+        }
+
+        template <typename... Args>
+        void packArgs(TraceRecord& record, const Args&... args) {
+            static_assert(scalarSize<Args...> + stringCount<Args...> <= std::tuple_size_v<decltype(record.payload)>,
+                          "Too many arguments for deferred logging");
+
+            if constexpr (sizeof...(Args) != 0) {
+                std::uint8_t* payload = record.payload.data();
+                PackState state{payload, payload + scalarSize<Args...>, payload + record.payload.size(), stringCount<Args...>};
+                (pack(state, args), ...);
+            }
+        }
+
+        struct UnpackState {
+            const std::uint8_t* scalars;
+            const std::uint8_t* strings;
+        };
+
+        template <typename T>
+        auto unpack(UnpackState& state) {
+            if constexpr (isString<T>) {
+                const char* str = reinterpret_cast<const char*>(state.strings);
+                state.strings += std::strlen(str) + 1;
+                return str;
+            } else {
+                std::decay_t<T> ret;
+                std::memcpy(&ret, state.scalars, sizeof(ret));
+                state.scalars += sizeof(ret);
+                return ret;
+            }
+        }
+
+        // Both the immediate and the deferred path print through here, so that a message comes out the same either way, even with no
+        // arguments (eg "%%" still gets unescaped). Goes through vfprintf like the loggers always have
+        inline void print(std::FILE* file, const char* fmt, ...) {
             std::va_list args;
             va_start(args, fmt);
-            std::vprintf(fmt, args);
+            std::vfprintf(file, fmt, args);
             va_end(args);
         }
+
+        // Instantiated once per argument pack. Rebuilds the arguments from the payload in the same order they were packed
+        template <typename... Args>
+        void format(std::FILE* file, const char* fmt, const std::uint8_t* payload) {
+            if constexpr (sizeof...(Args) == 0) {
+                print(file, fmt);
+            } else {
+                UnpackState state{payload, payload + scalarSize<Args...>};
+                // Braced init lists guarantee left-to-right evaluation order
+                std::tuple<decltype(unpack<Args>(state))...> args{unpack<Args>(state)...};
+                std::apply([&](auto... a) { print(file, fmt, a...); }, args);
+            }
+        }
+    }
+
+    // Our logger class. The template parameter controls whether the logger starts out enabled.
+    // Loggers can be toggled at runtime with setEnabled, or by name with Log::setEnabled
+    template <bool enabledByDefault>
+    class Logger {
+        bool enabled = enabledByDefault;
+
+    public:
+        const char* name;
+
+        Logger(const char* name);
+        void setEnabled(bool value) { enabled = value; }
+        bool isEnabled() { return enabled; }
+
+        template <typename... Args>
+        void log(const char* fmt, Args... args) {
+            if (!enabled) [[likely]] return;
+
+            if (deferredLogging.load(std::memory_order_relaxed)) {
+                TraceRing& ring = getThreadRing();
+                TraceRecord* record = ring.reserve();
+                if (record == nullptr) return;
+
+                Detail::packArgs(*record, args...);
+                record->formatter = &Detail::format<Args...>;
+                record->fmt = fmt;
+                ring.commit();
+            } else {
+                Detail::print(stdout, fmt, args...);
+            }
+        }
     };
 
-    // Our loggers here. Enable/disable by toggling the template param
-    static Logger<false> kernelLogger;
-    static Logger<true> debugStringLogger; // Enables output for the outputDebugString SVC
-    static Logger<false> errorLogger;
-    static Logger<false> fileIOLogger;
-    static Logger<false> svcLogger;
-    static Logger<false> threadLogger;
-    static Logger<false> gpuLogger;
-    static Logger<false> rendererLogger;
+    // Toggle every logger whose name shows up in a comma-separated list, eg "kernel,gpu,svc". "all" matches every logger
+    void setEnabled(std::string_view names, bool enabled);
+
+    namespace Detail {
+        struct LoggerEntry {
+            const char* name;
+            void (*setEnabled)(void* logger, bool enabled);
+            void* logger;
+        };
+
+        std::vector<LoggerEntry>& getLoggerList();
+    }
+
+    template <bool enabledByDefault>
+    Logger<enabledByDefault>::Logger(const char* name) : name(name) {
+        auto toggle = [](void* logger, bool value) { static_cast<Logger<enabledByDefault>*>(logger)->setEnabled(value); };
+        Detail::getLoggerList().push_back({name, toggle, this});
+    }
+
+    // Our loggers here. The template param decides whether they're on by default
+    inline Logger<false> kernelLogger{"kernel"};
+    inline Logger<true> debugStringLogger{"debugString"}; // Enables output for the outputDebugString SVC
+    inline Logger<false> errorLogger{"error"};
+    inline Logger<false> fileIOLogger{"fileIO"};
+    inline Logger<false> svcLogger{"svc"};
+    inline Logger<false> threadLogger{"thread"};
+    inline Logger<false> gpuLogger{"gpu"};
+    inline Logger<false> rendererLogger{"renderer"};
 
     // Service loggers
-    static Logger<false> acLogger;
-    static Logger<false> actLogger;
-    static Logger<false> amLogger;
-    static Logger<false> aptLogger;
-    static Logger<false> bossLogger;
-    static Logger<false> camLogger;
-    static Logger<false> cecdLogger;
-    static Logger<false> cfgLogger;
-    static Logger<false> dspServiceLogger;
-    static Logger<false> dlpSrvrLogger;
-    static Logger<false> frdLogger;
-    static Logger<false> fsLogger;
-    static Logger<false> hidLogger;
-    static Logger<false> gspGPULogger;
-    static Logger<false> gspLCDLogger;
-    static Logger<false> ldrLogger;
-    static Logger<false> micLogger;
-    static Logger<false> nfcLogger;
-    static Logger<false> nimLogger;
-    static Logger<false> ndmLogger;
-    static Logger<false> ptmLogger;
-    static Logger<false> y2rLogger;
-    static Logger<false> srvLogger;
+    inline Logger<false> acLogger{"ac"};
+    inline Logger<false> actLogger{"act"};
+    inline Logger<false> amLogger{"am"};
+    inline Logger<false> aptLogger{"apt"};
+    inline Logger<false> bossLogger{"boss"};
+    inline Logger<false> camLogger{"cam"};
+    inline Logger<false> cecdLogger{"cecd"};
+    inline Logger<false> cfgLogger{"cfg"};
+    inline Logger<false> dspServiceLogger{"dsp"};
+    inline Logger<false> dlpSrvrLogger{"dlpSrvr"};
+    inline Logger<false> frdLogger{"frd"};
+    inline Logger<false> fsLogger{"fs"};
+    inline Logger<false> hidLogger{"hid"};
+    inline Logger<false> gspGPULogger{"gspGPU"};
+    inline Logger<false> gspLCDLogger{"gspLCD"};
+    inline Logger<false> ldrLogger{"ldr"};
+    inline Logger<false> micLogger{"mic"};
+    inline Logger<false> nfcLogger{"nfc"};
+    inline Logger<false> nimLogger{"nim"};
+    inline Logger<false> ndmLogger{"ndm"};
+    inline Logger<false> ptmLogger{"ptm"};
+    inline Logger<false> y2rLogger{"y2r"};
+    inline Logger<false> srvLogger{"srv"};
 
     #define MAKE_LOG_FUNCTION(functionName, logger)      \
     template <typename... Args>                          \
@@ -5,6 +5,7 @@
 #include <fstream>
 #include <optional>
 #include <vector>
+#include "guest_profiler.hpp"
 #include "helpers.hpp"
 #include "handles.hpp"
 #include "loader/ncsd.hpp"
@@ -153,12 +154,20 @@ public:
 	u32 read32(u32 vaddr);
 	u64 read64(u32 vaddr);
 	std::string readString(u32 vaddr, u32 maxCharacters);
+	// Length of the null-terminated string at vaddr, scanning at most maxCharacters bytes
+	u32 stringLength(u32 vaddr, u32 maxCharacters = 0xFFFFFFFF);
 
 	void write8(u32 vaddr, u8 value);
 	void write16(u32 vaddr, u16 value);
 	void write32(u32 vaddr, u32 value);
 	void write64(u32 vaddr, u64 value);
 
+	// Bulk operations on guest memory. These work a page at a time through the page tables instead of going through read8/write8 for
+	// every byte, and only fall back to byte accesses for pages that aren't backed by host memory.
+	// copy handles overlapping buffers like memmove does
+	void copy(u32 dest, u32 source, u32 size);
+	void fill(u32 dest, u8 value, u32 size);
+
 	u32 getLinearHeapVaddr();
 	u8* getFCRAM() { return fcram; }
 
@@ -230,6 +239,11 @@ public:
 	// All of the above must be page-aligned.
 	void mirrorMapping(u32 destAddress, u32 sourceAddress, u32 size);
 
+	// Function symbols from the symbol table of the loaded ELF, if any. Used to symbolise guest profiles
+	std::vector<GuestSymbol> elfSymbols;
+	// Executable segments of the loaded title, as (vaddr, size) pairs. Used for scanning guest code for HLE signatures
+	std::vector<std::pair<u32, u32>> codeSegments;
+
 	// Backup of the game's CXI partition info, if any
 	std::optional<NCCH> loadedCXI = std::nullopt;
 	// File handle for reading the loaded ncch
@@ -20,9 +20,11 @@
 #pragma once
 #include <array>
 #include <cassert>
+#include <cstdint>
 #include <functional>
 #include <initializer_list>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <string_view>
 #include <type_traits>
@@ -40,6 +42,91 @@ namespace OpenGL {
     template <class...>
     constexpr std::false_type AlwaysFalse{};
 
+    // Shadow copy of the bound objects & fixed-function state set through this wrapper, so that calls which wouldn't change anything
+    // never reach the driver. This only works as long as every change to the tracked state goes through the wrapper, so call
+    // invalidate() after anything else touches it
+    struct StateTracker {
+        static constexpr GLuint unknownHandle = 0xFFFFFFFF;
+        static constexpr GLenum unknownEnum = 0xFFFFFFFF;
+        static constexpr int unknownBool = -1;
+
+        struct CallCounts {
+            uint64_t emitted = 0;    // Calls that went to the driver
+            uint64_t suppressed = 0; // Calls that were skipped because they wouldn't have changed anything
+        };
+
+        int blendEnabled, depthEnabled, scissorEnabled, stencilEnabled;
+        std::array<GLenum, 2> blendEquations;
+        std::array<GLenum, 4> blendFactors;
+        std::array<float, 4> blendColor;
+        GLenum depthFunc;
+        int depthMask;
+        std::array<int, 4> colorMask;
+        std::array<GLint, 4> viewport;
+
+        GLuint drawFramebuffer, readFramebuffer;
+        GLuint program;
+        GLuint vertexArray;
+        GLuint arrayBuffer;
+        GLuint texture2D; // GL_TEXTURE_2D binding of the active texture unit
+
+        CallCounts counts;    // Since the last endFrame call
+        CallCounts lastFrame; // Between the last 2 endFrame calls
+
+        StateTracker() { invalidate(); }
+
+        // Forget everything we know about the GL state, so the next call to each tracked function goes to the driver
+        void invalidate() {
+            blendEnabled = depthEnabled = scissorEnabled = stencilEnabled = unknownBool;
+            blendEquations.fill(unknownEnum);
+            blendFactors.fill(unknownEnum);
+            blendColor.fill(std::numeric_limits<float>::quiet_NaN()); // NaN never compares equal, so the next colour always gets set
+            depthFunc = unknownEnum;
+            depthMask = unknownBool;
+            colorMask.fill(unknownBool);
+            viewport.fill(-1);
+
+            drawFramebuffer = readFramebuffer = unknownHandle;
+            program = unknownHandle;
+            vertexArray = unknownHandle;
+            arrayBuffer = unknownHandle;
+            texture2D = unknownHandle;
+        }
+
+        void endFrame() {
+            lastFrame = counts;
+            counts = {};
+        }
+
+        // Set "shadow" to "value" and return whether it changed, in which case the caller has to make the GL call
+        template <typename T>
+        bool update(T& shadow, const T& value) {
+            if (shadow == value) {
+                counts.suppressed++;
+                return false;
+            }
+
+            shadow = value;
+            counts.emitted++;
+            return true;
+        }
+
+        void setEnabled(int& shadow, GLenum cap, bool enable) {
+            if (update(shadow, int(enable))) {
+                enable ? glEnable(cap) : glDisable(cap);
+            }
+        }
+
+        // Deleting a bound object reverts the binding to 0, which we need to know about in case the handle gets reused
+        static void forget(GLuint& binding, GLuint handle) {
+            if (binding == handle) {
+                binding = 0;
+            }
+        }
+    };
+
+    inline StateTracker stateTracker;
+
     struct VertexArray {
         GLuint m_handle = 0;
 
@@ -59,7 +146,11 @@ namespace OpenGL {
 #endif
         GLuint handle() { return m_handle; }
         bool exists() { return m_handle != 0; }
-        void bind() { glBindVertexArray(m_handle); }
+        void bind() {
+            if (stateTracker.update(stateTracker.vertexArray, m_handle)) {
+                glBindVertexArray(m_handle);
+            }
+        }
 
         template <typename T>
         void setAttributeFloat(GLuint index, GLint size, GLsizei stride, const void* offset, bool normalized = GL_FALSE) {
@@ -128,6 +219,7 @@ namespace OpenGL {
         void disableAttribute(GLuint index) { glDisableVertexAttribArray(index); }
 
         void free() {
+            StateTracker::forget(stateTracker.vertexArray, m_handle);
             glDeleteVertexArrays(1, &m_handle);
         }
     };
@@ -230,11 +322,14 @@ namespace OpenGL {
 #endif
         GLuint handle() { return m_handle; }
         bool exists() { return m_handle != 0; }
-        void bind() { glBindTexture(m_binding, m_handle); }
+        void bind();
         int width() { return m_width; }
         int height() { return m_height; }
 
-       void free() { glDeleteTextures(1, &m_handle); }
+        void free() {
+            StateTracker::forget(stateTracker.texture2D, m_handle);
+            glDeleteTextures(1, &m_handle);
+        }
     };
 
     struct Framebuffer {
@@ -258,9 +353,13 @@ namespace OpenGL {
 #endif
         GLuint handle() { return m_handle; }
         bool exists() { return m_handle != 0; }
-        void bind(GLenum target) { glBindFramebuffer(target, m_handle); }
+        void bind(GLenum target);
         void bind(FramebufferTypes target) { bind(static_cast<GLenum>(target)); }
-        void free() { glDeleteFramebuffers(1, &m_handle); }
+        void free() {
+            StateTracker::forget(stateTracker.drawFramebuffer, m_handle);
+            StateTracker::forget(stateTracker.readFramebuffer, m_handle);
+            glDeleteFramebuffers(1, &m_handle);
+        }
 
         void createWithTexture(Texture& tex, GLenum mode = GL_FRAMEBUFFER, GLenum textureType = GL_TEXTURE_2D) {
             m_textureType = textureType;
@@ -352,7 +451,7 @@ namespace OpenGL {
 
         GLuint handle() { return m_handle; }
         bool exists() { return m_handle != 0; }
-        void use() { glUseProgram(m_handle); }
+        void use();
     };
 
     static void dispatchCompute(GLuint groupsX = 1, GLuint groupsY = 1, GLuint groupsZ = 1) {
@@ -385,8 +484,8 @@ namespace OpenGL {
 #endif  
         GLuint handle() { return m_handle; }
         bool exists() { return m_handle != 0; }
-        void bind() { glBindBuffer(GL_ARRAY_BUFFER, m_handle); }
-        void free() { glDeleteBuffers(1, &m_handle); }
+        void bind();
+        void free();
 
         // Reallocates the buffer on every call. Prefer the sub version if possible.
         template <typename VertType>
@@ -424,23 +523,96 @@ namespace OpenGL {
     static void clearDepthAndStencil() { glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT); }
     static void clearAll() { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT); }
 
-    static void setViewport(GLsizei width, GLsizei height) { glViewport(0, 0, width, height); }
-    static void setViewport(GLsizei x, GLsizei y, GLsizei width, GLsizei height) { glViewport(x, y, width, height); }
+    static void setViewport(GLsizei x, GLsizei y, GLsizei width, GLsizei height) {
+        if (stateTracker.update(stateTracker.viewport, {x, y, width, height})) {
+            glViewport(x, y, width, height);
+        }
+    }
+    static void setViewport(GLsizei width, GLsizei height) { setViewport(0, 0, width, height); }
     static void setScissor(GLsizei width, GLsizei height) { glScissor(0, 0, width, height); }
     static void setScissor(GLsizei x, GLsizei y, GLsizei width, GLsizei height) { glScissor(x, y, width, height); }
     static void setStencilMask(GLuint mask) { glStencilMask(mask); }
 
-    static void bindScreenFramebuffer() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
-    static void enableScissor() { glEnable(GL_SCISSOR_TEST); }
-    static void disableScissor() { glDisable(GL_SCISSOR_TEST); }
-    static void enableBlend() { glEnable(GL_BLEND); }
-    static void disableBlend() { glDisable(GL_BLEND); }
-    static void enableDepth() { glEnable(GL_DEPTH_TEST); }
-    static void disableDepth() { glDisable(GL_DEPTH_TEST); }
-    static void enableStencil() { glEnable(GL_STENCIL_TEST); }
-    static void disableStencil() { glDisable(GL_STENCIL_TEST); }
+    inline void bindFramebuffer(GLenum target, GLuint handle) {
+        // GL_FRAMEBUFFER sets both bindings, so only skip it if neither of them changes
+        const bool draw = target != GL_READ_FRAMEBUFFER && stateTracker.update(stateTracker.drawFramebuffer, handle);
+        const bool read = target != GL_DRAW_FRAMEBUFFER && stateTracker.update(stateTracker.readFramebuffer, handle);
+
+        if (draw && read) {
+            glBindFramebuffer(GL_FRAMEBUFFER, handle);
+        } else if (draw) {
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, handle);
+        } else if (read) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, handle);
+        }
+    }
+
+    // Only GL_TEXTURE_2D bindings are tracked, other targets always go to the driver
+    inline void bindTexture(GLenum target, GLuint handle) {
+        if (target != GL_TEXTURE_2D || stateTracker.update(stateTracker.texture2D, handle)) {
+            glBindTexture(target, handle);
+        }
+    }
+
+    // Only GL_ARRAY_BUFFER bindings are tracked. Element buffer bindings are part of the VAO state
+    inline void bindBuffer(GLenum target, GLuint handle) {
+        if (target != GL_ARRAY_BUFFER || stateTracker.update(stateTracker.arrayBuffer, handle)) {
+            glBindBuffer(target, handle);
+        }
+    }
+
+    inline void deleteBuffer(GLuint handle) {
+        StateTracker::forget(stateTracker.arrayBuffer, handle);
+        glDeleteBuffers(1, &handle);
+    }
+
+    inline void useProgram(GLuint handle) {
+        if (stateTracker.update(stateTracker.program, handle)) {
+            glUseProgram(handle);
+        }
+    }
+
+    inline void Texture::bind() {
+        if (m_binding == GL_TEXTURE_2D) {
+            bindTexture(GL_TEXTURE_2D, m_handle);
+        } else {
+            glBindTexture(m_binding, m_handle);
+        }
+    }
+
+    inline void Framebuffer::bind(GLenum target) { bindFramebuffer(target, m_handle); }
+    inline void Program::use() { useProgram(m_handle); }
+    inline void VertexBuffer::bind() { bindBuffer(GL_ARRAY_BUFFER, m_handle); }
+    inline void VertexBuffer::free() { deleteBuffer(m_handle); }
+
+    static void bindScreenFramebuffer() { bindFramebuffer(GL_FRAMEBUFFER, 0); }
+    static void enableScissor() { stateTracker.setEnabled(stateTracker.scissorEnabled, GL_SCISSOR_TEST, true); }
+    static void disableScissor() { stateTracker.setEnabled(stateTracker.scissorEnabled, GL_SCISSOR_TEST, false); }
+    static void enableBlend() { stateTracker.setEnabled(stateTracker.blendEnabled, GL_BLEND, true); }
+    static void disableBlend() { stateTracker.setEnabled(stateTracker.blendEnabled, GL_BLEND, false); }
+    static void enableDepth() { stateTracker.setEnabled(stateTracker.depthEnabled, GL_DEPTH_TEST, true); }
+    static void disableDepth() { stateTracker.setEnabled(stateTracker.depthEnabled, GL_DEPTH_TEST, false); }
+    static void enableStencil() { stateTracker.setEnabled(stateTracker.stencilEnabled, GL_STENCIL_TEST, true); }
+    static void disableStencil() { stateTracker.setEnabled(stateTracker.stencilEnabled, GL_STENCIL_TEST, false); }
+
+    static void setDepthFunc(GLenum func) {
+        if (stateTracker.update(stateTracker.depthFunc, func)) {
+            glDepthFunc(func);
+        }
+    }
+    static void setDepthFunc(DepthFunc func) { setDepthFunc(static_cast<GLenum>(func)); }
+
+    static void setDepthMask(bool enable) {
+        if (stateTracker.update(stateTracker.depthMask, int(enable))) {
+            glDepthMask(enable ? GL_TRUE : GL_FALSE);
+        }
+    }
 
-    static void setDepthFunc(DepthFunc func) { glDepthFunc(static_cast<GLenum>(func)); }
+    static void setColorMask(bool r, bool g, bool b, bool a) {
+        if (stateTracker.update(stateTracker.colorMask, {int(r), int(g), int(b), int(a)})) {
+            glColorMask(r, g, b, a);
+        }
+    }
 
     enum Primitives {
         Triangle = GL_TRIANGLES,
@@ -461,6 +633,16 @@ namespace OpenGL {
         glDrawArrays(static_cast<GLenum>(prim), first, vertexCount);
     }
 
+    // Draw using the currently bound element buffer. indexType is GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    static void drawElements(Primitives prim, GLsizei indexCount, GLenum indexType, GLintptr offset = 0) {
+        glDrawElements(static_cast<GLenum>(prim), indexCount, indexType, reinterpret_cast<const void*>(offset));
+    }
+
+    // Same as drawElements, but baseVertex gets added to every index
+    static void drawElementsBaseVertex(Primitives prim, GLsizei indexCount, GLenum indexType, GLintptr offset, GLint baseVertex) {
+        glDrawElementsBaseVertex(static_cast<GLenum>(prim), indexCount, indexType, reinterpret_cast<const void*>(offset), baseVertex);
+    }
+
     enum FillMode { DrawPoints = GL_POINT, DrawWire = GL_LINE, FillPoly = GL_FILL };
 
     static void setFillMode(GLenum mode) { glPolygonMode(GL_FRONT_AND_BACK, mode); }
@@ -499,6 +681,21 @@ namespace OpenGL {
 
     static bool versionSupported(int major, int minor) { return gl3wIsSupported(major, minor); }
 
+    // Needs a current context
+    static bool extensionSupported(std::string_view name) {
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+
+        for (GLint i = 0; i < extensionCount; i++) {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension != nullptr && name == extension) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     [[nodiscard]] static GLint uniformLocation(GLuint program, const char* name) {
         return glGetUniformLocation(program, name);
     }
@@ -514,14 +711,25 @@ namespace OpenGL {
         Max = GL_MAX
     };
 
-    static void setBlendColor(float r, float g, float b, float a = 1.0) { glBlendColor(r, g, b, a); }
-    static void setBlendEquation(BlendEquation eq) { glBlendEquation(eq); }
-    static void setBlendEquation(BlendEquation eq1, BlendEquation eq2) { glBlendEquationSeparate(eq1, eq2); }
+    static void setBlendColor(float r, float g, float b, float a = 1.0) {
+        if (stateTracker.update(stateTracker.blendColor, {r, g, b, a})) {
+            glBlendColor(r, g, b, a);
+        }
+    }
+
+    static void setBlendEquation(GLenum eq1, GLenum eq2) {
+        if (stateTracker.update(stateTracker.blendEquations, {eq1, eq2})) {
+            glBlendEquationSeparate(eq1, eq2);
+        }
+    }
+    static void setBlendEquation(BlendEquation eq) { setBlendEquation(eq, eq); }
 
-    static void setBlendFactor(GLenum fac1, GLenum fac2) { glBlendFunc(fac1, fac2); }
     static void setBlendFactor(GLenum fac1, GLenum fac2, GLenum fac3, GLenum fac4) {
-        glBlendFuncSeparate(fac1, fac2, fac3, fac4);
+        if (stateTracker.update(stateTracker.blendFactors, {fac1, fac2, fac3, fac4})) {
+            glBlendFuncSeparate(fac1, fac2, fac3, fac4);
+        }
     }
+    static void setBlendFactor(GLenum fac1, GLenum fac2) { setBlendFactor(fac1, fac2, fac1, fac2); }
 
     // Abstraction for GLSL vectors
     template <typename T, int size>
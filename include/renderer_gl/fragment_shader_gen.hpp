@@ -0,0 +1,67 @@
+#pragma once
+#include <array>
+#include <string>
+#include "helpers.hpp"
+#include "PICA/regs.hpp"
+
+// The parts of the PICA fragment pipeline config that change the code of the fragment shader. Everything else (TEV constant colours,
+// the alpha test reference value, depth scale & offset...) goes through the FragmentUniforms block, so changing it doesn't need a new
+// program. All fields are u32s so the struct can be hashed as raw bytes without any padding getting in the way
+struct FragmentConfig {
+	static constexpr int tevStageCount = 6;
+	static constexpr std::array<u32, tevStageCount> tevStageRegs = {
+		PICAInternalRegs::TexEnv0Source, PICAInternalRegs::TexEnv1Source, PICAInternalRegs::TexEnv2Source,
+		PICAInternalRegs::TexEnv3Source, PICAInternalRegs::TexEnv4Source, PICAInternalRegs::TexEnv5Source,
+	};
+
+	std::array<u32, tevStageCount> tevSources;
+	std::array<u32, tevStageCount> tevOperands;
+	std::array<u32, tevStageCount> tevCombiners;
+	std::array<u32, tevStageCount> tevScales;
+	u32 tevBufferUpdate;   // Which stages write their output to the combiner buffer (Bits 8-11 for RGB, 12-15 for alpha)
+	u32 alphaTestFunction; // 1 (Always pass) if the alpha test is disabled
+	u32 texture0Enable;
+	u32 depthmapEnable;
+
+	static FragmentConfig fromRegs(const std::array<u32, 0x300>& regs);
+	u64 getHash() const;
+};
+
+// Layout of the FragmentUniforms block every fragment shader reads its uniforms from (std140)
+// The TEV stage config & buffer config are only read by the uber-shader, the specialised shaders have them baked in
+struct FragmentUniforms {
+	u32 tevConfig[6][4]; // Source, operand, combiner & scale registers of each TEV stage
+	float tevConstColour[6][4];
+	float tevBufferColour[4];
+	u32 tevBufferConfig;
+	u32 alphaControl;
+	u32 textureConfig;
+	float depthScale;
+	float depthOffset;
+	u32 depthmapEnable;
+	u32 padding[2];
+
+	static FragmentUniforms fromRegs(const std::array<u32, 0x300>& regs);
+};
+
+// Generates GLSL fragment shaders emulating the PICA fragment pipeline: The TEV combiner stages, alpha test & depth mapping.
+// Fragment lighting & texture units 1-3 aren't emulated, so their colours read as 0
+class FragmentShaderGenerator {
+	const FragmentConfig& config;
+	std::string source;
+
+	explicit FragmentShaderGenerator(const FragmentConfig& config) : config(config) {}
+
+	void emitStage(int stage);
+	std::string getSource(int stage, u32 source);
+	std::string getColourOperand(const std::string& source, u32 operand);
+	std::string getAlphaOperand(const std::string& source, u32 operand);
+	static std::string getCombiner(u32 combiner, const std::string& a, const std::string& b, const std::string& c, bool alpha);
+
+public:
+	// Returns the source of a fragment shader with everything in "config" baked in, so it doesn't branch on any of it per fragment
+	static std::string generate(const FragmentConfig& config);
+	// Returns the source of the shader that reads the whole config from FragmentUniforms at runtime. Slower, but one program handles
+	// every configuration, so it's used while the specialised shader for a new configuration is still compiling
+	static std::string generateUberShader();
+};
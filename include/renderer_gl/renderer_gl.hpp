@@ -1,13 +1,19 @@
 #pragma once
 #include <array>
+#include <memory>
+#include <vector>
 #include "helpers.hpp"
 #include "logger.hpp"
 #include "opengl.hpp"
+#include "PICA/program_cache.hpp"
+#include "fragment_shader_gen.hpp"
+#include "stream_buffer.hpp"
 #include "surface_cache.hpp"
 #include "textures.hpp"
 
 // More circular dependencies!
 class GPU;
+class PICAShader;
 
 struct Vertex {
 	OpenGL::vec4 position;
@@ -15,27 +21,92 @@ struct Vertex {
 	OpenGL::vec2 UVs;
 };
 
+// Where the host GPU fetches a vertex shader input register from, when running the vertex shader in GLSL
+struct HardwareVertexAttribute {
+	bool enabled = false; // If false, the input is "value" for every vertex
+	u32 type = 0;         // 0 = signed byte, 1 = unsigned byte, 2 = short, 3 = float
+	u32 components = 4;
+	u32 offset = 0;       // Offset of the attribute of the first vertex in the vertex data
+	u32 stride = 0;
+	std::array<float, 4> value = {0.0f, 0.0f, 0.0f, 0.0f};
+};
+
 class Renderer {
+	static constexpr u32 regNum = 0x300; // Number of internal PICA registers
+
 	GPU& gpu;
-	OpenGL::Program triangleProgram;
+	OpenGL::Program triangleProgram; // Runs the fragment uber-shader, for configs whose specialised program isn't ready yet
 	OpenGL::Program displayProgram;
 
+	// Vertices & indices of CPU-shaded draws are streamed through ring buffers, see stream_buffer.hpp
+	static constexpr u32 vertexStreamSize = 16_MB;
+	static constexpr u32 indexStreamSize = 2_MB;
 	OpenGL::VertexArray vao;
-	OpenGL::VertexBuffer vbo;
-	GLint alphaControlLoc = -1;
-	GLint texUnitConfigLoc = -1;
-	
-	// Depth configuration uniform locations
-	GLint depthOffsetLoc = -1;
-	GLint depthScaleLoc = -1;
-	GLint depthmapEnableLoc = -1;
-
-	u32 oldAlphaControl = 0;
-	u32 oldTexUnitConfig = 0;
-
-	float oldDepthScale = -1.0;
-	float oldDepthOffset = 0.0;
-	bool oldDepthmapEnable = false;
+	StreamBuffer vertexStream;
+	StreamBuffer indexStream;
+	OpenGL::Shader vertShader; // Shared between the regular program & the specialised fragment programs
+	OpenGL::Shader fragShader; // The uber-shader. Shared between the regular program & the ones running translated vertex shaders
+
+	// Programs with fragment shaders specialised for a fragment pipeline config, keyed by the hash of the config (see FragmentConfig).
+	// If the driver can compile them in the background, draws keep using the uber-shader until they're done
+	struct FragmentProgram {
+		OpenGL::Program program;
+		bool ready = false;  // Compiled & linked
+		bool failed = false; // Failed to compile or link, so this config always goes through the uber-shader
+
+		~FragmentProgram() { glDeleteProgram(program.handle()); }
+	};
+	static constexpr size_t maxFragmentPrograms = 256;
+	ProgramCache<std::unique_ptr<FragmentProgram>, maxFragmentPrograms> fragmentProgramCache;
+	FragmentProgram* activeFragmentProgram = nullptr;
+	bool parallelShaderCompile = false; // Whether ARB_parallel_shader_compile is supported
+
+	// Fragment shader uniforms, shared by every program through a uniform block. We keep a copy to skip uploads that don't change anything
+	GLuint fragmentUniformBuffer = 0;
+	FragmentUniforms fragmentUniforms;
+
+	FragmentProgram* getFragmentProgram(const FragmentConfig& config);
+	bool isFragmentProgramReady(FragmentProgram& program);
+	void updateFragmentUniforms();
+	GLuint getActiveProgram();
+
+	// Programs running PICA vertex shaders translated to GLSL, keyed by the hash of the PICA program
+	// Programs that couldn't be translated are cached as nullptr so we don't try to translate them again on every draw
+	struct HardwareShader {
+		OpenGL::Program program;
+
+		~HardwareShader() { glDeleteProgram(program.handle()); }
+	};
+	static constexpr size_t maxHardwareShaders = 64;
+	ProgramCache<std::unique_ptr<HardwareShader>, maxHardwareShaders> hardwareShaderCache;
+	HardwareShader* activeHardwareShader = nullptr;
+
+	// Raw attribute buffers, index buffer & uniforms for draws with translated vertex shaders
+	OpenGL::VertexArray hardwareVao;
+	OpenGL::VertexBuffer hardwareVbo;
+	GLuint hardwareIndexBuffer = 0;
+	GLuint uniformBuffer = 0;
+
+	// Groups of PICA state that get mirrored to the GL state before a draw. Register writes that change a value set the bits of the
+	// groups the register belongs to, and prepareDraw only re-emits the groups that are dirty. Anything else that touches the same GL
+	// state (eg display) has to mark the groups it clobbers as dirty too
+	enum DirtyState : u32 {
+		DirtyFragmentUniforms = 1 << 0,
+		DirtyBlending = 1 << 1,
+		DirtyDepthAndColourMask = 1 << 2,
+		DirtyFragmentProgram = 1 << 3, // Anything that goes into the FragmentConfig
+		DirtyViewport = 1 << 4,
+		DirtyTexture = 1 << 5,
+		DirtyBatchState = 1 << 6, // Any register that's part of the batch state hash changed. Cleared by addToBatch rather than prepareDraw
+
+		DirtyAll = (1 << 7) - 1,
+	};
+
+	u32 dirtyState = DirtyAll;
+	static const std::array<u8, regNum> regStateGroups; // Which groups each register belongs to
+	static std::array<u8, regNum> buildRegStateGroups();
+
+	bool depthBufferNeeded = false; // Whether the draws need a depth buffer attached, from the last time the depth state was updated
 
 	SurfaceCache<DepthBuffer, 10> depthBufferCache;
 	SurfaceCache<ColourBuffer, 10> colourBufferCache;
@@ -54,15 +125,32 @@ class Renderer {
 	OpenGL::VertexArray dummyVAO;
 	OpenGL::VertexBuffer dummyVBO;
 
-	static constexpr u32 regNum = 0x300; // Number of internal PICA registers
 	const std::array<u32, regNum>& regs;
 
 	OpenGL::Framebuffer getColourFBO();
 	OpenGL::Texture getTexture(Texture& tex);
 
+	// Consecutive triangle list draws with the same state get merged into one batch, which is only uploaded & drawn once something
+	// needs the result or the state changes. "Same state" means the same values in every register from the rasterizer up to the
+	// lighting registers (Texturing, TEV & framebuffer config included). The geometry pipeline & shader registers don't matter, as
+	// the vertices have already been shaded by the time they get here
+	static constexpr u32 batchStateStart = 0x40;
+	static constexpr u32 batchStateEnd = 0x200;
+	std::vector<Vertex> batchVertices;
+	std::vector<u16> batchIndices;
+	bool batchIndexed = false;
+	u64 batchStateHash = 0; // Hash of the batch state as of the last draw, only recomputed when DirtyBatchState is set
+
+	u64 getBatchStateHash();
+	// Add a triangle list to the pending batch, flushing it first if it can't go in the same draw. "indices" may be nullptr
+	void addToBatch(const Vertex* vertices, u32 vertexCount, const u16* indices, u32 indexCount);
+	// Upload vertices (And indices, unless they're nullptr) to the stream buffers and draw them
+	void drawStreamed(OpenGL::Primitives primType, const Vertex* vertices, u32 vertexCount, const u16* indices, u32 indexCount);
+
 	MAKE_LOG_FUNCTION(log, rendererLogger)
 	void setupBlending();
 	void bindDepthBuffer();
+	void prepareDraw();
 
 public:
 	Renderer(GPU& gpu, const std::array<u32, regNum>& internalRegs) : gpu(gpu), regs(internalRegs) {}
@@ -74,6 +162,20 @@ public:
 	void clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control); // Clear a GPU buffer in VRAM
 	void displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags); // Perform display transfer
 	void drawVertices(OpenGL::Primitives primType, Vertex* vertices, u32 count); // Draw the given vertices
+	// Draw using an index buffer. Every index must be < vertexCount
+	void drawIndexedVertices(OpenGL::Primitives primType, Vertex* vertices, u32 vertexCount, u16* indices, u32 indexCount);
+	// Called when a write to internal register "index" changed its value
+	void markRegDirty(u32 index) { dirtyState |= regStateGroups[index]; }
+	// Draw the pending batch of triangles, if any. Has to happen before anything reads the framebuffers or changes the GL state
+	void flushBatch();
+
+	// Get the vertex shader loaded into "shader" ready to run on the host GPU & upload its uniforms. Returns false if it can't be
+	// translated to GLSL, in which case the draw has to be shaded on the CPU
+	bool prepareHardwareShader(PICAShader& shader);
+	// Draw with the shader from prepareHardwareShader. "attributes" is indexed by shader input register, and the attribute offsets point
+	// into "vertexData". If "indices" is nullptr, "count" vertices get drawn in order
+	void drawHardwareShaded(OpenGL::Primitives primType, const std::array<HardwareVertexAttribute, 16>& attributes, const u8* vertexData,
+							size_t vertexDataSize, const u16* indices, u32 count);
 
 	void setFBSize(u32 width, u32 height) {
 		fbSize.x() = width;
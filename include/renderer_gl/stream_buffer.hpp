@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include "helpers.hpp"
+#include "opengl.hpp"
+
+// Ring buffer for streaming data we upload every draw (Vertices, indices) to the host GPU.
+// Every upload goes after the previous one instead of overwriting the start of the buffer, so the driver never has to wait for a draw
+// that's still reading the old data. Once the ring wraps around, we only wait for the GPU to be done with the part we're about to reuse.
+//
+// If ARB_buffer_storage is available, the buffer is mapped persistently and uploads are plain memcpys. The ring is split into segments,
+// and each segment gets a fence once all the draws reading it have been submitted, which is what we wait on before writing to it again.
+// Otherwise we map each upload unsynchronized and orphan the buffer when wrapping around, which lets the driver do the fencing for us
+class StreamBuffer {
+	static constexpr u32 segmentCount = 16;
+
+	GLenum target = GL_ARRAY_BUFFER;
+	GLuint handle = 0;
+	u32 size = 0;
+	u32 segmentSize = 0;
+	u32 position = 0; // Where the next upload goes
+	u8* mappedPointer = nullptr; // Pointer to the whole buffer if it's persistently mapped, nullptr otherwise
+
+	std::array<GLsync, segmentCount> fences = {};
+	u32 fenceSegment = 0; // First segment the GPU might still be reading without a fence
+
+	u32 getSegment(u32 offset) const { return offset / segmentSize; }
+	void fenceUpTo(u32 segment);
+	void waitForSegments(u32 first, u32 last);
+
+public:
+	// Create a buffer of "size" bytes for the given target (eg GL_ARRAY_BUFFER), leaving it bound
+	void create(GLenum target, u32 size);
+	void free();
+	void bind() { OpenGL::bindBuffer(target, handle); }
+	bool exists() const { return handle != 0; }
+	bool isPersistent() const { return mappedPointer != nullptr; }
+
+	// Copy "bytes" bytes of data into the buffer at an offset that's a multiple of "alignment" & return the offset.
+	// In the non-persistent case this binds the buffer, so element buffers should only be uploaded to with their VAO bound
+	u32 upload(const void* data, u32 bytes, u32 alignment);
+
+	// Check whether the GL driver supports persistently mapped buffers. Needs a current context
+	static bool persistentMappingSupported();
+};
@@ -47,7 +47,7 @@ struct ColourBuffer {
         texture.bind();
         texture.setMinFilter(OpenGL::Linear);
         texture.setMagFilter(OpenGL::Linear);
-        glBindTexture(GL_TEXTURE_2D, prevTexture);
+        OpenGL::bindTexture(GL_TEXTURE_2D, prevTexture);
 
         //Helpers::panic("Creating FBO: %d, %d\n", size.x(), size.y());
 
@@ -154,7 +154,7 @@ struct DepthBuffer {
         texture.setMinFilter(OpenGL::Nearest);
         texture.setMagFilter(OpenGL::Nearest);
         
-        glBindTexture(GL_TEXTURE_2D, prevTexture);
+        OpenGL::bindTexture(GL_TEXTURE_2D, prevTexture);
     }
 
     void free() {
@@ -56,12 +56,16 @@ class GPUService {
 	void triggerTextureCopy(u32* cmd);
 	void flushCacheRegions(u32* cmd);
 
+	// Hand a command to the GPU, raising "interrupt" once it's done
+	void submit(GPUCommand command, GPUInterrupt interrupt);
+
 public:
 	GPUService(Memory& mem, GPU& gpu, Kernel& kernel, u32& currentPID) : mem(mem), gpu(gpu),
 		kernel(kernel), currentPID(currentPID) {}
 	void reset();
 	void handleSyncRequest(u32 messagePointer);
 	void requestInterrupt(GPUInterrupt type);
+	void pollInterrupts();
 	void setSharedMem(u8* ptr) {
 		sharedMem = ptr;
 		if (ptr != nullptr) { // Zero-fill shared memory in case the process tries to read stale service data or vice versa
@@ -1,6 +1,7 @@
 #pragma once
 #include <array>
 #include <optional>
+#include "guest_registers.hpp"
 #include "kernel_types.hpp"
 #include "logger.hpp"
 #include "memory.hpp"
@@ -31,7 +32,7 @@
 class Kernel;
 
 class ServiceManager {
-	std::array<u32, 16>& regs;
+	GuestRegisters& regs;
 	Memory& mem;
 	Kernel& kernel;
 
@@ -70,7 +71,7 @@ class ServiceManager {
 	void subscribe(u32 messagePointer);
 
 public:
-	ServiceManager(std::array<u32, 16>& regs, Memory& mem, GPU& gpu, u32& currentPID, Kernel& kernel);
+	ServiceManager(GuestRegisters& regs, Memory& mem, GPU& gpu, u32& currentPID, Kernel& kernel);
 	void reset();
 	void initializeFS() { fs.initializeFilesystem(); }
 	void handleSyncRequest(u32 messagePointer);
@@ -80,6 +81,8 @@ public:
 
 	// Wrappers for communicating with certain services
 	void sendGPUInterrupt(GPUInterrupt type) { gsp_gpu.requestInterrupt(type); }
+	// Deliver the interrupts of GPU commands the GPU thread finished
+	void pollGPUInterrupts() { gsp_gpu.pollInterrupts(); }
 	void setGSPSharedMem(u8* ptr) { gsp_gpu.setSharedMem(ptr); }
 	void setHIDSharedMem(u8* ptr) { hid.setSharedMem(ptr); }
 
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "helpers.hpp"
+
+// Instrumentation for recording a timeline of what the emulator is doing inside a frame
+// Spans are recorded with TRACE_SCOPE and dumped in the Chrome trace event format, which can be opened with chrome://tracing or Perfetto
+// When tracing is off, a span costs a single relaxed load + branch
+namespace Tracing {
+	inline std::atomic<bool> enabled = false;
+	// Spans that were started while tracing was on and haven't been recorded yet, in every thread & in the calling thread.
+	// stop() waits for the ones in other threads before writing the trace out
+	inline std::atomic<u32> openSpans = 0;
+	inline thread_local u32 threadOpenSpans = 0;
+
+	static u64 now() {
+		using namespace std::chrono;
+		return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Record a finished span. Start and end are timestamps returned by now()
+	void record(const char* name, u64 start, u64 end, s64 arg);
+
+	// Start recording spans, discarding any previously recorded ones
+	void start();
+	// Stop recording and write the captured timeline to a trace JSON file. Returns false if the file couldn't be written
+	bool stop(const std::string& path);
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	class ScopedSpan {
+		const char* name;
+		u64 startTime = 0;
+		s64 arg;
+		bool active;
+
+	public:
+		// "name" must be a string with static storage duration, as we only store the pointer
+		ScopedSpan(const char* name, s64 arg = -1) : name(name), arg(arg), active(enabled.load(std::memory_order_relaxed)) {
+			if (active) [[unlikely]] {
+				// Check again once we're counted, so that stop() either waits for us or we see that tracing got turned off
+				openSpans.fetch_add(1);
+				active = enabled.load();
+				if (!active) {
+					openSpans.fetch_sub(1);
+					return;
+				}
+
+				threadOpenSpans++;
+				startTime = now();
+			}
+		}
+
+		~ScopedSpan() {
+			if (active) [[unlikely]] {
+				record(name, startTime, now(), arg);
+				threadOpenSpans--;
+				openSpans.fetch_sub(1, std::memory_order_release);
+			}
+		}
+
+		ScopedSpan(const ScopedSpan&) = delete;
+		ScopedSpan& operator=(const ScopedSpan&) = delete;
+	};
+}
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// Record a span covering the rest of the current scope. The optional argument shows up in the trace viewer (eg the SVC number)
+#define TRACE_SCOPE(name) Tracing::ScopedSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) Tracing::ScopedSpan TRACE_CONCAT(traceSpan, __LINE__)(name, static_cast<s64>(arg))
@@ -2,24 +2,27 @@
 #include "cpu_dynarmic.hpp"
 #include "arm_defs.hpp"
 
-CPU::CPU(Memory& mem, Kernel& kernel) : mem(mem), env(mem, kernel, *this) {
-    cp15 = std::make_shared<CP15>();
+CPUCore::CPUCore(CPU& cpu, Memory& mem, Kernel& kernel, GuestHLE& hle, Dynarmic::ExclusiveMonitor& monitor, int id)
+    : env(mem, kernel, cpu, hle, id) {
+    cp15 = std::make_shared<CP15>(id);
 
     Dynarmic::A32::UserConfig config;
     config.arch_version = Dynarmic::A32::ArchVersion::v6K;
     config.callbacks = &env;
     config.coprocessors[15] = cp15;
     config.define_unpredictable_behaviour = true;
-    config.global_monitor = &exclusiveMonitor;
-    config.processor_id = 0;
-    
+    config.global_monitor = &monitor;
+    config.processor_id = id;
+
     jit = std::make_unique<Dynarmic::A32::Jit>(config);
+    env.jit = jit.get();
 }
 
-void CPU::reset() {
-    setCPSR(CPSR::UserMode);
-    setFPSCR(FPSCR::MainThreadDefault);
+void CPUCore::reset() {
+    jit->SetCpsr(CPSR::UserMode);
+    jit->SetFpscr(FPSCR::MainThreadDefault);
     env.totalTicks = 0;
+    env.ticksLeft = 0;
 
     cp15->reset();
     cp15->setTLSBase(VirtualAddrs::TLSBase); // Set cp15 TLS pointer to the main thread's thread-local storage
@@ -29,4 +32,297 @@ void CPU::reset() {
     jit->ExtRegs().fill(0);
 }
 
-#endif // CPU_DYNARMIC
\ No newline at end of file
+CPU::CPU(Memory& mem, Kernel& kernel) : mem(mem), kernel(kernel) {
+    cores[0] = std::make_unique<CPUCore>(*this, mem, kernel, hle, exclusiveMonitor, 0);
+    activeCore = cores[0].get();
+    kernelRegs.bind(activeCore->jit->Regs());
+}
+
+CPU::~CPU() {
+    stopCores();
+}
+
+void MyEnvironment::sampleGuestPC() {
+    profiler.sample(jit->Regs()[15], jit->Regs()[14]);
+}
+
+void MyEnvironment::serviceSVC(u32 swi) {
+    cpu.serviceSVC(coreID, swi);
+}
+
+bool MyEnvironment::callHLE() {
+    auto& regs = jit->Regs();
+    const bool thumb = (jit->Cpsr() & CPSR::Thumb) != 0;
+    // PC has already been moved past the svc instruction by the time we get here
+    const u32 address = regs[15] - (thumb ? 2 : 4);
+
+    const std::optional<u64> ticks = hle.run(address, regs, mem);
+    if (!ticks.has_value()) {
+        return false;
+    }
+
+    // Charge the guest for the time the replaced routine would've taken
+    AddTicks(*ticks);
+
+    // Return to the caller, like a "bx lr" would
+    const u32 lr = regs[14];
+    regs[15] = lr & ~1;
+    if (lr & 1) {
+        jit->SetCpsr(jit->Cpsr() | CPSR::Thumb);
+    } else {
+        jit->SetCpsr(jit->Cpsr() & ~CPSR::Thumb);
+    }
+
+    return true;
+}
+
+void CPU::reset() {
+    stopCores();
+
+    cores[0]->reset();
+    activeCore = cores[0].get();
+    kernelRegs.bind(activeCore->jit->Regs());
+}
+
+// Point the kernel & our register accessors at "core". The kernel lock must be held, unless only the app core is up
+void CPU::activateCore(CPUCore& core) {
+    if (activeCore != &core) {
+        activeCore = &core;
+        kernelRegs.bind(core.jit->Regs());
+        kernel.setActiveCore(core.env.coreID);
+    }
+}
+
+void CPU::serviceSVC(int id, u32 svc) {
+    CPUCore& core = *cores[id];
+    // A core waiting for the kernel lock isn't touching guest memory, and a core stopping the others might be the one holding the lock
+    leaveGuest(core);
+    {
+        std::scoped_lock lock(kernelMutex);
+        activateCore(core);
+        kernel.serviceSVC(svc);
+    }
+    enterGuest(core);
+}
+
+void CPU::enableCore(int id) {
+    if (id <= 0 || id >= maxCores || cores[id] != nullptr) {
+        return;
+    }
+
+    pendingCores |= 1u << id;
+}
+
+// Called by runFrame at slice boundaries, when every core is parked outside of its JIT
+void CPU::startPendingCores() {
+    std::scoped_lock kernelLock(kernelMutex);
+    if (pendingCores == 0) [[likely]] {
+        return;
+    }
+
+    // Nothing but the emulator thread is running yet, so this is where the frontend gets to hand the graphics context off
+    if (workerCount == 0 && secondaryCoreCallback) {
+        secondaryCoreCallback();
+    }
+
+    for (int id = 1; id < maxCores; id++) {
+        if ((pendingCores & (1u << id)) == 0) {
+            continue;
+        }
+
+        printf("Bringing up CPU core %d\n", id);
+        auto core = std::make_unique<CPUCore>(*this, mem, kernel, hle, exclusiveMonitor, id);
+        core->reset();
+        core->env.totalTicks = cores[0]->env.totalTicks;
+
+        // The new core joins at the next slice, so hand it the current generation
+        std::scoped_lock lock(sliceMutex);
+        core->thread = std::thread(&CPU::workerMain, this, std::ref(*core), sliceGeneration);
+        cores[id] = std::move(core);
+        workerCount++;
+        activeCoreCount++;
+    }
+
+    pendingCores = 0;
+}
+
+// Cores only enter their JIT while no other core is changing the page tables, see stopOtherCores
+void CPU::enterGuest(CPUCore& core) {
+    std::unique_lock lock(pauseMutex);
+    pauseChanged.wait(lock, [&] { return !pauseRequested; });
+    core.inGuest = true;
+}
+
+void CPU::leaveGuest(CPUCore& core) {
+    {
+        std::scoped_lock lock(pauseMutex);
+        core.inGuest = false;
+    }
+    pauseChanged.notify_all();
+}
+
+// Kick every core out of its JIT and wait until they're all out. The caller is in the kernel, so it's already out of its own
+void CPU::stopOtherCores() {
+    std::unique_lock lock(pauseMutex);
+    pauseRequested = true;
+
+    for (auto& core : cores) {
+        if (core != nullptr && core->inGuest) {
+            core->jit->HaltExecution(Dynarmic::HaltReason::UserDefined2);
+        }
+    }
+
+    pauseChanged.wait(lock, [&] {
+        return std::none_of(cores.begin(), cores.end(), [](const auto& core) { return core != nullptr && core->inGuest; });
+    });
+}
+
+void CPU::resumeOtherCores() {
+    {
+        std::scoped_lock lock(pauseMutex);
+        pauseRequested = false;
+    }
+    pauseChanged.notify_all();
+}
+
+void CPU::idleActiveCore() {
+    activeCore->jit->HaltExecution(Dynarmic::HaltReason::UserDefined1);
+}
+
+void CPU::stopCores() {
+    {
+        std::scoped_lock lock(sliceMutex);
+        stopWorkers = true;
+    }
+    sliceStart.notify_all();
+
+    for (int i = 1; i < maxCores; i++) {
+        if (cores[i] != nullptr) {
+            cores[i]->thread.join();
+            cores[i].reset();
+        }
+    }
+
+    stopWorkers = false;
+    workerCount = 0;
+    activeCoreCount = 1;
+    pendingCores = 0;
+}
+
+void CPU::runSlice(CPUCore& core, u64 ticks) {
+    core.env.ticksLeft = ticks;
+
+    // Secondary cores go idle when they run out of threads. Ask the kernel for one before firing up the JIT
+    if (core.env.coreID != 0) {
+        std::scoped_lock lock(kernelMutex);
+        activateCore(core);
+
+        if (!kernel.scheduleActiveCore()) {
+            core.env.totalTicks += ticks;
+            core.env.ticksLeft = 0;
+            return;
+        }
+    }
+
+    Dynarmic::HaltReason exitReason;
+    while (true) {
+        enterGuest(core);
+        exitReason = core.jit->Run();
+        leaveGuest(core);
+
+        if (!Dynarmic::Has(exitReason, Dynarmic::HaltReason::UserDefined2)) [[likely]] {
+            break;
+        }
+
+        // Another core stopped us to change the page tables. Pick up where we left off, unless something else ended the slice too
+        core.jit->ClearHalt(Dynarmic::HaltReason::UserDefined2);
+        exitReason = static_cast<Dynarmic::HaltReason>(static_cast<u32>(exitReason) & ~static_cast<u32>(Dynarmic::HaltReason::UserDefined2));
+        if (static_cast<u32>(exitReason) != 0 || core.env.ticksLeft == 0) {
+            break;
+        }
+    }
+
+    if (Dynarmic::Has(exitReason, Dynarmic::HaltReason::UserDefined1)) {
+        // The core ran out of threads, so it sleeps through the rest of the slice
+        core.jit->ClearHalt(Dynarmic::HaltReason::UserDefined1);
+        core.env.totalTicks += core.env.ticksLeft;
+        core.env.ticksLeft = 0;
+    } else if (static_cast<u32>(exitReason) != 0) [[unlikely]] {
+        Helpers::panic("Exit reason: %d\nPC: %08X (core %d)", static_cast<u32>(exitReason), core.jit->Regs()[15], core.env.coreID);
+    }
+}
+
+void CPU::workerMain(CPUCore& core, u64 generation) {
+    while (true) {
+        u64 ticks;
+        {
+            std::unique_lock lock(sliceMutex);
+            sliceStart.wait(lock, [&] { return stopWorkers || sliceGeneration != generation; });
+            if (stopWorkers) {
+                return;
+            }
+
+            generation = sliceGeneration;
+            ticks = sliceTicks;
+        }
+
+        {
+            TRACE_SCOPE_ARG("CPU::runSlice", core.env.coreID);
+            runSlice(core, ticks);
+        }
+
+        std::scoped_lock lock(sliceMutex);
+        if (--pendingWorkers == 0) {
+            sliceDone.notify_one();
+        }
+    }
+}
+
+void CPU::runFrame() {
+    TRACE_SCOPE("CPU::runFrame");
+    constexpr u64 frameTicks = ticksPerSec / 60;
+
+    startPendingCores();
+
+    // Only the app core is up, so there's nothing to synchronise with
+    if (activeCoreCount == 1) [[likely]] {
+        runSlice(*cores[0], frameTicks);
+        return;
+    }
+
+    for (u64 ticksLeft = frameTicks; ticksLeft > 0;) {
+        // Every core is waiting at the barrier here, so cores enabled during the last slice can safely join
+        startPendingCores();
+
+        const u64 ticks = std::min(ticksLeft, syncInterval);
+        {
+            std::scoped_lock lock(sliceMutex);
+            sliceGeneration++;
+            sliceTicks = ticks;
+            pendingWorkers = workerCount;
+        }
+        sliceStart.notify_all();
+
+        runSlice(*cores[0], ticks);
+
+        // Barrier: Wait for the other cores to finish the slice, then bring their clocks in line with the app core's
+        {
+            std::unique_lock lock(sliceMutex);
+            sliceDone.wait(lock, [&] { return pendingWorkers == 0; });
+        }
+
+        for (int i = 1; i < maxCores; i++) {
+            if (cores[i] != nullptr) {
+                cores[i]->env.totalTicks = cores[0]->env.totalTicks;
+            }
+        }
+
+        ticksLeft -= ticks;
+    }
+
+    // The rest of the emulator talks to the kernel on behalf of the app core between frames
+    std::scoped_lock lock(kernelMutex);
+    activateCore(*cores[0]);
+}
+
+#endif // CPU_DYNARMIC
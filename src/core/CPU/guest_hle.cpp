@@ -0,0 +1,269 @@
+#include "guest_hle.hpp"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include "memory.hpp"
+
+namespace {
+	struct RoutineName {
+		const char* name;
+		HLERoutine routine;
+	};
+
+	// Symbol names we recognise in ELF symbol tables & map files. The first entry for each routine is also the name used in the config file
+	constexpr RoutineName routineNames[] = {
+		{"memcpy", HLERoutine::Memcpy},
+		{"__aeabi_memcpy", HLERoutine::Memcpy},
+		{"__aeabi_memcpy4", HLERoutine::Memcpy},
+		{"__aeabi_memcpy8", HLERoutine::Memcpy},
+		{"memmove", HLERoutine::Memmove},
+		{"__aeabi_memmove", HLERoutine::Memmove},
+		{"__aeabi_memmove4", HLERoutine::Memmove},
+		{"__aeabi_memmove8", HLERoutine::Memmove},
+		{"memset", HLERoutine::Memset},
+		{"__aeabi_memset", HLERoutine::AeabiMemset},
+		{"__aeabi_memset4", HLERoutine::AeabiMemset},
+		{"__aeabi_memset8", HLERoutine::AeabiMemset},
+		{"__aeabi_memclr", HLERoutine::AeabiMemclr},
+		{"__aeabi_memclr4", HLERoutine::AeabiMemclr},
+		{"__aeabi_memclr8", HLERoutine::AeabiMemclr},
+		{"strlen", HLERoutine::Strlen},
+	};
+
+	std::optional<HLERoutine> routineFromName(const std::string& name) {
+		for (const auto& entry : routineNames) {
+			if (name == entry.name) {
+				return entry.routine;
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	constexpr u32 routineBit(HLERoutine routine) { return 1u << static_cast<u32>(routine); }
+
+	// Rough cycle costs of the guest routines we replace, so HLE'd code doesn't run for free and timing-sensitive titles see about as much
+	// time pass as they would've with the guest code. Costs are a fixed call overhead plus a per-byte cost, based on a word-at-a-time
+	// ldm/stm copy loop, a word-at-a-time store loop for fills and a byte-at-a-time ldrb/cmp/bne loop for strlen
+	constexpr u64 routineBaseTicks = 16;
+	constexpr u64 copyTicks(u32 size) { return routineBaseTicks + size / 4; }
+	constexpr u64 fillTicks(u32 size) { return routineBaseTicks + size / 8; }
+	constexpr u64 strlenTicks(u32 length) { return routineBaseTicks + u64(length) * 3; }
+}
+
+const char* GuestHLE::routineName(HLERoutine routine) {
+	for (const auto& entry : routineNames) {
+		if (entry.routine == routine) {
+			return entry.name;
+		}
+	}
+
+	return "unknown";
+}
+
+bool GuestHLE::loadConfig(const std::filesystem::path& path) {
+	std::ifstream file(path);
+	if (!file.good()) {
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream stream(line);
+		std::string type;
+		if (!(stream >> type) || type[0] == '#') {
+			continue;
+		}
+
+		if (type == "signature") {
+			std::string name, mode, byte;
+			if (!(stream >> name >> mode)) {
+				Helpers::warn("HLE config: Invalid signature line: %s", line.c_str());
+				continue;
+			}
+
+			const auto routine = routineFromName(name);
+			if (!routine.has_value() || (mode != "arm" && mode != "thumb")) {
+				Helpers::warn("HLE config: Invalid signature line: %s", line.c_str());
+				continue;
+			}
+
+			Signature signature{routine.value(), mode == "thumb", {}, {}};
+			bool valid = true;
+
+			while (stream >> byte) {
+				if (byte == "??") {
+					signature.bytes.push_back(0);
+					signature.mask.push_back(0);
+				} else if (byte.size() == 2 && std::isxdigit(u8(byte[0])) && std::isxdigit(u8(byte[1]))) {
+					signature.bytes.push_back(static_cast<u8>(std::stoul(byte, nullptr, 16)));
+					signature.mask.push_back(0xFF);
+				} else {
+					valid = false;
+					break;
+				}
+			}
+
+			// Patterns need to at least cover the instruction we overwrite
+			if (!valid || signature.bytes.size() < 4 || signature.mask[0] == 0) {
+				Helpers::warn("HLE config: Invalid signature pattern: %s", line.c_str());
+				continue;
+			}
+
+			signatures.push_back(std::move(signature));
+		} else if (type == "title") {
+			std::string titleString, routineList;
+			if (!(stream >> titleString >> routineList)) {
+				Helpers::warn("HLE config: Invalid title line: %s", line.c_str());
+				continue;
+			}
+
+			u32 mask = 0;
+			std::istringstream routines(routineList);
+			std::string name;
+			while (std::getline(routines, name, ',')) {
+				if (const auto routine = routineFromName(name)) {
+					mask |= routineBit(routine.value());
+				} else {
+					Helpers::warn("HLE config: Unknown routine %s", name.c_str());
+				}
+			}
+
+			if (titleString == "*") {
+				globalAllowMask |= mask;
+			} else {
+				try {
+					allowlist[std::stoull(titleString, nullptr, 16)] |= mask;
+				} catch (...) {
+					Helpers::warn("HLE config: Invalid title ID %s", titleString.c_str());
+				}
+			}
+		} else {
+			Helpers::warn("HLE config: Unknown line: %s", line.c_str());
+		}
+	}
+
+	return true;
+}
+
+u32 GuestHLE::allowedRoutines(u64 titleID) const {
+	u32 mask = globalAllowMask;
+	if (auto it = allowlist.find(titleID); it != allowlist.end()) {
+		mask |= it->second;
+	}
+
+	return mask;
+}
+
+void GuestHLE::patch(Memory& mem, u32 address, HLERoutine routine, bool thumb) {
+	if (patches.contains(address)) {
+		return;
+	}
+
+	// Code pages are usually mapped read-only for the guest, so write the svc through the read pointer.
+	// Routines that straddle a page boundary on their first instruction are not worth the trouble
+	u8* pointer = (u8*)mem.getReadPointer(address);
+	const u32 instructionSize = thumb ? 2 : 4;
+	if (pointer == nullptr || (address & Memory::pageMask) > Memory::pageSize - instructionSize) {
+		return;
+	}
+
+	if (thumb) {
+		const u16 svc = 0xDF00 | svcNumber; // svc #0xFF
+		std::memcpy(pointer, &svc, sizeof(u16));
+	} else {
+		const u32 svc = 0xEF000000 | svcNumber; // svc #0xFF
+		std::memcpy(pointer, &svc, sizeof(u32));
+	}
+
+	patches[address] = {routine, thumb};
+	printf("HLE: Replaced %s at %08X (%s)\n", routineName(routine), address, thumb ? "Thumb" : "ARM");
+}
+
+void GuestHLE::applyPatches(Memory& mem, u64 titleID, const std::vector<GuestSymbol>& symbols) {
+	patches.clear();
+	for (auto& count : hits) {
+		count = 0;
+	}
+
+	const u32 allowed = allowedRoutines(titleID);
+	if (allowed == 0) {
+		return;
+	}
+
+	// Symbols first, as they're exact
+	for (const auto& symbol : symbols) {
+		const auto routine = routineFromName(symbol.name);
+		if (routine.has_value() && (allowed & routineBit(routine.value()))) {
+			patch(mem, symbol.address, routine.value(), symbol.thumb);
+		}
+	}
+
+	// Then scan the executable segments for signatures
+	for (const auto& [segmentStart, segmentSize] : mem.codeSegments) {
+		for (const auto& signature : signatures) {
+			if ((allowed & routineBit(signature.routine)) == 0 || segmentSize < signature.bytes.size()) {
+				continue;
+			}
+
+			const u32 alignment = signature.thumb ? 2 : 4;
+			const u32 patternSize = u32(signature.bytes.size());
+
+			for (u32 offset = 0; offset <= segmentSize - patternSize; offset += alignment) {
+				const u32 address = segmentStart + offset;
+				bool matches = true;
+
+				for (u32 i = 0; i < patternSize; i++) {
+					const u8* pointer = (const u8*)mem.getReadPointer(address + i);
+					if (pointer == nullptr || ((*pointer ^ signature.bytes[i]) & signature.mask[i]) != 0) {
+						matches = false;
+						break;
+					}
+				}
+
+				if (matches) {
+					patch(mem, address, signature.routine, signature.thumb);
+				}
+			}
+		}
+	}
+}
+
+std::optional<u64> GuestHLE::run(u32 address, std::array<u32, 16>& regs, Memory& mem) {
+	auto it = patches.find(address);
+	if (it == patches.end()) {
+		return std::nullopt;
+	}
+
+	const HLERoutine routine = it->second.routine;
+	hits[static_cast<size_t>(routine)].fetch_add(1, std::memory_order_relaxed);
+
+	// r0 already holds the destination, which is what memcpy/memmove/memset return
+	switch (routine) {
+		case HLERoutine::Memcpy:
+		case HLERoutine::Memmove: mem.copy(regs[0], regs[1], regs[2]); return copyTicks(regs[2]);
+		case HLERoutine::Memset: mem.fill(regs[0], u8(regs[1]), regs[2]); return fillTicks(regs[2]);
+		case HLERoutine::AeabiMemset: mem.fill(regs[0], u8(regs[2]), regs[1]); return fillTicks(regs[1]);
+		case HLERoutine::AeabiMemclr: mem.fill(regs[0], 0, regs[1]); return fillTicks(regs[1]);
+		case HLERoutine::Strlen: regs[0] = mem.stringLength(regs[0]); return strlenTicks(regs[0]);
+		default: Helpers::panic("Unknown HLE routine %d", static_cast<int>(routine));
+	}
+}
+
+void GuestHLE::printStats() const {
+	if (patches.empty()) {
+		return;
+	}
+
+	printf("HLE: %zu routines replaced\n", patches.size());
+	for (size_t i = 0; i < hits.size(); i++) {
+		const u64 count = hits[i].load();
+		if (count != 0) {
+			printf("  %s: %llu calls\n", routineName(static_cast<HLERoutine>(i)), (unsigned long long)count);
+		}
+	}
+}
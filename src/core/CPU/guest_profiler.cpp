@@ -0,0 +1,122 @@
+#include "guest_profiler.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+void GuestProfiler::start(u64 sampleInterval) {
+	samples.clear();
+	interval = sampleInterval;
+	ticksUntilSample = sampleInterval;
+	running = true;
+}
+
+void GuestProfiler::setSymbols(std::vector<GuestSymbol> newSymbols) {
+	symbols = std::move(newSymbols);
+	std::sort(symbols.begin(), symbols.end(), [](const GuestSymbol& a, const GuestSymbol& b) { return a.address < b.address; });
+}
+
+void GuestProfiler::addSymbols(const std::vector<GuestSymbol>& newSymbols) {
+	auto merged = symbols;
+	merged.insert(merged.end(), newSymbols.begin(), newSymbols.end());
+	setSymbols(std::move(merged));
+}
+
+bool GuestProfiler::loadMapFile(const std::filesystem::path& path) {
+	std::ifstream file(path);
+	if (!file.good()) {
+		return false;
+	}
+
+	std::vector<GuestSymbol> newSymbols;
+	std::string line;
+
+	while (std::getline(file, line)) {
+		std::istringstream stream(line);
+		std::string addressString, second, third;
+		if (!(stream >> addressString >> second)) {
+			continue;
+		}
+
+		GuestSymbol symbol;
+		try {
+			symbol.address = static_cast<u32>(std::stoul(addressString, nullptr, 16));
+
+			if (stream >> third) {
+				// nm-style lines have a single character symbol type in the middle, otherwise it's the symbol size
+				symbol.size = (second.size() == 1 && !std::isxdigit(static_cast<unsigned char>(second[0])))
+					? 0 : static_cast<u32>(std::stoul(second, nullptr, 16));
+				symbol.name = third;
+			} else {
+				symbol.size = 0;
+				symbol.name = second;
+			}
+		} catch (...) {
+			continue; // Skip lines that don't start with a hex address, eg headers
+		}
+
+		newSymbols.push_back(std::move(symbol));
+	}
+
+	addSymbols(newSymbols);
+	return true;
+}
+
+const GuestSymbol* GuestProfiler::findSymbol(u32 address) const {
+	// Find the last symbol starting at or before the address
+	auto it = std::upper_bound(symbols.begin(), symbols.end(), address, [](u32 addr, const GuestSymbol& s) { return addr < s.address; });
+	if (it == symbols.begin()) {
+		return nullptr;
+	}
+
+	const GuestSymbol& symbol = *(it - 1);
+	// Symbols of unknown size are assumed to extend up to the next symbol
+	if (symbol.size != 0 && address - symbol.address >= symbol.size) {
+		return nullptr;
+	}
+
+	return &symbol;
+}
+
+std::string GuestProfiler::symbolise(u32 address) const {
+	address &= ~1; // Ignore the Thumb bit
+
+	if (const GuestSymbol* symbol = findSymbol(address); symbol != nullptr) {
+		return symbol->name;
+	}
+
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "0x%08X", address);
+	return buffer;
+}
+
+bool GuestProfiler::writeCollapsedStacks(const std::filesystem::path& path) const {
+	std::ofstream file(path);
+	if (!file.good()) {
+		return false;
+	}
+
+	// Aggregate the raw (PC, LR) samples per function pair
+	std::map<std::string, u64> stacks;
+	for (const auto& [key, count] : samples) {
+		const std::string callee = symbolise(u32(key >> 32));
+		const std::string caller = symbolise(u32(key));
+
+		// LR is only a guess at the caller: Leaf functions keep it, but non-leaf functions may have clobbered it
+		// If it points into the same function (eg after a call returned), only keep one frame
+		if (caller == callee) {
+			stacks[callee] += count;
+		} else {
+			stacks[caller + ";" + callee] += count;
+		}
+	}
+
+	for (const auto& [stack, count] : stacks) {
+		file << stack << ' ' << count << '\n';
+	}
+
+	return true;
+}
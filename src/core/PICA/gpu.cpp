@@ -1,6 +1,8 @@
 #include "PICA/gpu.hpp"
 #include "PICA/float_types.hpp"
 #include "PICA/regs.hpp"
+#include "tracing.hpp"
+#include <algorithm>
 #include <cstdio>
 
 using namespace Floats;
@@ -8,19 +10,31 @@ using namespace Floats;
 GPU::GPU(Memory& mem) : mem(mem), renderer(*this, regs) {
 	vram = new u8[vramSize];
 	mem.setVRAM(vram); // Give the bus a pointer to our VRAM
+	indexRemapper.resize(Renderer::vertexBufferSize);
 }
 
+GPU::~GPU() { stopThread(); }
+
 void GPU::reset() {
+	submit({GPUCommand::Type::Reset});
+	sync();
+}
+
+void GPU::resetState() {
 	regs.fill(0);
 	shaderUnit.reset();
+	shaderJIT.reset();
 	std::memset(vram, 0, vramSize);
 
 	totalAttribCount = 0;
 	fixedAttribMask = 0;
 	fixedAttribIndex = 0;
 	fixedAttribCount = 0;
+	vertexLoaderDirty = true;
+	commandListCache.clear();
 	immediateModeAttrIndex = 0;
-	immediateModeVertIndex = 0;
+	immediateModeVertices.clear();
+	immediateModePending = false;
 
 	fixedAttrBuff.fill(0);
 
@@ -35,16 +49,24 @@ void GPU::reset() {
 }
 
 void GPU::drawArrays(bool indexed) {
+	const u64 startTime = (drawTimeLog != nullptr) ? Tracing::now() : 0;
+
 	if (indexed)
 		drawArrays<true>();
 	else
 		drawArrays<false>();
+
+	if (drawTimeLog != nullptr) {
+		drawTimeLog->push_back(Tracing::now() - startTime);
+	}
 }
 
 Vertex* vertices = new Vertex[Renderer::vertexBufferSize];
 
 template <bool indexed>
 void GPU::drawArrays() {
+	TRACE_SCOPE("GPU::drawArrays");
+
 	// Base address for vertex attributes
 	// The vertex base is always on a quadword boundary because the PICA does weird alignment shit any time possible
 	const u32 vertexBase = ((regs[PICAInternalRegs::VertexAttribLoc] >> 1) & 0xfffffff) * 16;
@@ -65,10 +87,6 @@ void GPU::drawArrays() {
 	u32 indexBufferPointer = vertexBase + (indexBufferConfig & 0xfffffff);
 	bool shortIndex = Helpers::getBit<31>(indexBufferConfig); // Indicates whether vert indices are 16-bit or 8-bit
 
-	// Stuff the global attribute config registers in one u64 to make attr parsing easier
-	// TODO: Cache this when the vertex attribute format registers are written to 
-	u64 vertexCfg = u64(regs[PICAInternalRegs::AttribFormatLow]) | (u64(regs[PICAInternalRegs::AttribFormatHigh]) << 32);
-
 	if constexpr (!indexed) {
 		u32 offset = regs[PICAInternalRegs::VertexOffsetReg];
 		log("PICA::DrawArrays(vertex count = %d, vertexOffset = %d)\n", vertexCount, offset);
@@ -78,134 +96,321 @@ void GPU::drawArrays() {
 
 	// Total number of input attributes to shader. Differs between GS and VS. Currently stubbed to the VS one, as we don't have geometry shaders.
 	const u32 inputAttrCount = (regs[PICAInternalRegs::VertexShaderInputBufferCfg] & 0xf) + 1;
-	const u64 inputAttrCfg = getVertexShaderInputConfig();
-		
-	for (u32 i = 0; i < vertexCount; i++) {
-		u32 vertexIndex; // Index of the vertex in the VBO
 
+	// The fourth type is meant to be "Geometry primitive". TODO: Find out what that is
+	static constexpr std::array<OpenGL::Primitives, 4> primTypes = {
+		OpenGL::Triangle, OpenGL::TriangleStrip, OpenGL::TriangleFan, OpenGL::Triangle
+	};
+	const auto shape = primTypes[primType];
+
+	if (vertexLoaderDirty) {
+		buildVertexLoader();
+	}
+
+	if (capture.isRunning()) [[unlikely]] {
+		captureDrawMemory<indexed>(vertexBase, vertexCount);
+	}
+
+	// The shader profiler has to see every instruction, so while it's running everything goes through the interpreter on this thread
+	const bool profiling = shaderProfiler.isRunning();
+	if (hardwareVertexShaders && !profiling && drawArraysHardware<indexed>(shape, vertexBase, vertexCount)) {
+		return;
+	}
+
+	shaderJIT.prepare(shaderUnit.vs);
+	// TODO: This is very unsafe
+	vertexLoader.setVertexBase(vertexBase, [this](u32 address) { return getPointerPhys<u8>(address); });
+
+	// Indexed draws only shade each vertex the index buffer references once, and then get drawn with a remapped index buffer
+	u32 shadedCount = vertexCount;
+	if constexpr (indexed) {
+		// TODO: These are very unsafe
+		if (shortIndex) {
+			shadedCount = indexRemapper.remap(getPointerPhys<u16>(indexBufferPointer), vertexCount);
+		} else {
+			shadedCount = indexRemapper.remap(getPointerPhys<u8>(indexBufferPointer), vertexCount);
+		}
+	}
+
+	const auto getVertexIndex = [&](u32 i) -> u32 { // Index of the vertex in the VBO
 		if constexpr (!indexed) {
-			vertexIndex = i + regs[PICAInternalRegs::VertexOffsetReg];
+			return i + regs[PICAInternalRegs::VertexOffsetReg];
+		} else {
+			return indexRemapper.uniqueIndices[i];
+		}
+	};
+
+	const auto storeVertex = [](Vertex& vertex, const vec4f& position, const vec4f& colour, const vec4f& UVs) {
+		std::memcpy(&vertex.position, &position, sizeof(vec4f));
+		std::memcpy(&vertex.colour, &colour, sizeof(vec4f));
+		std::memcpy(&vertex.UVs, &UVs, 2 * sizeof(f24));
+	};
+
+	// Shade the vertices in [begin, end) using the given shader unit. Big draws get split across threads, each with its own shader unit
+	// When the shader isn't recompiled, run the interpreter on batches of vertices at once, which amortizes decoding & dispatch
+	const auto shadeVertices = [&](PICAShader& shader, PICABatchShader& batch, u32 begin, u32 end) {
+		if (!profiling && !shaderJIT.isRecompiling() && end - begin >= PICABatchShader::laneCount) {
+			for (u32 i = begin; i < end; i += PICABatchShader::laneCount) {
+				const int laneCount = int(std::min<u32>(PICABatchShader::laneCount, end - i));
+				for (int lane = 0; lane < laneCount; lane++) {
+					vertexLoader.load(getVertexIndex(i + lane), shader.inputs);
+					batch.setInputs(lane, shader.inputs);
+				}
+
+				if (batch.run(shader, laneCount)) [[likely]] {
+					for (int lane = 0; lane < laneCount; lane++) {
+						storeVertex(vertices[i + lane], batch.getOutput(lane, 0), batch.getOutput(lane, 1), batch.getOutput(lane, 2));
+					}
+				} else {
+					// The lanes diverged in a way the batch interpreter can't handle, so run the vertices one by one
+					for (int lane = 0; lane < laneCount; lane++) {
+						batch.getInputs(lane, shader.inputs);
+						shader.run();
+						storeVertex(vertices[i + lane], shader.outputs[0], shader.outputs[1], shader.outputs[2]);
+					}
+				}
+			}
 		} else {
-			if (shortIndex) {
-				auto ptr = getPointerPhys<u16>(indexBufferPointer);
-				vertexIndex = *ptr; // TODO: This is very unsafe
-				indexBufferPointer += 2;
+			for (u32 i = begin; i < end; i++) {
+				vertexLoader.load(getVertexIndex(i), shader.inputs);
+				if (profiling) [[unlikely]] {
+					shader.run();
+				} else {
+					shaderJIT.run(shader);
+				}
+				storeVertex(vertices[i], shader.outputs[0], shader.outputs[1], shader.outputs[2]);
+			}
+		}
+	};
+
+	// Verify mode keeps track of mismatches in the JIT, so it has to stay on this thread
+	const bool multithreaded = shadedCount >= parallelVertexThreshold && vertexWorkers.getWorkerCount() > 1 &&
+							   shaderJIT.getMode() != ShaderJIT::Mode::Verify && !profiling;
+
+	if (profiling) [[unlikely]] {
+		shaderProfiler.beginDraw(shaderUnit.vs);
+	}
+
+	if (multithreaded) {
+		// Worker 0 is this thread, which uses the main shader unit. The rest get a copy of its program, uniforms & registers
+		while (workerShaders.size() + 1 < size_t(vertexWorkers.getWorkerCount())) {
+			workerShaders.push_back(std::make_unique<VertexWorkerShader>());
+		}
+
+		for (auto& worker : workerShaders) {
+			worker->shader.cloneFrom(shaderUnit.vs);
+		}
+
+		// Every chunk writes its own slice of the vertex buffer, so the workers never touch the same vertex
+		vertexWorkers.run(shadedCount, parallelChunkSize, [&](int worker, u32 begin, u32 end) {
+			if (worker == 0) {
+				shadeVertices(shaderUnit.vs, batchShader, begin, end);
 			} else {
-				auto ptr = getPointerPhys<u8>(indexBufferPointer);
-				vertexIndex = *ptr; // TODO: This is also very unsafe
-				indexBufferPointer += 1;
+				auto& state = *workerShaders[worker - 1];
+				shadeVertices(state.shader, state.batch, begin, end);
 			}
+		});
+	} else {
+		shadeVertices(shaderUnit.vs, batchShader, 0, shadedCount);
+	}
+
+	if (profiling) [[unlikely]] {
+		shaderProfiler.endDraw(shaderUnit.vs, shadedCount);
+	}
+
+	if constexpr (indexed) {
+		renderer.drawIndexedVertices(shape, vertices, shadedCount, indexRemapper.remappedIndices.data(), vertexCount);
+	} else {
+		renderer.drawVertices(shape, vertices, vertexCount);
+	}
+}
+
+template <bool indexed>
+void GPU::captureDrawMemory(u32 vertexBase, u32 vertexCount) {
+	if (vertexCount == 0) {
+		return;
+	}
+
+	u32 firstVertex, lastVertex;
+	if constexpr (indexed) {
+		const u32 indexBufferConfig = regs[PICAInternalRegs::IndexBufferConfig];
+		const u32 indexBufferPointer = vertexBase + (indexBufferConfig & 0xfffffff);
+		const bool shortIndex = Helpers::getBit<31>(indexBufferConfig);
+		captureMemory(indexBufferPointer, vertexCount * (shortIndex ? sizeof(u16) : sizeof(u8)));
+
+		const auto findRange = [&](const auto* indices) {
+			const auto [min, max] = std::minmax_element(indices, indices + vertexCount);
+			firstVertex = *min;
+			lastVertex = *max;
+		};
+
+		if (shortIndex) {
+			findRange(getPointerPhys<u16>(indexBufferPointer));
+		} else {
+			findRange(getPointerPhys<u8>(indexBufferPointer));
 		}
+	} else {
+		firstVertex = regs[PICAInternalRegs::VertexOffsetReg];
+		lastVertex = firstVertex + vertexCount - 1;
+	}
 
-		int attrCount = 0;
-		int buffer = 0; // Vertex buffer index for non-fixed attributes
+	// Every attribute buffer the vertex loader reads from, over the range of vertices the draw uses
+	u32 capturedBuffers = 0;
+	for (u32 i = 0; i < vertexLoader.getStepCount(); i++) {
+		const auto& step = vertexLoader.getStep(i);
+		if (step.isFixed() || (capturedBuffers & (1u << step.buffer))) {
+			continue;
+		}
 
-		while (attrCount < totalAttribCount) {
-			// Check if attribute is fixed or not
-			if (fixedAttribMask & (1 << attrCount)) { // Fixed attribute
-				vec4f& fixedAttr = shaderUnit.vs.fixedAttributes[attrCount]; // TODO: Is this how it works?
-				vec4f& inputAttr = currentAttributes[attrCount];
-				std::memcpy(&inputAttr, &fixedAttr, sizeof(vec4f)); // Copy fixed attr to input attr
-				attrCount++;
-			} else { // Non-fixed attribute
-				auto& attr = attributeInfo[buffer]; // Get information for this attribute
-				u64 attrCfg = attr.getConfigFull(); // Get config1 | (config2 << 32)
-				u32 attrAddress = vertexBase + attr.offset + (vertexIndex * attr.size);
-
-				for (int j = 0; j < attr.componentCount; j++) {
-					uint index = (attrCfg >> (j * 4)) & 0xf; // Get index of attribute in vertexCfg
-					if (index >= 12) Helpers::panic("[PICA] Vertex attribute used as padding");
-
-					u32 attribInfo = (vertexCfg >> (index * 4)) & 0xf;
-					u32 attribType = attribInfo & 0x3; //  Type of attribute(sbyte/ubyte/short/float)
-					u32 size = (attribInfo >> 2) + 1; // Total number of components
-
-					//printf("vertex_attribute_strides[%d] = %d\n", attrCount, attr.size);
-					vec4f& attribute = currentAttributes[attrCount];
-					uint component; // Current component
-
-					switch (attribType) {
-						case 0: { // Signed byte
-							s8* ptr = getPointerPhys<s8>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(s8);
-							break;
-						}
-
-						case 1: { // Unsigned byte
-							u8* ptr = getPointerPhys<u8>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(u8);
-							break;
-						}
-
-						case 2: { // Short
-							s16* ptr = getPointerPhys<s16>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(s16);
-							break;
-						}
-
-						case 3: { // Float
-							float* ptr = getPointerPhys<float>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = *ptr++;
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(float);
-							break;
-						}
-
-						default: Helpers::panic("[PICA] Unimplemented attribute type %d", attribType);
-					}
+		const auto& buffer = vertexLoader.getBuffer(step.buffer);
+		captureMemory(vertexBase + buffer.offset + firstVertex * buffer.stride, (lastVertex - firstVertex) * buffer.stride + buffer.size);
+		capturedBuffers |= 1u << step.buffer;
+	}
+}
 
-					// Fill the remaining attribute lanes with default parameters (1.0 for alpha/w, 0.0) for everything else
-					// Corgi does this although I'm not sure if it's actually needed for anything.
-					// TODO: Find out
-					while (component < 4) {
-						attribute[component] = (component == 3) ? f24::fromFloat32(1.0) : f24::fromFloat32(0.0);
-						component++;
-					}
+void GPU::recordCapturedMemory(u32 paddr, u32 size) {
+	if (size == 0) {
+		return;
+	}
 
-					attrCount++;
-				}
-				buffer++;
+	const u32 firstPage = paddr & ~(GPUCapture::pageSize - 1);
+	const u32 lastPage = (paddr + size - 1) & ~(GPUCapture::pageSize - 1);
+	for (u32 page = firstPage; page <= lastPage; page += GPUCapture::pageSize) {
+		capture.recordPage(page, getPointerPhys<u8>(page));
+	}
+}
+
+// Draw by running the vertex shader on the host GPU. Returns false if the shader or the attribute layout can't be handled there, in
+// which case the draw goes through the CPU path instead
+template <bool indexed>
+bool GPU::drawArraysHardware(OpenGL::Primitives shape, u32 vertexBase, u32 vertexCount) {
+	if (vertexCount == 0 || !renderer.prepareHardwareShader(shaderUnit.vs)) {
+		return false;
+	}
+
+	// Only the range of vertices the draw uses gets uploaded, so indices get rebased to the first one
+	u32 firstVertex, lastVertex;
+	if constexpr (indexed) {
+		const u32 indexBufferConfig = regs[PICAInternalRegs::IndexBufferConfig];
+		const u32 indexBufferPointer = vertexBase + (indexBufferConfig & 0xfffffff);
+
+		const auto rebaseIndices = [&](const auto* indices) {
+			firstVertex = indices[0];
+			lastVertex = indices[0];
+			for (u32 i = 1; i < vertexCount; i++) {
+				firstVertex = std::min<u32>(firstVertex, indices[i]);
+				lastVertex = std::max<u32>(lastVertex, indices[i]);
+			}
+
+			for (u32 i = 0; i < vertexCount; i++) {
+				indexRemapper.remappedIndices[i] = u16(indices[i] - firstVertex);
 			}
+		};
+
+		// TODO: These are very unsafe
+		if (Helpers::getBit<31>(indexBufferConfig)) {
+			rebaseIndices(getPointerPhys<u16>(indexBufferPointer));
+		} else {
+			rebaseIndices(getPointerPhys<u8>(indexBufferPointer));
 		}
+	} else {
+		firstVertex = regs[PICAInternalRegs::VertexOffsetReg];
+		lastVertex = firstVertex + vertexCount - 1;
+	}
+
+	static constexpr u32 notUploaded = 0xffffffff;
+	std::array<u32, maxAttribCount> bufferOffsets; // Where each attribute buffer is in hardwareVertexData
+	bufferOffsets.fill(notUploaded);
+	hardwareVertexData.clear();
+
+	std::array<HardwareVertexAttribute, 16> attributes;
+	for (u32 i = 0; i < vertexLoader.getStepCount(); i++) {
+		const auto& step = vertexLoader.getStep(i);
+		auto& attribute = attributes[step.inputRegister];
+
+		if (step.isFixed()) {
+			attribute.enabled = false;
+			std::memcpy(attribute.value.data(), step.fixedValue, sizeof(attribute.value));
+			continue;
+		}
+
+		const auto& buffer = vertexLoader.getBuffer(step.buffer);
+		if (buffer.stride == 0) { // A stride of 0 means "tightly packed" to OpenGL rather than every vertex sharing the attribute
+			return false;
+		}
+
+		u32& bufferOffset = bufferOffsets[step.buffer];
+		if (bufferOffset == notUploaded) {
+			bufferOffset = (hardwareVertexData.size() + 3) & ~3u; // Keep attributes 4-byte aligned, some drivers are very slow otherwise
+			const u32 size = (lastVertex - firstVertex) * buffer.stride + buffer.size;
+			hardwareVertexData.resize(bufferOffset + size);
 
-		// Before running the shader, the PICA maps the fetched attributes from the attribute registers to the shader input registers
-		// Based on the SH_ATTRIBUTES_PERMUTATION registers.
-		// Ie it might attribute #0 to v2, #1 to v7, etc
-		for (int j = 0; j < totalAttribCount; j++) {
-			const u32 mapping = (inputAttrCfg >> (j * 4)) & 0xf;
-			std::memcpy(&shaderUnit.vs.inputs[mapping], &currentAttributes[j], sizeof(vec4f));
+			// TODO: This is very unsafe
+			std::memcpy(&hardwareVertexData[bufferOffset], getPointerPhys<u8>(vertexBase + buffer.offset + firstVertex * buffer.stride), size);
 		}
-		
-		shaderUnit.vs.run();
-		std::memcpy(&vertices[i].position, &shaderUnit.vs.outputs[0], sizeof(vec4f));
-		std::memcpy(&vertices[i].colour, &shaderUnit.vs.outputs[1], sizeof(vec4f));
-		std::memcpy(&vertices[i].UVs, &shaderUnit.vs.outputs[2], 2 * sizeof(f24));
-
-		//printf("(x, y, z, w) = (%f, %f, %f, %f)\n", (double)vertices[i].position.x(), (double)vertices[i].position.y(), (double)vertices[i].position.z(), (double)vertices[i].position.w());
-		//printf("(r, g, b, a) = (%f, %f, %f, %f)\n", (double)vertices[i].colour.r(), (double)vertices[i].colour.g(), (double)vertices[i].colour.b(), (double)vertices[i].colour.a());
-		//printf("(u, v      ) = (%f, %f)\n", vertices[i].UVs.u(), vertices[i].UVs.v());
+
+		attribute.enabled = true;
+		attribute.type = step.type;
+		attribute.components = step.components;
+		attribute.offset = bufferOffset + (step.offset - buffer.offset);
+		attribute.stride = buffer.stride;
 	}
 
-	// The fourth type is meant to be "Geometry primitive". TODO: Find out what that is
-	static constexpr std::array<OpenGL::Primitives, 4> primTypes = {
-		OpenGL::Triangle, OpenGL::TriangleStrip, OpenGL::TriangleFan, OpenGL::Triangle
-	};
-	const auto shape = primTypes[primType];
-	renderer.drawVertices(shape, vertices, vertexCount);
+	const u16* indices = indexed ? indexRemapper.remappedIndices.data() : nullptr;
+	renderer.drawHardwareShaded(shape, attributes, hardwareVertexData.data(), hardwareVertexData.size(), indices, vertexCount);
+	return true;
+}
+
+// Turn the attribute format & input permutation registers into the list of attributes the vertex loader fetches for each vertex
+// Each attribute goes straight to the shader input register SH_ATTRIBUTES_PERMUTATION maps it to, ie it might send attribute #0 to v2,
+// #1 to v7, etc. Attributes past the total attribute count aren't passed to the shader, so they don't get loaded at all
+void GPU::buildVertexLoader() {
+	// Stuff the global attribute config registers in one u64 to make attr parsing easier
+	const u64 vertexCfg = u64(regs[PICAInternalRegs::AttribFormatLow]) | (u64(regs[PICAInternalRegs::AttribFormatHigh]) << 32);
+	const u64 inputAttrCfg = getVertexShaderInputConfig();
+	const auto getInputRegister = [&](u32 attribute) -> u32 { return (inputAttrCfg >> (attribute * 4)) & 0xf; };
+
+	vertexLoader.clear();
+	vertexLoaderDirty = false;
+
+	u32 attrCount = 0;
+	u32 buffer = 0; // Vertex buffer index for non-fixed attributes
+
+	while (attrCount < totalAttribCount) {
+		// Check if attribute is fixed or not
+		if (fixedAttribMask & (1 << attrCount)) { // Fixed attribute
+			// TODO: Is this how it works?
+			vertexLoader.addFixedAttribute(&shaderUnit.vs.fixedAttributes[attrCount], getInputRegister(attrCount));
+			attrCount++;
+		} else { // Non-fixed attribute
+			if (buffer >= maxAttribCount) [[unlikely]] {
+				Helpers::warn("[PICA] Ran out of vertex buffers while loading attributes");
+				break;
+			}
+
+			auto& attr = attributeInfo[buffer]; // Get information for this attribute
+			u64 attrCfg = attr.getConfigFull(); // Get config1 | (config2 << 32)
+			u32 offset = 0; // Offset of the current attribute within the vertex
+			vertexLoader.setBuffer(buffer, attr.offset, attr.size);
+
+			for (int j = 0; j < attr.componentCount; j++) {
+				uint index = (attrCfg >> (j * 4)) & 0xf; // Get index of attribute in vertexCfg
+				if (index >= 12) Helpers::panic("[PICA] Vertex attribute used as padding");
+
+				u32 attribInfo = (vertexCfg >> (index * 4)) & 0xf;
+				u32 attribType = attribInfo & 0x3; //  Type of attribute(sbyte/ubyte/short/float)
+				u32 size = (attribInfo >> 2) + 1; // Total number of components
+
+				if (attrCount < totalAttribCount) {
+					vertexLoader.addAttribute(attribType, size, buffer, offset, getInputRegister(attrCount));
+				}
+
+				offset += size * VertexLoader::typeSizes[attribType];
+				attrCount++;
+			}
+			buffer++;
+		}
+	}
 }
 
 Vertex GPU::getImmediateModeVertex() {
@@ -218,48 +423,23 @@ Vertex GPU::getImmediateModeVertex() {
 	}
 
 	// Run VS and return vertex data. TODO: Don't hardcode offsets for each attribute
-	shaderUnit.vs.run();
+	shaderJIT.prepare(shaderUnit.vs);
+	shaderJIT.run(shaderUnit.vs);
 	std::memcpy(&v.position, &shaderUnit.vs.outputs[0], sizeof(vec4f));
 	std::memcpy(&v.colour, &shaderUnit.vs.outputs[1], sizeof(vec4f));
 	std::memcpy(&v.UVs, &shaderUnit.vs.outputs[2], 2 * sizeof(f24));
 
-	printf("(x, y, z, w) = (%f, %f, %f, %f)\n", (double)v.position.x(), (double)v.position.y(), (double)v.position.z(), (double)v.position.w());
-	printf("(r, g, b, a) = (%f, %f, %f, %f)\n", (double)v.colour.r(), (double)v.colour.g(), (double)v.colour.b(), (double)v.colour.a());
-	printf("(u, v      ) = (%f, %f)\n", v.UVs.u(), v.UVs.v());
-
 	return v;
 }
 
 void GPU::fireDMA(u32 dest, u32 source, u32 size) {
 	log("[GPU] DMA of %08X bytes from %08X to %08X\n", size, source, dest);
-	constexpr u32 vramStart = VirtualAddrs::VramStart;
-	constexpr u32 vramSize = VirtualAddrs::VramSize;
-
-	const u32 fcramStart = mem.getLinearHeapVaddr();
-	constexpr u32 fcramSize = VirtualAddrs::FcramTotalSize;
 
-	// Shows whether this transfer is an FCRAM->VRAM transfer that's trivially optimizable
-	bool cpuToVRAM = true;
-
-	if (dest - vramStart >= vramSize || size > (vramSize - (dest - vramStart))) [[unlikely]] {
-		cpuToVRAM = false;
-		Helpers::panic("GPU DMA does not target VRAM");
-	}
-
-	if (source - fcramStart >= fcramSize || size > (fcramSize - (dest - fcramStart))) [[unlikely]] {
-		cpuToVRAM = false;
-		// Helpers::panic("GPU DMA does not have FCRAM as its source");
+	// Both addresses are physical and the range is physically contiguous, as the GSP service split the transfer up when submitting it
+	if (capture.isRunning()) [[unlikely]] {
+		captureMemory(source, size);
+		capture.recordDMA(dest, source, size);
 	}
 
-	if (cpuToVRAM) [[likely]] {
-		// Valid, optimized FCRAM->VRAM DMA. TODO: Is VRAM->VRAM DMA allowed?
-		u8* fcram = mem.getFCRAM();
-		std::memcpy(&vram[dest - vramStart], &fcram[source - fcramStart], size);
-	} else {
-		printf("Non-trivially optimizable GPU DMA. Falling back to byte-by-byte transfer\n");
-
-		for (u32 i = 0; i < size; i++) {
-			mem.write8(dest + i, mem.read8(source + i));
-		}
-	}
+	std::memcpy(getPointerPhys<u8>(dest), getPointerPhys<u8>(source), size);
 }
@@ -0,0 +1,128 @@
+#include "PICA/gpu_capture.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+u32 GPUCapture::getArgumentCount(RecordType type) {
+	switch (type) {
+		case RecordType::Page:
+		case RecordType::ZeroPage: return 1;
+		case RecordType::CommandList: return 2;
+		case RecordType::MemoryFill: return 4;
+		case RecordType::DisplayTransfer: return 5;
+		case RecordType::DMA: return 3;
+		case RecordType::Frame: return 0;
+		default: return 0;
+	}
+}
+
+bool GPUCapture::start(const std::filesystem::path& path) {
+	file = std::ofstream(path, std::ios::binary);
+	if (!file.good()) {
+		return false;
+	}
+
+	const u32 header[2] = {magic, version};
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	pageHashes.clear();
+	frames = 0;
+	running = true;
+	return true;
+}
+
+bool GPUCapture::stop() {
+	running = false;
+	file.close();
+
+	const bool success = !file.fail();
+	file = std::ofstream();
+	pageHashes.clear();
+	return success;
+}
+
+void GPUCapture::writeRecord(RecordType type, std::initializer_list<u32> args) {
+	if (!running) {
+		return;
+	}
+
+	const u8 typeByte = static_cast<u8>(type);
+	file.write(reinterpret_cast<const char*>(&typeByte), sizeof(typeByte));
+	file.write(reinterpret_cast<const char*>(args.begin()), args.size() * sizeof(u32));
+}
+
+void GPUCapture::recordPage(u32 paddr, const u8* data) {
+	if (!running) {
+		return;
+	}
+
+	u64 hash = std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(data), pageSize));
+	auto [entry, inserted] = pageHashes.try_emplace(paddr, hash);
+	if (!inserted) {
+		if (entry->second == hash) {
+			return; // The capture already has this version of the page
+		}
+		entry->second = hash;
+	}
+
+	// Freshly allocated memory is all zeroes, so don't waste 4KB on it
+	const bool zero = std::all_of(data, data + pageSize, [](u8 byte) { return byte == 0; });
+	if (zero) {
+		writeRecord(RecordType::ZeroPage, {paddr});
+	} else {
+		writeRecord(RecordType::Page, {paddr});
+		file.write(reinterpret_cast<const char*>(data), pageSize);
+	}
+}
+
+bool GPUCapture::load(const std::filesystem::path& path, std::vector<u8>& contents, std::vector<Record>& records) {
+	std::ifstream input(path, std::ios::binary);
+	if (!input.good()) {
+		return false;
+	}
+
+	contents.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	records.clear();
+
+	u32 header[2];
+	if (contents.size() < sizeof(header)) {
+		return false;
+	}
+
+	std::memcpy(header, contents.data(), sizeof(header));
+	if (header[0] != magic || header[1] != version) {
+		return false;
+	}
+
+	size_t offset = sizeof(header);
+	while (offset < contents.size()) {
+		Record record;
+		record.type = static_cast<RecordType>(contents[offset++]);
+		record.args.fill(0);
+		record.data = nullptr;
+
+		if (record.type > RecordType::Frame) {
+			Helpers::warn("Unknown GPU capture record type %d at offset %zu", int(record.type), offset - 1);
+			return false;
+		}
+
+		const size_t argSize = getArgumentCount(record.type) * sizeof(u32);
+		const size_t dataSize = (record.type == RecordType::Page) ? pageSize : 0;
+		if (contents.size() - offset < argSize + dataSize) {
+			Helpers::warn("GPU capture is cut off at offset %zu", offset - 1);
+			return false;
+		}
+
+		std::memcpy(record.args.data(), &contents[offset], argSize);
+		offset += argSize;
+
+		if (dataSize != 0) {
+			record.data = &contents[offset];
+			offset += dataSize;
+		}
+
+		records.push_back(record);
+	}
+
+	return true;
+}
@@ -0,0 +1,125 @@
+#include "PICA/gpu.hpp"
+#include "tracing.hpp"
+
+void GPU::submit(const GPUCommand& command) {
+	if (threadRunning) {
+		commandQueue.push(command);
+	} else {
+		execute(command);
+	}
+}
+
+void GPU::sync() {
+	if (threadRunning) {
+		TRACE_SCOPE("GPU::sync");
+		commandQueue.waitUntilEmpty();
+	}
+}
+
+void GPU::execute(const GPUCommand& command) {
+	using Type = GPUCommand::Type;
+	const auto& args = command.args;
+
+	switch (command.type) {
+		case Type::CommandList: startCommandList(args[0], args[1]); break;
+		case Type::MemoryFill: clearBuffer(args[0], args[1], args[2], args[3]); break;
+		case Type::DisplayTransfer: displayTransfer(args[0], args[1], args[2], args[3], args[4]); break;
+		case Type::DMA: fireDMA(args[0], args[1], args[2]); break;
+
+		case Type::WriteReg: {
+			const u32 mask = args[2];
+			writeReg(args[0], mask == 0xffffffff ? args[1] : ((readReg(args[0]) & ~mask) | (args[1] & mask)));
+			break;
+		}
+
+		case Type::BeginFrame: renderer.getGraphicsContext(); break;
+
+		case Type::PresentFrame: {
+			{
+				TRACE_SCOPE("GPU::display");
+				renderer.display();
+			}
+			capture.recordFrame();
+
+			if (presentCallback) {
+				TRACE_SCOPE("Present");
+				presentCallback();
+			}
+
+			presentedFrames.fetch_add(1, std::memory_order_release);
+			presentedFrames.notify_one();
+			break;
+		}
+
+		case Type::Reset: resetState(); break;
+		case Type::Nop: break;
+		case Type::Stop: break;
+	}
+
+	if (command.interrupts != 0) {
+		for (u32 i = 0; i < pendingInterrupts.size(); i++) {
+			if (command.interrupts & (1 << i)) {
+				pendingInterrupts[i].fetch_add(1, std::memory_order_release);
+			}
+		}
+
+		interruptsPending.store(true, std::memory_order_release);
+	}
+}
+
+void GPU::presentFrame() {
+	submit({GPUCommand::Type::PresentFrame});
+	if (!threadRunning) {
+		return;
+	}
+
+	// Let the CPU get up to one frame ahead of the GPU thread, but no further. Otherwise input lag piles up, and the CPU can get
+	// around to overwriting data the GPU hasn't read yet, which games only make sure can't happen on real hardware timings
+	submittedFrames++;
+	TRACE_SCOPE("GPU::waitForFrame");
+	for (u64 presented = presentedFrames.load(std::memory_order_acquire); presented + 1 < submittedFrames;
+		 presented = presentedFrames.load(std::memory_order_acquire)) {
+		presentedFrames.wait(presented, std::memory_order_acquire);
+	}
+}
+
+void GPU::startThread(std::function<void(bool)> setContextCurrent) {
+	if (threadRunning) {
+		return;
+	}
+
+	this->setContextCurrent = std::move(setContextCurrent);
+	submittedFrames = presentedFrames.load();
+	threadRunning = true;
+	thread = std::thread(&GPU::threadMain, this);
+}
+
+void GPU::stopThread() {
+	if (!threadRunning) {
+		return;
+	}
+
+	commandQueue.push({GPUCommand::Type::Stop});
+	thread.join();
+	threadRunning = false;
+
+	// Take the context back, so that the GPU can keep being used from this thread
+	setContextCurrent(true);
+}
+
+void GPU::threadMain() {
+	setContextCurrent(true);
+
+	while (true) {
+		const GPUCommand& command = commandQueue.front();
+		const bool stop = command.type == GPUCommand::Type::Stop;
+
+		execute(command);
+		commandQueue.pop(); // Only pop once the command is done, so that sync() waits for it
+		if (stop) {
+			break;
+		}
+	}
+
+	setContextCurrent(false);
+}
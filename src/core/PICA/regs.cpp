@@ -1,5 +1,8 @@
+#include <functional>
+#include <string_view>
 #include "PICA/gpu.hpp"
 #include "PICA/regs.hpp"
+#include "tracing.hpp"
 
 using namespace Floats;
 using namespace Helpers;
@@ -24,7 +27,7 @@ void GPU::writeReg(u32 address, u32 value) {
 }
 
 u32 GPU::readInternalReg(u32 index) {
-	if (index > regNum) {
+	if (index >= regNum) {
 		Helpers::panic("Tried to read invalid GPU register. Index: %X\n", index);
 		return 0;
 	}
@@ -33,255 +36,492 @@ u32 GPU::readInternalReg(u32 index) {
 }
 
 void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
-	using namespace PICAInternalRegs;
-
-	if (index > regNum) {
+	if (index >= regNum) {
 		Helpers::panic("Tried to write to invalid GPU register. Index: %X, value: %08X\n", index, value);
 		return;
 	}
 
+	// Anything but more immediate mode vertex data might change what the batched immediate mode vertices should be drawn with
+	if (immediateModePending && (index < PICAInternalRegs::FixedAttribData0 || index > PICAInternalRegs::FixedAttribData2)) [[unlikely]] {
+		// Only a write that actually sets the restart bit ends the current strip/fan, writing 0 to it doesn't
+		const bool restart = index == PICAInternalRegs::PrimitiveRestart && (value & mask & 1);
+		flushImmediateModeVertices(index == PICAInternalRegs::FixedAttribIndex || restart);
+	}
+
 	u32 currentValue = regs[index];
 	u32 newValue = (currentValue & ~mask) | (value & mask); // Only overwrite the bits specified by "mask"
 	regs[index] = newValue;
+	if (newValue != currentValue) {
+		renderer.markRegDirty(index);
+	}
 
 	// TODO: Figure out if things like the shader index use the unmasked value or the masked one
 	// We currently use the unmasked value like Citra does
-	switch (index) {
-		case SignalDrawArrays:
-			if (value != 0) drawArrays(false);
-			break;
+	registerHandlers[index](*this, index, value);
+}
 
-		case SignalDrawElements:
-			if (value != 0) drawArrays(true);
-			break;
+const std::array<GPU::RegisterHandler, GPU::regNum> GPU::registerHandlers = GPU::buildRegisterHandlers();
 
-		case AttribFormatHigh:
-			totalAttribCount = (value >> 28) + 1; // Total number of vertex attributes
-			fixedAttribMask = getBits<16, 12>(value); // Determines which vertex attributes are fixed for all vertices
-			break;
+std::array<GPU::RegisterHandler, GPU::regNum> GPU::buildRegisterHandlers() {
+	using namespace PICAInternalRegs;
+	std::array<RegisterHandler, regNum> handlers;
 
-		case ColourBufferLoc: {
-			u32 loc = (value & 0x0fffffff) << 3;
-			renderer.setColourBufferLoc(loc);
-			break;
-		};
+	// Most registers don't do anything when written, and just get read back when we draw
+	handlers.fill([](GPU& gpu, u32 index, u32 value) {
+		gpu.log("GPU: Wrote to unimplemented internal reg: %X, value: %08X\n", index, gpu.regs[index]);
+	});
 
-		case ColourBufferFormat: {
-			u32 format = getBits<16, 3>(value);
-			renderer.setColourFormat(format);
-			break;
+	// Fill in the handler for a range of registers, inclusive of "last"
+	const auto setHandlers = [&](u32 first, u32 last, RegisterHandler handler) {
+		for (u32 index = first; index <= last; index++) {
+			handlers[index] = handler;
 		}
+	};
 
-		case DepthBufferLoc: {
-			u32 loc = (value & 0x0fffffff) << 3;
-			renderer.setDepthBufferLoc(loc);
-			break;
+	handlers[SignalDrawArrays] = [](GPU& gpu, u32 index, u32 value) {
+		if (value != 0) gpu.drawArrays(false);
+	};
+
+	handlers[SignalDrawElements] = [](GPU& gpu, u32 index, u32 value) {
+		if (value != 0) gpu.drawArrays(true);
+	};
+
+	handlers[AttribFormatLow] = [](GPU& gpu, u32 index, u32 value) { gpu.vertexLoaderDirty = true; };
+
+	handlers[AttribFormatHigh] = [](GPU& gpu, u32 index, u32 value) {
+		gpu.totalAttribCount = (value >> 28) + 1; // Total number of vertex attributes
+		gpu.fixedAttribMask = getBits<16, 12>(value); // Determines which vertex attributes are fixed for all vertices
+		gpu.vertexLoaderDirty = true;
+	};
+
+	setHandlers(VertexShaderInputCfgLow, VertexShaderInputCfgHigh, [](GPU& gpu, u32 index, u32 value) { gpu.vertexLoaderDirty = true; });
+
+	// Vertex attribute registers
+	setHandlers(AttribInfoStart, AttribInfoEnd, [](GPU& gpu, u32 index, u32 value) {
+		uint attributeIndex = (index - AttribInfoStart) / 3; // Which attribute are we writing to
+		uint reg = (index - AttribInfoStart) % 3; // Which of this attribute's registers are we writing to?
+		auto& attr = gpu.attributeInfo[attributeIndex];
+		gpu.vertexLoaderDirty = true;
+
+		switch (reg) {
+			case 0: attr.offset = value & 0xfffffff; break; // Attribute offset
+			case 1:
+				attr.config1 = value;
+				break;
+			case 2:
+				attr.config2 = value;
+				attr.size = getBits<16, 8>(value);
+				attr.componentCount = value >> 28;
+				break;
 		}
+	});
 
-		case DepthBufferFormat: {
-			u32 fmt = value & 0x3;
-			renderer.setDepthFormat(fmt);
-			break;
+	handlers[ColourBufferLoc] = [](GPU& gpu, u32 index, u32 value) {
+		u32 loc = (value & 0x0fffffff) << 3;
+		gpu.renderer.setColourBufferLoc(loc);
+	};
+
+	handlers[ColourBufferFormat] = [](GPU& gpu, u32 index, u32 value) {
+		u32 format = getBits<16, 3>(value);
+		gpu.renderer.setColourFormat(format);
+	};
+
+	handlers[DepthBufferLoc] = [](GPU& gpu, u32 index, u32 value) {
+		u32 loc = (value & 0x0fffffff) << 3;
+		gpu.renderer.setDepthBufferLoc(loc);
+	};
+
+	handlers[DepthBufferFormat] = [](GPU& gpu, u32 index, u32 value) {
+		u32 fmt = value & 0x3;
+		gpu.renderer.setDepthFormat(fmt);
+	};
+
+	handlers[FramebufferSize] = [](GPU& gpu, u32 index, u32 value) {
+		const u32 width = value & 0x7ff;
+		const u32 height = getBits<12, 10>(value) + 1;
+		gpu.renderer.setFBSize(width, height);
+	};
+
+	handlers[VertexFloatUniformIndex] = [](GPU& gpu, u32 index, u32 value) { gpu.shaderUnit.vs.setFloatUniformIndex(value); };
+
+	setHandlers(VertexFloatUniformData0, VertexFloatUniformData7, [](GPU& gpu, u32 index, u32 value) {
+		gpu.shaderUnit.vs.uploadFloatUniform(value);
+	});
+
+	handlers[FixedAttribIndex] = [](GPU& gpu, u32 index, u32 value) {
+		gpu.fixedAttribCount = 0;
+		gpu.fixedAttribIndex = value & 0xf;
+
+		if (gpu.fixedAttribIndex == 0xf) {
+			gpu.log("[PICA] Immediate mode vertex submission enabled");
+			gpu.immediateModeAttrIndex = 0;
+			gpu.immediateModeVertices.clear();
 		}
+	};
 
-		case FramebufferSize: {
-			const u32 width = value & 0x7ff;
-			const u32 height = getBits<12, 10>(value) + 1;
-			renderer.setFBSize(width, height);
-			break;
+	// Restart immediate mode primitive drawing. The old primitive was already drawn by writeInternalReg
+	handlers[PrimitiveRestart] = [](GPU& gpu, u32 index, u32 value) {
+		if (value & 1) {
+			gpu.immediateModeAttrIndex = 0;
+			gpu.immediateModeVertices.clear();
 		}
+	};
 
-		case VertexFloatUniformIndex:
-			shaderUnit.vs.setFloatUniformIndex(value);
-			break;
+	setHandlers(FixedAttribData0, FixedAttribData2, [](GPU& gpu, u32 index, u32 value) { gpu.uploadFixedAttribute(value); });
 
-		case VertexFloatUniformData0: case VertexFloatUniformData1: case VertexFloatUniformData2:
-		case VertexFloatUniformData3: case VertexFloatUniformData4: case VertexFloatUniformData5:
-		case VertexFloatUniformData6: case VertexFloatUniformData7:
-			shaderUnit.vs.uploadFloatUniform(value);
-			break;
+	handlers[VertexShaderOpDescriptorIndex] = [](GPU& gpu, u32 index, u32 value) { gpu.shaderUnit.vs.setOpDescriptorIndex(value); };
+
+	setHandlers(VertexShaderOpDescriptorData0, VertexShaderOpDescriptorData7, [](GPU& gpu, u32 index, u32 value) {
+		gpu.shaderUnit.vs.uploadDescriptor(value);
+	});
+
+	handlers[VertexBoolUniform] = [](GPU& gpu, u32 index, u32 value) { gpu.shaderUnit.vs.boolUniform = value & 0xffff; };
 
-		case FixedAttribIndex:
-			fixedAttribCount = 0;
-			fixedAttribIndex = value & 0xf;
+	setHandlers(VertexIntUniform0, VertexIntUniform3, [](GPU& gpu, u32 index, u32 value) {
+		gpu.shaderUnit.vs.uploadIntUniform(index - VertexIntUniform0, value);
+	});
 
-			if (fixedAttribIndex == 0xf) {
-				log("[PICA] Immediate mode vertex submission enabled");
+	setHandlers(VertexShaderData0, VertexShaderData7, [](GPU& gpu, u32 index, u32 value) { gpu.shaderUnit.vs.uploadWord(value); });
+
+	handlers[VertexShaderEntrypoint] = [](GPU& gpu, u32 index, u32 value) { gpu.shaderUnit.vs.setEntrypoint(value & 0xffff); };
+
+	handlers[VertexShaderTransferEnd] = [](GPU& gpu, u32 index, u32 value) {
+		if (value != 0) gpu.shaderUnit.vs.finalize();
+	};
+
+	handlers[VertexShaderTransferIndex] = [](GPU& gpu, u32 index, u32 value) { gpu.shaderUnit.vs.setBufferIndex(value); };
+
+	// Command lists can write to the command processor registers and change the command list stream
+	// Several games are known to do this, including New Super Mario Bros 2 and Super Mario 3D Land
+	setHandlers(CmdBufTrigger0, CmdBufTrigger1, [](GPU& gpu, u32 index, u32 value) {
+		if (value != 0) { // A non-zero value triggers command list processing
+			int bufferIndex = index - CmdBufTrigger0; // Index of the command buffer to execute (0 or 1)
+			u32 addr = (gpu.regs[CmdBufAddr0 + bufferIndex] & 0xfffffff) << 3;
+			u32 size = (gpu.regs[CmdBufSize0 + bufferIndex] & 0xfffff) << 3;
+			gpu.captureMemory(addr, size);
+
+			// Set command buffer state to execute the new buffer
+			gpu.cmdBuffStart = gpu.getPointerPhys<u32>(addr);
+			gpu.cmdBuffCurr = gpu.cmdBuffStart;
+			gpu.cmdBuffEnd = gpu.cmdBuffStart + (size / sizeof(u32));
+		}
+	});
+
+	return handlers;
+}
+
+void GPU::uploadFixedAttribute(u32 value) {
+	fixedAttrBuff[fixedAttribCount++] = value;
+
+	if (fixedAttribCount == 3) {
+		fixedAttribCount = 0;
+
+		vec4f attr;
+		// These are stored in the reverse order anyone would expect them to be in
+		attr.x() = f24::fromRaw(fixedAttrBuff[2] & 0xffffff);
+		attr.y() = f24::fromRaw(((fixedAttrBuff[1] & 0xffff) << 8) | (fixedAttrBuff[2] >> 24));
+		attr.z() = f24::fromRaw(((fixedAttrBuff[0] & 0xff) << 16) | (fixedAttrBuff[1] >> 16));
+		attr.w() = f24::fromRaw(fixedAttrBuff[0] >> 8);
+
+		// If the fixed attribute index is < 12, we're just writing to one of the fixed attributes
+		if (fixedAttribIndex < 12) [[likely]] {
+			shaderUnit.vs.fixedAttributes[fixedAttribIndex++] = attr;
+		} else if (fixedAttribIndex == 15) { // Otherwise if it's 15, we're submitting an immediate mode vertex
+			const uint totalAttrCount = (regs[PICAInternalRegs::VertexShaderAttrNum] & 0xf) + 1;
+			if (totalAttrCount <= immediateModeAttrIndex) {
+				printf("Broken state in the immediate mode vertex submission pipeline. Failing silently\n");
 				immediateModeAttrIndex = 0;
-				immediateModeVertIndex = 0;
+				immediateModeVertices.clear();
 			}
-			break;
 
-		// Restart immediate mode primitive drawing
-		case PrimitiveRestart:
-			if (value & 1) {
+			immediateModeAttributes[immediateModeAttrIndex++] = attr;
+			if (immediateModeAttrIndex == totalAttrCount) {
 				immediateModeAttrIndex = 0;
-				immediateModeVertIndex = 0;
-			}
-			break;
+				immediateModeVertices.push_back(getImmediateModeVertex());
+				immediateModePending = true;
 
-		case FixedAttribData0: case FixedAttribData1: case FixedAttribData2:
-			fixedAttrBuff[fixedAttribCount++] = value;
-
-			if (fixedAttribCount == 3) {
-				fixedAttribCount = 0;
-
-				vec4f attr;
-				// These are stored in the reverse order anyone would expect them to be in
-				attr.x() = f24::fromRaw(fixedAttrBuff[2] & 0xffffff);
-				attr.y() = f24::fromRaw(((fixedAttrBuff[1] & 0xffff) << 8) | (fixedAttrBuff[2] >> 24));
-				attr.z() = f24::fromRaw(((fixedAttrBuff[0] & 0xff) << 16) | (fixedAttrBuff[1] >> 16));
-				attr.w() = f24::fromRaw(fixedAttrBuff[0] >> 8);
-
-				// If the fixed attribute index is < 12, we're just writing to one of the fixed attributes
-				if (fixedAttribIndex < 12) [[likely]] {
-					shaderUnit.vs.fixedAttributes[fixedAttribIndex++] = attr;
-				} else if (fixedAttribIndex == 15) { // Otherwise if it's 15, we're submitting an immediate mode vertex
-					const uint totalAttrCount = (regs[PICAInternalRegs::VertexShaderAttrNum] & 0xf) + 1;
-					if (totalAttrCount <= immediateModeAttrIndex) {
-						printf("Broken state in the immediate mode vertex submission pipeline. Failing silently\n");
-						immediateModeAttrIndex = 0;
-						immediateModeVertIndex = 0;
-					}
-
-					immediateModeAttributes[immediateModeAttrIndex++] = attr;
-					if (immediateModeAttrIndex == totalAttrCount) {
-						Vertex v = getImmediateModeVertex();
-						immediateModeAttrIndex = 0;
-						immediateModeVertices[immediateModeVertIndex++] = v;
-
-						// Get primitive type
-						const u32 primConfig = regs[PICAInternalRegs::PrimitiveConfig];
-						const u32 primType = getBits<8, 2>(primConfig);
-
-						// If we've reached 3 verts, issue a draw call
-						// Handle rendering depending on the primitive type
-						if (immediateModeVertIndex == 3) {
-							renderer.drawVertices(OpenGL::Triangle, &immediateModeVertices[0], 3);
-
-							switch (primType) {
-								// Triangle or geometry primitive. Draw a triangle and discard all vertices
-								case 0: case 3:
-									immediateModeVertIndex = 0;
-									break;
-
-								// Triangle strip. Draw triangle, discard first vertex and keep the last 2
-								case 1:
-									immediateModeVertIndex = 2;
-
-									immediateModeVertices[0] = immediateModeVertices[1];
-									immediateModeVertices[1] = immediateModeVertices[2];
-									break;
-
-								// Triangle fan. Draw triangle, keep first vertex and last vertex, discard second vertex
-								case 2:
-									immediateModeVertIndex = 2;
-									immediateModeVertices[1] = immediateModeVertices[2];
-									break;
-							}
-						}
-					}
-				} else { // Writing to fixed attributes 13 and 14 probably does nothing, but we'll see
-					log("Wrote to invalid fixed vertex attribute %d\n", fixedAttribIndex);
+				// Don't outgrow the renderer's vertex buffer. The buffer size is even, which keeps strips from flipping winding
+				if (immediateModeVertices.size() == Renderer::vertexBufferSize) {
+					flushImmediateModeVertices(false);
 				}
 			}
+		} else { // Writing to fixed attributes 13 and 14 probably does nothing, but we'll see
+			log("Wrote to invalid fixed vertex attribute %d\n", fixedAttribIndex);
+		}
+	}
+}
 
-			break;
+// Draw the batched immediate mode vertices. Unless the primitive is being restarted, the vertices the rest of the primitive still
+// needs are kept around, so that the next batch can pick up where this one left off
+void GPU::flushImmediateModeVertices(bool restart) {
+	TRACE_SCOPE("GPU::flushImmediateModeVertices");
+	immediateModePending = false;
+	auto& batch = immediateModeVertices;
+
+	// Triangle, triangle strip, triangle fan. The fourth type is "geometry primitive", which we treat as a triangle list like drawArrays
+	const u32 primType = getBits<8, 2>(regs[PICAInternalRegs::PrimitiveConfig]);
+	const size_t count = batch.size();
+
+	switch (primType) {
+		case 1: // Triangle strip
+			if (count >= 3) {
+				renderer.drawVertices(OpenGL::TriangleStrip, batch.data(), count);
+			}
 
-		case VertexShaderOpDescriptorIndex:
-			shaderUnit.vs.setOpDescriptorIndex(value);
+			if (restart) {
+				batch.clear();
+			} else if (count >= 3) {
+				// The last 2 vertices start the next batch. If an odd number of vertices was drawn, the next triangle has the opposite
+				// winding of the strip's first, so pad the batch with a degenerate triangle to keep the strip's winding where it was
+				const Vertex a = batch[count - 2];
+				const Vertex b = batch[count - 1];
+				batch.clear();
+				if (count % 2 != 0) {
+					batch.push_back(a);
+				}
+				batch.push_back(a);
+				batch.push_back(b);
+			}
 			break;
 
-		case VertexShaderOpDescriptorData0: case VertexShaderOpDescriptorData1: case VertexShaderOpDescriptorData2:
-		case VertexShaderOpDescriptorData3: case VertexShaderOpDescriptorData4: case VertexShaderOpDescriptorData5:
-		case VertexShaderOpDescriptorData6: case VertexShaderOpDescriptorData7:
-			shaderUnit.vs.uploadDescriptor(value);
-			break;
+		case 2: // Triangle fan
+			if (count >= 3) {
+				renderer.drawVertices(OpenGL::TriangleFan, batch.data(), count);
+			}
 
-		case VertexBoolUniform:
-			shaderUnit.vs.boolUniform = value & 0xffff;
+			if (restart) {
+				batch.clear();
+			} else if (count >= 3) {
+				// Keep the centre of the fan & its last vertex
+				batch[1] = batch[count - 1];
+				batch.resize(2);
+			}
 			break;
 
-		case VertexIntUniform0: case VertexIntUniform1: case VertexIntUniform2: case VertexIntUniform3:
-			shaderUnit.vs.uploadIntUniform(index - VertexIntUniform0, value);
-			break;
+		default: { // Triangle list. Leftover vertices that don't make a full triangle yet wait for the next batch
+			const size_t drawCount = count - (count % 3);
+			if (drawCount != 0) {
+				renderer.drawVertices(OpenGL::Triangle, batch.data(), drawCount);
+			}
 
-		case VertexShaderData0: case VertexShaderData1: case VertexShaderData2: case VertexShaderData3:
-		case VertexShaderData4: case VertexShaderData5: case VertexShaderData6: case VertexShaderData7:
-			shaderUnit.vs.uploadWord(value);
+			if (restart) {
+				batch.clear();
+			} else {
+				batch.erase(batch.begin(), batch.begin() + drawCount);
+			}
 			break;
+		}
+	}
+}
 
-		case VertexShaderEntrypoint:
-			shaderUnit.vs.entrypoint = value & 0xffff;
-			break;
+// Shader code, operand descriptors & float uniforms are uploaded by writing every word to the same data register (or sweeping
+// over the data registers in consecutive mode), so command lists are full of long runs of writes to them. Those get handed to the
+// shader unit in one go instead of going through the handler table word by word
+u32 GPU::getStreamLength(u32 index, u32 count, bool consecutive) {
+	using namespace PICAInternalRegs;
 
-		case VertexShaderTransferEnd:
-			if (value != 0) shaderUnit.vs.finalize();
-			break;
+	// Work out which stream the register belongs to & where its data registers end
+	u32 lastDataReg;
+	if (index >= VertexShaderData0 && index <= VertexShaderData7) {
+		lastDataReg = VertexShaderData7;
+	} else if (index >= VertexShaderOpDescriptorData0 && index <= VertexShaderOpDescriptorData7) {
+		lastDataReg = VertexShaderOpDescriptorData7;
+	} else if (index >= VertexFloatUniformData0 && index <= VertexFloatUniformData7) {
+		lastDataReg = VertexFloatUniformData7;
+	} else {
+		return 0;
+	}
 
-		case VertexShaderTransferIndex:
-			shaderUnit.vs.setBufferIndex(value);
-			break;
+	// In consecutive mode, only the writes that land on the data registers are part of the stream
+	return consecutive ? std::min(count, lastDataReg - index + 1) : count;
+}
 
-		// Command lists can write to the command processor registers and change the command list stream
-		// Several games are known to do this, including New Super Mario Bros 2 and Super Mario 3D Land
-		case CmdBufTrigger0:
-		case CmdBufTrigger1: {
-			if (value != 0) { // A non-zero value triggers command list processing
-				int bufferIndex = index - CmdBufTrigger0; // Index of the command buffer to execute (0 or 1)
-				u32 addr = (regs[CmdBufAddr0 + bufferIndex] & 0xfffffff) << 3;
-				u32 size = (regs[CmdBufSize0 + bufferIndex] & 0xfffff) << 3;
-
-				// Set command buffer state to execute the new buffer
-				cmdBuffStart = getPointerPhys<u32>(addr);
-				cmdBuffCurr = cmdBuffStart;
-				cmdBuffEnd = cmdBuffStart + (size / sizeof(u32));
-			}
-			break;
-		}
+u32 GPU::writeStreamingRegs(u32 index, const u32* values, u32 count, bool consecutive) {
+	using namespace PICAInternalRegs;
 
-		default:
-			// Vertex attribute registers
-			if (index >= AttribInfoStart && index <= AttribInfoEnd) {
-				uint attributeIndex = (index - AttribInfoStart) / 3; // Which attribute are we writing to
-				uint reg = (index - AttribInfoStart) % 3; // Which of this attribute's registers are we writing to?
-				auto& attr = attributeInfo[attributeIndex];
-
-				switch (reg) {
-					case 0: attr.offset = value & 0xfffffff; break; // Attribute offset
-					case 1: 
-						attr.config1 = value;
-						break;
-					case 2:
-						attr.config2 = value;
-						attr.size = getBits<16, 8>(value);
-						attr.componentCount = value >> 28;
-						break;
-				}
-			} else {
-				log("GPU: Wrote to unimplemented internal reg: %X, value: %08X\n", index, newValue);
-			}
-			break;
+	count = getStreamLength(index, count, consecutive);
+	if (count == 0) {
+		return 0;
 	}
-}
 
-void GPU::startCommandList(u32 addr, u32 size) {
-	cmdBuffStart = static_cast<u32*>(mem.getReadPointer(addr));
-	if (!cmdBuffStart) Helpers::panic("Couldn't get buffer for command list");
-	// TODO: This is very memory unsafe. We get a pointer to FCRAM and just keep writing without checking if we're gonna go OoB
+	if (immediateModePending) [[unlikely]] {
+		flushImmediateModeVertices(false);
+	}
 
-	cmdBuffCurr = cmdBuffStart;
-	cmdBuffEnd = cmdBuffStart + (size / sizeof(u32));
+	if (consecutive) {
+		for (u32 i = 0; i < count; i++) {
+			regs[index + i] = values[i];
+		}
+	} else {
+		regs[index] = values[count - 1];
+	}
 
+	if (index >= VertexShaderData0 && index <= VertexShaderData7) {
+		shaderUnit.vs.uploadWords(values, count);
+	} else if (index >= VertexShaderOpDescriptorData0 && index <= VertexShaderOpDescriptorData7) {
+		shaderUnit.vs.uploadDescriptors(values, count);
+	} else {
+		shaderUnit.vs.uploadFloatUniforms(values, count);
+	}
+
+	return count;
+}
+
+namespace {
 	// LUT for converting the parameter mask to an actual 32-bit mask
 	// The parameter mask is 4 bits long, each bit corresponding to one byte of the mask
 	// If the bit is 0 then the corresponding mask byte is 0, otherwise the mask byte is 0xff
 	// So for example if the parameter mask is 0b1001, the full mask is 0xff'00'00'ff
-	static constexpr std::array<u32, 16> maskLUT = {
+	constexpr std::array<u32, 16> maskLUT = {
 		0x00000000, 0x000000ff, 0x0000ff00, 0x0000ffff, 0x00ff0000, 0x00ff00ff, 0x00ffff00, 0x00ffffff,
 		0xff000000, 0xff0000ff, 0xff00ff00, 0xff00ffff, 0xffff0000, 0xffff00ff, 0xffffff00, 0xffffffff,
 	};
 
+	// Writing a non-zero value to one of the trigger registers makes the command processor jump to another command list
+	bool isCommandListJump(u32 index, u32 value) {
+		using namespace PICAInternalRegs;
+		return (index == CmdBufTrigger0 || index == CmdBufTrigger1) && value != 0;
+	}
+}
+
+void GPU::startCommandList(u32 paddr, u32 size) {
+	TRACE_SCOPE("GPU::startCommandList");
+
+	const bool capturing = capture.isRunning();
+	if (capturing) [[unlikely]] {
+		captureMemory(paddr, size);
+	}
+
+	// TODO: This is very memory unsafe. We get a pointer to FCRAM and just keep writing without checking if we're gonna go OoB
+	cmdBuffStart = getPointerPhys<u32>(paddr);
+	cmdBuffCurr = cmdBuffStart;
+	cmdBuffEnd = cmdBuffStart + (size / sizeof(u32));
+
+	// Replay the decoded version of the list. If it jumps to another list, the jump points cmdBuffStart & co at it, and we go again
+	while (cmdBuffCurr < cmdBuffEnd) {
+		const u32* listStart = cmdBuffStart;
+		const DecodedCommandList& decoded = getDecodedCommandList(cmdBuffStart, cmdBuffEnd);
+
+		if (!decoded.cacheable) [[unlikely]] {
+			runCommandList();
+			break;
+		}
+
+		replayCommandList(decoded, listStart);
+		if (!decoded.endsWithJump) {
+			break;
+		}
+	}
+
+	// Immediate mode vertices can't be left waiting for the next list, as memory fills & display transfers might need them drawn
+	if (immediateModePending) [[unlikely]] {
+		flushImmediateModeVertices(false);
+	}
+
+	if (capturing) [[unlikely]] {
+		capture.recordCommandList(paddr, size);
+	}
+}
+
+const DecodedCommandList& GPU::getDecodedCommandList(const u32* start, const u32* end) {
+	// The decoded list only depends on the contents of the list, not where it lives, so identical lists can share an entry
+	const size_t size = (end - start) * sizeof(u32);
+	u64 hash = std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(start), size));
+	hash ^= u64(size) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+
+	if (auto cached = commandListCache.find(hash); cached != nullptr) {
+		return *cached;
+	}
+
+	return commandListCache.insert(hash, decodeCommandList(start, end));
+}
+
+DecodedCommandList GPU::decodeCommandList(const u32* start, const u32* end) {
+	DecodedCommandList list;
+	const u32* curr = start;
+	bool done = false;
+
+	// Add a write to the list. Returns false if it's a jump, after which nothing else in the list is executed
+	const auto addWrite = [&](u32 index, u32 value, u32 mask) {
+		list.writes.push_back({index, value, mask, 0, false});
+		return !isCommandListJump(index, value);
+	};
+
+	while (!done && curr < end) {
+		// Same parsing as in runCommandList, see there for details
+		if ((curr - start) % 2 != 0) {
+			curr++;
+		}
+
+		// Commands that stick out past the end of the list would be read from memory that isn't part of the hash
+		if (end - curr < 2) {
+			list.cacheable = false;
+			break;
+		}
+
+		const u32 param1 = *curr++;
+		const u32 header = *curr++;
+
+		u32 id = header & 0xffff;
+		const u32 mask = maskLUT[getBits<16, 4>(header)];
+		const u32 paramCount = getBits<20, 8>(header);
+		const bool consecutiveWritingMode = (header >> 31) != 0;
+		const u32 idIncrement = (consecutiveWritingMode) ? 1 : 0;
+
+		// Out of bounds writes panic, so leave those to the regular command processor as well
+		if (u32(end - curr) < paramCount || id + paramCount * idIncrement >= regNum) {
+			list.cacheable = false;
+			break;
+		}
+
+		const u32* params = curr;
+		curr += paramCount;
+
+		if (!addWrite(id, param1, mask)) {
+			// Jumping in the middle of a command makes the rest of its parameters come from the new list. Don't even try
+			list.endsWithJump = (paramCount == 0);
+			list.cacheable = list.endsWithJump;
+			break;
+		}
+
+		id += idIncrement;
+		u32 i = 0;
+		if (mask == 0xffffffff && paramCount != 0) {
+			const u32 streamed = getStreamLength(id, paramCount, consecutiveWritingMode);
+			if (streamed != 0) {
+				list.writes.push_back({id, u32(params - start), mask, streamed, consecutiveWritingMode});
+				id += streamed * idIncrement;
+				i = streamed;
+			}
+		}
+
+		for (; i < paramCount; i++) {
+			if (!addWrite(id, params[i], mask)) {
+				list.endsWithJump = (i == paramCount - 1);
+				list.cacheable = list.endsWithJump;
+				done = true;
+				break;
+			}
+
+			id += idIncrement;
+		}
+	}
+
+	return list;
+}
+
+void GPU::replayCommandList(const DecodedCommandList& list, const u32* start) {
+	for (const auto& write : list.writes) {
+		if (write.streamCount == 0) [[likely]] {
+			writeInternalReg(write.index, write.value, write.mask);
+		} else {
+			writeStreamingRegs(write.index, start + write.value, write.streamCount, write.consecutive);
+		}
+	}
+}
+
+// Parse & execute the command list cmdBuffCurr points to directly, for lists we can't cache
+void GPU::runCommandList() {
 	while (cmdBuffCurr < cmdBuffEnd) {
 		// If the buffer is not aligned to an 8 byte boundary, force align it by moving the pointer up a word
 		// The curr pointer starts out doubleword-aligned and is increased by 4 bytes each time
@@ -308,10 +548,23 @@ void GPU::startCommandList(u32 addr, u32 size) {
 		u32 idIncrement = (consecutiveWritingMode) ? 1 : 0;
 
 		writeInternalReg(id, param1, mask);
+		if (paramCount == 0) {
+			continue;
+		}
+
+		// Runs of writes to the shader upload registers get handled in bulk. Masked writes are rare there, so leave them to the slow path
+		id += idIncrement;
+		if (mask == 0xffffffff) {
+			const u32 streamed = writeStreamingRegs(id, cmdBuffCurr, paramCount, consecutiveWritingMode);
+			cmdBuffCurr += streamed;
+			paramCount -= streamed;
+			id += streamed * idIncrement;
+		}
+
 		for (u32 i = 0; i < paramCount; i++) {
-			id += idIncrement;
 			u32 param = *cmdBuffCurr++;
 			writeInternalReg(id, param, mask);
+			id += idIncrement;
 		}
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,495 @@
+#include "PICA/shader_batch.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace {
+	// PICA gives 0 instead of NaN when multiplying 0 by inf, see Floats::Float::operator*
+	inline float picaMul(float a, float b) {
+		const float result = a * b;
+		return (std::isnan(result) && !std::isnan(a) && !std::isnan(b)) ? 0.0f : result;
+	}
+}
+
+void PICABatchShader::setInputs(int lane, const std::array<vec4f, 16>& in) {
+	for (int reg = 0; reg < 16; reg++) {
+		const float* values = reinterpret_cast<const float*>(&in[reg]);
+		for (int comp = 0; comp < 4; comp++) {
+			inputs[reg].components[comp][lane] = values[comp];
+		}
+	}
+}
+
+void PICABatchShader::getInputs(int lane, std::array<vec4f, 16>& out) const {
+	for (int reg = 0; reg < 16; reg++) {
+		float* values = reinterpret_cast<float*>(&out[reg]);
+		for (int comp = 0; comp < 4; comp++) {
+			values[comp] = inputs[reg].components[comp][lane];
+		}
+	}
+}
+
+PICABatchShader::vec4f PICABatchShader::getOutput(int lane, int index) const {
+	vec4f ret;
+	float* values = reinterpret_cast<float*>(&ret);
+	for (int comp = 0; comp < 4; comp++) {
+		values[comp] = outputs[index].components[comp][lane];
+	}
+
+	return ret;
+}
+
+bool PICABatchShader::run(PICAShader& shaderUnit, int count) {
+	if (shaderUnit.decodeDirty) [[unlikely]] {
+		shaderUnit.decode();
+	}
+
+	shader = &shaderUnit;
+	liveLanes = activeLanes = (1u << count) - 1;
+	pc = shaderUnit.entrypoint;
+	loopIndex = ifIndex = callIndex = 0;
+	cmpX = shaderUnit.cmpRegister[0] ? allLanes : 0;
+	cmpY = shaderUnit.cmpRegister[1] ? allLanes : 0;
+	addrRegisters[0].fill(shaderUnit.addrRegister.x());
+	addrRegisters[1].fill(shaderUnit.addrRegister.y());
+	addrRegisters[2].fill(s32(shaderUnit.loopCounter));
+
+	// Well-behaved shaders never read temporaries or outputs before writing them, but some do, so broadcast the scalar unit's
+	for (int reg = 0; reg < 16; reg++) {
+		const float* temp = reinterpret_cast<const float*>(&shaderUnit.tempRegisters[reg]);
+		const float* output = reinterpret_cast<const float*>(&shaderUnit.outputs[reg]);
+
+		for (int comp = 0; comp < 4; comp++) {
+			for (int lane = 0; lane < laneCount; lane++) {
+				tempRegisters[reg].components[comp][lane] = temp[comp];
+				outputs[reg].components[comp][lane] = output[comp];
+			}
+		}
+	}
+
+	const auto& program = shaderUnit.decodedProgram->instructions;
+	while (true) {
+		const DecodedInstruction& instruction = program[pc++];
+
+		switch (instruction.opcode) {
+			case ShaderOpcodes::ADD: binaryOp(instruction, [](float a, float b) { return a + b; }); break;
+			case ShaderOpcodes::MUL: binaryOp(instruction, picaMul); break;
+			case ShaderOpcodes::MAX: binaryOp(instruction, [](float a, float b) { return a > b ? a : b; }); break;
+			case ShaderOpcodes::MIN: binaryOp(instruction, [](float a, float b) { return a < b ? a : b; }); break;
+			case ShaderOpcodes::SLT: case ShaderOpcodes::SLTI:
+				binaryOp(instruction, [](float a, float b) { return a < b ? 1.0f : 0.0f; });
+				break;
+			case ShaderOpcodes::SGEI: binaryOp(instruction, [](float a, float b) { return a >= b ? 1.0f : 0.0f; }); break;
+			case ShaderOpcodes::MOV: unaryOp(instruction, [](float a) { return a; }); break;
+			case ShaderOpcodes::FLR: unaryOp(instruction, [](float a) { return std::floor(a); }); break;
+			case ShaderOpcodes::DP3: dotProduct<3>(instruction); break;
+			case ShaderOpcodes::DP4: dotProduct<4>(instruction); break;
+			case ShaderOpcodes::RCP: scalarOp(instruction, [](float a) { return 1.0f / a; }); break;
+			case ShaderOpcodes::RSQ: scalarOp(instruction, [](float a) { return 1.0f / std::sqrt(a); }); break;
+			case ShaderOpcodes::MAD: case ShaderOpcodes::MADI: mad(instruction); break;
+			case ShaderOpcodes::MOVA: mova(instruction); break;
+			case ShaderOpcodes::CMP1: case ShaderOpcodes::CMP2: cmp(instruction); break;
+			case ShaderOpcodes::NOP: break;
+
+			case ShaderOpcodes::END:
+				// If only some of the lanes got here, the rest would need to keep going on their own
+				if (activeLanes != liveLanes) {
+					return false;
+				}
+
+				writeBack(shaderUnit, count - 1);
+				return true;
+
+			case ShaderOpcodes::IFU:
+				if (shaderUnit.boolUniform & (1 << instruction.uniformIndex)) {
+					pushIf(instruction, activeLanes);
+				} else {
+					pc = instruction.target;
+				}
+				break;
+
+			case ShaderOpcodes::IFC: {
+				const LaneMask taken = evaluateCondition(instruction);
+				if (taken != 0) {
+					pushIf(instruction, taken);
+				} else {
+					pc = instruction.target;
+				}
+				break;
+			}
+
+			case ShaderOpcodes::CALL: call(instruction, activeLanes); break;
+			case ShaderOpcodes::CALLC: {
+				const LaneMask taken = evaluateCondition(instruction);
+				if (taken != 0) {
+					call(instruction, taken);
+				}
+				break;
+			}
+
+			case ShaderOpcodes::CALLU:
+				if (shaderUnit.boolUniform & (1 << instruction.uniformIndex)) {
+					call(instruction, activeLanes);
+				}
+				break;
+
+			case ShaderOpcodes::LOOP: loop(instruction); break;
+
+			case ShaderOpcodes::JMPU: {
+				const bool set = (shaderUnit.boolUniform >> instruction.uniformIndex) & 1;
+				if (set == instruction.jumpIfSet) {
+					pc = instruction.target;
+				}
+				break;
+			}
+
+			case ShaderOpcodes::JMPC: {
+				const LaneMask taken = evaluateCondition(instruction);
+				if (taken == activeLanes) {
+					pc = instruction.target;
+				} else if (taken != 0) {
+					return false; // Lanes want to go separate ways with no way to join back up
+				}
+				break;
+			}
+
+			default: return false; // Let the interpreter complain about it
+		}
+
+		if ((loopIndex | ifIndex | callIndex) != 0) {
+			handleControlFlow();
+		}
+
+		// Ran off the end of shader memory. Leave it to the regular interpreter
+		if (pc >= program.size()) [[unlikely]] {
+			return false;
+		}
+	}
+}
+
+// Leave the scalar unit's registers the way the last vertex of the batch left them, as if the vertices had been run back to back.
+// The next batch gets seeded from them, and so does the scalar interpreter if it has to take over
+void PICABatchShader::writeBack(PICAShader& shaderUnit, int lane) const {
+	for (int reg = 0; reg < 16; reg++) {
+		float* temp = reinterpret_cast<float*>(&shaderUnit.tempRegisters[reg]);
+		float* output = reinterpret_cast<float*>(&shaderUnit.outputs[reg]);
+
+		for (int comp = 0; comp < 4; comp++) {
+			temp[comp] = tempRegisters[reg].components[comp][lane];
+			output[comp] = outputs[reg].components[comp][lane];
+		}
+	}
+
+	shaderUnit.addrRegister.x() = addrRegisters[0][lane];
+	shaderUnit.addrRegister.y() = addrRegisters[1][lane];
+	shaderUnit.loopCounter = u32(addrRegisters[2][lane]);
+	shaderUnit.cmpRegister[0] = (cmpX >> lane) & 1;
+	shaderUnit.cmpRegister[1] = (cmpY >> lane) & 1;
+}
+
+// Same as PICAShader::handleControlFlow, except blocks also restore the lanes that were active when they started
+void PICABatchShader::handleControlFlow() {
+	if (loopIndex != 0) {
+		auto& loop = loopInfo[loopIndex - 1];
+		if (pc == loop.endingPC) {
+			loop.iterations -= 1;
+			for (int lane = 0; lane < laneCount; lane++) {
+				if (activeLanes & (1u << lane)) {
+					addrRegisters[2][lane] += loop.increment;
+				}
+			}
+
+			if (loop.iterations == 0)
+				loopIndex -= 1;
+			else
+				pc = loop.startingPC;
+		}
+	}
+
+	if (ifIndex != 0) {
+		auto& info = conditionalInfo[ifIndex - 1];
+		if (pc == info.endingPC) {
+			// If the lanes diverged, the ones that skipped the if block now run the else block, which starts right here
+			if (info.elseMask != 0 && info.endingPC != info.newPC) {
+				activeLanes = info.elseMask;
+				info.elseMask = 0;
+				info.endingPC = info.newPC;
+			} else {
+				pc = info.newPC;
+				activeLanes = info.savedMask;
+				ifIndex -= 1;
+			}
+		}
+	}
+
+	if (callIndex != 0) {
+		auto& info = callInfo[callIndex - 1];
+		if (pc == info.endingPC) {
+			pc = info.returnPC;
+			activeLanes = info.savedMask;
+			callIndex -= 1;
+		}
+	}
+}
+
+void PICABatchShader::pushIf(const DecodedInstruction& instruction, LaneMask taken) {
+	if (ifIndex >= 8) [[unlikely]]
+		Helpers::panic("[PICA] Overflowed IF stack");
+
+	auto& block = conditionalInfo[ifIndex++];
+	block.endingPC = instruction.target;
+	block.newPC = instruction.endPC;
+	block.savedMask = activeLanes;
+	block.elseMask = activeLanes & ~taken;
+	activeLanes = taken;
+}
+
+void PICABatchShader::call(const DecodedInstruction& instruction, LaneMask taken) {
+	if (callIndex >= 4) [[unlikely]]
+		Helpers::panic("[PICA] Overflowed CALL stack");
+
+	auto& block = callInfo[callIndex++];
+	block.endingPC = instruction.endPC;
+	block.returnPC = pc;
+	block.savedMask = activeLanes;
+
+	activeLanes = taken;
+	pc = instruction.target;
+}
+
+void PICABatchShader::loop(const DecodedInstruction& instruction) {
+	if (loopIndex >= 4) [[unlikely]]
+		Helpers::panic("[PICA] Overflowed loop stack");
+
+	auto& uniform = shader->intUniforms[instruction.uniformIndex];
+	for (int lane = 0; lane < laneCount; lane++) {
+		if (activeLanes & (1u << lane)) {
+			addrRegisters[2][lane] = uniform.y();
+		}
+	}
+
+	auto& loop = loopInfo[loopIndex++];
+
+	loop.startingPC = pc;
+	loop.endingPC = instruction.endPC;
+	loop.iterations = uniform.x() + 1;
+	loop.increment = uniform.z();
+}
+
+// Returns the active lanes for which the IFC/CALLC/JMPC condition is true
+PICABatchShader::LaneMask PICABatchShader::evaluateCondition(const DecodedInstruction& instruction) {
+	const LaneMask matchX = instruction.refX ? cmpX : ~cmpX;
+	const LaneMask matchY = instruction.refY ? cmpY : ~cmpY;
+	LaneMask ret;
+
+	switch (instruction.condition) {
+		case 0: ret = matchX | matchY; break;
+		case 1: ret = matchX & matchY; break;
+		case 2: ret = matchX; break;
+		default: ret = matchY; break;
+	}
+
+	return ret & activeLanes;
+}
+
+// Read one component of a register for a single lane. Used for relative addressing, as the offset can differ between lanes
+float PICABatchShader::readComponent(u32 source, int component, int lane) {
+	if (source < 0x10)
+		return inputs[source].components[component][lane];
+	else if (source < 0x20)
+		return tempRegisters[source - 0x10].components[component][lane];
+	else if (source <= 0x7f)
+		return reinterpret_cast<const float*>(&shader->floatUniforms[source - 0x20])[component];
+
+	Helpers::warn("[PICA] Unimplemented source value: %X\n", source);
+	return 0.0f;
+}
+
+void PICABatchShader::loadSource(Register& out, const DecodedInstruction& instruction, int n) {
+	const u32 source = instruction.src[n];
+	const u32 swizzle = instruction.swizzle[n];
+	// Relative addressing only applies to float uniforms
+	const u32 index = (n == instruction.indexedSource && source >= 0x20) ? instruction.index : 0;
+
+	if (index != 0) {
+		const auto& addr = addrRegisters[index - 1];
+		for (int comp = 0; comp < 4; comp++) {
+			const int selector = (swizzle >> (comp * 2)) & 3;
+			for (int lane = 0; lane < laneCount; lane++) {
+				out.components[comp][lane] = readComponent(u8(source + addr[lane]), selector, lane);
+			}
+		}
+	} else if (source < 0x20) {
+		const Register& reg = (source < 0x10) ? inputs[source] : tempRegisters[source - 0x10];
+		for (int comp = 0; comp < 4; comp++) {
+			std::memcpy(out.components[comp], reg.components[(swizzle >> (comp * 2)) & 3], sizeof(out.components[comp]));
+		}
+	} else {
+		// Uniforms are the same for every lane
+		for (int comp = 0; comp < 4; comp++) {
+			const float value = readComponent(source, (swizzle >> (comp * 2)) & 3, 0);
+			for (int lane = 0; lane < laneCount; lane++) {
+				out.components[comp][lane] = value;
+			}
+		}
+	}
+
+	if (instruction.negateMask & (1 << n)) {
+		for (int comp = 0; comp < 4; comp++) {
+			for (int lane = 0; lane < laneCount; lane++) {
+				out.components[comp][lane] = -out.components[comp][lane];
+			}
+		}
+	}
+}
+
+void PICABatchShader::storeDest(const DecodedInstruction& instruction, const Register& value) {
+	const u32 dest = instruction.dest;
+	Register* destReg;
+	if (dest < 0x10) {
+		destReg = &outputs[dest];
+	} else if (dest < 0x20) {
+		destReg = &tempRegisters[dest - 0x10];
+	} else {
+		Helpers::panic("[PICA] Unimplemented dest: %X", dest);
+	}
+
+	for (int comp = 0; comp < 4; comp++) {
+		if ((instruction.componentMask & (8 >> comp)) == 0) continue;
+
+		if (activeLanes == allLanes) [[likely]] {
+			std::memcpy(destReg->components[comp], value.components[comp], sizeof(value.components[comp]));
+		} else {
+			for (int lane = 0; lane < laneCount; lane++) {
+				if (activeLanes & (1u << lane)) {
+					destReg->components[comp][lane] = value.components[comp][lane];
+				}
+			}
+		}
+	}
+}
+
+template <typename Func>
+void PICABatchShader::binaryOp(const DecodedInstruction& instruction, Func func) {
+	Register src1, src2, result;
+	loadSource(src1, instruction, 0);
+	loadSource(src2, instruction, 1);
+
+	for (int comp = 0; comp < 4; comp++) {
+		for (int lane = 0; lane < laneCount; lane++) {
+			result.components[comp][lane] = func(src1.components[comp][lane], src2.components[comp][lane]);
+		}
+	}
+
+	storeDest(instruction, result);
+}
+
+template <typename Func>
+void PICABatchShader::unaryOp(const DecodedInstruction& instruction, Func func) {
+	Register src, result;
+	loadSource(src, instruction, 0);
+
+	for (int comp = 0; comp < 4; comp++) {
+		for (int lane = 0; lane < laneCount; lane++) {
+			result.components[comp][lane] = func(src.components[comp][lane]);
+		}
+	}
+
+	storeDest(instruction, result);
+}
+
+// Products are computed lane-parallel, but each lane sums them in x, y, z, w order like the scalar interpreter
+template <int components>
+void PICABatchShader::dotProduct(const DecodedInstruction& instruction) {
+	Register src1, src2, result;
+	loadSource(src1, instruction, 0);
+	loadSource(src2, instruction, 1);
+
+	for (int lane = 0; lane < laneCount; lane++) {
+		float dot = picaMul(src1.components[0][lane], src2.components[0][lane]);
+		for (int comp = 1; comp < components; comp++) {
+			dot += picaMul(src1.components[comp][lane], src2.components[comp][lane]);
+		}
+
+		for (int comp = 0; comp < 4; comp++) {
+			result.components[comp][lane] = dot;
+		}
+	}
+
+	storeDest(instruction, result);
+}
+
+// RCP & RSQ: Operate on the x component of the source and broadcast the result
+template <typename Func>
+void PICABatchShader::scalarOp(const DecodedInstruction& instruction, Func func) {
+	Register src, result;
+	loadSource(src, instruction, 0);
+
+	for (int lane = 0; lane < laneCount; lane++) {
+		const float value = func(src.components[0][lane]);
+		for (int comp = 0; comp < 4; comp++) {
+			result.components[comp][lane] = value;
+		}
+	}
+
+	storeDest(instruction, result);
+}
+
+void PICABatchShader::mad(const DecodedInstruction& instruction) {
+	Register src1, src2, src3, result;
+	loadSource(src1, instruction, 0);
+	loadSource(src2, instruction, 1);
+	loadSource(src3, instruction, 2);
+
+	for (int comp = 0; comp < 4; comp++) {
+		for (int lane = 0; lane < laneCount; lane++) {
+			result.components[comp][lane] = picaMul(src1.components[comp][lane], src2.components[comp][lane]) + src3.components[comp][lane];
+		}
+	}
+
+	storeDest(instruction, result);
+}
+
+void PICABatchShader::mova(const DecodedInstruction& instruction) {
+	Register src;
+	loadSource(src, instruction, 0);
+
+	for (int comp = 0; comp < 2; comp++) {
+		if ((instruction.componentMask & (8 >> comp)) == 0) continue;
+
+		for (int lane = 0; lane < laneCount; lane++) {
+			if (activeLanes & (1u << lane)) {
+				addrRegisters[comp][lane] = static_cast<s32>(src.components[comp][lane]);
+			}
+		}
+	}
+}
+
+void PICABatchShader::cmp(const DecodedInstruction& instruction) {
+	Register src1, src2;
+	loadSource(src1, instruction, 0);
+	loadSource(src2, instruction, 1);
+
+	for (int comp = 0; comp < 2; comp++) {
+		LaneMask result = 0;
+		for (int lane = 0; lane < laneCount; lane++) {
+			const float a = src1.components[comp][lane];
+			const float b = src2.components[comp][lane];
+			bool value;
+
+			switch (instruction.cmpOperations[comp]) {
+				case 0: value = a == b; break;
+				case 1: value = a != b; break;
+				case 2: value = a < b; break;
+				case 3: value = a <= b; break;
+				case 4: value = a > b; break;
+				case 5: value = a >= b; break;
+				default: value = true; break;
+			}
+
+			result |= LaneMask(value) << lane;
+		}
+
+		LaneMask& reg = (comp == 0) ? cmpX : cmpY;
+		reg = (reg & ~activeLanes) | (result & activeLanes);
+	}
+}
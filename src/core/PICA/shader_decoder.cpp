@@ -0,0 +1,151 @@
+#include "PICA/shader.hpp"
+
+using namespace Helpers;
+
+namespace {
+	// Operand descriptor swizzles have the selector for x in the top 2 bits, we want it in the bottom 2 instead
+	u8 reverseSwizzle(u32 swizzle) {
+		u8 ret = 0;
+		for (int comp = 0; comp < 4; comp++) {
+			ret |= u8(((swizzle >> (comp * 2)) & 3) << ((3 - comp) * 2));
+		}
+
+		return ret;
+	}
+
+	// src1, src2 and src3 have different negation & component swizzle bits in the operand descriptor
+	// https://problemkaputt.github.io/gbatek.htm#3dsgpushaderinstructionsetopcodesummary in the
+	// "Shader Operand Descriptors" section
+	void decodeOperandDescriptor(DecodedInstruction& decoded, u32 opDescriptor) {
+		decoded.componentMask = opDescriptor & 0xf;
+		decoded.negateMask = 0;
+
+		for (int n = 0; n < 3; n++) {
+			const int shift = 9 * n; // Each source's bits are 9 bits after the previous one's
+			if ((opDescriptor >> (4 + shift)) & 1) {
+				decoded.negateMask |= 1 << n;
+			}
+
+			decoded.swizzle[n] = reverseSwizzle((opDescriptor >> (5 + shift)) & 0xff);
+		}
+	}
+}
+
+DecodedInstruction PICAShader::decodeInstruction(u32 instruction, const std::array<u32, 128>& descriptors) {
+	DecodedInstruction decoded{};
+	u32 opcode = instruction >> 26; // Top 6 bits are the opcode
+	if (opcode >= ShaderOpcodes::MAD) {
+		opcode = ShaderOpcodes::MAD;
+	} else if (opcode >= ShaderOpcodes::MADI) {
+		opcode = ShaderOpcodes::MADI;
+	}
+
+	decoded.raw = instruction;
+	decoded.opcode = u8(opcode);
+
+	switch (opcode) {
+		// Format 1: 7-bit src1 which can use relative addressing and 5-bit src2. Instructions with 1 source just ignore src2
+		case ShaderOpcodes::ADD: case ShaderOpcodes::DP3: case ShaderOpcodes::DP4: case ShaderOpcodes::MUL:
+		case ShaderOpcodes::SLT: case ShaderOpcodes::FLR: case ShaderOpcodes::MAX: case ShaderOpcodes::MIN:
+		case ShaderOpcodes::RCP: case ShaderOpcodes::RSQ: case ShaderOpcodes::MOVA: case ShaderOpcodes::MOV:
+		case ShaderOpcodes::CMP1: case ShaderOpcodes::CMP2:
+			decodeOperandDescriptor(decoded, descriptors[instruction & 0x7f]);
+			decoded.src[0] = getBits<12, 7>(instruction);
+			decoded.src[1] = getBits<7, 5>(instruction); // src2 coming first because PICA moment
+			decoded.index = getBits<19, 2>(instruction);
+			decoded.indexedSource = 0;
+			decoded.dest = getBits<21, 5>(instruction);
+
+			// CMP has the comparison operations where the dest would be
+			decoded.cmpOperations[0] = getBits<24, 3>(instruction);
+			decoded.cmpOperations[1] = getBits<21, 3>(instruction);
+			break;
+
+		// Format 1i: Same as format 1, except src1 is 5 bits and src2 is 7 bits and gets the relative addressing
+		case ShaderOpcodes::SGEI: case ShaderOpcodes::SLTI:
+			decodeOperandDescriptor(decoded, descriptors[instruction & 0x7f]);
+			decoded.src[0] = getBits<14, 5>(instruction);
+			decoded.src[1] = getBits<7, 7>(instruction);
+			decoded.index = getBits<19, 2>(instruction);
+			decoded.indexedSource = 1;
+			decoded.dest = getBits<21, 5>(instruction);
+			break;
+
+		// MAD & MADI only have 5 bits for the operand descriptor index
+		case ShaderOpcodes::MAD:
+			decodeOperandDescriptor(decoded, descriptors[instruction & 0x1f]);
+			decoded.src[0] = getBits<17, 5>(instruction);
+			decoded.src[1] = getBits<10, 7>(instruction);
+			decoded.src[2] = getBits<5, 5>(instruction);
+			decoded.index = getBits<22, 2>(instruction);
+			decoded.indexedSource = 1;
+			decoded.dest = getBits<24, 5>(instruction);
+			break;
+
+		case ShaderOpcodes::MADI:
+			decodeOperandDescriptor(decoded, descriptors[instruction & 0x1f]);
+			decoded.src[0] = getBits<17, 5>(instruction);
+			decoded.src[1] = getBits<12, 5>(instruction);
+			decoded.src[2] = getBits<5, 7>(instruction);
+			decoded.index = getBits<22, 2>(instruction);
+			decoded.indexedSource = 2;
+			decoded.dest = getBits<24, 5>(instruction);
+			break;
+
+		// Flow control instructions
+		case ShaderOpcodes::CALL: case ShaderOpcodes::CALLC: case ShaderOpcodes::CALLU:
+		case ShaderOpcodes::IFU: case ShaderOpcodes::IFC:
+		case ShaderOpcodes::LOOP: case ShaderOpcodes::JMPC: case ShaderOpcodes::JMPU: {
+			const u32 num = instruction & 0xff;
+			decoded.target = getBits<10, 12>(instruction);
+			decoded.endPC = (opcode == ShaderOpcodes::LOOP) ? decoded.target + 1 : decoded.target + num; // Loops are inclusive of DST
+
+			decoded.condition = getBits<22, 2>(instruction);
+			decoded.refY = (getBit<24>(instruction)) != 0;
+			decoded.refX = (getBit<25>(instruction)) != 0;
+			decoded.uniformIndex = (opcode == ShaderOpcodes::LOOP) ? getBits<22, 2>(instruction) : getBits<22, 4>(instruction);
+			decoded.jumpIfSet = (instruction & 1) == 0;
+			break;
+		}
+
+		default: break; // END, NOP & unknown instructions don't have operands we care about
+	}
+
+	return decoded;
+}
+
+void PICAShader::decode() {
+	decodeDirty = false;
+
+	const u64 hash = getCodeHash();
+	if (auto cached = programCache.find(hash); cached != nullptr) {
+		decodedProgram = *cached;
+		return;
+	}
+
+	auto program = std::make_shared<DecodedProgram>();
+	auto& instructions = program->instructions;
+	auto& controlFlowBoundaries = program->controlFlowBoundaries;
+	instructions.resize(loadedShader.size());
+	controlFlowBoundaries[loadedShader.size()] = true;
+
+	for (size_t pc = 0; pc < loadedShader.size(); pc++) {
+		const DecodedInstruction decoded = decodeInstruction(loadedShader[pc], operandDescriptors);
+		instructions[pc] = decoded;
+
+		// Record where each block can end. IF blocks can end at DST (if the condition was true) and CALLs & LOOPs at the end PC
+		switch (decoded.opcode) {
+			case ShaderOpcodes::IFU: case ShaderOpcodes::IFC:
+				controlFlowBoundaries[decoded.target] = true;
+				break;
+
+			case ShaderOpcodes::CALL: case ShaderOpcodes::CALLC: case ShaderOpcodes::CALLU: case ShaderOpcodes::LOOP:
+				if (decoded.endPC < controlFlowBoundaries.size()) {
+					controlFlowBoundaries[decoded.endPC] = true;
+				}
+				break;
+		}
+	}
+
+	decodedProgram = programCache.insert(hash, std::move(program));
+}
@@ -0,0 +1,385 @@
+#include "PICA/shader_decompiler.hpp"
+#include <cstdio>
+
+using namespace Helpers;
+
+namespace {
+	// Everything the translated program body needs. Registers are globals so that inlined calls & relative addressing can get to them
+	constexpr const char* shaderHeader = R"(#version 410 core
+
+layout (location = 0) in vec4 a_v0;
+layout (location = 1) in vec4 a_v1;
+layout (location = 2) in vec4 a_v2;
+layout (location = 3) in vec4 a_v3;
+layout (location = 4) in vec4 a_v4;
+layout (location = 5) in vec4 a_v5;
+layout (location = 6) in vec4 a_v6;
+layout (location = 7) in vec4 a_v7;
+layout (location = 8) in vec4 a_v8;
+layout (location = 9) in vec4 a_v9;
+layout (location = 10) in vec4 a_v10;
+layout (location = 11) in vec4 a_v11;
+layout (location = 12) in vec4 a_v12;
+layout (location = 13) in vec4 a_v13;
+layout (location = 14) in vec4 a_v14;
+layout (location = 15) in vec4 a_v15;
+
+layout (std140) uniform PICAUniforms {
+	vec4 fUniforms[96];
+	uvec4 iUniforms[4];
+	uint bUniforms;
+};
+
+out vec4 colour;
+out vec2 tex0_UVs;
+
+vec4 v[16]; // Inputs
+vec4 r[16]; // Temporaries
+vec4 o[16]; // Outputs
+ivec2 a0;   // Address registers
+int aL;     // Loop counter
+bvec2 cmp;  // Comparison results
+
+// Sources with relative addressing can end up pointing at any register, not just the uniforms
+vec4 readIndexed(int index) {
+	index &= 0xff;
+	if (index < 16) return v[index];
+	if (index < 32) return r[index - 16];
+	if (index < 128) return fUniforms[index - 32];
+	return vec4(0.0);
+}
+
+// The PICA turns 0 * inf into 0 instead of NaN. Products are precise so that the driver can't fuse them with additions into FMAs,
+// which round differently from the PICA & would make comparisons against the results go the other way every now and then
+vec4 picaMul(vec4 a, vec4 b) {
+	precise vec4 product = a * b;
+	bvec4 fixup = bvec4(uvec4(isnan(product)) & uvec4(not(isnan(a))) & uvec4(not(isnan(b))));
+	return mix(product, vec4(0.0), fixup);
+}
+
+float picaDot3(vec4 a, vec4 b) {
+	vec4 product = picaMul(a, b);
+	return product.x + product.y + product.z;
+}
+
+float picaDot4(vec4 a, vec4 b) {
+	vec4 product = picaMul(a, b);
+	return product.x + product.y + product.z + product.w;
+}
+
+vec4 picaMax(vec4 a, vec4 b) { return mix(b, a, greaterThan(a, b)); }
+vec4 picaMin(vec4 a, vec4 b) { return mix(b, a, lessThan(a, b)); }
+
+)";
+
+	constexpr const char* shaderMain = R"(
+void main() {
+	v = vec4[16](a_v0, a_v1, a_v2, a_v3, a_v4, a_v5, a_v6, a_v7, a_v8, a_v9, a_v10, a_v11, a_v12, a_v13, a_v14, a_v15);
+	for (int n = 0; n < 16; n++) {
+		r[n] = vec4(0.0);
+		o[n] = vec4(0.0);
+	}
+
+	a0 = ivec2(0);
+	aL = 0;
+	cmp = bvec2(false);
+	execute();
+
+	// Same outputs the CPU path puts in our Vertex struct. Flip the y axis of UVs like the regular vertex shader does
+	gl_Position = o[0];
+	colour = o[1];
+	tex0_UVs = vec2(o[2].x, 1.0 - o[2].y);
+}
+)";
+
+	// Inlining calls can blow up the size of the output, give up on programs that get silly
+	constexpr size_t maxSourceSize = 1024 * 1024;
+	constexpr int maxCallDepth = 4; // Same as the size of the CALL stack
+	constexpr u32 programSize = 4096;
+}
+
+std::optional<std::string> ShaderDecompiler::decompile(PICAShader& shader) {
+	if (shader.decodeDirty) {
+		shader.decode();
+	}
+
+	ShaderDecompiler decompiler(*shader.decodedProgram);
+	decompiler.source = shaderHeader;
+	decompiler.source += "void execute() {\n";
+
+	if (!decompiler.emitBlock(shader.entrypoint, programSize, true)) {
+		Helpers::warn("Shader decompiler: Can't translate shader %016llX (%s)\n", (unsigned long long)shader.getCodeHash(),
+					  decompiler.error.c_str());
+		return std::nullopt;
+	}
+
+	decompiler.source += "}\n";
+	decompiler.source += shaderMain;
+	return std::move(decompiler.source);
+}
+
+bool ShaderDecompiler::fail(const char* message, u32 pc) {
+	char buffer[128];
+	std::snprintf(buffer, sizeof(buffer), "%s at PC %03X", message, pc);
+	error = buffer;
+	return false;
+}
+
+void ShaderDecompiler::emitLine(const std::string& line) {
+	source.append(indentLevel, '\t');
+	source += line;
+	source += '\n';
+}
+
+// Emit the instructions in [begin, end). The top level block of the program is the only one an END actually stops at, every other
+// block may be followed by more code
+bool ShaderDecompiler::emitBlock(u32 begin, u32 end, bool topLevel) {
+	for (u32 pc = begin; pc < end;) {
+		const DecodedInstruction& instruction = program.instructions[pc];
+		if (source.size() > maxSourceSize) {
+			return fail("Program too big", pc);
+		}
+
+		switch (instruction.opcode) {
+			case ShaderOpcodes::END:
+				emitLine("return;");
+				if (topLevel) {
+					return true;
+				}
+				pc++;
+				break;
+
+			case ShaderOpcodes::IFU:
+			case ShaderOpcodes::IFC: {
+				// The if block is [pc + 1, DST) and the else block [DST, DST + NUM)
+				const u32 target = instruction.target;
+				const u32 endPC = instruction.endPC;
+				if (target <= pc || endPC > end) {
+					return fail("IF block isn't nested in its parent", pc);
+				}
+
+				emitLine("if (" + getCondition(instruction) + ") {");
+				indentLevel++;
+				if (!emitBlock(pc + 1, target)) return false;
+				indentLevel--;
+
+				if (endPC > target) {
+					emitLine("} else {");
+					indentLevel++;
+					if (!emitBlock(target, endPC)) return false;
+					indentLevel--;
+				}
+
+				emitLine("}");
+				pc = endPC;
+				break;
+			}
+
+			case ShaderOpcodes::CALL:
+			case ShaderOpcodes::CALLC:
+			case ShaderOpcodes::CALLU: {
+				// Calls get inlined. The function is [DST, DST + NUM)
+				if (instruction.target >= instruction.endPC || instruction.endPC > programSize) {
+					return fail("Invalid CALL", pc);
+				} else if (callDepth >= maxCallDepth) {
+					return fail("CALLs nested too deep", pc);
+				}
+
+				emitLine(instruction.opcode == ShaderOpcodes::CALL ? "{" : "if (" + getCondition(instruction) + ") {");
+				indentLevel++;
+				callDepth++;
+				if (!emitBlock(instruction.target, instruction.endPC)) return false;
+				callDepth--;
+				indentLevel--;
+				emitLine("}");
+
+				pc++;
+				break;
+			}
+
+			case ShaderOpcodes::LOOP: {
+				// The loop body is [pc + 1, DST], and it runs int uniform.x + 1 times
+				const u32 endPC = instruction.endPC;
+				if (endPC <= pc + 1 || endPC > end) {
+					return fail("LOOP block isn't nested in its parent", pc);
+				}
+
+				const std::string uniform = "iUniforms[" + std::to_string(instruction.uniformIndex) + "]";
+				const std::string counter = "iteration" + std::to_string(indentLevel);
+
+				emitLine("aL = int(" + uniform + ".y);");
+				emitLine("for (uint " + counter + " = 0u; " + counter + " <= " + uniform + ".x; " + counter + "++) {");
+				indentLevel++;
+				if (!emitBlock(pc + 1, endPC)) return false;
+				emitLine("aL += int(" + uniform + ".z);");
+				indentLevel--;
+				emitLine("}");
+
+				pc = endPC;
+				break;
+			}
+
+			case ShaderOpcodes::JMPC:
+			case ShaderOpcodes::JMPU: {
+				// Forward jumps within the current block are just an if around the code they skip
+				const u32 target = instruction.target;
+				if (target <= pc || target > end) {
+					return fail("Unstructured jump", pc);
+				}
+
+				emitLine("if (!(" + getCondition(instruction) + ")) {");
+				indentLevel++;
+				if (!emitBlock(pc + 1, target)) return false;
+				indentLevel--;
+				emitLine("}");
+
+				pc = target;
+				break;
+			}
+
+			default:
+				if (!emitInstruction(instruction)) {
+					return fail("Unsupported instruction", pc);
+				}
+				pc++;
+				break;
+		}
+	}
+
+	return true;
+}
+
+std::string ShaderDecompiler::getCondition(const DecodedInstruction& instruction) {
+	switch (instruction.opcode) {
+		case ShaderOpcodes::IFU:
+		case ShaderOpcodes::CALLU:
+			return "(bUniforms & " + std::to_string(1u << instruction.uniformIndex) + "u) != 0u";
+
+		case ShaderOpcodes::JMPU:
+			return "(bUniforms & " + std::to_string(1u << instruction.uniformIndex) + "u) " + (instruction.jumpIfSet ? "!=" : "==") + " 0u";
+
+		default: {
+			const std::string x = instruction.refX ? "cmp.x" : "!cmp.x";
+			const std::string y = instruction.refY ? "cmp.y" : "!cmp.y";
+
+			switch (instruction.condition) {
+				case 0: return x + " || " + y;
+				case 1: return x + " && " + y;
+				case 2: return x;
+				default: return y;
+			}
+		}
+	}
+}
+
+std::string ShaderDecompiler::getSource(const DecodedInstruction& instruction, int n) {
+	const u32 source = instruction.src[n];
+	std::string ret;
+
+	if (n == instruction.indexedSource && instruction.index != 0 && source >= 0x20) {
+		static constexpr const char* offsets[4] = {"", "a0.x", "a0.y", "aL"};
+		ret = "readIndexed(" + std::to_string(source) + " + " + offsets[instruction.index] + ")";
+	} else if (source < 0x10) {
+		ret = "v[" + std::to_string(source) + "]";
+	} else if (source < 0x20) {
+		ret = "r[" + std::to_string(source - 0x10) + "]";
+	} else if (source <= 0x7f) {
+		ret = "fUniforms[" + std::to_string(source - 0x20) + "]";
+	} else {
+		ret = "vec4(0.0)";
+	}
+
+	const u8 swizzle = instruction.swizzle[n];
+	if (swizzle != 0b11'10'01'00) { // xyzw doesn't need a swizzle
+		ret += '.';
+		for (int i = 0; i < 4; i++) {
+			ret += "xyzw"[(swizzle >> (i * 2)) & 3];
+		}
+	}
+
+	if (instruction.negateMask & (1 << n)) {
+		ret = "-" + ret;
+	}
+
+	return ret;
+}
+
+bool ShaderDecompiler::emitInstruction(const DecodedInstruction& instruction) {
+	const auto src = [&](int n) { return getSource(instruction, n); };
+	std::string value;
+
+	switch (instruction.opcode) {
+		case ShaderOpcodes::NOP: return true;
+		case ShaderOpcodes::ADD: value = src(0) + " + " + src(1); break;
+		case ShaderOpcodes::MUL: value = "picaMul(" + src(0) + ", " + src(1) + ")"; break;
+		case ShaderOpcodes::MAD:
+		case ShaderOpcodes::MADI: value = "picaMul(" + src(0) + ", " + src(1) + ") + " + src(2); break;
+		case ShaderOpcodes::DP3: value = "vec4(picaDot3(" + src(0) + ", " + src(1) + "))"; break;
+		case ShaderOpcodes::DP4: value = "vec4(picaDot4(" + src(0) + ", " + src(1) + "))"; break;
+		case ShaderOpcodes::FLR: value = "floor(" + src(0) + ")"; break;
+		case ShaderOpcodes::MAX: value = "picaMax(" + src(0) + ", " + src(1) + ")"; break;
+		case ShaderOpcodes::MIN: value = "picaMin(" + src(0) + ", " + src(1) + ")"; break;
+		case ShaderOpcodes::MOV: value = src(0); break;
+		case ShaderOpcodes::RCP: value = "vec4(1.0 / (" + src(0) + ").x)"; break;
+		case ShaderOpcodes::RSQ: value = "vec4(inversesqrt((" + src(0) + ").x))"; break;
+		case ShaderOpcodes::SLT:
+		case ShaderOpcodes::SLTI: value = "vec4(lessThan(" + src(0) + ", " + src(1) + "))"; break;
+		case ShaderOpcodes::SGEI: value = "vec4(greaterThanEqual(" + src(0) + ", " + src(1) + "))"; break;
+
+		case ShaderOpcodes::MOVA:
+			// Write both components at once, as the source can be indexed by a0.x
+			switch (instruction.componentMask & 0b1100) {
+				case 0b1100: emitLine("a0 = ivec2((" + src(0) + ").xy);"); break;
+				case 0b1000: emitLine("a0.x = int((" + src(0) + ").x);"); break;
+				case 0b0100: emitLine("a0.y = int((" + src(0) + ").y);"); break;
+				default: break;
+			}
+			return true;
+
+		case ShaderOpcodes::CMP1:
+		case ShaderOpcodes::CMP2: {
+			static constexpr const char* operations[6] = {"==", "!=", "<", "<=", ">", ">="};
+			static constexpr const char* components[2] = {"x", "y"};
+
+			for (int i = 0; i < 2; i++) {
+				const u32 operation = instruction.cmpOperations[i];
+				const std::string component = components[i];
+
+				if (operation < 6) {
+					emitLine("cmp." + component + " = (" + src(0) + ")." + component + " " + operations[operation] + " (" + src(1) + ")." +
+							 component + ";");
+				} else {
+					emitLine("cmp." + component + " = true;");
+				}
+			}
+			return true;
+		}
+
+		default: return false;
+	}
+
+	std::string dest;
+	if (instruction.dest < 0x10) {
+		dest = "o[" + std::to_string(instruction.dest) + "]";
+	} else if (instruction.dest < 0x20) {
+		dest = "r[" + std::to_string(instruction.dest - 0x10) + "]";
+	} else {
+		return false;
+	}
+
+	// Write mask has x in bit 3
+	std::string mask;
+	for (int i = 0; i < 4; i++) {
+		if (instruction.componentMask & (0b1000 >> i)) {
+			mask += "xyzw"[i];
+		}
+	}
+
+	if (mask.size() == 4) {
+		emitLine(dest + " = " + value + ";");
+	} else if (!mask.empty()) {
+		emitLine(dest + "." + mask + " = (" + value + ")." + mask + ";");
+	}
+
+	return true;
+}
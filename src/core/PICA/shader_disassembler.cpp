@@ -0,0 +1,211 @@
+#include "PICA/shader_disassembler.hpp"
+#include <cstdio>
+
+using namespace Helpers;
+
+const char* ShaderDisassembler::getMnemonic(u32 opcode) {
+	switch (opcode) {
+		case ShaderOpcodes::ADD: return "add";
+		case ShaderOpcodes::DP3: return "dp3";
+		case ShaderOpcodes::DP4: return "dp4";
+		case ShaderOpcodes::MUL: return "mul";
+		case ShaderOpcodes::SLT: return "slt";
+		case ShaderOpcodes::FLR: return "flr";
+		case ShaderOpcodes::MAX: return "max";
+		case ShaderOpcodes::MIN: return "min";
+		case ShaderOpcodes::RCP: return "rcp";
+		case ShaderOpcodes::RSQ: return "rsq";
+		case ShaderOpcodes::MOVA: return "mova";
+		case ShaderOpcodes::MOV: return "mov";
+		case ShaderOpcodes::SGEI: return "sgei";
+		case ShaderOpcodes::SLTI: return "slti";
+		case ShaderOpcodes::NOP: return "nop";
+		case ShaderOpcodes::END: return "end";
+		case ShaderOpcodes::CALL: return "call";
+		case ShaderOpcodes::CALLC: return "callc";
+		case ShaderOpcodes::CALLU: return "callu";
+		case ShaderOpcodes::IFU: return "ifu";
+		case ShaderOpcodes::IFC: return "ifc";
+		case ShaderOpcodes::LOOP: return "loop";
+		case ShaderOpcodes::JMPC: return "jmpc";
+		case ShaderOpcodes::JMPU: return "jmpu";
+		case ShaderOpcodes::CMP1: case ShaderOpcodes::CMP2: return "cmp";
+		case ShaderOpcodes::MADI: return "madi";
+		case ShaderOpcodes::MAD: return "mad";
+		default: return nullptr;
+	}
+}
+
+namespace {
+	template <typename... Args>
+	std::string format(const char* fmt, Args... args) {
+		char buffer[128];
+		std::snprintf(buffer, sizeof(buffer), fmt, args...);
+		return buffer;
+	}
+
+	std::string getSourceName(u32 source) {
+		if (source < 0x10) return format("v%d", source);
+		if (source < 0x20) return format("r%d", source - 0x10);
+		if (source < 0x80) return format("c%d", source - 0x20);
+		return format("src%02X", source);
+	}
+
+	std::string getDestName(u32 dest) {
+		if (dest < 0x10) return format("o%d", dest);
+		if (dest < 0x20) return format("r%d", dest - 0x10);
+		return format("dst%02X", dest);
+	}
+
+	// Write masks have x in bit 3. A full mask isn't printed
+	std::string getMaskSuffix(u32 mask) {
+		if (mask == 0xf) return "";
+
+		std::string ret = ".";
+		for (int comp = 0; comp < 4; comp++) {
+			if (mask & (0b1000 >> comp)) ret += "xyzw"[comp];
+		}
+		return ret;
+	}
+
+	// Decoded swizzles have the selector for x in the bottom 2 bits. The identity swizzle isn't printed
+	std::string getSwizzleSuffix(u8 swizzle) {
+		static constexpr u8 identity = 0b11'10'01'00;
+		if (swizzle == identity) return "";
+
+		std::string ret = ".";
+		for (int comp = 0; comp < 4; comp++) {
+			ret += "xyzw"[(swizzle >> (comp * 2)) & 3];
+		}
+		return ret;
+	}
+
+	std::string getSource(const DecodedInstruction& instruction, int n) {
+		std::string ret = (instruction.negateMask & (1 << n)) ? "-" : "";
+		ret += getSourceName(instruction.src[n]);
+
+		// Relative addressing only does anything to uniforms
+		if (n == instruction.indexedSource && instruction.index != 0 && instruction.src[n] >= 0x20) {
+			static constexpr const char* indexNames[4] = {"", "[a0.x]", "[a0.y]", "[aL]"};
+			ret += indexNames[instruction.index];
+		}
+
+		return ret + getSwizzleSuffix(instruction.swizzle[n]);
+	}
+
+	std::string getCondition(const DecodedInstruction& instruction) {
+		const std::string x = instruction.refX ? "cmp.x" : "!cmp.x";
+		const std::string y = instruction.refY ? "cmp.y" : "!cmp.y";
+
+		switch (instruction.condition) {
+			case 0: return x + " || " + y;
+			case 1: return x + " && " + y;
+			case 2: return x;
+			default: return y;
+		}
+	}
+
+	bool isFlowControl(u32 opcode) {
+		switch (opcode) {
+			case ShaderOpcodes::CALL: case ShaderOpcodes::CALLC: case ShaderOpcodes::CALLU:
+			case ShaderOpcodes::IFU: case ShaderOpcodes::IFC:
+			case ShaderOpcodes::LOOP: case ShaderOpcodes::JMPC: case ShaderOpcodes::JMPU:
+				return true;
+			default: return false;
+		}
+	}
+}
+
+std::string ShaderDisassembler::disassemble(const DecodedInstruction& instruction) {
+	const char* mnemonic = getMnemonic(instruction.opcode);
+	if (mnemonic == nullptr) {
+		return format(".word 0x%08X", instruction.raw);
+	}
+
+	const std::string name = mnemonic;
+	const auto src = [&](int n) { return getSource(instruction, n); };
+	const std::string dest = getDestName(instruction.dest) + getMaskSuffix(instruction.componentMask);
+
+	// Flow control operands
+	const std::string boolUniform = format("b%d", instruction.uniformIndex);
+	const std::string target = format("0x%03X", instruction.target);
+	const std::string blockEnd = format(", end 0x%03X", instruction.endPC);
+
+	switch (instruction.opcode) {
+		case ShaderOpcodes::ADD: case ShaderOpcodes::DP3: case ShaderOpcodes::DP4: case ShaderOpcodes::MUL:
+		case ShaderOpcodes::SLT: case ShaderOpcodes::MAX: case ShaderOpcodes::MIN: case ShaderOpcodes::SGEI:
+		case ShaderOpcodes::SLTI:
+			return name + " " + dest + ", " + src(0) + ", " + src(1);
+
+		case ShaderOpcodes::FLR: case ShaderOpcodes::RCP: case ShaderOpcodes::RSQ: case ShaderOpcodes::MOV:
+			return name + " " + dest + ", " + src(0);
+
+		case ShaderOpcodes::MAD: case ShaderOpcodes::MADI:
+			return name + " " + dest + ", " + src(0) + ", " + src(1) + ", " + src(2);
+
+		case ShaderOpcodes::MOVA: return name + " a0" + getMaskSuffix(instruction.componentMask & 0b1100) + ", " + src(0);
+
+		case ShaderOpcodes::CMP1: case ShaderOpcodes::CMP2: {
+			static constexpr const char* operations[8] = {"eq", "ne", "lt", "le", "gt", "ge", "true", "true"};
+			const char* opX = operations[instruction.cmpOperations[0]];
+			const char* opY = operations[instruction.cmpOperations[1]];
+			return name + " " + src(0) + ", " + opX + ", " + opY + ", " + src(1);
+		}
+
+		// For IFs, the target is where the else block starts & the end PC is right after it
+		case ShaderOpcodes::IFC: return name + " " + getCondition(instruction) + ", else " + target + blockEnd;
+		case ShaderOpcodes::IFU: return name + " " + boolUniform + ", else " + target + blockEnd;
+
+		case ShaderOpcodes::CALL: return name + " " + target + blockEnd;
+		case ShaderOpcodes::CALLC: return name + " " + getCondition(instruction) + ", " + target + blockEnd;
+		case ShaderOpcodes::CALLU: return name + " " + boolUniform + ", " + target + blockEnd;
+
+		// The loop body runs up to & including the target, so the end PC is the one after it
+		case ShaderOpcodes::LOOP: return name + format(" i%d", instruction.uniformIndex) + blockEnd;
+
+		case ShaderOpcodes::JMPC: return name + " " + getCondition(instruction) + ", " + target;
+		case ShaderOpcodes::JMPU: return name + " " + (instruction.jumpIfSet ? "" : "!") + boolUniform + ", " + target;
+
+		default: return name; // NOP & END
+	}
+}
+
+std::string ShaderDisassembler::disassemble(const DecodedProgram& program, u32 entrypoint, u32 begin, u32 end) {
+	std::string ret;
+	end = std::min<u32>(end, u32(program.instructions.size()));
+
+	for (u32 pc = begin; pc < end; pc++) {
+		const DecodedInstruction& instruction = program.instructions[pc];
+		if (pc == entrypoint) {
+			ret += "main:\n";
+		}
+
+		ret += format("%03X: %08X    ", pc, instruction.raw) + disassemble(instruction) + "\n";
+	}
+
+	return ret;
+}
+
+std::string ShaderDisassembler::disassemble(PICAShader& shader) {
+	if (shader.decodeDirty) {
+		shader.decode();
+	}
+
+	// Code memory past the end of the program is full of whatever was uploaded before, so stop at the first END we find that
+	// comes after the entrypoint & after every block or function the program references
+	const DecodedProgram& program = *shader.decodedProgram;
+	u32 furthestPC = shader.entrypoint;
+	u32 end = u32(program.instructions.size());
+
+	for (u32 pc = 0; pc < program.instructions.size(); pc++) {
+		const DecodedInstruction& instruction = program.instructions[pc];
+		if (isFlowControl(instruction.opcode)) {
+			furthestPC = std::max<u32>({furthestPC, instruction.target, instruction.endPC});
+		} else if (instruction.opcode == ShaderOpcodes::END && pc >= furthestPC) {
+			end = pc + 1;
+			break;
+		}
+	}
+
+	return disassemble(program, shader.entrypoint, 0, end);
+}
@@ -4,16 +4,36 @@
 using namespace Helpers;
 
 void PICAShader::run() {
+	if (decodeDirty) [[unlikely]] {
+		decode();
+	}
+
+	// Counting instructions for the profiler gets its own copy of the loop, so that normal runs don't pay for it
+	if (profileCounters != nullptr) [[unlikely]] {
+		runProgram<true>();
+	} else {
+		runProgram<false>();
+	}
+}
+
+template <bool profiling>
+void PICAShader::runProgram() {
 	pc = entrypoint;
 	loopIndex = 0;
 	ifIndex = 0;
 	callIndex = 0;
 
+	const auto& instructions = decodedProgram->instructions;
+	const auto& controlFlowBoundaries = decodedProgram->controlFlowBoundaries;
 	while (true) {
-		const u32 instruction = loadedShader[pc++];
-		const u32 opcode = instruction >> 26; // Top 6 bits are the opcode
+		if constexpr (profiling) {
+			profileCounters[pc]++;
+			profiledInstructions++;
+		}
 
-		switch (opcode) {
+		const DecodedInstruction& instruction = instructions[pc++];
+
+		switch (instruction.opcode) {
 			case ShaderOpcodes::ADD: add(instruction); break;
 			case ShaderOpcodes::CALL: call(instruction); break;
 			case ShaderOpcodes::CALLC: callc(instruction); break;
@@ -30,6 +50,8 @@ void PICAShader::run() {
 			case ShaderOpcodes::JMPC: jmpc(instruction); break;
 			case ShaderOpcodes::JMPU: jmpu(instruction); break;
 			case ShaderOpcodes::LOOP: loop(instruction); break;
+			case ShaderOpcodes::MAD: mad(instruction); break;
+			case ShaderOpcodes::MADI: madi(instruction); break;
 			case ShaderOpcodes::MAX: max(instruction); break;
 			case ShaderOpcodes::MIN: min(instruction); break;
 			case ShaderOpcodes::MOV: mov(instruction); break;
@@ -42,47 +64,52 @@ void PICAShader::run() {
 			case ShaderOpcodes::SLT: slt(instruction); break;
 			case ShaderOpcodes::SLTI: slti(instruction); break;
 
-			case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
-				madi(instruction);
-				break;
+			default: Helpers::panic("Unimplemented PICA instruction %08X (Opcode = %02X)", instruction.raw, instruction.opcode);
+		}
 
-			case 0x38: case 0x39: case 0x3A: case 0x3B: case 0x3C: case 0x3D: case 0x3E: case 0x3F:
-				mad(instruction);
-				break;
+		// Only PCs where some block may end need to look at the control flow stacks
+		if (controlFlowBoundaries[pc]) [[unlikely]] {
+			handleControlFlow();
 
-			default:Helpers::panic("Unimplemented PICA instruction %08X (Opcode = %02X)", instruction, opcode);
+			// Ran off the end of shader memory without any block taking us back
+			if (pc >= instructions.size()) [[unlikely]] {
+				return;
+			}
 		}
+	}
+}
 
-		// Handle control flow statements. The ordering is important as the priority goes: LOOP > IF > CALL
-		// Handle loop
-		if (loopIndex != 0) {
-			auto& loop = loopInfo[loopIndex - 1];
-			if (pc == loop.endingPC) { // Check if the loop needs to start over
-				loop.iterations -= 1;
-				if (loop.iterations == 0) // If the loop ended, go one level down on the loop stack
-					loopIndex -= 1;
-
-				loopCounter += loop.increment;
+void PICAShader::handleControlFlow() {
+	// Handle control flow statements. The ordering is important as the priority goes: LOOP > IF > CALL
+	// Handle loop
+	if (loopIndex != 0) {
+		auto& loop = loopInfo[loopIndex - 1];
+		if (pc == loop.endingPC) { // Check if the loop needs to start over
+			loop.iterations -= 1;
+			loopCounter += loop.increment;
+
+			if (loop.iterations == 0) // If the loop ended, go one level down on the loop stack
+				loopIndex -= 1;
+			else
 				pc = loop.startingPC;
-			}
 		}
+	}
 
-		// Handle ifs
-		if (ifIndex != 0) {
-			auto& info = conditionalInfo[ifIndex - 1];
-			if (pc == info.endingPC) { // Check if the IF block ended
-				pc = info.newPC;
-				ifIndex -= 1;
-			}
+	// Handle ifs
+	if (ifIndex != 0) {
+		auto& info = conditionalInfo[ifIndex - 1];
+		if (pc == info.endingPC) { // Check if the IF block ended
+			pc = info.newPC;
+			ifIndex -= 1;
 		}
+	}
 
-		// Handle calls
-		if (callIndex != 0) {
-			auto& info = callInfo[callIndex - 1];
-			if (pc == info.endingPC) { // Check if the CALL block ended
-				pc = info.returnPC;
-				callIndex -= 1;
-			}
+	// Handle calls
+	if (callIndex != 0) {
+		auto& info = callInfo[callIndex - 1];
+		if (pc == info.endingPC) { // Check if the CALL block ended
+			pc = info.returnPC;
+			callIndex -= 1;
 		}
 	}
 }
@@ -105,7 +132,7 @@ u8 PICAShader::getIndexedSource(u32 source, u32 index) {
 	return 0;
 }
 
-PICAShader::vec4f PICAShader::getSource(u32 source) {
+const PICAShader::vec4f& PICAShader::getSource(u32 source) {
 	if (source < 0x10)
 		return inputs[source];
 	else if (source < 0x20)
@@ -113,8 +140,9 @@ PICAShader::vec4f PICAShader::getSource(u32 source) {
 	else if (source <= 0x7f)
 		return floatUniforms[source - 0x20];
 	else {
+		alignas(16) static const vec4f zero({f24::zero(), f24::zero(), f24::zero(), f24::zero()});
 		Helpers::warn("[PICA] Unimplemented source value: %X\n", source);
-		return vec4f({ f24::zero(), f24::zero(), f24::zero(), f24::zero() });
+		return zero;
 	}
 }
 
@@ -127,12 +155,11 @@ PICAShader::vec4f& PICAShader::getDest(u32 dest) {
 	Helpers::panic("[PICA] Unimplemented dest: %X", dest);
 }
 
-bool PICAShader::isCondTrue(u32 instruction) {
-	u32 condition = getBits<22, 2>(instruction);
-	bool refY = (getBit<24>(instruction)) != 0;
-	bool refX = (getBit<25>(instruction)) != 0;
+bool PICAShader::isCondTrue(const DecodedInstruction& instruction) {
+	const bool refX = instruction.refX;
+	const bool refY = instruction.refY;
 
-	switch (condition) {
+	switch (instruction.condition) {
 		case 0: // Either cmp register matches 
 			return cmpRegister[0] == refX || cmpRegister[1] == refY;
 		case 1: // Both cmp registers match
@@ -144,350 +171,105 @@ bool PICAShader::isCondTrue(u32 instruction) {
 	}
 }
 
-void PICAShader::add(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction); // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] + srcVec2[3 - i];
-		}
-	}
+void PICAShader::add(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	storeDest(instruction, SIMD::add(srcVec1, srcVec2));
 }
 
-void PICAShader::mul(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction); // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] * srcVec2[3 - i];
-		}
-	}
+void PICAShader::mul(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	storeDest(instruction, SIMD::mul(srcVec1, srcVec2));
 }
 
-void PICAShader::flr(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src = getIndexedSource(src, idx);
-	vec4f srcVector = getSourceSwizzled<1>(src, operandDescriptor);
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = f24::fromFloat32(std::floor(srcVector[3 - 1].toFloat32()));
-		}
-	}
+void PICAShader::flr(const DecodedInstruction& instruction) {
+	storeDest(instruction, SIMD::floor(getSourceVector(instruction, 0)));
 }
 
-void PICAShader::max(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction); // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	if (idx) Helpers::panic("[PICA] MAX: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			const auto maximum = srcVec1[3 - i] > srcVec2[3 - i] ? srcVec1[3 - i] : srcVec2[3 - i];
-			destVector[3 - i] = maximum;
-		}
-	}
+void PICAShader::max(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	storeDest(instruction, SIMD::max(srcVec1, srcVec2));
 }
 
-void PICAShader::min(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction); // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	if (idx) Helpers::panic("[PICA] MIN: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			const auto mininum = srcVec1[3 - i] < srcVec2[3 - i] ? srcVec1[3 - i] : srcVec2[3 - i];
-			destVector[3 - i] = mininum;
-		}
-	}
+void PICAShader::min(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	storeDest(instruction, SIMD::min(srcVec1, srcVec2));
 }
 
-void PICAShader::mov(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src = getIndexedSource(src, idx);
-	vec4f srcVector = getSourceSwizzled<1>(src, operandDescriptor);
-	vec4f& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVector[3 - i];
-		}
-	}
+void PICAShader::mov(const DecodedInstruction& instruction) {
+	storeDest(instruction, getSourceVector(instruction, 0));
 }
 
-void PICAShader::mova(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-
-	if (idx) Helpers::panic("[PICA] MOVA: idx != 0");
-	vec4f srcVector = getSourceSwizzled<1>(src, operandDescriptor);
+void PICAShader::mova(const DecodedInstruction& instruction) {
+	const auto srcVector = SIMD::toArray(getSourceVector(instruction, 0));
 
-	u32 componentMask = operandDescriptor & 0xf;
+	u32 componentMask = instruction.componentMask;
 	if (componentMask & 0b1000) // x component
-		addrRegister.x() = static_cast<s32>(srcVector.x().toFloat32());
+		addrRegister.x() = static_cast<s32>(srcVector[0]);
 	if (componentMask & 0b0100) // y component
-		addrRegister.y() = static_cast<s32>(srcVector.y().toFloat32());
+		addrRegister.y() = static_cast<s32>(srcVector[1]);
 }
 
-void PICAShader::dp3(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction); // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	f24 dot = srcVec1[0] * srcVec2[0] + srcVec1[1] * srcVec2[1] + srcVec1[2] * srcVec2[2];
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = dot;
-		}
-	}
+void PICAShader::dp3(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	storeDest(instruction, SIMD::broadcast(SIMD::dot3(srcVec1, srcVec2)));
 }
 
-void PICAShader::dp4(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction); // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	f24 dot = srcVec1[0] * srcVec2[0] + srcVec1[1] * srcVec2[1] + srcVec1[2] * srcVec2[2] + srcVec1[3] * srcVec2[3];
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = dot;
-		}
-	}
+void PICAShader::dp4(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	storeDest(instruction, SIMD::broadcast(SIMD::dot4(srcVec1, srcVec2)));
 }
 
-void PICAShader::rcp(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	if (idx) Helpers::panic("[PICA] RCP: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	f24 res = f24::fromFloat32(1.0f) / srcVec1[0];
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = res;
-		}
-	}
+void PICAShader::rcp(const DecodedInstruction& instruction) {
+	const float src = SIMD::toArray(getSourceVector(instruction, 0))[0];
+	storeDest(instruction, SIMD::broadcast(1.0f / src));
 }
 
-void PICAShader::rsq(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	if (idx) Helpers::panic("[PICA] RSQ: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-
-	vec4f& destVector = getDest(dest);
-	f24 res = f24::fromFloat32(1.0f / std::sqrt(srcVec1[0].toFloat32()));
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = res;
-		}
-	}
+void PICAShader::rsq(const DecodedInstruction& instruction) {
+	const float src = SIMD::toArray(getSourceVector(instruction, 0))[0];
+	storeDest(instruction, SIMD::broadcast(1.0f / std::sqrt(src)));
 }
 
-void PICAShader::mad(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x1f];
-	const u32 src1 = getBits<17, 5>(instruction);
-	u32 src2 = getBits<10, 7>(instruction);
-	const u32 src3 = getBits<5, 5>(instruction);
-	const u32 idx = getBits<22, 2>(instruction);
-	const u32 dest = getBits<24, 5>(instruction);
-
-	src2 = getIndexedSource(src2, idx);
-
-	auto srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	auto srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto srcVec3 = getSourceSwizzled<3>(src3, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] * srcVec2[3 - i] + srcVec3[3 - i];
-		}
-	}
+// MAD & MADI only differ in which sources are 7 bits & get relative addressing, which the decoder already took care of
+void PICAShader::mad(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	const auto srcVec3 = getSourceVector(instruction, 2);
+	storeDest(instruction, SIMD::add(SIMD::mul(srcVec1, srcVec2), srcVec3));
 }
 
-void PICAShader::madi(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x1f];
-	const u32 src1 = getBits<17, 5>(instruction);
-	const u32 src2 = getBits<12, 5>(instruction);
-	u32 src3 = getBits<5, 7>(instruction);
-	const u32 idx = getBits<22, 2>(instruction);
-	const u32 dest = getBits<24, 5>(instruction);
-
-	src3 = getIndexedSource(src3, idx);
-
-	auto srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	auto srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto srcVec3 = getSourceSwizzled<3>(src3, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] * srcVec2[3 - i] + srcVec3[3 - i];
-		}
-	}
+void PICAShader::madi(const DecodedInstruction& instruction) {
+	mad(instruction);
 }
 
-void PICAShader::slt(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction); // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src1 = getIndexedSource(src1, idx);
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] < srcVec2[3 - i] ? f24::fromFloat32(1.0) : f24::zero();
-		}
-	}
+void PICAShader::slt(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	storeDest(instruction, SIMD::lessThan(srcVec1, srcVec2));
 }
 
-void PICAShader::sgei(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<14, 5>(instruction);
-	u32 src2 = getBits<7, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src2 = getIndexedSource(src2, idx);
-
-	auto srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	auto srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] >= srcVec2[3 - i] ? f24::fromFloat32(1.0) : f24::zero();
-		}
-	}
+void PICAShader::sgei(const DecodedInstruction& instruction) {
+	const auto srcVec1 = getSourceVector(instruction, 0);
+	const auto srcVec2 = getSourceVector(instruction, 1);
+	storeDest(instruction, SIMD::greaterEqual(srcVec1, srcVec2));
 }
 
-void PICAShader::slti(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<14, 5>(instruction);
-	u32 src2 = getBits<7, 7>(instruction);
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 dest = getBits<21, 5>(instruction);
-
-	src2 = getIndexedSource(src2, idx);
-
-	auto srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	auto srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
-	auto& destVector = getDest(dest);
-
-	u32 componentMask = operandDescriptor & 0xf;
-	for (int i = 0; i < 4; i++) {
-		if (componentMask & (1 << i)) {
-			destVector[3 - i] = srcVec1[3 - i] < srcVec2[3 - i] ? f24::fromFloat32(1.0) : f24::zero();
-		}
-	}
+// SLTI is SLT with the source formats swapped
+void PICAShader::slti(const DecodedInstruction& instruction) {
+	slt(instruction);
 }
 
-void PICAShader::cmp(u32 instruction) {
-	const u32 operandDescriptor = operandDescriptors[instruction & 0x7f];
-	const u32 src1 = getBits<12, 7>(instruction);
-	const u32 src2 = getBits<7, 5>(instruction); // src2 coming first because PICA moment
-	const u32 idx = getBits<19, 2>(instruction);
-	const u32 cmpY = getBits<21, 3>(instruction);
-	const u32 cmpX = getBits<24, 3>(instruction);
-	const u32 cmpOperations[2] = { cmpX, cmpY };
-
-	if (idx) Helpers::panic("[PICA] CMP: idx != 0");
-	vec4f srcVec1 = getSourceSwizzled<1>(src1, operandDescriptor);
-	vec4f srcVec2 = getSourceSwizzled<2>(src2, operandDescriptor);
+void PICAShader::cmp(const DecodedInstruction& instruction) {
+	const auto srcVec1 = SIMD::toArray(getSourceVector(instruction, 0));
+	const auto srcVec2 = SIMD::toArray(getSourceVector(instruction, 1));
 
 	for (int i = 0; i < 2; i++) {
-		switch (cmpOperations[i]) {
+		switch (instruction.cmpOperations[i]) {
 			case 0: // Equal
 				cmpRegister[i] = srcVec1[i] == srcVec2[i];
 				break;
@@ -519,105 +301,77 @@ void PICAShader::cmp(u32 instruction) {
 	}
 }
 
-void PICAShader::ifc(u32 instruction) {
-	const u32 dest = getBits<10, 12>(instruction);
-
+void PICAShader::ifc(const DecodedInstruction& instruction) {
 	if (isCondTrue(instruction)) {
 		if (ifIndex >= 8) [[unlikely]]
 			Helpers::panic("[PICA] Overflowed IF stack");
 
-		const u32 num = instruction & 0xff;
-
 		auto& block = conditionalInfo[ifIndex++];
-		block.endingPC = dest;
-		block.newPC = dest + num;
+		block.endingPC = instruction.target;
+		block.newPC = instruction.endPC;
 	} else {
-		pc = dest;
+		pc = instruction.target;
 	}
 }
 
-void PICAShader::ifu(u32 instruction) {
-	const u32 dest = getBits<10, 12>(instruction);
-	const u32 bit = getBits<22, 4>(instruction); // Bit of the bool uniform to check
-
-	if (boolUniform & (1 << bit)) {
+void PICAShader::ifu(const DecodedInstruction& instruction) {
+	if (boolUniform & (1 << instruction.uniformIndex)) {
 		if (ifIndex >= 8) [[unlikely]]
 			Helpers::panic("[PICA] Overflowed IF stack");
 
-		const u32 num = instruction & 0xff;
-
 		auto& block = conditionalInfo[ifIndex++];
-		block.endingPC = dest;
-		block.newPC = dest + num;
+		block.endingPC = instruction.target;
+		block.newPC = instruction.endPC;
 	}
 	else {
-		pc = dest;
+		pc = instruction.target;
 	}
 }
 
-void PICAShader::call(u32 instruction) {
+void PICAShader::call(const DecodedInstruction& instruction) {
 	if (callIndex >= 4) [[unlikely]]
 		Helpers::panic("[PICA] Overflowed CALL stack");
 
-	const u32 num = instruction & 0xff;
-	const u32 dest = getBits<10, 12>(instruction);
-
 	auto& block = callInfo[callIndex++];
-	block.endingPC = dest + num;
+	block.endingPC = instruction.endPC;
 	block.returnPC = pc;
 
-	pc = dest;
+	pc = instruction.target;
 }
 
-void PICAShader::callc(u32 instruction) {
+void PICAShader::callc(const DecodedInstruction& instruction) {
 	if (isCondTrue(instruction)) {
 		call(instruction); // Pls inline
 	}
 }
 
-void PICAShader::callu(u32 instruction) {
-	const u32 bit = getBits<22, 4>(instruction); // Bit of the bool uniform to check
-
-	if (boolUniform & (1 << bit)) {
-		if (callIndex >= 4) [[unlikely]]
-			Helpers::panic("[PICA] Overflowed CALL stack");
-
-		const u32 num = instruction & 0xff;
-		const u32 dest = getBits<10, 12>(instruction);
-
-		auto& block = callInfo[callIndex++];
-		block.endingPC = dest + num;
-		block.returnPC = pc;
-
-		pc = dest;
+void PICAShader::callu(const DecodedInstruction& instruction) {
+	if (boolUniform & (1 << instruction.uniformIndex)) {
+		call(instruction);
 	}
 }
 
-void PICAShader::loop(u32 instruction) {
+void PICAShader::loop(const DecodedInstruction& instruction) {
 	if (loopIndex >= 4) [[unlikely]]
 		Helpers::panic("[PICA] Overflowed loop stack");
 
-	u32 dest = getBits<10, 12>(instruction);
-	auto& uniform = intUniforms[getBits<22, 2>(instruction)]; // The uniform we'll get loop info from
+	auto& uniform = intUniforms[instruction.uniformIndex]; // The uniform we'll get loop info from
 	loopCounter = uniform.y();
 	auto& loop = loopInfo[loopIndex++];
 
 	loop.startingPC = pc;
-	loop.endingPC = dest + 1; // Loop is inclusive so we need + 1 here
+	loop.endingPC = instruction.endPC;
 	loop.iterations = uniform.x() + 1;
 	loop.increment = uniform.z();
 }
 
-void PICAShader::jmpc(u32 instruction) {
+void PICAShader::jmpc(const DecodedInstruction& instruction) {
 	if (isCondTrue(instruction))
-		pc = getBits<10, 12>(instruction);
+		pc = instruction.target;
 }
 
-void PICAShader::jmpu(u32 instruction) {
-	const u32 test = (instruction & 1) ^ 1; // If the LSB is 0 we want to compare to true, otherwise compare to false
-	const u32 dest = getBits<10, 12>(instruction);
-	const u32 bit = getBits<22, 4>(instruction); // Bit of the bool uniform to check
-
-	if (((boolUniform >> bit) & 1) == test) // Jump if the bool uniform is the value we want
-		pc = dest;
-}
\ No newline at end of file
+void PICAShader::jmpu(const DecodedInstruction& instruction) {
+	const bool set = (boolUniform >> instruction.uniformIndex) & 1;
+	if (set == instruction.jumpIfSet) // Jump if the bool uniform is the value we want
+		pc = instruction.target;
+}
@@ -0,0 +1,109 @@
+#include "PICA/shader_jit.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+#include "PICA/shader_jit_x64.hpp"
+#endif
+
+// Out of line so the unique_ptr destructor sees the full ShaderEmitter
+ShaderJIT::ShaderJIT() = default;
+ShaderJIT::~ShaderJIT() = default;
+
+void ShaderJIT::setMode(Mode newMode) {
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+	if (newMode != Mode::Interpreter && !ShaderEmitter::isSupported()) {
+		Helpers::warn("Shader JIT: Host CPU doesn't support SSE4.1, using the shader interpreter\n");
+		newMode = Mode::Interpreter;
+	}
+#else
+	if (newMode != Mode::Interpreter) {
+		Helpers::warn("Shader JIT: This build doesn't include the recompiler (ENABLE_SHADER_JIT), using the shader interpreter\n");
+	}
+	newMode = Mode::Interpreter;
+#endif
+
+	mode = newMode;
+	reset();
+}
+
+void ShaderJIT::reset() {
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+	activeProgram = nullptr;
+	reportedMismatch = false;
+	cache.clear();
+#endif
+}
+
+void ShaderJIT::prepare(PICAShader& shaderUnit) {
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+	if (mode == Mode::Interpreter) {
+		activeProgram = nullptr;
+		return;
+	}
+
+	// Switching to a program we've seen before is just a lookup
+	const u64 hash = shaderUnit.getCodeHash();
+	std::unique_ptr<ShaderEmitter>* program = cache.find(hash);
+
+	if (program == nullptr) {
+		std::unique_ptr<ShaderEmitter> emitter;
+		try {
+			emitter = std::make_unique<ShaderEmitter>(shaderUnit);
+			if (!emitter->compile(shaderUnit)) {
+				Helpers::warn("Shader JIT: Interpreting shader %016llX (%s)\n", (unsigned long long)hash, emitter->getError());
+				emitter.reset();
+			}
+		} catch (const Xbyak::Error& e) { // Most likely failing to allocate the code buffer
+			Helpers::warn("Shader JIT: Interpreting shader %016llX (%s)\n", (unsigned long long)hash, e.what());
+			emitter.reset();
+		}
+
+		program = &cache.insert(hash, std::move(emitter));
+		reportedMismatch = false;
+	}
+
+	activeProgram = (*program != nullptr) ? (*program)->getPrologue() : nullptr;
+#endif
+}
+
+#ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+// Run the compiled program and the interpreter from the same state and compare their outputs. The interpreter's results are the ones we keep
+void ShaderJIT::verify(PICAShader& shaderUnit) {
+	const auto tempRegisters = shaderUnit.tempRegisters;
+	const auto addrRegister = shaderUnit.addrRegister;
+	const auto loopCounter = shaderUnit.loopCounter;
+	const bool cmpRegister[2] = {shaderUnit.cmpRegister[0], shaderUnit.cmpRegister[1]};
+
+	activeProgram(shaderUnit);
+	auto jitOutputs = shaderUnit.outputs;
+
+	shaderUnit.tempRegisters = tempRegisters;
+	shaderUnit.addrRegister = addrRegister;
+	shaderUnit.loopCounter = loopCounter;
+	shaderUnit.cmpRegister[0] = cmpRegister[0];
+	shaderUnit.cmpRegister[1] = cmpRegister[1];
+	shaderUnit.run();
+
+	if (reportedMismatch || std::memcmp(&jitOutputs, &shaderUnit.outputs, sizeof(jitOutputs)) == 0) [[likely]] {
+		return;
+	}
+
+	reportedMismatch = true;
+	Helpers::warn("Shader JIT: Output mismatch for shader %016llX\n", (unsigned long long)shaderUnit.getCodeHash());
+
+	for (int i = 0; i < 16; i++) {
+		auto& expected = shaderUnit.outputs[i];
+		auto& actual = jitOutputs[i];
+
+		if (std::memcmp(&expected, &actual, sizeof(expected)) != 0) {
+			printf(
+				"  o%d: interpreter (%f, %f, %f, %f), JIT (%f, %f, %f, %f)\n", i, expected[0].toFloat64(), expected[1].toFloat64(),
+				expected[2].toFloat64(), expected[3].toFloat64(), actual[0].toFloat64(), actual[1].toFloat64(), actual[2].toFloat64(),
+				actual[3].toFloat64()
+			);
+		}
+	}
+}
+#endif
@@ -0,0 +1,719 @@
+#ifdef PANDA3DS_SHADER_JIT_X64
+#include "PICA/shader_jit_x64.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "xbyak/xbyak_util.h"
+
+using namespace Helpers;
+using namespace Xbyak;
+
+// Register usage of the emitted code. We stick to registers that are callee-saved (r14, r15) or volatile (rax, rcx, xmm0-xmm4) in both the
+// System V & Microsoft x64 ABIs, so the prologue only has to preserve r14 & r15.
+// r15: Pointer to the PICAShader we're running
+// r14: Host stack pointer after the prologue, so END can bail out from inside CALLs
+// xmm0-xmm3: Sources & temporaries. xmm4: Used by storeDest for write masking
+
+namespace {
+	// Write masks have x in bit 3, while blendps takes x from bit 0
+	constexpr u8 maskToBlend(u32 mask) {
+		return u8(((mask & 8) >> 3) | ((mask & 4) >> 1) | ((mask & 2) << 1) | ((mask & 1) << 3));
+	}
+
+	// Operand descriptor swizzles have the selector for x in the top 2 bits, while shufps immediates have it in the bottom 2
+	constexpr u8 swizzleToShuffle(u32 swizzle) {
+		u8 shuffle = 0;
+		for (int comp = 0; comp < 4; comp++) {
+			shuffle |= u8(((swizzle >> (comp * 2)) & 3) << ((3 - comp) * 2));
+		}
+
+		return shuffle;
+	}
+
+	constexpr u8 identityShuffle = 0xE4; // xyzw
+	static_assert(swizzleToShuffle(0x1B) == identityShuffle);
+
+	// The interpreter's LOOP & CALL stacks are 4 entries deep. Compiled code checks the same limits and ends up here if they're exceeded
+	[[noreturn]] void stackOverflow(const char* stack) { Helpers::panic("[PICA] Overflowed %s stack in recompiled shader", stack); }
+}
+
+bool ShaderEmitter::isSupported() {
+	const Xbyak::util::Cpu cpu;
+	return cpu.has(Xbyak::util::Cpu::tSSE41);
+}
+
+// Everything past the last non-zero instruction is padding, unless some jump, call or block points there
+u32 ShaderEmitter::findProgramEnd(const PICAShader& shader) {
+	u32 end = shader.entrypoint + 1;
+
+	for (u32 pc = 0; pc < maxInstructionCount; pc++) {
+		const u32 instruction = shader.loadedShader[pc];
+		if (instruction == 0) {
+			continue;
+		}
+
+		end = std::max(end, pc + 1);
+		const u32 opcode = instruction >> 26;
+		const u32 dest = getBits<10, 12>(instruction);
+		const u32 num = instruction & 0xff;
+
+		switch (opcode) {
+			case ShaderOpcodes::CALL:
+			case ShaderOpcodes::CALLC:
+			case ShaderOpcodes::CALLU:
+			case ShaderOpcodes::IFU:
+			case ShaderOpcodes::IFC: end = std::max(end, dest + std::max<u32>(num, 1)); break;
+
+			case ShaderOpcodes::LOOP:
+			case ShaderOpcodes::JMPC:
+			case ShaderOpcodes::JMPU: end = std::max(end, dest + 1); break;
+		}
+	}
+
+	return std::min<u32>(end, maxInstructionCount);
+}
+
+void ShaderEmitter::scanProgram(const PICAShader& shader) {
+	programEnd = findProgramEnd(shader);
+	returnPCs.reset();
+
+	for (u32 pc = 0; pc < programEnd; pc++) {
+		const u32 instruction = shader.loadedShader[pc];
+		const u32 opcode = instruction >> 26;
+
+		if (opcode == ShaderOpcodes::CALL || opcode == ShaderOpcodes::CALLC || opcode == ShaderOpcodes::CALLU) {
+			// Functions that end past the last instruction can never return, so they don't need a check
+			const u32 end = getBits<10, 12>(instruction) + (instruction & 0xff);
+			if (end < maxInstructionCount) {
+				returnPCs[end] = true;
+			}
+		}
+	}
+}
+
+void ShaderEmitter::computeOffsets(const PICAShader& shader) {
+	const auto offsetOf = [&shader](const void* member) { return int(uintptr_t(member) - uintptr_t(&shader)); };
+
+	inputsOffset = offsetOf(&shader.inputs[0]);
+	tempsOffset = offsetOf(&shader.tempRegisters[0]);
+	uniformsOffset = offsetOf(&shader.floatUniforms[0]);
+	outputsOffset = offsetOf(&shader.outputs[0]);
+	addrRegisterOffset = offsetOf(&shader.addrRegister);
+	loopCounterOffset = offsetOf(&shader.loopCounter);
+	cmpRegisterOffset = offsetOf(&shader.cmpRegister[0]);
+	boolUniformOffset = offsetOf(&shader.boolUniform);
+	intUniformsOffset = offsetOf(&shader.intUniforms[0]);
+	loopInfoOffset = offsetOf(&shader.loopInfo[0]);
+	loopIndexOffset = offsetOf(&shader.loopIndex);
+}
+
+bool ShaderEmitter::compile(const PICAShader& shader) {
+	static_assert(sizeof(PICAShader::vec4f) == 16, "Shader JIT expects vec4f to be 4 packed floats");
+	static_assert(sizeof(PICAShader::Loop) == 16, "Shader JIT indexes the loop stack with a shift by 4");
+	static_assert(sizeof(OpenGL::Vector<s32, 2>) == 8 && sizeof(OpenGL::Vector<u8, 4>) == 4);
+
+	if (shader.entrypoint >= maxInstructionCount) {
+		fail("Entrypoint out of range");
+		return false;
+	}
+
+	try {
+		computeOffsets(shader);
+		scanProgram(shader);
+		instructionLabels = std::vector<Label>(programEnd);
+
+		emitPrologue(shader);
+		recompilerPC = 0;
+		compileUntil(shader, programEnd);
+		jmp(epilogueLabel, T_NEAR); // Falling off the end of the program
+		emitEpilogue();
+
+		if (error != nullptr) {
+			return false;
+		}
+
+		ready();
+		prologue = getCode<PrologueCallback>();
+		return true;
+	} catch (const Xbyak::Error& e) {
+		fail(e.what());
+		return false;
+	}
+}
+
+void ShaderEmitter::emitPrologue(const PICAShader& shader) {
+	push(r15);
+	push(r14);
+#ifdef _WIN32
+	mov(r15, rcx);
+#else
+	mov(r15, rdi);
+#endif
+
+	// Guard values for the return checks at the top level, see compileCall
+	mov(rax, u64(-1));
+	push(rax);
+	push(rax);
+	mov(r14, rsp);
+
+	mov(dword[r15 + loopIndexOffset], 0);
+	jmp(instructionLabels[shader.entrypoint], T_NEAR);
+}
+
+void ShaderEmitter::emitEpilogue() {
+	L(epilogueLabel);
+	mov(rsp, r14);
+	add(rsp, 16);
+	pop(r14);
+	pop(r15);
+	ret();
+
+	emitOverflowHandler(loopOverflowLabel, "loop");
+	emitOverflowHandler(callOverflowLabel, "CALL");
+
+	align(16);
+	L(negateMaskLabel);
+	for (int i = 0; i < 4; i++) dd(0x80000000);
+	L(onesLabel);
+	for (int i = 0; i < 4; i++) dd(0x3F800000); // 1.0f
+}
+
+// Calls stackOverflow with the name of the stack. It never returns, so we can realign rsp however we like
+void ShaderEmitter::emitOverflowHandler(Label& label, const char* stack) {
+	L(label);
+	and_(rsp, -16);
+	sub(rsp, 32); // Shadow space for the Microsoft ABI
+#ifdef _WIN32
+	mov(rcx, reinterpret_cast<uintptr_t>(stack));
+#else
+	mov(rdi, reinterpret_cast<uintptr_t>(stack));
+#endif
+	mov(rax, reinterpret_cast<uintptr_t>(&stackOverflow));
+	call(rax);
+}
+
+void ShaderEmitter::compileUntil(const PICAShader& shader, u32 end) {
+	if (end > programEnd) {
+		fail("Block ends past the end of shader memory");
+		return;
+	}
+
+	while (recompilerPC < end && error == nullptr) {
+		if (returnPCs[recompilerPC]) {
+			emitReturnCheck(recompilerPC);
+		}
+
+		L(instructionLabels[recompilerPC]);
+		compileInstruction(shader);
+	}
+}
+
+void ShaderEmitter::compileInstruction(const PICAShader& shader) {
+	const u32 instruction = shader.loadedShader[recompilerPC++];
+	const u32 opcode = instruction >> 26; // Top 6 bits are the opcode
+
+	switch (opcode) {
+		case ShaderOpcodes::ADD: recADD(shader, instruction); break;
+		case ShaderOpcodes::CALL: recCALL(shader, instruction); break;
+		case ShaderOpcodes::CALLC: recCALLC(shader, instruction); break;
+		case ShaderOpcodes::CALLU: recCALLU(shader, instruction); break;
+		case ShaderOpcodes::CMP1: case ShaderOpcodes::CMP2:
+			recCMP(shader, instruction);
+			break;
+		case ShaderOpcodes::DP3: recDP3(shader, instruction); break;
+		case ShaderOpcodes::DP4: recDP4(shader, instruction); break;
+		case ShaderOpcodes::END: jmp(epilogueLabel, T_NEAR); break;
+		case ShaderOpcodes::FLR: recFLR(shader, instruction); break;
+		case ShaderOpcodes::IFC: recIFC(shader, instruction); break;
+		case ShaderOpcodes::IFU: recIFU(shader, instruction); break;
+		case ShaderOpcodes::JMPC: recJMPC(shader, instruction); break;
+		case ShaderOpcodes::JMPU: recJMPU(shader, instruction); break;
+		case ShaderOpcodes::LOOP: recLOOP(shader, instruction); break;
+		case ShaderOpcodes::MAX: recMAX(shader, instruction); break;
+		case ShaderOpcodes::MIN: recMIN(shader, instruction); break;
+		case ShaderOpcodes::MOV: recMOV(shader, instruction); break;
+		case ShaderOpcodes::MOVA: recMOVA(shader, instruction); break;
+		case ShaderOpcodes::MUL: recMUL(shader, instruction); break;
+		case ShaderOpcodes::NOP: break;
+		case ShaderOpcodes::RCP: recRCP(shader, instruction); break;
+		case ShaderOpcodes::RSQ: recRSQ(shader, instruction); break;
+		case ShaderOpcodes::SGEI: recSGEI(shader, instruction); break;
+		case ShaderOpcodes::SLT: recSLT(shader, instruction); break;
+		case ShaderOpcodes::SLTI: recSLTI(shader, instruction); break;
+
+		case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
+			recMADI(shader, instruction);
+			break;
+
+		case 0x38: case 0x39: case 0x3A: case 0x3B: case 0x3C: case 0x3D: case 0x3E: case 0x3F:
+			recMAD(shader, instruction);
+			break;
+
+		// Leave unknown instructions to the interpreter, so they blow up in the same place they always did
+		default: fail("Unimplemented instruction"); break;
+	}
+}
+
+int ShaderEmitter::sourceOffset(u32 source) const {
+	if (source < 0x10) {
+		return inputsOffset + int(source) * 16;
+	} else if (source < 0x20) {
+		return tempsOffset + int(source - 0x10) * 16;
+	} else {
+		return uniformsOffset + int(source - 0x20) * 16;
+	}
+}
+
+int ShaderEmitter::destOffset(u32 dest) const {
+	return (dest < 0x10) ? outputsOffset + int(dest) * 16 : tempsOffset + int(dest - 0x10) * 16;
+}
+
+void ShaderEmitter::loadSource(const Xmm& reg, u32 source, u32 index, u32 operandDescriptor, int sourceIndex) {
+	// Relative addressing only applies to uniforms, same as getIndexedSource
+	if (source >= 0x20 && index != 0) {
+		loadIndexedUniform(reg, source, index);
+	} else {
+		movups(reg, xword[r15 + sourceOffset(source)]);
+	}
+
+	// src1, src2 & src3 have their negate bit & swizzle 9 bits apart from each other in the operand descriptor
+	const int shift = 9 * (sourceIndex - 1);
+	const bool negate = ((operandDescriptor >> (4 + shift)) & 1) != 0;
+	const u8 shuffle = swizzleToShuffle((operandDescriptor >> (5 + shift)) & 0xff);
+
+	if (shuffle != identityShuffle) {
+		shufps(reg, reg, shuffle);
+	}
+
+	if (negate) {
+		xorps(reg, xword[rip + negateMaskLabel]);
+	}
+}
+
+void ShaderEmitter::loadIndexedUniform(const Xmm& reg, u32 source, u32 index) {
+	switch (index) {
+		case 1: mov(eax, dword[r15 + addrRegisterOffset]); break;
+		case 2: mov(eax, dword[r15 + addrRegisterOffset + 4]); break;
+		default: mov(eax, dword[r15 + loopCounterOffset]); break;
+	}
+
+	add(eax, source);
+	movzx(eax, al); // The register index wraps around at 8 bits
+
+	// Like the interpreter, indices that leave the uniform range read inputs, temporaries or zero
+	Label notUniform, input, outOfRange, done;
+	cmp(eax, 0x20);
+	jb(notUniform);
+	cmp(eax, 0x7f);
+	ja(outOfRange);
+	shl(eax, 4);
+	movups(reg, xword[r15 + rax + (uniformsOffset - 0x20 * 16)]);
+	jmp(done);
+
+	L(notUniform);
+	cmp(eax, 0x10);
+	jb(input);
+	shl(eax, 4);
+	movups(reg, xword[r15 + rax + (tempsOffset - 0x10 * 16)]);
+	jmp(done);
+
+	L(input);
+	shl(eax, 4);
+	movups(reg, xword[r15 + rax + inputsOffset]);
+	jmp(done);
+
+	L(outOfRange);
+	xorps(reg, reg);
+	L(done);
+}
+
+void ShaderEmitter::storeDest(const Xmm& reg, u32 dest, u32 operandDescriptor) {
+	const u32 mask = operandDescriptor & 0xf;
+	const int offset = destOffset(dest);
+
+	if (mask == 0xf) {
+		movups(xword[r15 + offset], reg);
+	} else if (mask != 0) {
+		movups(xmm4, xword[r15 + offset]);
+		blendps(xmm4, reg, maskToBlend(mask));
+		movups(xword[r15 + offset], xmm4);
+	}
+}
+
+// Format 1 instructions: src1 is 7 bits and can use relative addressing, src2 is 5 bits. Loads src1 into xmm0 & src2 into xmm1
+void ShaderEmitter::loadFormat1Sources(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	loadSource(xmm0, getBits<12, 7>(instruction), getBits<19, 2>(instruction), operandDescriptor, 1);
+	loadSource(xmm1, getBits<7, 5>(instruction), 0, operandDescriptor, 2);
+}
+
+// Format 1i instructions have the sizes of src1 & src2 swapped, so the relative addressing goes to src2 instead
+void ShaderEmitter::loadFormat1iSources(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	loadSource(xmm0, getBits<14, 5>(instruction), 0, operandDescriptor, 1);
+	loadSource(xmm1, getBits<7, 7>(instruction), getBits<19, 2>(instruction), operandDescriptor, 2);
+}
+
+// xmm0 = xmm0 * xmm1, except the PICA gives 0 instead of NaN for 0 * inf. Clobbers xmm2 & xmm3
+void ShaderEmitter::emitSafeMultiply() {
+	movaps(xmm2, xmm0);
+	cmpordps(xmm2, xmm1); // Lanes where neither input is NaN
+	mulps(xmm0, xmm1);
+	movaps(xmm3, xmm0);
+	cmpunordps(xmm3, xmm0); // Lanes where the product is NaN
+	andps(xmm2, xmm3);      // NaN products of non-NaN inputs, which need to be zeroed
+	andnps(xmm2, xmm0);
+	movaps(xmm0, xmm2);
+}
+
+// Dot product of xmm0 & xmm1 over the first "components" lanes, broadcast to all of xmm0.
+// The lanes are summed in order, so we round exactly like the interpreter does
+void ShaderEmitter::emitDotProduct(int components) {
+	emitSafeMultiply();
+	movaps(xmm2, xmm0);
+
+	for (int lane = 1; lane < components; lane++) {
+		movaps(xmm1, xmm2);
+		shufps(xmm1, xmm1, u8(lane * 0x55));
+		addss(xmm0, xmm1);
+	}
+
+	shufps(xmm0, xmm0, 0);
+}
+
+// Compare lane 0 of xmm0 and xmm1 and store the result in the cmp register at "offset"
+void ShaderEmitter::emitComparison(u32 operation, int offset) {
+	// ucomiss sets ZF, PF & CF on unordered operands, so NaNs compare false for everything except "not equal"
+	switch (operation) {
+		case 0: // Equal
+			ucomiss(xmm0, xmm1);
+			sete(al);
+			setnp(cl);
+			and_(al, cl);
+			break;
+
+		case 1: // Not equal
+			ucomiss(xmm0, xmm1);
+			setne(al);
+			setp(cl);
+			or_(al, cl);
+			break;
+
+		case 2: ucomiss(xmm1, xmm0); seta(al); break;  // Less than
+		case 3: ucomiss(xmm1, xmm0); setae(al); break; // Less than or equal
+		case 4: ucomiss(xmm0, xmm1); seta(al); break;  // Greater than
+		case 5: ucomiss(xmm0, xmm1); setae(al); break; // Greater than or equal
+		default: mov(al, 1); break;
+	}
+
+	mov(byte[r15 + offset], al);
+}
+
+// Clears ZF if the cmp register condition of an IFC/JMPC/CALLC holds
+void ShaderEmitter::emitCondition(u32 instruction) {
+	const u32 condition = getBits<22, 2>(instruction);
+	const bool refY = (getBit<24>(instruction)) != 0;
+	const bool refX = (getBit<25>(instruction)) != 0;
+
+	// eax = (cmp.x == refX), ecx = (cmp.y == refY)
+	movzx(eax, byte[r15 + cmpRegisterOffset]);
+	if (!refX) xor_(eax, 1);
+	movzx(ecx, byte[r15 + cmpRegisterOffset + 1]);
+	if (!refY) xor_(ecx, 1);
+
+	switch (condition) {
+		case 0: or_(eax, ecx); break;   // Either cmp register matches
+		case 1: and_(eax, ecx); break;  // Both cmp registers match
+		case 2: test(eax, eax); break;  // cmp.x matches
+		default: test(ecx, ecx); break; // cmp.y matches
+	}
+}
+
+// Clears ZF if the bool uniform checked by an IFU/JMPU/CALLU is set
+void ShaderEmitter::emitBoolUniformTest(u32 instruction) {
+	const u32 bit = getBits<22, 4>(instruction);
+	test(dword[r15 + boolUniformOffset], 1u << bit);
+}
+
+// PICA functions don't end with a return instruction. Instead, a function ends once execution reaches its dest + num.
+// So compileCall pushes the ending PC under the return address, and every PC some function can end at checks it before running.
+// The prologue pushes guard values that no PC matches, so falling through the same PCs outside a call does nothing
+void ShaderEmitter::emitReturnCheck(u32 pc) {
+	Label notReturning;
+	cmp(dword[rsp + 8], pc);
+	jne(notReturning);
+	ret();
+	L(notReturning);
+}
+
+void ShaderEmitter::compileCall(u32 instruction) {
+	const u32 num = instruction & 0xff;
+	const u32 dest = getBits<10, 12>(instruction);
+
+	// Every active call has pushed 16 bytes (ending PC & return address) below r14, so a 5th nested call would go past r14 - 64
+	lea(rax, ptr[r14 - 16 * int(maxCallDepth)]);
+	cmp(rsp, rax);
+	jbe(callOverflowLabel, T_NEAR);
+
+	mov(eax, dest + num);
+	push(rax);
+	call(instructionLabels[dest]);
+	add(rsp, 8);
+}
+
+void ShaderEmitter::recCALL(const PICAShader& shader, u32 instruction) {
+	compileCall(instruction);
+}
+
+void ShaderEmitter::recCALLC(const PICAShader& shader, u32 instruction) {
+	Label skip;
+	emitCondition(instruction);
+	jz(skip, T_NEAR);
+	compileCall(instruction);
+	L(skip);
+}
+
+void ShaderEmitter::recCALLU(const PICAShader& shader, u32 instruction) {
+	Label skip;
+	emitBoolUniformTest(instruction);
+	jz(skip, T_NEAR);
+	compileCall(instruction);
+	L(skip);
+}
+
+// Expects ZF to be clear if the IF condition holds. The "if" block is [pc, dest) and the "else" block is [dest, dest + num)
+void ShaderEmitter::compileIf(const PICAShader& shader, u32 instruction) {
+	const u32 dest = getBits<10, 12>(instruction);
+	const u32 num = instruction & 0xff;
+
+	if (dest < recompilerPC) {
+		fail("IF block ends before it starts");
+		return;
+	}
+
+	Label elseBlock, endIf;
+	jz(elseBlock, T_NEAR);
+	compileUntil(shader, dest);
+
+	if (num == 0) {
+		L(elseBlock);
+	} else {
+		jmp(endIf, T_NEAR);
+		L(elseBlock);
+		compileUntil(shader, dest + num);
+		L(endIf);
+	}
+}
+
+void ShaderEmitter::recIFC(const PICAShader& shader, u32 instruction) {
+	emitCondition(instruction);
+	compileIf(shader, instruction);
+}
+
+void ShaderEmitter::recIFU(const PICAShader& shader, u32 instruction) {
+	emitBoolUniformTest(instruction);
+	compileIf(shader, instruction);
+}
+
+void ShaderEmitter::recJMPC(const PICAShader& shader, u32 instruction) {
+	emitCondition(instruction);
+	jnz(instructionLabels[getBits<10, 12>(instruction)], T_NEAR);
+}
+
+void ShaderEmitter::recJMPU(const PICAShader& shader, u32 instruction) {
+	const u32 dest = getBits<10, 12>(instruction);
+	emitBoolUniformTest(instruction);
+
+	// If the LSB is 0 we jump if the uniform is true, otherwise we jump if it's false
+	if ((instruction & 1) == 0) {
+		jnz(instructionLabels[dest], T_NEAR);
+	} else {
+		jz(instructionLabels[dest], T_NEAR);
+	}
+}
+
+// The loop stack lives in the PICAShader rather than in host registers, as loops can nest through CALLs
+void ShaderEmitter::recLOOP(const PICAShader& shader, u32 instruction) {
+	const u32 dest = getBits<10, 12>(instruction);
+	const int uniformOffset = intUniformsOffset + int(getBits<22, 2>(instruction)) * 4;
+	const int iterationsOffset = loopInfoOffset + int(offsetof(PICAShader::Loop, iterations));
+	const int incrementOffset = loopInfoOffset + int(offsetof(PICAShader::Loop, increment));
+
+	if (dest < recompilerPC) {
+		fail("LOOP block ends before it starts");
+		return;
+	}
+
+	// Push a loop with uniform.x + 1 iterations, incrementing the loop counter by uniform.z, starting from uniform.y
+	mov(ecx, dword[r15 + loopIndexOffset]);
+	cmp(ecx, u32(shader.loopInfo.size()));
+	jae(loopOverflowLabel, T_NEAR);
+	shl(ecx, 4);
+	movzx(eax, byte[r15 + uniformOffset + 1]);
+	mov(dword[r15 + loopCounterOffset], eax);
+	movzx(eax, byte[r15 + uniformOffset]);
+	inc(eax);
+	mov(dword[r15 + rcx + iterationsOffset], eax);
+	movzx(eax, byte[r15 + uniformOffset + 2]);
+	mov(dword[r15 + rcx + incrementOffset], eax);
+	inc(dword[r15 + loopIndexOffset]);
+
+	const u32 loopStart = recompilerPC;
+	compileUntil(shader, dest + 1); // The loop body is inclusive of dest
+
+	mov(ecx, dword[r15 + loopIndexOffset]);
+	dec(ecx);
+	shl(ecx, 4);
+	mov(eax, dword[r15 + rcx + incrementOffset]);
+	add(dword[r15 + loopCounterOffset], eax);
+	dec(dword[r15 + rcx + iterationsOffset]);
+	jnz(instructionLabels[loopStart], T_NEAR);
+	dec(dword[r15 + loopIndexOffset]);
+}
+
+void ShaderEmitter::recADD(const PICAShader& shader, u32 instruction) {
+	loadFormat1Sources(shader, instruction);
+	addps(xmm0, xmm1);
+	storeDest(xmm0, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+void ShaderEmitter::recMUL(const PICAShader& shader, u32 instruction) {
+	loadFormat1Sources(shader, instruction);
+	emitSafeMultiply();
+	storeDest(xmm0, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+void ShaderEmitter::recDP3(const PICAShader& shader, u32 instruction) {
+	loadFormat1Sources(shader, instruction);
+	emitDotProduct(3);
+	storeDest(xmm0, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+void ShaderEmitter::recDP4(const PICAShader& shader, u32 instruction) {
+	loadFormat1Sources(shader, instruction);
+	emitDotProduct(4);
+	storeDest(xmm0, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+// maxps & minps return the second operand when either is NaN, which matches the ternaries in the interpreter
+void ShaderEmitter::recMAX(const PICAShader& shader, u32 instruction) {
+	loadFormat1Sources(shader, instruction);
+	maxps(xmm0, xmm1);
+	storeDest(xmm0, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+void ShaderEmitter::recMIN(const PICAShader& shader, u32 instruction) {
+	loadFormat1Sources(shader, instruction);
+	minps(xmm0, xmm1);
+	storeDest(xmm0, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+void ShaderEmitter::recSLT(const PICAShader& shader, u32 instruction) {
+	loadFormat1Sources(shader, instruction);
+	cmpltps(xmm0, xmm1);
+	andps(xmm0, xword[rip + onesLabel]);
+	storeDest(xmm0, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+void ShaderEmitter::recSLTI(const PICAShader& shader, u32 instruction) {
+	loadFormat1iSources(shader, instruction);
+	cmpltps(xmm0, xmm1);
+	andps(xmm0, xword[rip + onesLabel]);
+	storeDest(xmm0, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+void ShaderEmitter::recSGEI(const PICAShader& shader, u32 instruction) {
+	loadFormat1iSources(shader, instruction);
+	cmpleps(xmm1, xmm0); // src1 >= src2 is src2 <= src1, without the NaN problems of cmpnltps
+	andps(xmm1, xword[rip + onesLabel]);
+	storeDest(xmm1, getBits<21, 5>(instruction), shader.operandDescriptors[instruction & 0x7f]);
+}
+
+void ShaderEmitter::recCMP(const PICAShader& shader, u32 instruction) {
+	loadFormat1Sources(shader, instruction);
+	emitComparison(getBits<24, 3>(instruction), cmpRegisterOffset); // cmp.x
+
+	shufps(xmm0, xmm0, 0x55);
+	shufps(xmm1, xmm1, 0x55);
+	emitComparison(getBits<21, 3>(instruction), cmpRegisterOffset + 1); // cmp.y
+}
+
+void ShaderEmitter::recFLR(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	loadSource(xmm0, getBits<12, 7>(instruction), getBits<19, 2>(instruction), operandDescriptor, 1);
+	roundps(xmm0, xmm0, 1); // Round towards -inf
+	storeDest(xmm0, getBits<21, 5>(instruction), operandDescriptor);
+}
+
+void ShaderEmitter::recMOV(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	loadSource(xmm0, getBits<12, 7>(instruction), getBits<19, 2>(instruction), operandDescriptor, 1);
+	storeDest(xmm0, getBits<21, 5>(instruction), operandDescriptor);
+}
+
+void ShaderEmitter::recMOVA(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	const u32 componentMask = operandDescriptor & 0xf;
+	loadSource(xmm0, getBits<12, 7>(instruction), getBits<19, 2>(instruction), operandDescriptor, 1);
+
+	if (componentMask & 0b1000) { // x component
+		cvttss2si(eax, xmm0);
+		mov(dword[r15 + addrRegisterOffset], eax);
+	}
+
+	if (componentMask & 0b0100) { // y component
+		shufps(xmm0, xmm0, 0x55);
+		cvttss2si(eax, xmm0);
+		mov(dword[r15 + addrRegisterOffset + 4], eax);
+	}
+}
+
+// RCP & RSQ use exact division instead of rcpss/rsqrtss, so we get the same results as the interpreter
+void ShaderEmitter::recRCP(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	loadSource(xmm0, getBits<12, 7>(instruction), getBits<19, 2>(instruction), operandDescriptor, 1);
+
+	movss(xmm1, dword[rip + onesLabel]);
+	divss(xmm1, xmm0);
+	shufps(xmm1, xmm1, 0);
+	storeDest(xmm1, getBits<21, 5>(instruction), operandDescriptor);
+}
+
+void ShaderEmitter::recRSQ(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	loadSource(xmm0, getBits<12, 7>(instruction), getBits<19, 2>(instruction), operandDescriptor, 1);
+
+	sqrtss(xmm0, xmm0);
+	movss(xmm1, dword[rip + onesLabel]);
+	divss(xmm1, xmm0);
+	shufps(xmm1, xmm1, 0);
+	storeDest(xmm1, getBits<21, 5>(instruction), operandDescriptor);
+}
+
+// MAD & MADI use a smaller operand descriptor index, and put relative addressing on src2 & src3 respectively
+void ShaderEmitter::recMAD(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x1f];
+	const u32 idx = getBits<22, 2>(instruction);
+
+	loadSource(xmm0, getBits<17, 5>(instruction), 0, operandDescriptor, 1);
+	loadSource(xmm1, getBits<10, 7>(instruction), idx, operandDescriptor, 2);
+	emitSafeMultiply();
+	loadSource(xmm1, getBits<5, 5>(instruction), 0, operandDescriptor, 3);
+	addps(xmm0, xmm1);
+	storeDest(xmm0, getBits<24, 5>(instruction), operandDescriptor);
+}
+
+void ShaderEmitter::recMADI(const PICAShader& shader, u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x1f];
+	const u32 idx = getBits<22, 2>(instruction);
+
+	loadSource(xmm0, getBits<17, 5>(instruction), 0, operandDescriptor, 1);
+	loadSource(xmm1, getBits<12, 5>(instruction), 0, operandDescriptor, 2);
+	emitSafeMultiply();
+	loadSource(xmm1, getBits<5, 7>(instruction), idx, operandDescriptor, 3);
+	addps(xmm0, xmm1);
+	storeDest(xmm0, getBits<24, 5>(instruction), operandDescriptor);
+}
+
+#endif // PANDA3DS_SHADER_JIT_X64
@@ -0,0 +1,173 @@
+#include "PICA/shader_profiler.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include "PICA/shader_disassembler.hpp"
+
+namespace {
+	template <typename... Args>
+	std::string format(const char* fmt, Args... args) {
+		char buffer[256];
+		std::snprintf(buffer, sizeof(buffer), fmt, args...);
+		return buffer;
+	}
+
+	// Print opcode totals, most executed first
+	void writeOpcodeCounts(std::ofstream& file, const std::map<std::string, u64>& counts, u64 total, const char* indent) {
+		std::vector<std::pair<std::string, u64>> sorted(counts.begin(), counts.end());
+		std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+
+		for (const auto& [opcode, count] : sorted) {
+			const double percentage = total == 0 ? 0.0 : 100.0 * double(count) / double(total);
+			file << indent << format("%-8s %14" PRIu64 "  %6.2f%%", opcode.c_str(), count, percentage) << '\n';
+		}
+	}
+
+	std::string getOpcodeName(const DecodedInstruction& instruction) {
+		const char* mnemonic = ShaderDisassembler::getMnemonic(instruction.opcode);
+		return mnemonic != nullptr ? mnemonic : format("op%02X", instruction.opcode);
+	}
+}
+
+void ShaderProfiler::start() {
+	programs.clear();
+	draws.clear();
+	totalDraws = 0;
+	currentProgram = nullptr;
+	running = true;
+}
+
+void ShaderProfiler::beginDraw(PICAShader& shader) {
+	if (shader.decodeDirty) {
+		shader.decode();
+	}
+
+	currentHash = shader.getCodeHash();
+	auto& profile = programs[currentHash];
+	if (!profile) {
+		profile = std::make_unique<ProgramProfile>();
+		profile->program = shader.decodedProgram;
+		profile->entrypoint = shader.entrypoint;
+	}
+
+	currentProgram = profile.get();
+	shader.profileCounters = profile->pcCounts.data();
+	shader.profiledInstructions = 0;
+}
+
+void ShaderProfiler::endDraw(PICAShader& shader, u32 vertexCount) {
+	if (currentProgram == nullptr) [[unlikely]] {
+		return;
+	}
+
+	const u64 instructions = shader.profiledInstructions;
+	currentProgram->draws++;
+	currentProgram->vertices += vertexCount;
+	currentProgram->instructions += instructions;
+
+	if (draws.size() < maxRecordedDraws) {
+		draws.push_back(DrawRecord{currentHash, vertexCount, instructions});
+	}
+
+	totalDraws++;
+	shader.profileCounters = nullptr;
+	currentProgram = nullptr;
+}
+
+bool ShaderProfiler::writeReport(const std::filesystem::path& path) const {
+	std::ofstream file(path);
+	if (!file.good()) {
+		return false;
+	}
+
+	// Hottest programs first
+	std::vector<std::pair<u64, const ProgramProfile*>> sortedPrograms;
+	for (const auto& [hash, profile] : programs) {
+		sortedPrograms.emplace_back(hash, profile.get());
+	}
+	std::sort(sortedPrograms.begin(), sortedPrograms.end(), [](const auto& a, const auto& b) {
+		return a.second->instructions > b.second->instructions;
+	});
+
+	// Opcode totals over every program, weighted by how often each instruction ran
+	std::map<std::string, u64> opcodeCounts;
+	u64 totalInstructions = 0;
+	u64 totalVertices = 0;
+	for (const auto& [hash, profile] : sortedPrograms) {
+		for (u32 pc = 0; pc < profile->pcCounts.size(); pc++) {
+			if (profile->pcCounts[pc] != 0) {
+				opcodeCounts[getOpcodeName(profile->program->instructions[pc])] += profile->pcCounts[pc];
+			}
+		}
+
+		totalInstructions += profile->instructions;
+		totalVertices += profile->vertices;
+	}
+
+	file << format("PICA shader profile: %" PRIu64 " draws, %" PRIu64 " vertices, %" PRIu64 " instructions, %zu programs\n\n",
+				   totalDraws, totalVertices, totalInstructions, programs.size());
+	file << "Instructions per opcode:\n";
+	writeOpcodeCounts(file, opcodeCounts, totalInstructions, "    ");
+
+	for (const auto& [hash, profile] : sortedPrograms) {
+		const auto& counts = profile->pcCounts;
+		const auto& instructions = profile->program->instructions;
+		const double perVertex = profile->vertices == 0 ? 0.0 : double(profile->instructions) / double(profile->vertices);
+
+		file << '\n'
+			 << format("Program %016" PRIX64 ": %" PRIu64 " draws, %" PRIu64 " vertices, %" PRIu64 " instructions (%.1f per vertex)\n",
+					   hash, profile->draws, profile->vertices, profile->instructions, perVertex);
+
+		// Only disassemble the part of the program that ever ran
+		u32 begin = profile->entrypoint;
+		u32 end = begin + 1;
+		std::map<std::string, u64> programOpcodeCounts;
+		for (u32 pc = 0; pc < counts.size(); pc++) {
+			if (counts[pc] != 0) {
+				begin = std::min(begin, pc);
+				end = std::max(end, pc + 1);
+				programOpcodeCounts[getOpcodeName(instructions[pc])] += counts[pc];
+			}
+		}
+
+		file << "  Instructions per opcode:\n";
+		writeOpcodeCounts(file, programOpcodeCounts, profile->instructions, "    ");
+		file << "  Code (execution count, PC, instruction):\n";
+
+		for (u32 pc = begin; pc < end; pc++) {
+			const DecodedInstruction& instruction = instructions[pc];
+			std::string line = (counts[pc] != 0) ? format("%14" PRIu64, counts[pc]) : std::string(14, ' ');
+			line += format("  %03X: ", pc) + ShaderDisassembler::disassemble(instruction);
+
+			// How control flow usually goes is the interesting part: How many times loops spin & how often IFs are taken
+			// Only IFs with a non-empty if block can be judged by the count of the instruction after them
+			if (counts[pc] != 0) {
+				const double executions = double(counts[pc]);
+				if (instruction.opcode == ShaderOpcodes::LOOP && instruction.target < counts.size()) {
+					line += format("    ; %.2f iterations on average", double(counts[instruction.target]) / executions);
+				} else if ((instruction.opcode == ShaderOpcodes::IFC || instruction.opcode == ShaderOpcodes::IFU) &&
+						   instruction.target > pc + 1) {
+					line += format("    ; taken %.1f%% of the time", 100.0 * double(counts[pc + 1]) / executions);
+				}
+			}
+
+			if (pc == profile->entrypoint) {
+				file << "  main:\n";
+			}
+			file << line << '\n';
+		}
+	}
+
+	file << '\n' << format("Draws (first %zu of %" PRIu64 "):\n", draws.size(), totalDraws);
+	file << "  Draw  Program           Vertices  Instructions  Per vertex\n";
+	for (size_t i = 0; i < draws.size(); i++) {
+		const DrawRecord& draw = draws[i];
+		const double perVertex = draw.vertices == 0 ? 0.0 : double(draw.instructions) / double(draw.vertices);
+		file << format("%6zu  %016" PRIX64 "  %8u  %12" PRIu64 "  %10.1f\n", i, draw.hash, draw.vertices, draw.instructions, perVertex);
+	}
+
+	return true;
+}
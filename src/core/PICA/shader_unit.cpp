@@ -1,4 +1,6 @@
 #include "PICA/shader_unit.hpp"
+#include <functional>
+#include <string_view>
 
 void ShaderUnit::reset() {
 	vs.reset();
@@ -7,7 +9,6 @@ void ShaderUnit::reset() {
 
 void PICAShader::reset() {
 	loadedShader.fill(0);
-	bufferedShader.fill(0);
 	operandDescriptors.fill(0);
 
 	boolUniform = 0;
@@ -30,4 +31,50 @@ void PICAShader::reset() {
 	addrRegister.x() = 0;
 	addrRegister.y() = 0;
 	loopCounter = 0;
-}
\ No newline at end of file
+	codeHashDirty = true;
+	decodeDirty = true;
+	decodedProgram.reset();
+	programCache.clear();
+}
+
+u64 PICAShader::getCodeHash() {
+	if (codeHashDirty) {
+		codeHashDirty = false;
+
+		const auto hashBytes = [](const void* data, size_t size) -> u64 {
+			return std::hash<std::string_view>()(std::string_view(static_cast<const char*>(data), size));
+		};
+
+		// Combine the hashes boost::hash_combine style, with the entrypoint mixed in as well since it changes the compiled code
+		u64 hash = hashBytes(loadedShader.data(), sizeof(loadedShader));
+		hash ^= hashBytes(operandDescriptors.data(), sizeof(operandDescriptors)) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+		hash ^= u64(entrypoint) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+		lastCodeHash = hash;
+	}
+
+	return lastCodeHash;
+}
+void PICAShader::cloneFrom(PICAShader& other) {
+	if (other.decodeDirty) {
+		other.decode();
+	}
+
+	// The decoded program is immutable, so we can just share it instead of copying it
+	decodedProgram = other.decodedProgram;
+	entrypoint = other.entrypoint;
+	lastCodeHash = other.lastCodeHash;
+	codeHashDirty = false;
+	decodeDirty = false;
+
+	boolUniform = other.boolUniform;
+	intUniforms = other.intUniforms;
+	floatUniforms = other.floatUniforms;
+	fixedAttributes = other.fixedAttributes;
+
+	tempRegisters = other.tempRegisters;
+	outputs = other.outputs;
+	addrRegister = other.addrRegister;
+	cmpRegister[0] = other.cmpRegister[0];
+	cmpRegister[1] = other.cmpRegister[1];
+	loopCounter = other.loopCounter;
+}
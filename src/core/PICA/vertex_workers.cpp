@@ -0,0 +1,91 @@
+#include "PICA/vertex_workers.hpp"
+#include <algorithm>
+
+int VertexWorkerPool::defaultThreadCount() {
+	static constexpr int maxThreads = 7;
+	const int hostThreads = int(std::thread::hardware_concurrency()); // Can be 0 if the host won't tell us
+	return std::clamp(hostThreads - 2, 0, maxThreads);
+}
+
+void VertexWorkerPool::setThreadCount(int count) {
+	stop();
+	threadCount = std::max(count, 0);
+}
+
+void VertexWorkerPool::stop() {
+	{
+		std::scoped_lock lock(mutex);
+		stopThreads = true;
+	}
+	jobStart.notify_all();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	threads.clear();
+	stopThreads = false;
+}
+
+void VertexWorkerPool::run(u32 count, u32 size, const Job& func) {
+	if (threadCount == 0 || count <= size) {
+		func(0, 0, count);
+		return;
+	}
+
+	if (threads.empty()) {
+		for (int i = 0; i < threadCount; i++) {
+			threads.emplace_back(&VertexWorkerPool::threadMain, this, i + 1, jobGeneration);
+		}
+	}
+
+	{
+		std::scoped_lock lock(mutex);
+		job = &func;
+		itemCount = count;
+		chunkSize = size;
+		nextItem = 0;
+		pendingThreads = threadCount;
+		jobGeneration++;
+	}
+	jobStart.notify_all();
+
+	processChunks(0);
+
+	// Wait for the other threads to finish their last chunk, so the job's captures can't go out of scope under them
+	std::unique_lock lock(mutex);
+	jobDone.wait(lock, [this] { return pendingThreads == 0; });
+	job = nullptr;
+}
+
+void VertexWorkerPool::processChunks(int worker) {
+	while (true) {
+		const u32 begin = nextItem.fetch_add(chunkSize, std::memory_order_relaxed);
+		if (begin >= itemCount) {
+			return;
+		}
+
+		(*job)(worker, begin, std::min(begin + chunkSize, itemCount));
+	}
+}
+
+void VertexWorkerPool::threadMain(int worker, u64 generation) {
+	while (true) {
+		{
+			std::unique_lock lock(mutex);
+			jobStart.wait(lock, [&] { return stopThreads || jobGeneration != generation; });
+			if (stopThreads) {
+				return;
+			}
+
+			generation = jobGeneration;
+		}
+
+		processChunks(worker);
+
+		std::scoped_lock lock(mutex);
+		if (--pendingThreads == 0) {
+			jobDone.notify_one();
+		}
+	}
+}
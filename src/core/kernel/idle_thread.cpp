@@ -63,6 +63,7 @@ void Kernel::setupIdleThread() {
 	// (High priority value = low priority)
 	t.priority = 0xff;
 	t.status = ThreadStatus::Ready;
+	t.processorID = 0; // Only the app core idles in a thread, other cores just stop when they have nothing to do
 
 	// Add idle thread to the list of thread indices
 	threadIndices.push_back(idleThreadIndex);
@@ -2,9 +2,10 @@
 #include "kernel.hpp"
 #include "kernel_types.hpp"
 #include "cpu.hpp"
+#include "tracing.hpp"
 
 Kernel::Kernel(CPU& cpu, Memory& mem, GPU& gpu)
-	: cpu(cpu), regs(cpu.regs()), mem(mem), handleCounter(0), serviceManager(regs, mem, gpu, currentProcess, *this) {
+	: cpu(cpu), regs(cpu.kernelRegisters()), mem(mem), handleCounter(0), serviceManager(regs, mem, gpu, currentProcess, *this) {
 	objects.reserve(512); // Make room for a few objects to avoid further memory allocs later
 	portHandles.reserve(32);
 	threadIndices.reserve(appResourceLimits.maxThreads);
@@ -26,6 +27,12 @@ Kernel::Kernel(CPU& cpu, Memory& mem, GPU& gpu)
 }
 
 void Kernel::serviceSVC(u32 svc) {
+	TRACE_SCOPE_ARG("SVC", svc);
+
+	// With the GPU on its own thread, commands finish whenever, so every SVC is a chance to deliver their interrupts
+	// The idle thread keeps calling SleepThread, so this also runs while the guest is waiting on a GPU interrupt
+	serviceManager.pollGPUInterrupts();
+
 	switch (svc) {
 		case 0x01: controlMemory(); break;
 		case 0x02: queryMemory(); break;
@@ -134,6 +141,8 @@ void Kernel::reset() {
 	// which is thankfully not used. Maybe we should prevent this
 	mainThread = makeThread(0, VirtualAddrs::StackTop, 0x30, -2, 0, ThreadStatus::Running);
 	currentThreadIndex = 0;
+	activeCore = 0;
+	coreThreads.fill(-1);
 	setupIdleThread();
 
 	// Create some of the OS ports
@@ -1,4 +1,6 @@
 #include "kernel.hpp"
+// For CPU::StoppedCores, see the comment in threads.cpp about the kernel/CPU forward declarations
+#include "cpu.hpp"
 #include "services/shared_font.hpp"
 
 namespace Operation {
@@ -69,6 +71,9 @@ void Kernel::controlMemory() {
 			addr0, addr1, size, operation, r ? 'r' : '-', w ? 'w' : '-', x ? 'x' : '-', linear ? ", linear" : ""
 	);
 
+	// The other cores read the page tables without locking, so keep them out of guest code while we change them
+	const CPU::StoppedCores stoppedCores(cpu);
+
 	switch (operation & 0xFF) {
 		case Operation::Commit: {
 			std::optional<u32> address = mem.allocateMemory(addr0, 0, size, linear, r, w, x, true);
@@ -124,6 +129,7 @@ void Kernel::mapMemoryBlock() {
 
 	if (KernelHandles::isSharedMemHandle(block)) {
 		if (block == KernelHandles::FontSharedMemHandle && addr == 0) addr = 0x18000000;
+		const CPU::StoppedCores stoppedCores(cpu); // Mapping changes the page tables, see controlMemory
 		u8* ptr = mem.mapSharedMemory(block, addr, myPerms, otherPerms); // Map shared memory block
 
 		// Pass pointer to shared memory to the appropriate service
@@ -9,21 +9,19 @@
 // Switch to another thread
 // newThread: Index of the newThread in the thread array (NOT a handle).
 void Kernel::switchThread(int newThreadIndex) {
-	auto& oldThread = threads[currentThreadIndex];
 	auto& newThread = threads[newThreadIndex];
 	newThread.status = ThreadStatus::Running;
-	logThread("Switching from thread %d to %d\n", currentThreadIndex, newThreadIndex);
+	logThread("Switching from thread %d to %d on core %d\n", currentThreadIndex, newThreadIndex, activeCore);
 
 	// Bail early if the new thread is actually the old thread
 	if (currentThreadIndex == newThreadIndex) [[unlikely]] {
 		return;
 	}
 
-	// Backup context
-	std::memcpy(&oldThread.gprs[0], &cpu.regs()[0], 16 * sizeof(u32)); // Backup the 16 GPRs
-	std::memcpy(&oldThread.fprs[0], &cpu.fprs()[0], 32 * sizeof(u32)); // Backup the 32 FPRs
-	oldThread.cpsr = cpu.getCPSR();   // Backup CPSR
-	oldThread.fpscr = cpu.getFPSCR(); // Backup FPSCR
+	// Backup context, unless the core was idle and had no context to back up
+	if (currentThreadIndex != -1) {
+		saveContext(threads[currentThreadIndex]);
+	}
 
 	// Load new context
 	std::memcpy(&cpu.regs()[0], &newThread.gprs[0], 16 * sizeof(u32)); // Load 16 GPRs
@@ -35,6 +33,14 @@ void Kernel::switchThread(int newThreadIndex) {
 	currentThreadIndex = newThreadIndex;
 }
 
+// Back up the context of the active core into a thread
+void Kernel::saveContext(Thread& thread) {
+	std::memcpy(&thread.gprs[0], &cpu.regs()[0], 16 * sizeof(u32)); // Backup the 16 GPRs
+	std::memcpy(&thread.fprs[0], &cpu.fprs()[0], 32 * sizeof(u32)); // Backup the 32 FPRs
+	thread.cpsr = cpu.getCPSR();   // Backup CPSR
+	thread.fpscr = cpu.getFPSCR(); // Backup FPSCR
+}
+
 // Sort the threadIndices vector based on the priority of each thread
 // The threads with higher priority (aka the ones with a lower priority value) should come first in the vector
 void Kernel::sortThreads() {
@@ -63,14 +69,23 @@ bool Kernel::canThreadRun(const Thread& t) {
 	return false;
 }
 
-// Get the index of the next thread to run by iterating through the thread list and finding the free thread with the highest priority
+// Processor ID -2 means the process' ideal core, which is the app core for applications. -1 means any core that's up
+bool Kernel::canRunOnCore(const Thread& t, int core) {
+	switch (t.processorID) {
+		case -1: return true;
+		case -2: return core == 0;
+		default: return t.processorID == core;
+	}
+}
+
+// Get the index of the next thread to run on the active core by iterating through the thread list and finding the free thread with the highest priority
 // Returns the thread index if a thread is found, or nullopt otherwise
 std::optional<int> Kernel::getNextThread() {
 	for (auto index : threadIndices) {
 		const Thread& t = threads[index];
 
 		// Thread is ready, return it
-		if (canThreadRun(t)) {
+		if (canThreadRun(t) && canRunOnCore(t, activeCore)) {
 			return index;
 		}
 	}
@@ -81,7 +96,19 @@ std::optional<int> Kernel::getNextThread() {
 
 void Kernel::switchToNextThread() {
 	std::optional<int> newThreadIndex = getNextThread();
-	
+
+	// Only the app core has an idle thread. Secondary cores with nothing to run simply stop until the next sync point
+	if (!newThreadIndex.has_value() && activeCore != 0) {
+		if (currentThreadIndex != -1) {
+			saveContext(threads[currentThreadIndex]);
+		}
+
+		logThread("Core %d has no thread to run, idling\n", activeCore);
+		currentThreadIndex = -1;
+		cpu.idleActiveCore();
+		return;
+	}
+
 	if (!newThreadIndex.has_value()) {
 		log("Kernel tried to switch to the next thread but none found. Switching to random thread\n");
 		assert(aliveThreadCount != 0);
@@ -108,6 +135,26 @@ void Kernel::rescheduleThreads() {
 	}
 }
 
+void Kernel::setActiveCore(int core) {
+	coreThreads[activeCore] = currentThreadIndex;
+	currentThreadIndex = coreThreads[core];
+	activeCore = core;
+}
+
+bool Kernel::scheduleActiveCore() {
+	if (currentThreadIndex != -1) {
+		return true;
+	}
+
+	std::optional<int> newThreadIndex = getNextThread();
+	if (!newThreadIndex.has_value()) {
+		return false;
+	}
+
+	switchThread(newThreadIndex.value());
+	return true;
+}
+
 // Internal OS function to spawn a thread
 Handle Kernel::makeThread(u32 entrypoint, u32 initialSP, u32 priority, s32 id, u32 arg, ThreadStatus status) {
 	int index; // Index of the created thread in the  threads array
@@ -157,6 +204,14 @@ Handle Kernel::makeThread(u32 entrypoint, u32 initialSP, u32 priority, s32 id, u
 	// Initial TLS base has already been set in Kernel::Kernel()
 	// TODO: Does svcCreateThread zero-set the TLS of the new thread?
 
+	// Threads pinned to one of the other cores need that core to be up
+	if (id > 0) {
+		if (id >= maxARM11Cores) [[unlikely]] {
+			Helpers::panic("Created thread on non-existent core %d", id);
+		}
+		cpu.enableCore(id);
+	}
+
 	sortThreads();
 	return ret;
 }
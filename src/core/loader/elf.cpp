@@ -7,6 +7,8 @@ using namespace ELFIO;
 
 std::optional<u32> Memory::loadELF(std::ifstream& file) {
     loadedCXI = std::nullopt; // ELF files don't have a CXI, so set this to null
+    elfSymbols.clear();
+    codeSegments.clear();
 
 	elfio reader;
 	if (!file.good() || !reader.load(file)) {
@@ -54,6 +56,30 @@ std::optional<u32> Memory::loadELF(std::ifstream& file) {
 
         // Allocate the segment on the OS side
         allocateMemory(vaddr, fcramAddr, memorySize, true, r, w, x);
+        if (x) {
+            codeSegments.push_back({vaddr, fileSize});
+        }
+    }
+
+    // Collect function symbols, if the ELF hasn't been stripped
+    for (const auto& sec : reader.sections) {
+        if (sec->get_type() != SHT_SYMTAB) {
+            continue;
+        }
+
+        const symbol_section_accessor accessor(reader, sec);
+        for (Elf_Xword i = 0; i < accessor.get_symbols_num(); i++) {
+            std::string name;
+            Elf64_Addr value;
+            Elf_Xword size;
+            unsigned char bind, type, other;
+            Elf_Half sectionIndex;
+
+            if (accessor.get_symbol(i, name, value, size, bind, type, sectionIndex, other) && type == STT_FUNC && value != 0) {
+                // Thumb functions have the LSB of their address set
+                elfSymbols.push_back({static_cast<u32>(value) & ~1u, static_cast<u32>(size), std::move(name), (value & 1) != 0});
+            }
+        }
     }
 
     return static_cast<u32>(reader.get_entry());
@@ -16,7 +16,7 @@ bool NCCH::loadFromHeader(u8* header, IOFile& file) {
     size = u64(*(u32*)&header[0x104]) * mediaUnit; // TODO: Maybe don't type pun because big endian will break
     exheaderSize = *(u32*)&header[0x180];
 
-    const u64 programID = *(u64*)&header[0x118];
+    programID = *(u64*)&header[0x118];
 
     // Read NCCH flags
     isNew3DS = header[0x188 + 4] == 2;
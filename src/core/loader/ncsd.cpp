@@ -118,6 +118,7 @@ std::optional<NCSD> Memory::loadNCSD(const std::filesystem::path& path) {
     allocateMemory(dataAddr, paddr + dataOffset, dataSize, true, true, true, false); // Data+BSS is RW-
 
     ncsd.entrypoint = textAddr;
+    codeSegments = {{textAddr, cxi.text.size}};
 
     // Back the IOFile for accessing the ROM, as well as the ROM's CXI partition, in the memory class.
     CXIFile = ncsd.file;
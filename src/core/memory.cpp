@@ -1,7 +1,9 @@
 #include "memory.hpp"
 #include "config_mem.hpp"
 #include "resource_limits.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <chrono> // For time since epoch
 
 using namespace KernelMemoryTypes;
@@ -218,6 +220,94 @@ std::string Memory::readString(u32 address, u32 maxSize) {
 	return string;
 }
 
+u32 Memory::stringLength(u32 address, u32 maxSize) {
+	u32 length = 0;
+
+	while (length < maxSize) {
+		const u32 chunk = std::min<u32>(pageSize - (address & pageMask), maxSize - length);
+		const u8* pointer = (const u8*)getReadPointer(address);
+
+		if (pointer != nullptr) [[likely]] {
+			const void* terminator = std::memchr(pointer, 0, chunk);
+			if (terminator != nullptr) {
+				return length + u32((const u8*)terminator - pointer);
+			}
+		} else {
+			for (u32 i = 0; i < chunk; i++) {
+				if (read8(address + i) == 0) {
+					return length + i;
+				}
+			}
+		}
+
+		length += chunk;
+		address += chunk;
+	}
+
+	return length;
+}
+
+void Memory::copy(u32 dest, u32 source, u32 size) {
+	// If the destination overlaps the end of the source, we need to copy backwards so we don't clobber bytes we haven't copied yet
+	const bool backwards = dest > source && dest - source < size;
+
+	while (size > 0) {
+		u32 chunk, s, d;
+
+		if (!backwards) {
+			chunk = std::min({size, pageSize - (source & pageMask), pageSize - (dest & pageMask)});
+			s = source;
+			d = dest;
+		} else {
+			// Copy the last (up to) page-sized piece that doesn't straddle a page boundary in either buffer
+			const u32 sourceLast = source + size - 1;
+			const u32 destLast = dest + size - 1;
+			chunk = std::min({size, (sourceLast & pageMask) + 1, (destLast & pageMask) + 1});
+			s = source + size - chunk;
+			d = dest + size - chunk;
+		}
+
+		const u8* sourcePointer = (const u8*)getReadPointer(s);
+		u8* destPointer = (u8*)getWritePointer(d);
+
+		if (sourcePointer != nullptr && destPointer != nullptr) [[likely]] {
+			std::memmove(destPointer, sourcePointer, chunk);
+		} else if (!backwards) {
+			for (u32 i = 0; i < chunk; i++) {
+				write8(d + i, read8(s + i));
+			}
+		} else {
+			for (u32 i = chunk; i-- > 0;) {
+				write8(d + i, read8(s + i));
+			}
+		}
+
+		size -= chunk;
+		if (!backwards) {
+			source += chunk;
+			dest += chunk;
+		}
+	}
+}
+
+void Memory::fill(u32 dest, u8 value, u32 size) {
+	while (size > 0) {
+		const u32 chunk = std::min(size, pageSize - (dest & pageMask));
+		u8* pointer = (u8*)getWritePointer(dest);
+
+		if (pointer != nullptr) [[likely]] {
+			std::memset(pointer, value, chunk);
+		} else {
+			for (u32 i = 0; i < chunk; i++) {
+				write8(dest + i, value);
+			}
+		}
+
+		size -= chunk;
+		dest += chunk;
+	}
+}
+
 // Return a pointer to the linear heap vaddr based on the kernel ver, because it needed to be moved
 // thanks to the New 3DS having more FCRAM
 u32 Memory::getLinearHeapVaddr() {
@@ -0,0 +1,368 @@
+#include "renderer_gl/fragment_shader_gen.hpp"
+#include <cstdio>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+#include "PICA/float_types.hpp"
+
+using namespace Helpers;
+
+namespace {
+	// Everything both the specialised shaders & the uber-shader need
+	constexpr const char* shaderHeader = R"(#version 410 core
+
+in vec4 colour;
+in vec2 tex0_UVs;
+
+out vec4 fragColour;
+
+uniform sampler2D u_tex0;
+
+layout (std140) uniform FragmentUniforms {
+	uvec4 tevConfig[6]; // Source, operand, combiner & scale registers of each TEV stage
+	vec4 tevConstColour[6];
+	vec4 tevBufferColour;
+	uint tevBufferConfig;
+	uint alphaControl;
+	uint textureConfig;
+	float depthScale;
+	float depthOffset;
+	uint depthmapEnable;
+};
+
+float getDepth(bool depthmapEnable) {
+	// Get original depth value by converting from [near, far] = [0, 1] to [-1, 1]
+	// We do this by converting to [0, 2] first and subtracting 1 to go to [-1, 1]
+	float z_over_w = gl_FragCoord.z * 2.0f - 1.0f;
+	float depth = z_over_w * depthScale + depthOffset;
+
+	if (!depthmapEnable) // Divide z by w if depthmap enable == 0 (ie using W-buffering)
+		depth /= gl_FragCoord.w;
+
+	return depth;
+}
+
+bool alphaTestFails(uint func, float alpha) {
+	float reference = float((alphaControl >> 8u) & 0xffu) / 255.0;
+
+	switch (func) {
+		case 0u: return true;                // Never pass alpha test
+		case 1u: return false;               // Always pass alpha test
+		case 2u: return alpha != reference;  // Pass if equal
+		case 3u: return alpha == reference;  // Pass if not equal
+		case 4u: return alpha >= reference;  // Pass if less than
+		case 5u: return alpha > reference;   // Pass if less than or equal
+		case 6u: return alpha <= reference;  // Pass if greater than
+		default: return alpha < reference;   // Pass if greater than or equal
+	}
+}
+)";
+
+	// The uber-shader does everything the generator does, but with switches on the config registers
+	constexpr const char* uberShaderBody = R"(
+vec4 tevSource(uint source, vec4 tex0, vec4 combinerBuffer, vec4 constColour, vec4 previous) {
+	switch (source) {
+		case 0u: return colour;
+		case 3u: return tex0;
+		case 13u: return combinerBuffer;
+		case 14u: return constColour;
+		case 15u: return previous;
+		default: return vec4(0.0); // Fragment lighting & texture units 1-3 aren't emulated
+	}
+}
+
+vec3 tevColourOperand(vec4 source, uint operand) {
+	switch (operand) {
+		case 1u: return vec3(1.0) - source.rgb;
+		case 2u: return source.aaa;
+		case 3u: return vec3(1.0) - source.aaa;
+		case 4u: return source.rrr;
+		case 5u: return vec3(1.0) - source.rrr;
+		case 8u: return source.ggg;
+		case 9u: return vec3(1.0) - source.ggg;
+		case 12u: return source.bbb;
+		case 13u: return vec3(1.0) - source.bbb;
+		default: return source.rgb;
+	}
+}
+
+float tevAlphaOperand(vec4 source, uint operand) {
+	switch (operand) {
+		case 1u: return 1.0 - source.a;
+		case 2u: return source.r;
+		case 3u: return 1.0 - source.r;
+		case 4u: return source.g;
+		case 5u: return 1.0 - source.g;
+		case 6u: return source.b;
+		case 7u: return 1.0 - source.b;
+		default: return source.a;
+	}
+}
+
+vec3 tevCombineColour(uint combiner, vec3 a, vec3 b, vec3 c) {
+	switch (combiner) {
+		case 1u: return a * b;
+		case 2u: return a + b;
+		case 3u: return a + b - 0.5;
+		case 4u: return mix(b, a, c);
+		case 5u: return a - b;
+		case 6u:
+		case 7u: return vec3(4.0 * dot(a - 0.5, b - 0.5));
+		case 8u: return a * b + c;
+		case 9u: return min(a + b, 1.0) * c;
+		default: return a;
+	}
+}
+
+float tevCombineAlpha(uint combiner, float a, float b, float c) {
+	switch (combiner) {
+		case 1u: return a * b;
+		case 2u: return a + b;
+		case 3u: return a + b - 0.5;
+		case 4u: return mix(b, a, c);
+		case 5u: return a - b;
+		case 8u: return a * b + c;
+		case 9u: return min(a + b, 1.0) * c;
+		default: return a;
+	}
+}
+
+float tevScale(uint scale) { return (scale == 1u) ? 2.0 : ((scale == 2u) ? 4.0 : 1.0); }
+
+void main() {
+	vec4 tex0 = ((textureConfig & 1u) != 0u) ? texture(u_tex0, tex0_UVs) : vec4(0.0);
+	vec4 previous = vec4(0.0);
+	vec4 combinerBuffer = vec4(0.0);
+	vec4 nextCombinerBuffer = tevBufferColour;
+
+	for (int stage = 0; stage < 6; stage++) {
+		uvec4 config = tevConfig[stage];
+		vec3 colourInputs[3];
+		float alphaInputs[3];
+
+		for (uint n = 0u; n < 3u; n++) {
+			vec4 colourSource = tevSource((config.x >> (4u * n)) & 15u, tex0, combinerBuffer, tevConstColour[stage], previous);
+			vec4 alphaSource = tevSource((config.x >> (16u + 4u * n)) & 15u, tex0, combinerBuffer, tevConstColour[stage], previous);
+			colourInputs[n] = tevColourOperand(colourSource, (config.y >> (4u * n)) & 15u);
+			alphaInputs[n] = tevAlphaOperand(alphaSource, (config.y >> (12u + 4u * n)) & 7u);
+		}
+
+		uint colourCombiner = config.z & 15u;
+		vec3 rgb = clamp(tevCombineColour(colourCombiner, colourInputs[0], colourInputs[1], colourInputs[2]), 0.0, 1.0);
+		float alpha = (colourCombiner == 7u) ? rgb.r :
+			clamp(tevCombineAlpha((config.z >> 16u) & 15u, alphaInputs[0], alphaInputs[1], alphaInputs[2]), 0.0, 1.0);
+		previous = clamp(vec4(rgb * tevScale(config.w & 3u), alpha * tevScale((config.w >> 16u) & 3u)), 0.0, 1.0);
+
+		// Writes to the combiner buffer only show up a stage later. Only the first 4 stages can write to it
+		combinerBuffer = nextCombinerBuffer;
+		if (stage < 4) {
+			if ((tevBufferConfig & (1u << (8 + stage))) != 0u) nextCombinerBuffer.rgb = previous.rgb;
+			if ((tevBufferConfig & (1u << (12 + stage))) != 0u) nextCombinerBuffer.a = previous.a;
+		}
+	}
+
+	fragColour = previous;
+	gl_FragDepth = getDepth(depthmapEnable != 0u);
+
+	if ((alphaControl & 1u) != 0u && alphaTestFails((alphaControl >> 4u) & 7u, fragColour.a)) {
+		discard;
+	}
+}
+)";
+
+	float scaleFactor(u32 scale) { return (scale == 1) ? 2.0f : ((scale == 2) ? 4.0f : 1.0f); }
+}  // namespace
+
+FragmentConfig FragmentConfig::fromRegs(const std::array<u32, 0x300>& regs) {
+	using namespace PICAInternalRegs;
+	FragmentConfig config;
+
+	for (int i = 0; i < tevStageCount; i++) {
+		const u32 base = tevStageRegs[i];
+		config.tevSources[i] = regs[base];
+		config.tevOperands[i] = regs[base + 1];
+		config.tevCombiners[i] = regs[base + 2];
+		config.tevScales[i] = regs[base + 4];
+	}
+
+	config.tevBufferUpdate = regs[TexEnvBufferConfig] & 0xff00;
+	const u32 alphaControl = regs[AlphaTestConfig];
+	config.alphaTestFunction = (alphaControl & 1) ? getBits<4, 3>(alphaControl) : 1;
+	config.texture0Enable = regs[TexUnitCfg] & 1;
+	config.depthmapEnable = regs[DepthmapEnable] & 1;
+	return config;
+}
+
+u64 FragmentConfig::getHash() const {
+	static_assert(std::has_unique_object_representations_v<FragmentConfig>, "FragmentConfig can't be hashed as raw bytes");
+	return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(this), sizeof(*this)));
+}
+
+FragmentUniforms FragmentUniforms::fromRegs(const std::array<u32, 0x300>& regs) {
+	using namespace PICAInternalRegs;
+	FragmentUniforms uniforms = {};
+
+	// Colours are stored as RGBA8, with red in the bottom byte
+	const auto unpackColour = [](float* out, u32 colour) {
+		for (int component = 0; component < 4; component++) {
+			out[component] = float((colour >> (component * 8)) & 0xff) / 255.0f;
+		}
+	};
+
+	for (int i = 0; i < FragmentConfig::tevStageCount; i++) {
+		const u32 base = FragmentConfig::tevStageRegs[i];
+		uniforms.tevConfig[i][0] = regs[base];
+		uniforms.tevConfig[i][1] = regs[base + 1];
+		uniforms.tevConfig[i][2] = regs[base + 2];
+		uniforms.tevConfig[i][3] = regs[base + 4];
+		unpackColour(uniforms.tevConstColour[i], regs[base + 3]);
+	}
+
+	unpackColour(uniforms.tevBufferColour, regs[TexEnvBufferColour]);
+	uniforms.tevBufferConfig = regs[TexEnvBufferConfig];
+	uniforms.alphaControl = regs[AlphaTestConfig];
+	uniforms.textureConfig = regs[TexUnitCfg];
+	uniforms.depthScale = Floats::f24::fromRaw(regs[DepthScale] & 0xffffff).toFloat32();
+	uniforms.depthOffset = Floats::f24::fromRaw(regs[DepthOffset] & 0xffffff).toFloat32();
+	uniforms.depthmapEnable = regs[DepthmapEnable] & 1;
+	return uniforms;
+}
+
+std::string FragmentShaderGenerator::generateUberShader() { return std::string(shaderHeader) + uberShaderBody; }
+
+std::string FragmentShaderGenerator::generate(const FragmentConfig& config) {
+	FragmentShaderGenerator generator(config);
+	std::string& source = generator.source;
+
+	source = shaderHeader;
+	source += "\nvoid main() {\n";
+	source += config.texture0Enable ? "\tvec4 tex0 = texture(u_tex0, tex0_UVs);\n" : "\tvec4 tex0 = vec4(0.0);\n";
+	source += "\tvec4 previous = vec4(0.0);\n";
+	source += "\tvec4 combinerBuffer = vec4(0.0);\n";
+	source += "\tvec4 nextCombinerBuffer = tevBufferColour;\n";
+	source += "\tvec3 rgb;\n";
+	source += "\tfloat alpha;\n";
+
+	for (int stage = 0; stage < FragmentConfig::tevStageCount; stage++) {
+		generator.emitStage(stage);
+	}
+
+	source += "\n\tfragColour = previous;\n";
+	source += config.depthmapEnable ? "\tgl_FragDepth = getDepth(true);\n" : "\tgl_FragDepth = getDepth(false);\n";
+
+	// The function is a constant, so the switch in alphaTestFails folds down to a single comparison
+	if (config.alphaTestFunction != 1) {
+		source += "\tif (alphaTestFails(" + std::to_string(config.alphaTestFunction) + "u, fragColour.a)) discard;\n";
+	}
+
+	source += "}\n";
+	return source;
+}
+
+void FragmentShaderGenerator::emitStage(int stage) {
+	const u32 sources = config.tevSources[stage];
+	const u32 operands = config.tevOperands[stage];
+	const u32 combiners = config.tevCombiners[stage];
+	const u32 scales = config.tevScales[stage];
+
+	const u32 colourCombiner = combiners & 0xf;
+	const u32 alphaCombiner = getBits<16, 4>(combiners);
+	const u32 colourScale = scales & 3;
+	const u32 alphaScale = getBits<16, 2>(scales);
+
+	// Stages that output the previous stage's result as is are pretty common, and don't need any code other than the buffer update
+	const bool passthrough = (sources & 0xf) == 0xf && getBits<16, 4>(sources) == 0xf && (operands & 0xf) == 0 &&
+							 getBits<12, 3>(operands) == 0 && colourCombiner == 0 && alphaCombiner == 0 && colourScale == 0 && alphaScale == 0;
+	source += "\n\t// TEV stage " + std::to_string(stage) + "\n";
+
+	if (!passthrough) {
+		std::array<std::string, 3> colourInputs;
+		std::array<std::string, 3> alphaInputs;
+		for (u32 n = 0; n < 3; n++) {
+			colourInputs[n] = getColourOperand(getSource(stage, (sources >> (4 * n)) & 0xf), (operands >> (4 * n)) & 0xf);
+			alphaInputs[n] = getAlphaOperand(getSource(stage, (sources >> (16 + 4 * n)) & 0xf), (operands >> (12 + 4 * n)) & 0x7);
+		}
+
+		source += "\trgb = clamp(" + getCombiner(colourCombiner, colourInputs[0], colourInputs[1], colourInputs[2], false) + ", 0.0, 1.0);\n";
+		if (colourCombiner == 7) { // Dot3 RGBA writes the dot product to alpha too
+			source += "\talpha = rgb.r;\n";
+		} else {
+			source += "\talpha = clamp(" + getCombiner(alphaCombiner, alphaInputs[0], alphaInputs[1], alphaInputs[2], true) + ", 0.0, 1.0);\n";
+		}
+
+		char line[128];
+		std::snprintf(line, sizeof(line), "\tprevious = clamp(vec4(rgb * %.1f, alpha * %.1f), 0.0, 1.0);\n", scaleFactor(colourScale),
+					  scaleFactor(alphaScale));
+		source += line;
+	}
+
+	// Writes to the combiner buffer only show up a stage later. Only the first 4 stages can write to it
+	source += "\tcombinerBuffer = nextCombinerBuffer;\n";
+	if (stage < 4) {
+		if (config.tevBufferUpdate & (1 << (8 + stage))) {
+			source += "\tnextCombinerBuffer.rgb = previous.rgb;\n";
+		}
+
+		if (config.tevBufferUpdate & (1 << (12 + stage))) {
+			source += "\tnextCombinerBuffer.a = previous.a;\n";
+		}
+	}
+}
+
+std::string FragmentShaderGenerator::getSource(int stage, u32 source) {
+	switch (source) {
+		case 0: return "colour";
+		case 3: return "tex0";
+		case 13: return "combinerBuffer";
+		case 14: return "tevConstColour[" + std::to_string(stage) + "]";
+		case 15: return "previous";
+		default: return "vec4(0.0)"; // Fragment lighting & texture units 1-3 aren't emulated
+	}
+}
+
+std::string FragmentShaderGenerator::getColourOperand(const std::string& source, u32 operand) {
+	switch (operand) {
+		case 1: return "(vec3(1.0) - " + source + ".rgb)";
+		case 2: return source + ".aaa";
+		case 3: return "(vec3(1.0) - " + source + ".aaa)";
+		case 4: return source + ".rrr";
+		case 5: return "(vec3(1.0) - " + source + ".rrr)";
+		case 8: return source + ".ggg";
+		case 9: return "(vec3(1.0) - " + source + ".ggg)";
+		case 12: return source + ".bbb";
+		case 13: return "(vec3(1.0) - " + source + ".bbb)";
+		default: return source + ".rgb";
+	}
+}
+
+std::string FragmentShaderGenerator::getAlphaOperand(const std::string& source, u32 operand) {
+	switch (operand) {
+		case 1: return "(1.0 - " + source + ".a)";
+		case 2: return source + ".r";
+		case 3: return "(1.0 - " + source + ".r)";
+		case 4: return source + ".g";
+		case 5: return "(1.0 - " + source + ".g)";
+		case 6: return source + ".b";
+		case 7: return "(1.0 - " + source + ".b)";
+		default: return source + ".a";
+	}
+}
+
+std::string FragmentShaderGenerator::getCombiner(u32 combiner, const std::string& a, const std::string& b, const std::string& c,
+												 bool alpha) {
+	switch (combiner) {
+		case 1: return a + " * " + b;
+		case 2: return a + " + " + b;
+		case 3: return a + " + " + b + " - 0.5";
+		case 4: return "mix(" + b + ", " + a + ", " + c + ")";
+		case 5: return a + " - " + b;
+		case 6:
+		case 7:
+			// Dot3 only exists for the colour combiner
+			if (alpha) return a;
+			return "vec3(4.0 * dot(" + a + " - 0.5, " + b + " - 0.5))";
+		case 8: return a + " * " + b + " + " + c;
+		case 9: return "min(" + a + " + " + b + ", 1.0) * " + c;
+		default: return a;
+	}
+}
@@ -1,7 +1,13 @@
 #include "renderer_gl/renderer_gl.hpp"
+#include <cstring>
+#include <functional>
+#include <string_view>
 #include "PICA/float_types.hpp"
 #include "PICA/gpu.hpp"
 #include "PICA/regs.hpp"
+#include "PICA/shader_decompiler.hpp"
+#include "renderer_gl/fragment_shader_gen.hpp"
+#include "tracing.hpp"
 
 using namespace Floats;
 using namespace Helpers;
@@ -27,79 +33,6 @@ const char* vertexShader = R"(
 	}
 )";
 
-const char* fragmentShader = R"(
-	#version 410 core
-	
-	in vec4 colour;
-	in vec2 tex0_UVs;
-
-	out vec4 fragColour;
-
-	uniform uint u_alphaControl;
-	uniform uint u_textureConfig;
-
-	// Depth control uniforms
-	uniform float u_depthScale;
-	uniform float u_depthOffset;
-	uniform bool u_depthmapEnable;
-
-	uniform sampler2D u_tex0;
-
-	void main() {
-		if ((u_textureConfig & 1u) != 0) { // Render texture 0 if enabled
-			fragColour = texture(u_tex0, tex0_UVs);
-		} else {
-			fragColour = colour;
-		}
-
-		// Get original depth value by converting from [near, far] = [0, 1] to [-1, 1]
-		// We do this by converting to [0, 2] first and subtracting 1 to go to [-1, 1]
-		float z_over_w = gl_FragCoord.z * 2.0f - 1.0f;
-		float depth = z_over_w * u_depthScale + u_depthOffset;
-
-		if (!u_depthmapEnable) // Divide z by w if depthmap enable == 0 (ie using W-buffering)
-			depth /= gl_FragCoord.w;
-
-		// Write final fragment depth
-		gl_FragDepth = depth;
-
-		if ((u_alphaControl & 1u) != 0u) { // Check if alpha test is on
-			uint func = (u_alphaControl >> 4u) & 7u;
-			float reference = float((u_alphaControl >> 8u) & 0xffu) / 255.0;
-			float alpha = fragColour.a;
-
-			switch (func) {
-				case 0: discard; // Never pass alpha test
-				case 1: break;          // Always pass alpha test
-				case 2:                 // Pass if equal
-					if (alpha != reference)
-						discard;
-					break;
-				case 3:                 // Pass if not equal
-					if (alpha == reference)
-						discard;
-					break;
-				case 4:                 // Pass if less than
-					if (alpha >= reference)
-						discard;
-					break;
-				case 5:                 // Pass if less than or equal
-					if (alpha > reference)
-						discard;
-					break;
-				case 6:                 // Pass if greater than
-					if (alpha <= reference)
-						discard;
-					break;
-				case 7:                 // Pass if greater than or equal
-					if (alpha < reference)
-						discard;
-					break;
-			}
-		}
-	}
-)";
-
 const char* displayVertexShader = R"(
 	#version 410 core
 	out vec2 UV;
@@ -138,6 +71,10 @@ const char* displayFragmentShader = R"(
 )";
 
 void Renderer::reset() {
+	batchVertices.clear();
+	batchIndices.clear();
+	dirtyState = DirtyAll;
+
 	depthBufferCache.reset();
 	colourBufferCache.reset();
 	textureCache.reset();
@@ -148,42 +85,31 @@ void Renderer::reset() {
 
 	depthBufferLoc = 0;
 	depthBufferFormat = DepthBuffer::Formats::Depth16;
-
-	if (triangleProgram.exists()) {
-		const auto oldProgram = OpenGL::getProgram();
-
-		triangleProgram.use();
-		oldAlphaControl = 0; // Default alpha control to 0
-		oldTexUnitConfig = 0; // Default tex unit config to 0
-		
-		oldDepthScale = -1.0; // Default depth scale to -1.0, which is what games typically use
-		oldDepthOffset = 0.0; // Default depth offset to 0
-		oldDepthmapEnable = false; // Enable w buffering
-
-		glUniform1ui(alphaControlLoc, oldAlphaControl);
-		glUniform1ui(texUnitConfigLoc, oldTexUnitConfig);
-		glUniform1f(depthScaleLoc, oldDepthScale);
-		glUniform1f(depthOffsetLoc, oldDepthOffset);
-		glUniform1i(depthmapEnableLoc, oldDepthmapEnable);
-
-		glUseProgram(oldProgram); // Switch to old GL program
-	}
+	// The fragment uniforms get recomputed from the freshly reset registers on the next draw, as everything is dirty now
 }
 
 void Renderer::initGraphicsContext() {
-	OpenGL::Shader vert(vertexShader, OpenGL::Vertex);
-	OpenGL::Shader frag(fragmentShader, OpenGL::Fragment);
-	triangleProgram.create({ vert, frag });
+	vertShader.create(vertexShader, OpenGL::Vertex);
+	fragShader.create(FragmentShaderGenerator::generateUberShader(), OpenGL::Fragment);
+	triangleProgram.create({ vertShader, fragShader });
 	triangleProgram.use();
-	
-	alphaControlLoc = OpenGL::uniformLocation(triangleProgram, "u_alphaControl");
-	texUnitConfigLoc = OpenGL::uniformLocation(triangleProgram, "u_textureConfig");
 
-	depthScaleLoc = OpenGL::uniformLocation(triangleProgram, "u_depthScale");
-	depthOffsetLoc = OpenGL::uniformLocation(triangleProgram, "u_depthOffset");
-	depthmapEnableLoc = OpenGL::uniformLocation(triangleProgram, "u_depthmapEnable");
+	glUniformBlockBinding(triangleProgram.handle(), glGetUniformBlockIndex(triangleProgram.handle(), "FragmentUniforms"), 1);
 	glUniform1i(OpenGL::uniformLocation(triangleProgram, "u_tex0"), 0); // Init sampler object
 
+	// Fragment uniforms, shared by the uber-shader & all the specialised programs. Starts out matching our copy of it
+	fragmentUniforms = {};
+	glGenBuffers(1, &fragmentUniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, fragmentUniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FragmentUniforms), &fragmentUniforms, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 1, fragmentUniformBuffer);
+
+	// Let the driver compile specialised fragment programs on its own threads if it can, with as many threads as it wants
+	parallelShaderCompile = OpenGL::extensionSupported("GL_ARB_parallel_shader_compile");
+	if (parallelShaderCompile) {
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}
+
 	OpenGL::Shader vertDisplay(displayVertexShader, OpenGL::Vertex);
 	OpenGL::Shader fragDisplay(displayFragmentShader, OpenGL::Fragment);
 	displayProgram.create({ vertDisplay, fragDisplay });
@@ -191,8 +117,7 @@ void Renderer::initGraphicsContext() {
 
 	glUniform1i(OpenGL::uniformLocation(displayProgram, "u_texture"), 0); // Init sampler object
 
-	vbo.createFixedSize(sizeof(Vertex) * vertexBufferSize, GL_STREAM_DRAW);
-	vbo.bind();
+	vertexStream.create(GL_ARRAY_BUFFER, vertexStreamSize);
 	vao.create();
 	vao.bind();
 
@@ -206,6 +131,24 @@ void Renderer::initGraphicsContext() {
 	vao.setAttributeFloat<float>(2, 2, sizeof(Vertex), offsetof(Vertex, UVs));
 	vao.enableAttribute(2);
 
+	// Index buffer for indexed draws, which reference the vertex buffer above. Its binding is part of the VAO state
+	indexStream.create(GL_ELEMENT_ARRAY_BUFFER, indexStreamSize);
+
+	// Translated vertex shaders read the raw attribute buffers instead, which get their own VAO since the layout changes every draw
+	hardwareVbo.create();
+	hardwareVao.create();
+	hardwareVao.bind();
+	glGenBuffers(1, &hardwareIndexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hardwareIndexBuffer);
+
+	glGenBuffers(1, &uniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(HardwareShaderUniforms), nullptr, GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniformBuffer);
+
+	vertexStream.bind();
+	vao.bind();
+
 	dummyVBO.create();
 	dummyVAO.create();
 	reset();
@@ -214,10 +157,11 @@ void Renderer::initGraphicsContext() {
 void Renderer::getGraphicsContext() {
 	OpenGL::disableScissor();
 	OpenGL::setViewport(400, 240);
+	dirtyState |= DirtyViewport;
 
-	vbo.bind();
+	vertexStream.bind();
 	vao.bind();
-	triangleProgram.use();
+	OpenGL::useProgram(getActiveProgram());
 }
 
 // Set up the OpenGL blending context to match the emulated PICA
@@ -260,56 +204,113 @@ void Renderer::setupBlending() {
 		OpenGL::setBlendColor(float(r) / 255.f, float(g) / 255.f, float(b) / 255.f, float(a) / 255.f);
 
 		// Translate equations and funcs to their GL equivalents and set them
-		glBlendEquationSeparate(blendingEquations[rgbEquation], blendingEquations[alphaEquation]);
-		glBlendFuncSeparate(blendingFuncs[rgbSourceFunc], blendingFuncs[rgbDestFunc], blendingFuncs[alphaSourceFunc], blendingFuncs[alphaDestFunc]);
+		OpenGL::setBlendEquation(blendingEquations[rgbEquation], blendingEquations[alphaEquation]);
+		OpenGL::setBlendFactor(blendingFuncs[rgbSourceFunc], blendingFuncs[rgbDestFunc], blendingFuncs[alphaSourceFunc], blendingFuncs[alphaDestFunc]);
 	}
 }
 
-void Renderer::drawVertices(OpenGL::Primitives primType, Vertex* vertices, u32 count) {
-	// Adjust alpha test if necessary
-	const u32 alphaControl = regs[PICAInternalRegs::AlphaTestConfig];
-	if (alphaControl != oldAlphaControl) {
-		oldAlphaControl = alphaControl;
-		glUniform1ui(alphaControlLoc, alphaControl);
+const std::array<u8, Renderer::regNum> Renderer::regStateGroups = Renderer::buildRegStateGroups();
+
+std::array<u8, Renderer::regNum> Renderer::buildRegStateGroups() {
+	using namespace PICAInternalRegs;
+	std::array<u8, regNum> groups = {};
+
+	for (u32 index = batchStateStart; index < batchStateEnd; index++) {
+		groups[index] |= DirtyBatchState;
 	}
 
-	setupBlending();
-	OpenGL::Framebuffer poop = getColourFBO();
-	poop.bind(OpenGL::DrawAndReadFramebuffer);
+	groups[ColourOperation] |= DirtyBlending;
+	groups[BlendFunc] |= DirtyBlending;
+	groups[BlendColour] |= DirtyBlending;
+	groups[DepthAndColorMask] |= DirtyDepthAndColourMask;
+	groups[ViewportWidth] |= DirtyViewport;
+	groups[ViewportHeight] |= DirtyViewport;
 
-	const u32 depthControl = regs[PICAInternalRegs::DepthAndColorMask];
-	const bool depthEnable = depthControl & 1;
-	const bool depthWriteEnable = getBit<12>(depthControl);
-	const int depthFunc = getBits<4, 3>(depthControl);
-	const int colourMask = getBits<8, 4>(depthControl);
-	glColorMask(colourMask & 1, colourMask & 2, colourMask & 4, colourMask & 8);
+	// Everything in FragmentUniforms, which includes the whole config for the uber-shader
+	for (u32 index : {AlphaTestConfig, TexUnitCfg, DepthScale, DepthOffset, DepthmapEnable, TexEnvBufferConfig, TexEnvBufferColour}) {
+		groups[index] |= DirtyFragmentUniforms;
+	}
 
-	static constexpr std::array<GLenum, 8> depthModes = {
-		GL_NEVER, GL_ALWAYS, GL_EQUAL, GL_NOTEQUAL, GL_LESS, GL_LEQUAL, GL_GREATER, GL_GEQUAL
-	};
+	// Everything in FragmentConfig
+	for (u32 index : {AlphaTestConfig, TexUnitCfg, DepthmapEnable, TexEnvBufferConfig}) {
+		groups[index] |= DirtyFragmentProgram;
+	}
 
-	const float depthScale = f24::fromRaw(regs[PICAInternalRegs::DepthScale] & 0xffffff).toFloat32();
-	const float depthOffset = f24::fromRaw(regs[PICAInternalRegs::DepthOffset] & 0xffffff).toFloat32();
-	const bool depthMapEnable = regs[PICAInternalRegs::DepthmapEnable] & 1;
+	for (u32 stage : FragmentConfig::tevStageRegs) {
+		for (u32 index = stage; index < stage + 5; index++) {
+			groups[index] |= DirtyFragmentUniforms;
+		}
 
-	// Update depth uniforms
-	if (oldDepthScale != depthScale) {
-		oldDepthScale = depthScale;
-		glUniform1f(depthScaleLoc, depthScale);
+		// All of the stage's registers but the constant colour
+		groups[stage] |= DirtyFragmentProgram;
+		groups[stage + 1] |= DirtyFragmentProgram;
+		groups[stage + 2] |= DirtyFragmentProgram;
+		groups[stage + 4] |= DirtyFragmentProgram;
 	}
-	
-	if (oldDepthOffset != depthOffset) {
-		oldDepthOffset = depthOffset;
-		glUniform1f(depthOffsetLoc, depthOffset);
+
+	// Texture unit 0 config, from the enable bit in TexUnitCfg up to the format register
+	for (u32 index = TexUnitCfg; index <= 0x8E; index++) {
+		groups[index] |= DirtyTexture;
 	}
 
-	if (oldDepthmapEnable != depthMapEnable) {
-		oldDepthmapEnable = depthMapEnable;
-		glUniform1i(depthmapEnableLoc, depthMapEnable);
+	return groups;
+}
+
+// Sync the GL state with the PICA registers before a draw. Only the state groups that changed since the last draw get updated
+void Renderer::prepareDraw() {
+	if (dirtyState & DirtyFragmentProgram) {
+		activeFragmentProgram = getFragmentProgram(FragmentConfig::fromRegs(regs));
+	}
+
+	// Not just when the config changed, as the config's program might have finished compiling since the last draw
+	OpenGL::useProgram(getActiveProgram());
+
+	if (dirtyState & DirtyFragmentUniforms) {
+		updateFragmentUniforms();
+	}
+
+	if (dirtyState & DirtyBlending) {
+		setupBlending();
+	}
+
+	// The framebuffer isn't part of the dirty state, as the surface cache decides which one we get
+	OpenGL::Framebuffer poop = getColourFBO();
+	poop.bind(OpenGL::DrawAndReadFramebuffer);
+
+	if (dirtyState & DirtyDepthAndColourMask) {
+		const u32 depthControl = regs[PICAInternalRegs::DepthAndColorMask];
+		const bool depthEnable = depthControl & 1;
+		const bool depthWriteEnable = getBit<12>(depthControl);
+		const int depthFunc = getBits<4, 3>(depthControl);
+		const int colourMask = getBits<8, 4>(depthControl);
+		OpenGL::setColorMask(colourMask & 1, colourMask & 2, colourMask & 4, colourMask & 8);
+
+		static constexpr std::array<GLenum, 8> depthModes = {
+			GL_NEVER, GL_ALWAYS, GL_EQUAL, GL_NOTEQUAL, GL_LESS, GL_LEQUAL, GL_GREATER, GL_GEQUAL
+		};
+
+		depthBufferNeeded = depthEnable || depthWriteEnable;
+		if (depthEnable) {
+			OpenGL::enableDepth();
+			OpenGL::setDepthFunc(depthModes[depthFunc]);
+			OpenGL::setDepthMask(depthWriteEnable);
+		} else if (depthWriteEnable) {
+			OpenGL::enableDepth();
+			OpenGL::setDepthFunc(OpenGL::Always);
+			OpenGL::setDepthMask(true);
+		} else {
+			OpenGL::disableDepth();
+		}
+	}
+
+	// Note: This must execute after we've bound the colour buffer & its framebuffer
+	// Because it attaches a depth texture to the aforementioned colour buffer
+	if (depthBufferNeeded) {
+		bindDepthBuffer();
 	}
 
 	// Hack for rendering texture 1
-	if (regs[0x80] & 1) {
+	if ((dirtyState & DirtyTexture) && (regs[0x80] & 1)) {
 		const u32 dim = regs[0x82];
 		const u32 config = regs[0x83];
 		const u32 height = dim & 0x7ff;
@@ -322,38 +323,293 @@ void Renderer::drawVertices(OpenGL::Primitives primType, Vertex* vertices, u32 c
 		tex.bind();
 	}
 
-	// Update the texture unit configuration uniform if it changed
-	const u32 texUnitConfig = regs[PICAInternalRegs::TexUnitCfg];
-	if (oldTexUnitConfig != texUnitConfig) {
-		oldTexUnitConfig = texUnitConfig;
-		glUniform1ui(texUnitConfigLoc, texUnitConfig);
+	// TODO: Actually use this
+	if (dirtyState & DirtyViewport) {
+		float viewportWidth = f24::fromRaw(regs[PICAInternalRegs::ViewportWidth] & 0xffffff).toFloat32() * 2.0;
+		float viewportHeight = f24::fromRaw(regs[PICAInternalRegs::ViewportHeight] & 0xffffff).toFloat32() * 2.0;
+		OpenGL::setViewport(viewportWidth, viewportHeight);
 	}
 
-	// TODO: Actually use this
-	float viewportWidth = f24::fromRaw(regs[PICAInternalRegs::ViewportWidth] & 0xffffff).toFloat32() * 2.0;
-	float viewportHeight = f24::fromRaw(regs[PICAInternalRegs::ViewportHeight] & 0xffffff).toFloat32() * 2.0;
-	OpenGL::setViewport(viewportWidth, viewportHeight);
+	dirtyState &= DirtyBatchState;
+}
 
-	// Note: The code below must execute after we've bound the colour buffer & its framebuffer
-	// Because it attaches a depth texture to the aforementioned colour buffer
-	if (depthEnable) {
-		OpenGL::enableDepth();
-		glDepthFunc(depthModes[depthFunc]);
-		glDepthMask(depthWriteEnable ? GL_TRUE : GL_FALSE);
-		bindDepthBuffer();
+Renderer::FragmentProgram* Renderer::getFragmentProgram(const FragmentConfig& config) {
+	const u64 hash = config.getHash();
+	if (std::unique_ptr<FragmentProgram>* cached = fragmentProgramCache.find(hash); cached != nullptr) {
+		return cached->get();
+	}
+
+	TRACE_SCOPE("Renderer::compileFragmentProgram");
+	const std::string source = FragmentShaderGenerator::generate(config);
+	const GLchar* const sources[1] = { source.c_str() };
+
+	// Compile & link without checking how it went, which would make the driver finish compiling right away instead of in the background.
+	// isFragmentProgramReady checks the result once it's done
+	const GLuint frag = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(frag, 1, sources, nullptr);
+	glCompileShader(frag);
+
+	auto fragmentProgram = std::make_unique<FragmentProgram>();
+	const GLuint handle = glCreateProgram();
+	glAttachShader(handle, vertShader.handle());
+	glAttachShader(handle, frag);
+	glLinkProgram(handle);
+	glDeleteShader(frag); // The program holds on to it
+	fragmentProgram->program.m_handle = handle;
+
+	return fragmentProgramCache.insert(hash, std::move(fragmentProgram)).get();
+}
+
+bool Renderer::isFragmentProgramReady(FragmentProgram& fragmentProgram) {
+	if (fragmentProgram.ready || fragmentProgram.failed) {
+		return fragmentProgram.ready;
+	}
+
+	const GLuint handle = fragmentProgram.program.handle();
+	if (parallelShaderCompile) {
+		GLint done = GL_FALSE;
+		glGetProgramiv(handle, GL_COMPLETION_STATUS_ARB, &done);
+		if (done == GL_FALSE) {
+			return false;
+		}
+	}
+
+	GLint success = GL_FALSE;
+	glGetProgramiv(handle, GL_LINK_STATUS, &success);
+	if (success == GL_FALSE) {
+		char buf[4096];
+		glGetProgramInfoLog(handle, sizeof(buf), nullptr, buf);
+		Helpers::warn("Failed to link specialised fragment shader, falling back to the uber-shader\nError: %s", buf);
+		fragmentProgram.failed = true;
+		return false;
+	}
+
+	// The sampler uniform defaults to texture unit 0, so the block binding is all that needs setting up
+	glUniformBlockBinding(handle, glGetUniformBlockIndex(handle, "FragmentUniforms"), 1);
+	fragmentProgram.ready = true;
+	return true;
+}
+
+GLuint Renderer::getActiveProgram() {
+	if (activeFragmentProgram != nullptr && isFragmentProgramReady(*activeFragmentProgram)) {
+		return activeFragmentProgram->program.handle();
+	}
+
+	return triangleProgram.handle();
+}
+
+void Renderer::updateFragmentUniforms() {
+	const FragmentUniforms uniforms = FragmentUniforms::fromRegs(regs);
+
+	if (std::memcmp(&uniforms, &fragmentUniforms, sizeof(FragmentUniforms)) != 0) {
+		fragmentUniforms = uniforms;
+		glBindBuffer(GL_UNIFORM_BUFFER, fragmentUniformBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FragmentUniforms), &fragmentUniforms);
+	}
+}
+
+void Renderer::drawVertices(OpenGL::Primitives primType, Vertex* vertices, u32 count) {
+	TRACE_SCOPE("Renderer::drawVertices");
+	if (primType == OpenGL::Triangle) {
+		addToBatch(vertices, count, nullptr, 0);
+		return;
+	}
+
+	// Strips & fans can't be merged with each other without primitive restart, so they're drawn on their own
+	flushBatch();
+	prepareDraw();
+	drawStreamed(primType, vertices, count, nullptr, 0);
+}
+
+void Renderer::drawIndexedVertices(OpenGL::Primitives primType, Vertex* vertices, u32 vertexCount, u16* indices, u32 indexCount) {
+	TRACE_SCOPE("Renderer::drawIndexedVertices");
+	if (primType == OpenGL::Triangle) {
+		addToBatch(vertices, vertexCount, indices, indexCount);
+		return;
+	}
+
+	flushBatch();
+	prepareDraw();
+	drawStreamed(primType, vertices, vertexCount, indices, indexCount);
+}
+
+void Renderer::drawStreamed(OpenGL::Primitives primType, const Vertex* vertices, u32 vertexCount, const u16* indices, u32 indexCount) {
+	// Vertices are aligned to their size, so that the draw can find them with a base vertex instead of changing the attribute offsets
+	const u32 vertexOffset = vertexStream.upload(vertices, vertexCount * sizeof(Vertex), sizeof(Vertex));
+	const GLint baseVertex = GLint(vertexOffset / sizeof(Vertex));
+
+	if (indices != nullptr) {
+		const u32 indexOffset = indexStream.upload(indices, indexCount * sizeof(u16), sizeof(u16));
+		OpenGL::drawElementsBaseVertex(primType, GLsizei(indexCount), GL_UNSIGNED_SHORT, indexOffset, baseVertex);
 	} else {
-		if (depthWriteEnable) {
-			OpenGL::enableDepth();
-			glDepthFunc(GL_ALWAYS);
-			glDepthMask(GL_TRUE);
-			bindDepthBuffer();
+		OpenGL::draw(primType, baseVertex, GLsizei(vertexCount));
+	}
+}
+
+u64 Renderer::getBatchStateHash() {
+	const auto* start = reinterpret_cast<const char*>(&regs[batchStateStart]);
+	return std::hash<std::string_view>()(std::string_view(start, (batchStateEnd - batchStateStart) * sizeof(u32)));
+}
+
+void Renderer::addToBatch(const Vertex* vertices, u32 vertexCount, const u16* indices, u32 indexCount) {
+	const bool indexed = indices != nullptr;
+	// A draw ending in an incomplete triangle would shift every triangle appended after it, so drop the leftover vertices like GL would
+	if (indexed) {
+		indexCount -= indexCount % 3;
+	} else {
+		vertexCount -= vertexCount % 3;
+	}
+
+	if ((indexed ? indexCount : vertexCount) == 0) {
+		return;
+	}
+
+	// Only rehash the state if one of the registers in it changed since the last draw
+	if (dirtyState & DirtyBatchState) {
+		dirtyState &= ~DirtyBatchState;
+		const u64 stateHash = getBatchStateHash();
+
+		if (stateHash != batchStateHash) {
+			flushBatch();
+			batchStateHash = stateHash;
+		}
+	}
+
+	if (!batchVertices.empty()) {
+		// Indices are 16-bit & both buffers are vertexBufferSize entries long, so the batch can't grow past that
+		const bool fits = batchVertices.size() + vertexCount <= vertexBufferSize && batchIndices.size() + indexCount <= vertexBufferSize;
+		if (indexed != batchIndexed || !fits) {
+			flushBatch();
+		}
+	}
+
+	// The GL state is set up when the batch starts, while the registers still hold the state it's drawn with
+	if (batchVertices.empty()) {
+		prepareDraw();
+		batchIndexed = indexed;
+	}
+
+	const u16 base = u16(batchVertices.size());
+	batchVertices.insert(batchVertices.end(), vertices, vertices + vertexCount);
+
+	if (indexed) {
+		const size_t oldSize = batchIndices.size();
+		batchIndices.resize(oldSize + indexCount);
+		for (u32 i = 0; i < indexCount; i++) {
+			batchIndices[oldSize + i] = indices[i] + base;
+		}
+	}
+}
+
+void Renderer::flushBatch() {
+	if (batchVertices.empty()) {
+		return;
+	}
+
+	TRACE_SCOPE("Renderer::flushBatch");
+	const u16* indices = batchIndexed ? batchIndices.data() : nullptr;
+	drawStreamed(OpenGL::Triangle, batchVertices.data(), u32(batchVertices.size()), indices, u32(batchIndices.size()));
+
+	batchVertices.clear();
+	batchIndices.clear();
+}
+
+bool Renderer::prepareHardwareShader(PICAShader& shader) {
+	const u64 hash = shader.getCodeHash();
+	std::unique_ptr<HardwareShader>* cached = hardwareShaderCache.find(hash);
+
+	if (cached == nullptr) {
+		std::unique_ptr<HardwareShader> hardwareShader;
+
+		if (auto source = ShaderDecompiler::decompile(shader); source.has_value()) {
+			OpenGL::Shader vert(*source, OpenGL::Vertex);
+
+			if (vert.exists()) {
+				hardwareShader = std::make_unique<HardwareShader>();
+				auto& program = hardwareShader->program;
+
+				if (program.create({ vert, fragShader })) {
+					const GLuint handle = program.handle();
+					// The block doesn't exist if the shader doesn't read any uniforms
+					const GLuint uniformBlock = glGetUniformBlockIndex(handle, "PICAUniforms");
+					if (uniformBlock != GL_INVALID_INDEX) {
+						glUniformBlockBinding(handle, uniformBlock, 0);
+					}
+
+					// Translated vertex shaders always run with the fragment uber-shader
+					glUniformBlockBinding(handle, glGetUniformBlockIndex(handle, "FragmentUniforms"), 1);
+
+					program.use();
+					glUniform1i(OpenGL::uniformLocation(program, "u_tex0"), 0);
+					OpenGL::useProgram(getActiveProgram());
+				} else {
+					hardwareShader.reset();
+				}
+
+				glDeleteShader(vert.handle()); // The program holds on to it if it linked
+			}
+		}
+
+		cached = &hardwareShaderCache.insert(hash, std::move(hardwareShader));
+	}
+
+	activeHardwareShader = cached->get();
+	if (activeHardwareShader == nullptr) {
+		return false;
+	}
+
+	HardwareShaderUniforms uniforms;
+	std::memcpy(uniforms.floatUniforms, shader.floatUniforms.data(), sizeof(uniforms.floatUniforms));
+	for (int i = 0; i < 4; i++) {
+		for (int component = 0; component < 4; component++) {
+			uniforms.intUniforms[i][component] = shader.intUniforms[i][component];
+		}
+	}
+	uniforms.boolUniforms = shader.boolUniform;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(uniforms), &uniforms);
+	return true;
+}
+
+void Renderer::drawHardwareShaded(OpenGL::Primitives primType, const std::array<HardwareVertexAttribute, 16>& attributes,
+								  const u8* vertexData, size_t vertexDataSize, const u16* indices, u32 count) {
+	TRACE_SCOPE("Renderer::drawHardwareShaded");
+	flushBatch();
+	prepareDraw();
+
+	// The fragment uniforms are in a uniform block shared by every program, so prepareDraw already set them up for us
+	activeHardwareShader->program.use();
+
+	hardwareVao.bind();
+	hardwareVbo.bind();
+	glBufferData(GL_ARRAY_BUFFER, vertexDataSize, vertexData, GL_STREAM_DRAW);
+
+	static constexpr std::array<GLenum, 4> attributeTypes = { GL_BYTE, GL_UNSIGNED_BYTE, GL_SHORT, GL_FLOAT };
+	for (GLuint i = 0; i < 16; i++) {
+		const auto& attribute = attributes[i];
+
+		if (attribute.enabled) {
+			const void* offset = reinterpret_cast<const void*>(uintptr_t(attribute.offset));
+			glVertexAttribPointer(i, attribute.components, attributeTypes[attribute.type], GL_FALSE, attribute.stride, offset);
+			hardwareVao.enableAttribute(i);
 		} else {
-			OpenGL::disableDepth();
+			hardwareVao.disableAttribute(i);
+			glVertexAttrib4fv(i, attribute.value.data());
 		}
 	}
 
-	vbo.bufferVertsSub(vertices, count);
-	OpenGL::draw(primType, count);
+	if (indices != nullptr) {
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(u16), indices, GL_STREAM_DRAW);
+		OpenGL::drawElements(primType, count, GL_UNSIGNED_SHORT);
+	} else {
+		OpenGL::draw(primType, count);
+	}
+
+	// Back to the state the regular draws expect
+	vertexStream.bind();
+	vao.bind();
+	OpenGL::useProgram(getActiveProgram());
 }
 
 constexpr u32 topScreenBuffer = 0x1f000000;
@@ -361,6 +617,8 @@ constexpr u32 bottomScreenBuffer = 0x1f05dc00;
 
 // Quick hack to display top screen for now
 void Renderer::display() {
+	flushBatch();
+
 	OpenGL::disableBlend();
 	OpenGL::disableDepth();
 	OpenGL::disableScissor();
@@ -375,9 +633,18 @@ void Renderer::display() {
 	OpenGL::clearColor();
 	OpenGL::setViewport(0, 240, 400, 240); // Actually draw our 3DS screen
 	OpenGL::draw(OpenGL::TriangleStrip, 4);
+
+	// We just overwrote most of the GL state the draws depend on
+	dirtyState = DirtyAll;
+
+	OpenGL::stateTracker.endFrame();
+	const auto& glCalls = OpenGL::stateTracker.lastFrame;
+	log("GL state calls this frame: %llu emitted, %llu suppressed\n", (unsigned long long)glCalls.emitted,
+		(unsigned long long)glCalls.suppressed);
 }
 
 void Renderer::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) {
+	flushBatch();
 	return;
 	log("GPU: Clear buffer\nStart: %08X End: %08X\nValue: %08X Control: %08X\n", startAddress, endAddress, value, control);
 
@@ -436,6 +703,7 @@ OpenGL::Texture Renderer::getTexture(Texture& tex) {
 	if (buffer.has_value()) {
 		return buffer.value().get().texture;
 	} else {
+		gpu.captureMemory(tex.location, u32(tex.sizeInBytes()));
 		const void* textureData = gpu.getPointerPhys<void*>(tex.location); // Get pointer to the texture data in 3DS memory
 		Texture& newTex = textureCache.add(tex);
 		newTex.decodeTexture(textureData);
@@ -445,6 +713,8 @@ OpenGL::Texture Renderer::getTexture(Texture& tex) {
 }
 
 void Renderer::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {
+	flushBatch(); // The transfer reads the colour buffers, so draw everything that's still pending first
+
 	const u32 inputWidth = inputSize & 0xffff;
 	const u32 inputGap = inputSize >> 16;
 
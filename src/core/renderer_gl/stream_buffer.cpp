@@ -0,0 +1,143 @@
+#include "renderer_gl/stream_buffer.hpp"
+#include <cstring>
+
+bool StreamBuffer::persistentMappingSupported() {
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 4)) {
+		return true; // Buffer storage is core since GL 4.4
+	}
+
+	return OpenGL::extensionSupported("GL_ARB_buffer_storage");
+}
+
+void StreamBuffer::create(GLenum target, u32 size) {
+	this->target = target;
+	this->size = size;
+	segmentSize = size / segmentCount;
+	position = 0;
+	fenceSegment = 0;
+
+	glGenBuffers(1, &handle);
+	bind();
+
+	if (persistentMappingSupported()) {
+		constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, size, nullptr, flags);
+		mappedPointer = static_cast<u8*>(glMapBufferRange(target, 0, size, flags));
+
+		if (mappedPointer != nullptr) {
+			return;
+		}
+
+		// Buffer storage is immutable, so we need a new buffer to fall back to the unsynchronized mapping path
+		Helpers::warn("Failed to persistently map stream buffer, falling back to unsynchronized mapping");
+		OpenGL::deleteBuffer(handle);
+		glGenBuffers(1, &handle);
+		bind();
+	}
+
+	glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+}
+
+void StreamBuffer::free() {
+	if (handle == 0) {
+		return;
+	}
+
+	if (mappedPointer != nullptr) {
+		bind();
+		glUnmapBuffer(target);
+		mappedPointer = nullptr;
+	}
+
+	for (auto& fence : fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	OpenGL::deleteBuffer(handle);
+	handle = 0;
+}
+
+// Every draw reading from the segments before "segment" has been submitted by now, so fence them
+void StreamBuffer::fenceUpTo(u32 segment) {
+	for (; fenceSegment < segment; fenceSegment++) {
+		GLsync& fence = fences[fenceSegment];
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+		}
+
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+// Wait for the GPU to finish reading segments first to last inclusive from the previous trip around the ring
+void StreamBuffer::waitForSegments(u32 first, u32 last) {
+	for (u32 segment = first; segment <= last; segment++) {
+		GLsync& fence = fences[segment];
+		if (fence == nullptr) {
+			continue;
+		}
+
+		GLenum result;
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+
+		if (result == GL_WAIT_FAILED) {
+			Helpers::warn("Waiting on stream buffer fence failed");
+		}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+u32 StreamBuffer::upload(const void* data, u32 bytes, u32 alignment) {
+	if (bytes > size) {
+		Helpers::panic("Tried to upload %u bytes to a stream buffer of %u bytes", bytes, size);
+	}
+
+	u32 offset = (position + alignment - 1) / alignment * alignment;
+	if (bytes == 0) {
+		return offset;
+	}
+
+	const bool wrap = u64(offset) + bytes > size;
+	if (wrap) {
+		offset = 0;
+	}
+
+	if (mappedPointer != nullptr) {
+		if (wrap) {
+			// Fence everything up to the end of the ring, including the segment we're in, as we're starting over from the beginning
+			fenceUpTo(segmentCount);
+			fenceSegment = 0;
+		} else {
+			fenceUpTo(getSegment(offset));
+		}
+
+		waitForSegments(getSegment(offset), getSegment(offset + bytes - 1));
+		std::memcpy(mappedPointer + offset, data, bytes);
+	} else {
+		// Nothing the GPU might still be reading gets overwritten before we wrap around, so the mapping doesn't have to be synchronized.
+		// When we do wrap around, invalidating the whole buffer orphans it, and the driver hands us fresh storage
+		const GLbitfield access = GL_MAP_WRITE_BIT | (wrap ? GL_MAP_INVALIDATE_BUFFER_BIT : (GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+
+		bind();
+		void* pointer = glMapBufferRange(target, offset, bytes, access);
+		if (pointer == nullptr) {
+			Helpers::panic("Failed to map stream buffer");
+		}
+
+		std::memcpy(pointer, data, bytes);
+		glUnmapBuffer(target);
+	}
+
+	position = offset + bytes;
+	return offset;
+}
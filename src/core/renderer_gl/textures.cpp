@@ -1,5 +1,6 @@
 #include "renderer_gl/textures.hpp"
 #include "colour.hpp"
+#include "tracing.hpp"
 #include <array>
 
 using namespace Helpers;
@@ -258,6 +259,7 @@ u32 Texture::decodeTexel(u32 u, u32 v, Texture::Formats fmt, const void* data) {
 }
 
 void Texture::decodeTexture(const void* data) {
+    TRACE_SCOPE("Texture::decodeTexture");
     std::vector<u32> decoded;
     decoded.reserve(u64(size.u()) * u64(size.v()));
 
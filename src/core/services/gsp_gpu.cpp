@@ -1,4 +1,7 @@
 #include "services/gsp_gpu.hpp"
+
+#include <algorithm>
+
 #include "ipc.hpp"
 #include "kernel.hpp"
 
@@ -147,6 +150,26 @@ void GPUService::requestInterrupt(GPUInterrupt type) {
 	}
 }
 
+void GPUService::submit(GPUCommand command, GPUInterrupt interrupt) {
+	command.interrupts = 1 << static_cast<u32>(interrupt);
+	gpu.submit(command);
+	// Without the GPU thread the command is done by now, so raise its interrupt right away like the hardware would've
+	pollInterrupts();
+}
+
+// Raise the interrupts of the GPU commands that finished since the last time we checked
+void GPUService::pollInterrupts() {
+	if (!gpu.checkPendingInterrupts()) [[likely]] {
+		return;
+	}
+
+	for (u32 i = 0; i <= static_cast<u32>(GPUInterrupt::DMA); i++) {
+		for (u32 count = gpu.takePendingInterrupts(i); count != 0; count--) {
+			requestInterrupt(static_cast<GPUInterrupt>(i));
+		}
+	}
+}
+
 void GPUService::writeHwRegs(u32 messagePointer) {
 	u32 ioAddr = mem.read32(messagePointer + 4); // GPU address based at 0x1EB00000, word aligned
 	const u32 size = mem.read32(messagePointer + 8); // Size in bytes
@@ -169,7 +192,7 @@ void GPUService::writeHwRegs(u32 messagePointer) {
 	ioAddr += 0x1EB00000;
 	for (u32 i = 0; i < size; i += 4) {
 		const u32 value = mem.read32(dataPointer);
-		gpu.writeReg(ioAddr, value);
+		gpu.submit({GPUCommand::Type::WriteReg, 0, {ioAddr, value, 0xffffffff}});
 		dataPointer += 4;
 		ioAddr += 4;
 	}
@@ -205,13 +228,11 @@ void GPUService::writeHwRegsWithMask(u32 messagePointer) {
 	
 	ioAddr += 0x1EB00000;
 	for (u32 i = 0; i < size; i += 4) {
-		const u32 current = gpu.readReg(ioAddr);
 		const u32 data = mem.read32(dataPointer);
 		const u32 mask = mem.read32(maskPointer);
 
-		u32 newValue = (current & ~mask) | (data & mask);
-
-		gpu.writeReg(ioAddr, newValue);
+		// The GPU does the read-modify-write itself, so we don't have to wait for the GPU thread to read the current value
+		gpu.submit({GPUCommand::Type::WriteReg, 0, {ioAddr, data, mask}});
 		maskPointer += 4;
 		dataPointer += 4;
 		ioAddr += 4;
@@ -321,13 +342,11 @@ void GPUService::memoryFill(u32* cmd) {
 	u32 control1 = control >> 16;
 
 	if (start0 != 0) {
-		gpu.clearBuffer(start0, end0, value0, control0);
-		requestInterrupt(GPUInterrupt::PSC0);
+		submit({GPUCommand::Type::MemoryFill, 0, {start0, end0, value0, control0}}, GPUInterrupt::PSC0);
 	}
 
 	if (start1 != 0) {
-		gpu.clearBuffer(start1, end1, value1, control1);
-		requestInterrupt(GPUInterrupt::PSC1);
+		submit({GPUCommand::Type::MemoryFill, 0, {start1, end1, value1, control1}}, GPUInterrupt::PSC1);
 	}
 }
 
@@ -339,8 +358,8 @@ void GPUService::triggerDisplayTransfer(u32* cmd) {
 	const u32 flags = cmd[5];
 
 	log("GSP::GPU::TriggerDisplayTransfer (Stubbed)\n");
-	gpu.displayTransfer(inputAddr, outputAddr, inputSize, outputSize, flags);
-	requestInterrupt(GPUInterrupt::PPF); // Send "Display transfer finished" interrupt
+	// Sends a "Display transfer finished" interrupt once it's done
+	submit({GPUCommand::Type::DisplayTransfer, 0, {inputAddr, outputAddr, inputSize, outputSize, flags}}, GPUInterrupt::PPF);
 }
 
 void GPUService::triggerDMARequest(u32* cmd) {
@@ -350,8 +369,44 @@ void GPUService::triggerDMARequest(u32* cmd) {
 	const bool flush = cmd[7] == 1;
 
 	log("GSP::GPU::TriggerDMARequest (source = %08X, dest = %08X, size = %08X)\n", source, dest, size);
-	gpu.fireDMA(dest, source, size);
-	requestInterrupt(GPUInterrupt::DMA);
+
+	// The GPU thread works with physical addresses, as the page tables can change under it. Virtually contiguous pages needn't be
+	// physically contiguous, so the transfer is split into physically contiguous pieces, with only the last one raising the interrupt
+	u32 pieceSource = 0, pieceDest = 0, pieceSize = 0;
+	for (u32 offset = 0; offset < size;) {
+		const void* sourcePointer = mem.getReadPointer(source + offset);
+		void* destPointer = mem.getWritePointer(dest + offset);
+		if (sourcePointer == nullptr || destPointer == nullptr) [[unlikely]] {
+			Helpers::warn("GSP::GPU::TriggerDMARequest: Unmapped address (source = %08X, dest = %08X)", source + offset, dest + offset);
+			break;
+		}
+
+		// Transfer up to the next page boundary of either address
+		const u32 sourceLeft = Memory::pageSize - ((source + offset) & Memory::pageMask);
+		const u32 destLeft = Memory::pageSize - ((dest + offset) & Memory::pageMask);
+		const u32 chunk = std::min({size - offset, sourceLeft, destLeft});
+
+		const u32 sourcePaddr = gpu.getPhysicalAddress(sourcePointer);
+		const u32 destPaddr = gpu.getPhysicalAddress(destPointer);
+		if (pieceSize != 0 && (sourcePaddr != pieceSource + pieceSize || destPaddr != pieceDest + pieceSize)) {
+			gpu.submit({GPUCommand::Type::DMA, 0, {pieceDest, pieceSource, pieceSize}});
+			pieceSize = 0;
+		}
+
+		if (pieceSize == 0) {
+			pieceSource = sourcePaddr;
+			pieceDest = destPaddr;
+		}
+
+		pieceSize += chunk;
+		offset += chunk;
+	}
+
+	if (pieceSize != 0) {
+		submit({GPUCommand::Type::DMA, 0, {pieceDest, pieceSource, pieceSize}}, GPUInterrupt::DMA);
+	} else { // Nothing to transfer, but the DMA interrupt is still expected
+		submit({GPUCommand::Type::Nop}, GPUInterrupt::DMA);
+	}
 }
 
 void GPUService::flushCacheRegions(u32* cmd) {
@@ -366,8 +421,12 @@ void GPUService::processCommandList(u32* cmd) {
 	const bool flushBuffer = cmd[7] == 1; // Flush buffer (0 = don't flush, 1 = flush)
 
 	log("GPU::GSP::processCommandList. Address: %08X, size in bytes: %08X\n", address, size);
-	gpu.startCommandList(address, size);
-	requestInterrupt(GPUInterrupt::P3D); // Send an IRQ when command list processing is over
+	// The GPU thread works with physical addresses, as the page tables can change under it
+	const void* list = mem.getReadPointer(address);
+	if (list == nullptr) Helpers::panic("Couldn't get buffer for command list");
+
+	// Send an IRQ when command list processing is over
+	submit({GPUCommand::Type::CommandList, 0, {gpu.getPhysicalAddress(list), size}}, GPUInterrupt::P3D);
 }
 
 // TODO: Emulate the transfer engine & its registers
@@ -375,6 +434,6 @@ void GPUService::processCommandList(u32* cmd) {
 void GPUService::triggerTextureCopy(u32* cmd) {
 	Helpers::warn("GSP::GPU::TriggerTextureCopy (unimplemented)\n");
 	// This uses the transfer engine and thus needs to fire a PPF interrupt.
-	// NSMB2 relies on this
-	requestInterrupt(GPUInterrupt::PPF);
+	// NSMB2 relies on this. It goes through the GPU like the other transfers, so it isn't raised before the ones submitted before it
+	submit({GPUCommand::Type::Nop}, GPUInterrupt::PPF);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "emulator.hpp"
+#include "tracing.hpp"
 
 void Emulator::reset() {
     cpu.reset();
@@ -23,9 +24,9 @@ void Emulator::render() {
 
 void Emulator::run() {
     while (running) {
-        gpu.getGraphicsContext(); // Give the GPU a rendering context
+        gpu.beginFrame(); // Give the GPU a rendering context
         runFrame(); // Run 1 frame of instructions
-        gpu.display(); // Display graphics
+        gpu.presentFrame(); // Display graphics. With the GPU thread, this happens while we run the next frame
 
         ServiceManager& srv = kernel.getServiceManager();
 
@@ -64,6 +65,15 @@ void Emulator::run() {
 
                         case SDLK_RETURN: srv.pressKey(Keys::Start); break;
                         case SDLK_BACKSPACE: srv.pressKey(Keys::Select); break;
+
+                        // Start/stop recording a timeline of the emulator's frame phases
+                        case SDLK_F12: toggleTraceCapture(); break;
+                        // Start/stop sampling the guest PC
+                        case SDLK_F11: toggleGuestProfiler(); break;
+                        // Start/stop counting executed vertex shader instructions
+                        case SDLK_F10: toggleShaderProfiler(); break;
+                        // Stop the GPU capture started with ALBER_GPU_CAPTURE
+                        case SDLK_F9: stopGPUCapture(); break;
                     }
                     break;
                 case SDL_KEYUP:
@@ -122,7 +132,117 @@ void Emulator::run() {
 
         // Update inputs in the HID module
         srv.updateInputs(cpu.getTicks());
-        SDL_GL_SwapWindow(window);
+    }
+}
+
+void Emulator::startGPUThread() {
+    if (gpu.isThreaded()) {
+        return;
+    }
+
+    // The GPU thread takes the GL context over from us
+    SDL_GL_MakeCurrent(window, nullptr);
+    gpu.startThread([this](bool current) { SDL_GL_MakeCurrent(window, current ? glContext : nullptr); });
+}
+
+void Emulator::toggleGuestProfiler() {
+    GuestProfiler& profiler = cpu.getProfiler();
+
+    if (!profiler.isRunning()) {
+        printf("Started guest profiler\n");
+        profiler.start();
+    } else {
+        profiler.stop();
+
+        if (profiler.writeCollapsedStacks(profileFilePath)) {
+            printf("Wrote guest profile to %s\n", profileFilePath);
+        } else {
+            Helpers::warn("Failed to write guest profile to %s", profileFilePath);
+        }
+    }
+}
+
+void Emulator::toggleShaderProfiler() {
+    ShaderProfiler& profiler = gpu.getShaderProfiler();
+    gpu.sync(); // The GPU thread uses the profiler while drawing
+
+    if (!profiler.isRunning()) {
+        printf("Started shader profiler\n");
+        profiler.start();
+    } else {
+        profiler.stop();
+
+        if (profiler.writeReport(shaderProfileFilePath)) {
+            printf("Wrote shader profile to %s\n", shaderProfileFilePath);
+        } else {
+            Helpers::warn("Failed to write shader profile to %s", shaderProfileFilePath);
+        }
+    }
+}
+
+bool Emulator::startGPUCapture(const std::filesystem::path& path) {
+    gpu.sync();
+    if (!gpu.getCapture().start(path)) {
+        return false;
+    }
+
+    gpuCapturePath = path;
+    printf("Started GPU capture\n");
+    return true;
+}
+
+void Emulator::stopGPUCapture() {
+    GPUCapture& capture = gpu.getCapture();
+    gpu.sync(); // Finish the commands that are still in flight, so that they make it into the capture
+    if (!capture.isRunning()) {
+        return;
+    }
+
+    const u64 frames = capture.getFrameCount();
+    if (capture.stop()) {
+        printf("Wrote GPU capture of %llu frames to %s\n", (unsigned long long)frames, gpuCapturePath.string().c_str());
+    } else {
+        Helpers::warn("Failed to write GPU capture to %s", gpuCapturePath.string().c_str());
+    }
+}
+
+bool Emulator::loadSymbolMap(const std::filesystem::path& path) {
+    return cpu.getProfiler().loadMapFile(path);
+}
+
+bool Emulator::loadHLEConfig(const std::filesystem::path& path) {
+    return cpu.getHLE().loadConfig(path);
+}
+
+void Emulator::applyHLEPatches() {
+    GuestHLE& hle = cpu.getHLE();
+    if (!hle.isEnabled()) {
+        return;
+    }
+
+    // ELFs don't have a title ID, so they use title ID 0 in the allowlist. Only ELFs come with symbols
+    if (romType == ROMType::ELF) {
+        hle.applyPatches(memory, 0, memory.elfSymbols);
+    } else {
+        hle.applyPatches(memory, memory.getCXI()->programID, {});
+    }
+}
+
+void Emulator::printHLEStats() {
+    cpu.getHLE().printStats();
+}
+
+void Emulator::toggleTraceCapture() {
+    // The GPU thread records spans too, so wait for it to be idle before touching the recorded events
+    gpu.sync();
+
+    if (!Tracing::isEnabled()) {
+        printf("Started capturing trace\n");
+        Tracing::start();
+    } else if (Tracing::stop(traceFilePath)) {
+        printf("Wrote trace to %s\n", traceFilePath);
+    } else {
+        Helpers::warn("Failed to write trace to %s", traceFilePath);
     }
 }
 
@@ -161,12 +281,14 @@ bool Emulator::loadNCSD(const std::filesystem::path& path) {
     }
 
     loadedNCSD = opt.value();
+    cpu.getProfiler().setSymbols({}); // NCSDs don't come with symbols, drop any left over from a previous ROM
     cpu.setReg(15, loadedNCSD.entrypoint);
 
     if (loadedNCSD.entrypoint & 1) {
         Helpers::panic("Misaligned NCSD entrypoint; should this start the CPU in Thumb mode?");
     }
 
+    applyHLEPatches();
     return true;
 }
 
@@ -174,7 +296,13 @@ bool Emulator::loadELF(const std::filesystem::path& path) {
     loadedELF.open(path, std::ios_base::binary); // Open ROM in binary mode
     romType = ROMType::ELF;
 
-    return loadELF(loadedELF);
+    if (!loadELF(loadedELF)) {
+        return false;
+    }
+
+    // Replace rather than merge, so symbols from a previously loaded ROM don't linger. Map files are merged in after loading
+    cpu.getProfiler().setSymbols(memory.elfSymbols);
+    return true;
 }
 
 bool Emulator::loadELF(std::ifstream& file) {
@@ -190,5 +318,7 @@ bool Emulator::loadELF(std::ifstream& file) {
     if (entrypoint.value() & 1) {
         Helpers::panic("Misaligned ELF entrypoint. TODO: Check if ELFs can boot in thumb mode");
     }
+
+    applyHLEPatches();
     return true;
 }
\ No newline at end of file
@@ -0,0 +1,204 @@
+// AlberReplay: Replays a GPU capture made with ALBER_GPU_CAPTURE through the GPU & renderer without emulating the CPU or the OS,
+// and reports how long each frame & draw took. Useful for benchmarking & bisecting GPU-side changes on their own.
+// Usage: AlberReplay <capture file> [number of passes] [per draw CSV output path]
+#include <SDL.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+#include "PICA/gpu.hpp"
+#include "PICA/gpu_capture.hpp"
+#include "gl3w.h"
+#include "memory.hpp"
+#include "tracing.hpp"
+
+namespace {
+    struct FrameStats {
+        u64 time;       // Nanoseconds spent on the frame's commands & presenting it, not counting loading captured memory
+        u64 drawTime;   // Nanoseconds spent in draws
+        u32 firstDraw;  // Index of the frame's first draw in the draw time log
+        u32 drawCount;
+        u64 glCalls;           // GL state calls that went to the driver, see OpenGL::StateTracker
+        u64 glCallsSuppressed; // GL state calls skipped as they wouldn't have changed anything
+    };
+
+    double toMilliseconds(u64 nanoseconds) { return double(nanoseconds) / 1000000.0; }
+
+    // Value at the given percentile of a sorted list
+    u64 percentile(const std::vector<u64>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        return sorted[std::min<size_t>(sorted.size() - 1, size_t(p / 100.0 * double(sorted.size())))];
+    }
+
+    void printSummary(const char* name, std::vector<u64> times) {
+        if (times.empty()) {
+            return;
+        }
+
+        u64 total = 0;
+        for (u64 time : times) total += time;
+        std::sort(times.begin(), times.end());
+
+        printf("%-6s count %8zu  avg %8.3f ms  min %8.3f ms  median %8.3f ms  p99 %8.3f ms  max %8.3f ms\n", name, times.size(),
+               toMilliseconds(total) / double(times.size()), toMilliseconds(times.front()), toMilliseconds(percentile(times, 50.0)),
+               toMilliseconds(percentile(times, 99.0)), toMilliseconds(times.back()));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <capture file> [number of passes] [per draw CSV output path]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<u8> contents;
+    std::vector<GPUCapture::Record> records;
+    if (!GPUCapture::load(argv[1], contents, records)) {
+        Helpers::panic("Failed to load GPU capture %s", argv[1]);
+    }
+
+    const int passes = (argc > 2) ? std::max(1, std::atoi(argv[2])) : 1;
+
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        Helpers::panic("Failed to initialize SDL2");
+    }
+
+    // Same context as the emulator proper, so that the numbers are comparable
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+    SDL_Window* window = SDL_CreateWindow("AlberReplay", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 400, 480, SDL_WINDOW_OPENGL);
+    SDL_GLContext glContext = SDL_GL_CreateContext(window);
+
+    if (gl3wInit()) {
+        Helpers::panic("Failed to initialize OpenGL");
+    }
+
+    // The GPU only uses the memory for FCRAM, which the capture fills in
+    u64 ticks = 0;
+    Memory mem(ticks);
+    GPU gpu(mem);
+    gpu.initGraphicsContext();
+
+    // Same GPU knobs as the emulator, so that their effect can be measured
+    if (const char* shaderJIT = std::getenv("ALBER_SHADER_JIT")) {
+        const std::string_view value = shaderJIT;
+        if (value == "0" || value == "off") {
+            gpu.setShaderJITMode(ShaderJIT::Mode::Interpreter);
+        } else if (value == "1" || value == "on") {
+            gpu.setShaderJITMode(ShaderJIT::Mode::Recompiler);
+        } else if (value == "verify") {
+            gpu.setShaderJITMode(ShaderJIT::Mode::Verify);
+        }
+    }
+
+    if (const char* vertexThreads = std::getenv("ALBER_VERTEX_THREADS")) {
+        gpu.setVertexThreadCount(std::atoi(vertexThreads));
+    }
+
+    if (const char* gpuShaders = std::getenv("ALBER_GPU_SHADERS")) {
+        gpu.setHardwareVertexShaders(std::atoi(gpuShaders) != 0);
+    }
+
+    std::vector<u64> drawTimes;
+    std::vector<FrameStats> frames;
+    gpu.setDrawTimeLog(&drawTimes);
+
+    for (int pass = 0; pass < passes; pass++) {
+        // Captures start from a freshly reset GPU. Stats are only kept for the last pass, earlier ones warm up the caches
+        gpu.reset();
+        drawTimes.clear();
+        frames.clear();
+
+        FrameStats frame = {0, 0, 0, 0, 0, 0};
+        for (const auto& record : records) {
+            using Type = GPUCapture::RecordType;
+            const auto& args = record.args;
+
+            // Loading captured memory isn't something the emulator does, so it's left out of the timings
+            if (record.type == Type::Page) {
+                std::memcpy(gpu.getPointerPhys<u8>(args[0]), record.data, GPUCapture::pageSize);
+                continue;
+            } else if (record.type == Type::ZeroPage) {
+                std::memset(gpu.getPointerPhys<u8>(args[0]), 0, GPUCapture::pageSize);
+                continue;
+            }
+
+            const u64 startTime = Tracing::now();
+            switch (record.type) {
+                case Type::CommandList: gpu.startCommandList(args[0], args[1]); break;
+                case Type::MemoryFill: gpu.clearBuffer(args[0], args[1], args[2], args[3]); break;
+                case Type::DisplayTransfer: gpu.displayTransfer(args[0], args[1], args[2], args[3], args[4]); break;
+                case Type::DMA: std::memcpy(gpu.getPointerPhys<u8>(args[0]), gpu.getPointerPhys<u8>(args[1]), args[2]); break;
+
+                case Type::Frame:
+                    gpu.getGraphicsContext();
+                    gpu.display();
+                    SDL_GL_SwapWindow(window);
+                    // Draw times only cover submitting the work to the host GPU, so wait for it to be done before ending the frame
+                    glFinish();
+                    break;
+
+                default: break;
+            }
+            frame.time += Tracing::now() - startTime;
+
+            if (record.type == Type::Frame) {
+                frame.drawCount = u32(drawTimes.size()) - frame.firstDraw;
+                frame.glCalls = OpenGL::stateTracker.lastFrame.emitted;
+                frame.glCallsSuppressed = OpenGL::stateTracker.lastFrame.suppressed;
+                for (u32 i = frame.firstDraw; i < drawTimes.size(); i++) {
+                    frame.drawTime += drawTimes[i];
+                }
+
+                frames.push_back(frame);
+                frame = {0, 0, u32(drawTimes.size()), 0, 0, 0};
+
+                SDL_Event event;
+                while (SDL_PollEvent(&event)) {
+                    if (event.type == SDL_QUIT) {
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Replayed %zu frames with %zu draws (%d passes)\n\n", frames.size(), drawTimes.size(), passes);
+    printf("Frame  Draws  Frame time (ms)  Draw time (ms)  GL calls  Suppressed\n");
+    for (size_t i = 0; i < frames.size(); i++) {
+        const FrameStats& frame = frames[i];
+        printf("%5zu  %5u  %15.3f  %14.3f  %8llu  %10llu\n", i, frame.drawCount, toMilliseconds(frame.time), toMilliseconds(frame.drawTime),
+               (unsigned long long)frame.glCalls, (unsigned long long)frame.glCallsSuppressed);
+    }
+
+    std::vector<u64> frameTimes;
+    for (const auto& frame : frames) frameTimes.push_back(frame.time);
+
+    printf("\n");
+    printSummary("Frames", frameTimes);
+    printSummary("Draws", drawTimes);
+
+    if (argc > 3) {
+        std::ofstream csv(argv[3]);
+        csv << "frame,draw,nanoseconds\n";
+        for (size_t i = 0; i < frames.size(); i++) {
+            for (u32 draw = 0; draw < frames[i].drawCount; draw++) {
+                csv << i << ',' << draw << ',' << drawTimes[frames[i].firstDraw + draw] << '\n';
+            }
+        }
+
+        if (!csv.good()) {
+            Helpers::warn("Failed to write per draw times to %s", argv[3]);
+        }
+    }
+
+    SDL_GL_DeleteContext(glContext);
+    SDL_DestroyWindow(window);
+    return 0;
+}
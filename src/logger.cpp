@@ -0,0 +1,123 @@
+#include "logger.hpp"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Log {
+	namespace {
+		std::mutex ringListMutex;
+		std::vector<std::unique_ptr<TraceRing>> rings; // Rings are never freed, so the writer can keep draining them after their thread exits
+
+		std::thread writerThread;
+		std::atomic<bool> writerRunning = false;
+		std::FILE* writerFile = nullptr;
+
+		// Drain every registered ring once. Returns the number of records written
+		size_t drainAll() {
+			std::scoped_lock lock(ringListMutex);
+			size_t count = 0;
+
+			for (auto& ring : rings) {
+				count += ring->drain(writerFile);
+			}
+
+			return count;
+		}
+
+		void writerLoop() {
+			while (writerRunning.load(std::memory_order_acquire)) {
+				// Sleep for a bit if we had nothing to do, to avoid hogging a host core
+				if (drainAll() == 0) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+
+			drainAll(); // Flush anything logged before we were stopped
+		}
+	}
+
+	size_t TraceRing::drain(std::FILE* file) {
+		const size_t h = head.load(std::memory_order_acquire);
+		size_t t = tail.load(std::memory_order_relaxed);
+		const size_t count = h - t;
+
+		for (; t != h; t++) {
+			const TraceRecord& record = records[t & mask];
+			record.formatter(file, record.fmt, record.payload.data());
+		}
+
+		tail.store(t, std::memory_order_release);
+		return count;
+	}
+
+	TraceRing& getThreadRing() {
+		thread_local TraceRing* ring = nullptr;
+
+		if (ring == nullptr) [[unlikely]] {
+			std::scoped_lock lock(ringListMutex);
+			rings.push_back(std::make_unique<TraceRing>());
+			ring = rings.back().get();
+		}
+
+		return *ring;
+	}
+
+	bool startDeferredLogging(const char* path) {
+		if (writerRunning.load()) {
+			return true;
+		}
+
+		writerFile = (path == nullptr || path[0] == '\0') ? stdout : std::fopen(path, "w");
+		if (writerFile == nullptr) {
+			return false;
+		}
+
+		writerRunning = true;
+		writerThread = std::thread(writerLoop);
+		deferredLogging = true;
+		return true;
+	}
+
+	void stopDeferredLogging() {
+		if (!writerRunning.load()) {
+			return;
+		}
+
+		deferredLogging = false;
+		writerRunning = false;
+		writerThread.join();
+
+		for (auto& ring : rings) {
+			if (ring->droppedCount() != 0) {
+				std::fprintf(writerFile, "[Log] %llu records were dropped because a trace ring was full\n", (unsigned long long)ring->droppedCount());
+			}
+		}
+
+		if (writerFile != stdout) {
+			std::fclose(writerFile);
+		}
+		writerFile = nullptr;
+	}
+
+	void setEnabled(std::string_view names, bool enabled) {
+		while (!names.empty()) {
+			const size_t comma = names.find(',');
+			const std::string_view name = names.substr(0, comma);
+
+			for (auto& entry : Detail::getLoggerList()) {
+				if (name == "all" || name == entry.name) {
+					entry.setEnabled(entry.logger, enabled);
+				}
+			}
+
+			names = (comma == std::string_view::npos) ? std::string_view() : names.substr(comma + 1);
+		}
+	}
+
+	std::vector<Detail::LoggerEntry>& Detail::getLoggerList() {
+		static std::vector<LoggerEntry> loggers;
+		return loggers;
+	}
+}
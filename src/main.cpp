@@ -1,5 +1,8 @@
+#include <cstdlib>
+#include <string_view>
 #include "emulator.hpp"
 #include "gl3w.h"
+#include "logger.hpp"
 
 int main (int argc, char *argv[]) {
     Emulator emu;
@@ -9,11 +12,84 @@ int main (int argc, char *argv[]) {
 
     emu.initGraphicsContext();
 
+    // Loggers can be switched on at runtime with a comma-separated list, eg ALBER_LOGGERS=kernel,gpu,svc
+    // If ALBER_LOG_FILE is set, logs are formatted and written to that file by a background thread instead of the emulator thread
+    if (const char* loggers = std::getenv("ALBER_LOGGERS")) {
+        Log::setEnabled(loggers, true);
+    }
+
+    if (const char* logFile = std::getenv("ALBER_LOG_FILE")) {
+        if (!Log::startDeferredLogging(logFile)) {
+            Helpers::warn("Failed to open log file %s", logFile);
+        }
+    }
+
+    // Signatures & per-title allowlist for replacing guest library routines (memcpy & co) with host code. See guest_hle.hpp
+    if (const char* hleConfig = std::getenv("ALBER_HLE_CONFIG")) {
+        if (!emu.loadHLEConfig(hleConfig)) {
+            Helpers::warn("Failed to load HLE config %s", hleConfig);
+        }
+    }
+
+    // Vertex shaders run on the interpreter by default. In builds with ENABLE_SHADER_JIT, ALBER_SHADER_JIT=1 recompiles them to native
+    // code where possible, while ALBER_SHADER_JIT=verify runs both and reports shaders where they disagree
+    if (const char* shaderJIT = std::getenv("ALBER_SHADER_JIT")) {
+        const std::string_view value = shaderJIT;
+        if (value == "0" || value == "off") {
+            emu.setShaderJITMode(ShaderJIT::Mode::Interpreter);
+        } else if (value == "1" || value == "on") {
+            emu.setShaderJITMode(ShaderJIT::Mode::Recompiler);
+        } else if (value == "verify") {
+            emu.setShaderJITMode(ShaderJIT::Mode::Verify);
+        }
+    }
+
+    // Big draws get their vertices shaded on a pool of host threads. ALBER_VERTEX_THREADS sets how many extra threads to use, 0 = none
+    if (const char* vertexThreads = std::getenv("ALBER_VERTEX_THREADS")) {
+        emu.setVertexThreadCount(std::atoi(vertexThreads));
+    }
+
+    // ALBER_GPU_SHADERS=1 translates vertex shaders to GLSL and runs them on the host GPU, for the shaders that can be translated
+    if (const char* gpuShaders = std::getenv("ALBER_GPU_SHADERS")) {
+        emu.setHardwareVertexShaders(std::atoi(gpuShaders) != 0);
+    }
+
+    // Titles using more than one CPU core have the cores meet every ALBER_CPU_SYNC_INTERVAL ticks (268111856 per second). Smaller values
+    // keep the cores' clocks closer together, at the cost of more time spent waiting at the barrier
+    if (const char* syncInterval = std::getenv("ALBER_CPU_SYNC_INTERVAL")) {
+        emu.setCPUSyncInterval(std::strtoull(syncInterval, nullptr, 10));
+    }
+
+    // ALBER_GPU_THREAD=1 runs the GPU on its own thread, with the CPU emulating the next frame while the GPU renders the current one
+    // Games that use more than one CPU core always get the GPU thread, as the GL context can only be used from one thread
+    if (const char* gpuThread = std::getenv("ALBER_GPU_THREAD")) {
+        if (std::atoi(gpuThread) != 0) {
+            emu.startGPUThread();
+        }
+    }
+
+    // ALBER_GPU_CAPTURE=path records the GPU commands of the session until F9 is pressed or the emulator exits, for AlberReplay
+    if (const char* gpuCapture = std::getenv("ALBER_GPU_CAPTURE")) {
+        if (!emu.startGPUCapture(gpuCapture)) {
+            Helpers::warn("Failed to open GPU capture file %s", gpuCapture);
+        }
+    }
+
     auto romPath = std::filesystem::current_path() / (argc > 1 ? argv[1] : "Metroid Prime - Federation Force (Europe) (En,Fr,De,Es,It).3ds");
     if (!emu.loadROM(romPath)) {
         // For some reason just .c_str() doesn't show the proper path
         Helpers::panic("Failed to load ROM file: %s", romPath.string().c_str());
     }
 
+    // Extra guest symbols for the profiler, eg for titles without symbols or for CROs
+    if (const char* symbolMap = std::getenv("ALBER_SYMBOL_MAP")) {
+        if (!emu.loadSymbolMap(symbolMap)) {
+            Helpers::warn("Failed to load symbol map %s", symbolMap);
+        }
+    }
+
     emu.run();
+    emu.stopGPUCapture();
+    emu.printHLEStats();
+    Log::stopDeferredLogging();
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "tracing.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Tracing {
+	namespace {
+		struct Event {
+			const char* name;
+			u64 start;
+			u64 end;
+			s64 arg;
+		};
+
+		// Each host thread records into its own list. The list's mutex is only contended while start() or stop() go through the lists
+		struct ThreadEvents {
+			std::mutex mutex;
+			u32 tid;
+			std::vector<Event> events;
+		};
+
+		std::mutex threadListMutex;
+		std::vector<std::unique_ptr<ThreadEvents>> threadEvents;
+		u64 traceStart = 0;
+		u32 nextTid = 0;
+
+		ThreadEvents& getThreadEvents() {
+			thread_local ThreadEvents* list = nullptr;
+
+			if (list == nullptr) [[unlikely]] {
+				std::scoped_lock lock(threadListMutex);
+				threadEvents.push_back(std::make_unique<ThreadEvents>());
+				list = threadEvents.back().get();
+				list->tid = nextTid++;
+				list->events.reserve(1 << 16);
+			}
+
+			return *list;
+		}
+	}
+
+	void record(const char* name, u64 start, u64 end, s64 arg) {
+		ThreadEvents& list = getThreadEvents();
+		std::scoped_lock lock(list.mutex);
+		list.events.push_back({name, start, end, arg});
+	}
+
+	void start() {
+		std::scoped_lock lock(threadListMutex);
+		for (auto& list : threadEvents) {
+			std::scoped_lock listLock(list->mutex);
+			list->events.clear();
+		}
+
+		traceStart = now();
+		enabled = true;
+	}
+
+	bool stop(const std::string& path) {
+		enabled = false;
+
+		// Let spans that are still open in other threads finish, so they make it into the trace. Ours can't finish while we're in here
+		while (openSpans.load(std::memory_order_acquire) != threadOpenSpans) {
+			std::this_thread::yield();
+		}
+
+		std::FILE* file = std::fopen(path.c_str(), "w");
+		if (file == nullptr) {
+			return false;
+		}
+
+		std::scoped_lock lock(threadListMutex);
+		std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+		bool first = true;
+
+		for (auto& list : threadEvents) {
+			std::scoped_lock listLock(list->mutex);
+			for (const Event& e : list->events) {
+				// Timestamps and durations are in microseconds in the trace event format
+				const double ts = double(e.start - traceStart) / 1000.0;
+				const double dur = double(e.end - e.start) / 1000.0;
+
+				std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", first ? "" : ",\n", e.name,
+							 list->tid, ts, dur);
+				if (e.arg >= 0) {
+					std::fprintf(file, ",\"args\":{\"value\":\"0x%llX\"}", (unsigned long long)e.arg);
+				}
+				std::fputc('}', file);
+				first = false;
+			}
+
+			list->events.clear();
+		}
+
+		std::fputs("\n]}\n", file);
+		std::fclose(file);
+		return true;
+	}
+}
@@ -0,0 +1,92 @@
+// Checks that the decoded command list cache never replays stale commands after the guest rewrites a list in memory
+#include "PICA/gpu.hpp"
+#include "PICA/regs.hpp"
+#include "test.hpp"
+
+namespace {
+	constexpr u32 listPaddr = PhysicalAddrs::FCRAM + 0x10000;
+	constexpr u32 jumpTargetPaddr = PhysicalAddrs::FCRAM + 0x20000;
+
+	// Command header for writing "paramCount" extra parameters after the first one. The mask has a bit for each byte of the register
+	constexpr u32 header(u32 index, u32 paramCount = 0, bool consecutive = false, u32 byteMask = 0xf) {
+		return index | (byteMask << 16) | (paramCount << 20) | (u32(consecutive) << 31);
+	}
+
+	// The TEV registers don't do anything when written apart from getting stored, so they're good for seeing which list was run
+	constexpr u32 texEnvSource = PICAInternalRegs::TexEnv0Source;
+	constexpr u32 texEnvOperand = PICAInternalRegs::TexEnv0Source + 1;
+	constexpr u32 texEnvCombiner = PICAInternalRegs::TexEnv0Source + 2;
+
+	// Writes TEV stage 0's source, operand & combiner registers with a single consecutive command, then the blend colour with a mask
+	void writeList(u32* list, u32 source, u32 operand, u32 combiner, u32 blendColour) {
+		list[0] = source;
+		list[1] = header(texEnvSource, 2, true);
+		list[2] = operand;
+		list[3] = combiner;
+		list[4] = blendColour;
+		list[5] = header(PICAInternalRegs::BlendColour, 0, false, 0b0011);
+	}
+
+	constexpr u32 listSize = 6 * sizeof(u32);
+}
+
+TEST_CASE(commandListCacheSeesGuestWrites) {
+	u64 ticks = 0;
+	Memory mem(ticks);
+	GPU gpu(mem);
+	gpu.reset();
+
+	auto& regs = gpu.getRegisters();
+	u32* list = gpu.getPointerPhys<u32>(listPaddr);
+
+	writeList(list, 0x11, 0x22, 0x33, 0xAABBCCDD);
+	gpu.startCommandList(listPaddr, listSize);
+	CHECK(regs[texEnvSource] == 0x11 && regs[texEnvOperand] == 0x22 && regs[texEnvCombiner] == 0x33);
+	CHECK(regs[PICAInternalRegs::BlendColour] == 0x0000CCDD);
+
+	// Resubmitting the same list replays the cached version, which has to give the same result
+	regs[texEnvSource] = 0;
+	gpu.startCommandList(listPaddr, listSize);
+	CHECK(regs[texEnvSource] == 0x11 && regs[texEnvOperand] == 0x22 && regs[texEnvCombiner] == 0x33);
+
+	// The guest rewrites the list in place, both a parameter & the header that decides which registers get written
+	list[3] = 0x44;
+	list[5] = header(PICAInternalRegs::BlendColour, 0, false, 0b1100);
+	gpu.startCommandList(listPaddr, listSize);
+	CHECK(regs[texEnvSource] == 0x11 && regs[texEnvCombiner] == 0x44);
+	CHECK(regs[PICAInternalRegs::BlendColour] == 0xAABBCCDD);
+
+	// Going back to the old contents has to give the old results again, even though they might still be in the cache
+	writeList(list, 0x11, 0x22, 0x33, 0);
+	gpu.startCommandList(listPaddr, listSize);
+	CHECK(regs[texEnvCombiner] == 0x33);
+}
+
+TEST_CASE(commandListCacheSeesJumpTargetWrites) {
+	u64 ticks = 0;
+	Memory mem(ticks);
+	GPU gpu(mem);
+	gpu.reset();
+
+	auto& regs = gpu.getRegisters();
+	u32* list = gpu.getPointerPhys<u32>(listPaddr);
+	u32* target = gpu.getPointerPhys<u32>(jumpTargetPaddr);
+
+	// The first list points command buffer 0 at the second one & jumps to it
+	using namespace PICAInternalRegs;
+	list[0] = listSize / 8;
+	list[1] = header(CmdBufSize0);
+	list[2] = jumpTargetPaddr >> 3;
+	list[3] = header(CmdBufAddr0);
+	list[4] = 1;
+	list[5] = header(CmdBufTrigger0);
+
+	writeList(target, 0x55, 0x66, 0x77, 0);
+	gpu.startCommandList(listPaddr, listSize);
+	CHECK(regs[texEnvSource] == 0x55 && regs[texEnvCombiner] == 0x77);
+
+	// The list that jumps is unchanged, but the one it jumps to was rewritten
+	target[0] = 0x88;
+	gpu.startCommandList(listPaddr, listSize);
+	CHECK(regs[texEnvSource] == 0x88 && regs[texEnvCombiner] == 0x77);
+}
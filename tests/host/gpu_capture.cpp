@@ -0,0 +1,139 @@
+// Records GPU work into a capture, loads it back & replays it on a fresh GPU like AlberReplay does, which has to end up in the same state
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include "PICA/gpu.hpp"
+#include "PICA/gpu_capture.hpp"
+#include "PICA/regs.hpp"
+#include "test.hpp"
+
+namespace {
+	using RecordType = GPUCapture::RecordType;
+
+	constexpr u32 listPaddr = PhysicalAddrs::FCRAM + 0x10000;
+	constexpr u32 textureSourcePaddr = PhysicalAddrs::FCRAM + 0x30000;
+	constexpr u32 zeroSourcePaddr = PhysicalAddrs::FCRAM + 0x40000;
+	constexpr u32 textureDestPaddr = PhysicalAddrs::VRAM + 0x1000;
+	constexpr u32 textureSize = 2 * GPUCapture::pageSize + 0x100; // Not a multiple of the page size, so it spans 3 pages
+
+	// A list that writes TEV stage 0's source, operand & combiner registers
+	void writeList(u32* list, u32 source) {
+		list[0] = source;
+		list[1] = PICAInternalRegs::TexEnv0Source | (0xf << 16) | (2 << 20) | (1u << 31);
+		list[2] = 0x1234;
+		list[3] = 0x5678;
+	}
+
+	constexpr u32 listSize = 4 * sizeof(u32);
+
+	// Runs the records that don't need a host graphics context on "gpu", the same way the replay tool does
+	void replay(GPU& gpu, const std::vector<GPUCapture::Record>& records) {
+		for (const auto& record : records) {
+			const auto& args = record.args;
+			switch (record.type) {
+				case RecordType::Page: std::memcpy(gpu.getPointerPhys<u8>(args[0]), record.data, GPUCapture::pageSize); break;
+				case RecordType::ZeroPage: std::memset(gpu.getPointerPhys<u8>(args[0]), 0, GPUCapture::pageSize); break;
+				case RecordType::CommandList: gpu.startCommandList(args[0], args[1]); break;
+				case RecordType::DMA: std::memcpy(gpu.getPointerPhys<u8>(args[0]), gpu.getPointerPhys<u8>(args[1]), args[2]); break;
+				default: break;
+			}
+		}
+	}
+
+	size_t countRecords(const std::vector<GPUCapture::Record>& records, RecordType type) {
+		size_t count = 0;
+		for (const auto& record : records) {
+			count += (record.type == type) ? 1 : 0;
+		}
+		return count;
+	}
+}
+
+TEST_CASE(gpuCaptureRoundTrip) {
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "alber_test_capture.bin";
+
+	u64 ticks = 0;
+	Memory mem(ticks);
+	GPU gpu(mem);
+	gpu.reset();
+	CHECK(gpu.getCapture().start(path));
+
+	// Frame 1: Run a command list & DMA a texture to VRAM
+	u32* list = gpu.getPointerPhys<u32>(listPaddr);
+	writeList(list, 0x11);
+	gpu.startCommandList(listPaddr, listSize);
+
+	u8* texture = gpu.getPointerPhys<u8>(textureSourcePaddr);
+	for (u32 i = 0; i < textureSize; i++) {
+		texture[i] = u8(i * 31 + 7);
+	}
+	gpu.fireDMA(textureDestPaddr, textureSourcePaddr, textureSize);
+	gpu.getCapture().recordFrame();
+
+	// Frame 2: The same list again, which doesn't need its page saved again, then a modified one, which does.
+	// Then part of the texture gets overwritten by a DMA from memory that's all zeroes
+	gpu.startCommandList(listPaddr, listSize);
+	writeList(list, 0x22);
+	gpu.startCommandList(listPaddr, listSize);
+	gpu.fireDMA(textureDestPaddr + 0x80, zeroSourcePaddr, 0x100);
+	gpu.getCapture().recordFrame();
+
+	CHECK(gpu.getCapture().getFrameCount() == 2);
+	CHECK(gpu.getCapture().stop());
+
+	std::vector<u8> contents;
+	std::vector<GPUCapture::Record> records;
+	CHECK(GPUCapture::load(path, contents, records));
+	std::filesystem::remove(path);
+
+	CHECK(countRecords(records, RecordType::CommandList) == 3);
+	CHECK(countRecords(records, RecordType::DMA) == 2);
+	CHECK(countRecords(records, RecordType::Frame) == 2);
+	CHECK(countRecords(records, RecordType::ZeroPage) == 1);
+	// The list's page twice (once per version of the list) & the 3 pages of the texture
+	CHECK(countRecords(records, RecordType::Page) == 5);
+
+	// Every record arrives with the arguments it was recorded with
+	for (const auto& record : records) {
+		if (record.type == RecordType::CommandList) {
+			CHECK(record.args[0] == listPaddr && record.args[1] == listSize);
+		} else if (record.type == RecordType::DMA) {
+			CHECK(record.args[0] == textureDestPaddr || record.args[0] == textureDestPaddr + 0x80);
+		}
+	}
+
+	// Replaying on a fresh GPU has to give the same registers & VRAM
+	u64 replayTicks = 0;
+	Memory replayMem(replayTicks);
+	GPU replayGPU(replayMem);
+	replayGPU.reset();
+	replay(replayGPU, records);
+
+	CHECK(replayGPU.getRegisters() == gpu.getRegisters());
+	CHECK(replayGPU.getRegisters()[PICAInternalRegs::TexEnv0Source] == 0x22);
+	CHECK(std::memcmp(replayGPU.getPointerPhys<u8>(textureDestPaddr), gpu.getPointerPhys<u8>(textureDestPaddr), textureSize) == 0);
+	CHECK(replayGPU.getPointerPhys<u8>(textureDestPaddr + 0x80)[0] == 0);
+	CHECK(replayGPU.getPointerPhys<u8>(textureDestPaddr)[1] == texture[1]);
+}
+
+TEST_CASE(gpuCaptureRejectsBadFiles) {
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "alber_test_bad_capture.bin";
+	std::vector<u8> contents;
+	std::vector<GPUCapture::Record> records;
+
+	// Missing file
+	std::filesystem::remove(path);
+	CHECK(!GPUCapture::load(path, contents, records));
+
+	// Capture cut off in the middle of a page record
+	GPUCapture capture;
+	CHECK(capture.start(path));
+	std::vector<u8> page(GPUCapture::pageSize, 0x5A);
+	capture.recordPage(PhysicalAddrs::FCRAM, page.data());
+	CHECK(capture.stop());
+
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+	CHECK(!GPUCapture::load(path, contents, records));
+	std::filesystem::remove(path);
+}
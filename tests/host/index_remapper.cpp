@@ -0,0 +1,87 @@
+// Checks the index buffer deduplication indexed draws go through
+#include <vector>
+
+#include "PICA/index_remapper.hpp"
+#include "test.hpp"
+
+namespace {
+	// The remapped index buffer has to reference the same vertices as the original, and every unique vertex has to appear exactly once
+	template <typename T>
+	void checkRemap(IndexRemapper& remapper, const std::vector<T>& indices, u32 expectedUniqueCount) {
+		const u32 count = u32(indices.size());
+		const u32 uniqueCount = remapper.remap(indices.data(), count);
+		CHECK(uniqueCount == expectedUniqueCount);
+
+		for (u32 i = 0; i < count; i++) {
+			CHECK(remapper.remappedIndices[i] < uniqueCount);
+			CHECK(remapper.uniqueIndices[remapper.remappedIndices[i]] == indices[i]);
+		}
+
+		for (u32 i = 0; i < uniqueCount; i++) {
+			for (u32 j = i + 1; j < uniqueCount; j++) {
+				CHECK(remapper.uniqueIndices[i] != remapper.uniqueIndices[j]);
+			}
+		}
+	}
+}
+
+TEST_CASE(indexRemapperQuads) {
+	IndexRemapper remapper;
+	remapper.resize(0x10000);
+
+	// 2 quads drawn as triangle lists share 2 vertices per quad
+	const std::vector<u16> indices = {0, 1, 2, 2, 1, 3, 4, 5, 6, 6, 5, 7};
+	checkRemap(remapper, indices, 8);
+
+	// Unique vertices are kept in order of first use
+	CHECK(remapper.uniqueIndices[0] == 0 && remapper.uniqueIndices[3] == 3 && remapper.uniqueIndices[7] == 7);
+	CHECK(remapper.remappedIndices[3] == 2 && remapper.remappedIndices[4] == 1);
+}
+
+TEST_CASE(indexRemapperOffsetRange) {
+	IndexRemapper remapper;
+	remapper.resize(0x10000);
+
+	// Indices far away from 0, and ones at the very top of the 16-bit range
+	checkRemap(remapper, std::vector<u16>{1000, 1001, 1002, 1002, 1001, 1000}, 3);
+	checkRemap(remapper, std::vector<u16>{0xffff, 0xfffe, 0xffff, 0x8000}, 3);
+	checkRemap(remapper, std::vector<u16>{0, 0xffff, 0, 0xffff}, 2);
+
+	// Single index & empty index buffers
+	checkRemap(remapper, std::vector<u16>{42}, 1);
+	CHECK(remapper.remap(static_cast<const u16*>(nullptr), 0) == 0);
+}
+
+TEST_CASE(indexRemapperU8Indices) {
+	IndexRemapper remapper;
+	remapper.resize(0x10000);
+
+	checkRemap(remapper, std::vector<u8>{255, 254, 253, 255, 0, 254}, 4);
+	checkRemap(remapper, std::vector<u8>{7, 7, 7, 7}, 1);
+}
+
+TEST_CASE(indexRemapperReuse) {
+	IndexRemapper remapper;
+	remapper.resize(0x10000);
+
+	// The slot table has to be clean after each draw, or indices of the previous draw would be treated as already seen
+	checkRemap(remapper, std::vector<u16>{10, 11, 12, 10}, 3);
+	checkRemap(remapper, std::vector<u16>{12, 11, 10, 13}, 4);
+	CHECK(remapper.uniqueIndices[0] == 12 && remapper.remappedIndices[3] == 3);
+
+	// Every vertex used once
+	std::vector<u16> sequential(3000);
+	for (u32 i = 0; i < sequential.size(); i++) {
+		sequential[i] = u16(i * 7 % 3000);
+	}
+	checkRemap(remapper, sequential, 3000);
+
+	// Strip-like reuse over a big buffer
+	std::vector<u16> strip;
+	for (u16 i = 0; i < 4000; i++) {
+		strip.push_back(i);
+		strip.push_back(u16(i + 1));
+		strip.push_back(u16(i + 2));
+	}
+	checkRemap(remapper, strip, 4002);
+}
@@ -0,0 +1,34 @@
+// Runs the host-side tests. Usage: AlberTests [test name...], where no names means every test
+#include <cstring>
+
+#include "test.hpp"
+
+int main(int argc, char* argv[]) {
+	int failedTests = 0;
+	int ranTests = 0;
+
+	for (const auto& test : Test::getCases()) {
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; i++) {
+			selected |= std::strcmp(argv[i], test.name) == 0;
+		}
+
+		if (!selected) {
+			continue;
+		}
+
+		const int failedBefore = Test::failedChecks;
+		test.func();
+		ranTests++;
+
+		if (Test::failedChecks != failedBefore) {
+			std::printf("[FAIL] %s\n", test.name);
+			failedTests++;
+		} else {
+			std::printf("[ OK ] %s\n", test.name);
+		}
+	}
+
+	std::printf("%d of %d tests passed\n", ranTests - failedTests, ranTests);
+	return (failedTests == 0 && ranTests != 0) ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+// Checks that the batched shader interpreter gives the same outputs as the regular interpreter running the vertices one at a time
+#include <cstring>
+#include <vector>
+
+#include "PICA/shader.hpp"
+#include "PICA/shader_batch.hpp"
+#include "test.hpp"
+
+namespace {
+	using f24 = Floats::f24;
+	using vec4f = OpenGL::Vector<f24, 4>;
+
+	// Just enough of an assembler to write the test programs. Registers are numbered like in shader sources: v0-v15 are 0x00-0x0F,
+	// r0-r15 are 0x10-0x1F and c0-c95 are 0x20-0x7F. Destinations use 0x00-0x0F for o0-o15
+	namespace Asm {
+		constexpr u32 v(u32 n) { return n; }
+		constexpr u32 o(u32 n) { return n; }
+		constexpr u32 r(u32 n) { return 0x10 + n; }
+		constexpr u32 c(u32 n) { return 0x20 + n; }
+
+		// Relative addressing modes
+		constexpr u32 a0x = 1, a0y = 2, aL = 3;
+
+		// Swizzles are written as strings like "xyzw". Descriptors keep the selector for x in the top 2 bits
+		constexpr u32 swizzle(const char* s) {
+			u32 ret = 0;
+			for (int i = 0; i < 4; i++) {
+				const u32 selector = (s[i] == 'x') ? 0 : (s[i] == 'y') ? 1 : (s[i] == 'z') ? 2 : 3;
+				ret |= selector << ((3 - i) * 2);
+			}
+			return ret;
+		}
+
+		// Operand descriptor with a destination mask (x in bit 3), the swizzle of each source & a mask of the negated sources
+		constexpr u32 descriptor(u32 mask, const char* s1 = "xyzw", const char* s2 = "xyzw", const char* s3 = "xyzw", u32 negate = 0) {
+			u32 ret = mask;
+			const char* swizzles[3] = {s1, s2, s3};
+			for (u32 n = 0; n < 3; n++) {
+				ret |= ((negate >> n) & 1) << (4 + 9 * n);
+				ret |= swizzle(swizzles[n]) << (5 + 9 * n);
+			}
+			return ret;
+		}
+
+		// 7-bit src1 with relative addressing, 5-bit src2
+		constexpr u32 format1(u32 opcode, u32 dest, u32 src1, u32 src2, u32 desc, u32 index = 0) {
+			return (opcode << 26) | (dest << 21) | (index << 19) | (src1 << 12) | (src2 << 7) | desc;
+		}
+
+		// SGEI/SLTI: 5-bit src1, 7-bit src2 with relative addressing
+		constexpr u32 format1i(u32 opcode, u32 dest, u32 src1, u32 src2, u32 desc, u32 index = 0) {
+			return (opcode << 26) | (dest << 21) | (index << 19) | (src1 << 14) | (src2 << 7) | desc;
+		}
+
+		// 5-bit src1, 7-bit src2 with relative addressing, 5-bit src3. Only descriptors 0-31 can be used
+		constexpr u32 mad(u32 dest, u32 src1, u32 src2, u32 src3, u32 desc, u32 index = 0) {
+			return (0x7u << 29) | (dest << 24) | (index << 22) | (src1 << 17) | (src2 << 10) | (src3 << 5) | desc;
+		}
+
+		// Comparison operations: 0 = eq, 1 = ne, 2 = lt, 3 = le, 4 = gt, 5 = ge
+		constexpr u32 cmp(u32 opX, u32 opY, u32 src1, u32 src2, u32 desc) {
+			return (0x17u << 27) | (opX << 24) | (opY << 21) | (src1 << 12) | (src2 << 7) | desc;
+		}
+
+		// Conditions: 0 = x || y, 1 = x && y, 2 = x, 3 = y, each compared against refX/refY
+		constexpr u32 flow(u32 opcode, u32 dst, u32 num, u32 condition = 0, bool refX = false, bool refY = false) {
+			return (opcode << 26) | (u32(refX) << 25) | (u32(refY) << 24) | (condition << 22) | (dst << 10) | num;
+		}
+
+		constexpr u32 loop(u32 dst, u32 intUniform) { return (ShaderOpcodes::LOOP << 26) | (intUniform << 22) | (dst << 10); }
+		constexpr u32 end() { return ShaderOpcodes::END << 26; }
+	}
+
+	struct Program {
+		std::vector<u32> code;
+		std::vector<u32> descriptors;
+		u32 outputCount; // The program writes o0 to o(outputCount - 1) on every path
+	};
+
+	constexpr u32 maskXYZW = 0xf, maskXYZ = 0xe, maskX = 0x8, maskW = 0x1;
+
+	// tests/SimplerTri/source/vshader.v.pica, which tests/ImmediateModeTriangles uses as well. The projection matrix is in c0-c3 and
+	// myconst in c4
+	Program simplerTriShader() {
+		using namespace Asm;
+		using namespace ShaderOpcodes;
+
+		return {
+			{
+				format1(MOV, r(0), v(0), 0, 0),        // mov r0.xyz, inpos
+				format1(MOV, r(0), c(4), 0, 1),        // mov r0.w, ones
+				format1(DP4, o(0), c(0), r(0), 2),     // dp4 outpos.x, projection[0], r0
+				format1(DP4, o(0), c(1), r(0), 3),     // dp4 outpos.y, projection[1], r0
+				format1(DP4, o(0), c(2), r(0), 4),     // dp4 outpos.z, projection[2], r0
+				format1(DP4, o(0), c(3), r(0), 5),     // dp4 outpos.w, projection[3], r0
+				format1(MOV, o(1), v(1), 0, 6),        // mov outclr, inclr
+				end(),
+			},
+			{
+				descriptor(maskXYZ), descriptor(maskW, "yyyy"), descriptor(maskX), descriptor(0x4), descriptor(0x2),
+				descriptor(maskW), descriptor(maskXYZW),
+			},
+			2,
+		};
+	}
+
+	// Goes through every arithmetic instruction, relative addressing, loops & branches that send lanes different ways. Uses c4-c9,
+	// with c4 = (0, 1, -1, 0.1) like myconst, and the LOOP uses i0
+	Program arithmeticShader() {
+		using namespace Asm;
+		using namespace ShaderOpcodes;
+
+		constexpr u32 full = 0, xOnly = 1, yyyy = 2, negSrc2 = 3, xxxx = 4;
+		return {
+			{
+				/* 0 */ format1(MOV, r(10), c(4), 0, xxxx),          // mov r10, c4.xxxx
+				/* 1 */ format1(ADD, r(1), v(0), v(1), full),        // add r1, v0, v1
+				/* 2 */ format1(MUL, r(2), c(6), r(1), full),        // mul r2, c6, r1
+				/* 3 */ mad(r(3), r(2), c(6), r(1), full),           // mad r3, r2, c6, r1
+				/* 4 */ format1(MAX, r(4), c(5), r(3), negSrc2),     // max r4, c5, -r3
+				/* 5 */ format1(MIN, r(4), c(6), r(4), full),        // min r4, c6, r4
+				/* 6 */ format1(FLR, r(5), r(3), 0, full),           // flr r5, r3
+				/* 7 */ format1(RCP, r(6), c(6), 0, xOnly),          // rcp r6.x, c6.x
+				/* 8 */ format1(RSQ, r(6), r(3), 0, yyyy),           // rsq r6, r3.y
+				/* 9 */ format1(DP3, o(2), c(6), r(3), full),        // dp3 o2, c6, r3
+				/* 10 */ format1(SLT, r(7), v(0), v(1), full),       // slt r7, v0, v1
+				/* 11 */ format1i(SGEI, r(8), v(0), c(4), full),     // sgei r8, v0, c4
+				/* 12 */ format1i(SLTI, r(9), v(1), c(5), full),     // slti r9, v1, c5
+				/* 13 */ format1(ADD, r(11), r(7), r(8), full),      // add r11, r7, r8
+				/* 14 */ format1(ADD, o(3), r(9), r(11), full),      // add o3, r9, r11
+				/* 15 */ format1(MOVA, 0, v(2), 0, xOnly),           // mova a0.x, v2.x
+				/* 16 */ format1(MOV, o(4), c(4), 0, full, a0x),     // mov o4, c4[a0.x]
+				/* 17 */ loop(18, 0),                                // loop i0
+				/* 18 */ format1(ADD, r(10), c(4), r(10), full, aL), //   add r10, c4[aL], r10
+				/* 19 */ format1(MOV, o(5), r(10), 0, full),         // mov o5, r10
+				/* 20 */ cmp(2, 5, v(0), r(2), full),                // cmp v0.x < r2.x, v0.y >= r2.y
+				/* 21 */ flow(IFC, 24, 2, 2, true),                  // ifc cmp.x
+				/* 22 */ format1(MUL, r(12), c(6), r(4), full),      //   mul r12, c6, r4
+				/* 23 */ format1(ADD, o(6), r(12), r(5), full),      //   add o6, r12, r5
+				/* 24 */ format1(MOV, o(6), r(5), 0, full),          // else: mov o6, r5
+				/* 25 */ format1(MOV, o(6), r(6), 0, xOnly),         //   mov o6.x, r6.x
+				/* 26 */ format1(MOV, o(7), c(4), 0, xxxx),          // mov o7, c4.xxxx
+				/* 27 */ flow(CALLC, 31, 2, 3, false, true),         // callc cmp.y, function
+				/* 28 */ format1(MOV, o(0), r(3), 0, full),          // mov o0, r3
+				/* 29 */ format1(MOV, o(1), r(4), 0, full),          // mov o1, r4
+				/* 30 */ end(),
+				/* 31 */ format1(MUL, o(7), c(9), r(1), full),       // function: mul o7, c9, r1
+				/* 32 */ format1(MAX, o(7), c(8), r(6), full),       //   max o7, c8, r6
+			},
+			{
+				descriptor(maskXYZW), descriptor(maskX), descriptor(maskXYZW, "yyyy"), descriptor(maskXYZW, "xyzw", "xyzw", "xyzw", 0b010),
+				descriptor(maskXYZW, "xxxx"),
+			},
+			8,
+		};
+	}
+
+	vec4f makeVector(float x, float y, float z, float w) {
+		return vec4f({f24::fromFloat32(x), f24::fromFloat32(y), f24::fromFloat32(z), f24::fromFloat32(w)});
+	}
+
+	void loadProgram(PICAShader& shader, const Program& program) {
+		shader.reset();
+		shader.setBufferIndex(0);
+		shader.uploadWords(program.code.data(), u32(program.code.size()));
+		shader.setOpDescriptorIndex(0);
+		shader.uploadDescriptors(program.descriptors.data(), u32(program.descriptors.size()));
+		shader.setEntrypoint(0);
+		shader.finalize();
+
+		// Projection matrix with a bit of everything in it
+		shader.floatUniforms[0] = makeVector(1.5f, 0.0f, 0.25f, -1.0f);
+		shader.floatUniforms[1] = makeVector(0.0f, -2.0f, 0.5f, 1.0f);
+		shader.floatUniforms[2] = makeVector(0.125f, 0.0f, 1.0f, 0.0f);
+		shader.floatUniforms[3] = makeVector(0.0f, 0.0f, 0.0f, 1.0f);
+		shader.floatUniforms[4] = makeVector(0.0f, 1.0f, -1.0f, 0.1f);
+		shader.floatUniforms[5] = makeVector(0.3f, 0.0f, 0.0f, 0.0f);
+		shader.floatUniforms[6] = makeVector(2.0f, 0.5f, 3.0f, 4.0f);
+		shader.floatUniforms[7] = makeVector(-0.75f, 8.0f, 0.0f, 1.0f);
+		shader.floatUniforms[8] = makeVector(0.2f, -0.2f, 0.4f, -0.4f);
+		shader.floatUniforms[9] = makeVector(1.0f, -1.0f, 0.5f, -0.5f);
+
+		// i0: 3 + 1 iterations, counter starting at 0 & going up by 1
+		shader.uploadIntUniform(0, 3 | (0 << 8) | (1 << 16));
+	}
+
+	// Vertex n's inputs. v2.x cycles through 0-3 for relative addressing, and positions land on both sides of the branches
+	std::array<vec4f, 16> makeInputs(u32 n) {
+		std::array<vec4f, 16> inputs;
+		inputs.fill(makeVector(0.0f, 0.0f, 0.0f, 0.0f));
+
+		const float t = float(n);
+		inputs[0] = makeVector(t * 0.37f - 2.0f, 1.5f - t * 0.21f, t * 0.05f, 1.0f);
+		inputs[1] = makeVector(0.1f * float(n % 7), 1.0f - 0.13f * float(n % 5), 0.5f, t * -0.5f + 3.0f);
+		inputs[2] = makeVector(float(n % 4), 0.0f, 0.0f, 0.0f);
+		return inputs;
+	}
+
+	bool sameVector(const vec4f& a, const vec4f& b) { return std::memcmp(&a, &b, sizeof(vec4f)) == 0; }
+
+	// Run "vertexCount" vertices through both interpreters & compare every output the program writes
+	void checkBatchMatchesScalar(const Program& program, u32 vertexCount) {
+		PICAShader scalar(ShaderType::Vertex);
+		PICAShader batched(ShaderType::Vertex);
+		PICABatchShader batch;
+		loadProgram(scalar, program);
+		loadProgram(batched, program);
+
+		std::vector<std::array<vec4f, 16>> expected(vertexCount);
+		for (u32 i = 0; i < vertexCount; i++) {
+			scalar.inputs = makeInputs(i);
+			scalar.run();
+			expected[i] = scalar.outputs;
+		}
+
+		for (u32 i = 0; i < vertexCount; i += PICABatchShader::laneCount) {
+			const int laneCount = int(std::min<u32>(PICABatchShader::laneCount, vertexCount - i));
+			for (int lane = 0; lane < laneCount; lane++) {
+				batch.setInputs(lane, makeInputs(i + lane));
+			}
+
+			CHECK(batch.run(batched, laneCount));
+			for (int lane = 0; lane < laneCount; lane++) {
+				for (u32 output = 0; output < program.outputCount; output++) {
+					CHECK(sameVector(batch.getOutput(lane, output), expected[i + lane][output]));
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE(shaderBatchMatchesScalarSimplerTri) {
+	// Full batches & a partial one at the end
+	checkBatchMatchesScalar(simplerTriShader(), 3);
+	checkBatchMatchesScalar(simplerTriShader(), PICABatchShader::laneCount * 4 + 3);
+}
+
+TEST_CASE(shaderBatchMatchesScalarArithmetic) {
+	const Program program = arithmeticShader();
+	checkBatchMatchesScalar(program, 1);
+	checkBatchMatchesScalar(program, PICABatchShader::laneCount * 8 + 5);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+// Bare-bones test harness for the host-side tests. Each TEST_CASE registers itself at startup and main.cpp runs them all.
+// A failing CHECK prints where it failed and marks the test as failed, but lets it keep going so that one run shows every failure
+namespace Test {
+	struct Case {
+		const char* name;
+		void (*func)();
+	};
+
+	inline std::vector<Case>& getCases() {
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	inline int failedChecks = 0;
+
+	inline void fail(const char* file, int line, const char* expression) {
+		std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+		failedChecks++;
+	}
+
+	struct Registration {
+		Registration(const char* name, void (*func)()) { getCases().push_back({name, func}); }
+	};
+}
+
+#define TEST_CASE(name)                                                  \
+	static void name();                                                  \
+	static const Test::Registration name##Registration(#name, name); \
+	static void name()
+
+#define CHECK(expression)                                  \
+	do {                                                   \
+		if (!(expression)) {                               \
+			Test::fail(__FILE__, __LINE__, #expression); \
+		}                                                  \
+	} while (0)